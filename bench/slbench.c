@@ -0,0 +1,1180 @@
+/***************************************************************************
+ * slbench.c
+ *
+ * Benchmark of the collect, parse and archive path of slinktool.
+ *
+ * A recording of Mini-SEED records of any length, e.g. a dumpfile
+ * written with the -o option of slinktool, is replayed as a SeedLink
+ * data stream with synthetic SL headers through a socket pair to a
+ * connection of libslink, at the maximum rate or at a set packet rate.  Each packet
+ * goes through the stages of slinktool:
+ *
+ *   receive : sl_collect_nb_size() calls reading from the socket, this
+ *             includes waiting for data when the rate is limited
+ *   collect : sl_collect_nb_size() calls returning a packet, finding the
+ *             packet in the buffer and matching it to the streams
+ *   route   : decoding of the header fields used for the archives
+ *   parse   : sl_msr_parse() including unpacking of the samples
+ *   archive : sds_streamproc(), writing to an SDS archive if requested
+ *   output  : sf_write(), formatting the samples for the -uf option of
+ *             slinktool to /dev/null if requested
+ *
+ * The time of each stage per packet, the number of allocations per
+ * packet and percentiles of the processing time and of the latency,
+ * from sending a packet to the end of its processing, are reported.
+ *
+ * The Steim decoders are benchmarked with synthetic records encoded
+ * from signals typical for several sample rates, with the scalar and
+ * the vectorized decoders.
+ *
+ * The startup with a large number of streams is benchmarked by reading
+ * and parsing a synthetic stream list, saving the state of the streams
+ * and recovering it, in the text and the binary formats.
+ *
+ * Allocations are counted by wrapping malloc(), calloc() and realloc()
+ * with the --wrap option of the GNU linker, only allocations by the
+ * linked objects are counted.
+ *
+ * modified: 2026.287
+ ***************************************************************************/
+
+#include <errno.h>
+#include <math.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include <libslink.h>
+
+#include "archive.h"
+#include "samples.h"
+
+#define PACKAGE "slbench"
+#define VERSION "2026.287"
+
+/* Number of packets written to the socket at once at the maximum rate */
+#define CHUNK_PACKETS 64
+
+/* Number of decoding iterations of each Steim benchmark */
+#define STEIM_ITERATIONS 100000
+
+/* Number of streams of the startup benchmark */
+#define STARTUP_STREAMS 50000
+
+/* Stages of the packet path */
+enum
+{
+  STAGE_RECEIVE,
+  STAGE_COLLECT,
+  STAGE_ROUTE,
+  STAGE_PARSE,
+  STAGE_ARCHIVE,
+  STAGE_OUTPUT,
+  STAGE_COUNT
+};
+
+static const char *stagenames[STAGE_COUNT] = {"receive", "collect", "route",
+                                              "parse", "archive", "output"};
+
+/* A recording prepared for replay */
+typedef struct Replay_s
+{
+  char   *stream;        /* SeedLink packets of one pass */
+  size_t *offsets;       /* Offset of each packet and of the end of a pass */
+  int     numpackets;    /* Number of packets in one pass */
+  int     repeat;        /* Number of passes */
+  double  rate;          /* Packets per second, 0 for the maximum rate */
+  int     fd;            /* Sending end of the socket pair */
+  int64_t *sendtimes;    /* Time each packet was sent */
+}
+Replay;
+
+static int64_t allocations = 0;
+
+static int64_t bench_clock (void);
+static void *replay_thread (void *arg);
+static int load_recording (const char *path, Replay *replay, SLCD *slconn);
+static int bench_replay (Replay *replay, SLCD *slconn, const char *sdsdir,
+                         int sampleformat);
+static void bench_steim (int iterations);
+static int bench_startup (int numstreams);
+static void stream_codes (int index, char *net, char *sta);
+static int encode_steim (int encoding, const int32_t *samples, int count,
+                         int32_t *frames, int numframes);
+static int build_record (char *record, int encoding, double samprate,
+                         const int32_t *samples, int count);
+static void generate_signal (int32_t *samples, int count, double samprate);
+static int compare_station (const void *a, const void *b);
+static int compare_int64 (const void *a, const void *b);
+static void report_percentiles (const char *name, int64_t *values, int count);
+static void usage (void);
+
+void *__real_malloc (size_t size);
+void *__real_calloc (size_t nmemb, size_t size);
+void *__real_realloc (void *ptr, size_t size);
+
+int
+main (int argc, char **argv)
+{
+  Replay replay;
+  SLCD *slconn;
+  char *recording = 0;
+  char *sdsdir    = 0;
+  int sampleformat = 0;
+  int steimonly   = 0;
+  int startonly   = 0;
+  int numstreams  = STARTUP_STREAMS;
+  int iterations  = STEIM_ITERATIONS;
+  int wbufsize    = 0;
+  int optind;
+
+  memset (&replay, 0, sizeof (replay));
+  replay.repeat = 1;
+
+  for (optind = 1; optind < argc; optind++)
+  {
+    if (strcmp (argv[optind], "-h") == 0)
+    {
+      usage ();
+      exit (0);
+    }
+    else if (strcmp (argv[optind], "-r") == 0 && optind + 1 < argc)
+    {
+      replay.repeat = atoi (argv[++optind]);
+    }
+    else if (strcmp (argv[optind], "-R") == 0 && optind + 1 < argc)
+    {
+      replay.rate = atof (argv[++optind]);
+    }
+    else if (strcmp (argv[optind], "-SDS") == 0 && optind + 1 < argc)
+    {
+      sdsdir = argv[++optind];
+    }
+    else if (strcmp (argv[optind], "-wb") == 0 && optind + 1 < argc)
+    {
+      wbufsize = atoi (argv[++optind]);
+    }
+    else if (strcmp (argv[optind], "-uf") == 0 && optind + 1 < argc)
+    {
+      if ((sampleformat = sf_format (argv[++optind])) < 0)
+      {
+        fprintf (stderr, "Unknown sample format: %s\n", argv[optind]);
+        exit (1);
+      }
+    }
+    else if (strcmp (argv[optind], "-steim") == 0)
+    {
+      steimonly = 1;
+    }
+    else if (strcmp (argv[optind], "-startup") == 0)
+    {
+      startonly = 1;
+    }
+    else if (strcmp (argv[optind], "-n") == 0 && optind + 1 < argc)
+    {
+      numstreams = atoi (argv[++optind]);
+    }
+    else if (strcmp (argv[optind], "-i") == 0 && optind + 1 < argc)
+    {
+      iterations = atoi (argv[++optind]);
+    }
+    else if (strncmp (argv[optind], "-", 1) == 0)
+    {
+      fprintf (stderr, "Unknown option: %s\n", argv[optind]);
+      exit (1);
+    }
+    else
+    {
+      recording = argv[optind];
+    }
+  }
+
+  if ((!recording && !steimonly && !startonly) || replay.repeat <= 0 ||
+      replay.rate < 0.0 || iterations <= 0 || wbufsize < 0 || numstreams <= 0)
+  {
+    usage ();
+    exit (1);
+  }
+
+  /* Writing to a socket closed by the reader must not end the program */
+  signal (SIGPIPE, SIG_IGN);
+
+  if (recording && !steimonly && !startonly)
+  {
+    slconn         = sl_newslcd ();
+    slconn->sladdr = "replay";
+    slconn->netto  = 0;
+    slconn->netdly = 0;
+
+    if (load_recording (recording, &replay, slconn))
+      return 1;
+
+    arch_setbuffersize (wbufsize);
+
+    if (bench_replay (&replay, slconn, sdsdir, sampleformat))
+      return 1;
+
+    printf ("\n");
+  }
+
+  if (!startonly)
+  {
+    bench_steim (iterations);
+    printf ("\n");
+  }
+
+  if (!steimonly && bench_startup (numstreams))
+    return 1;
+
+  return 0;
+} /* End of main() */
+
+/***************************************************************************
+ * Allocation counting wrappers, see the --wrap linker options.
+ ***************************************************************************/
+void *
+__wrap_malloc (size_t size)
+{
+  __atomic_fetch_add (&allocations, 1, __ATOMIC_RELAXED);
+  return __real_malloc (size);
+}
+
+void *
+__wrap_calloc (size_t nmemb, size_t size)
+{
+  __atomic_fetch_add (&allocations, 1, __ATOMIC_RELAXED);
+  return __real_calloc (nmemb, size);
+}
+
+void *
+__wrap_realloc (void *ptr, size_t size)
+{
+  __atomic_fetch_add (&allocations, 1, __ATOMIC_RELAXED);
+  return __real_realloc (ptr, size);
+}
+
+/***************************************************************************
+ * bench_clock:
+ *
+ * Returns a monotonic time in nanoseconds.
+ ***************************************************************************/
+static int64_t
+bench_clock (void)
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+
+  return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+} /* End of bench_clock() */
+
+/***************************************************************************
+ * replay_thread:
+ *
+ * Write all passes of the recording to the socket, at the set rate or
+ * in chunks as fast as possible, recording the time each packet is
+ * sent.  The socket is closed at the end of the recording.
+ ***************************************************************************/
+static void *
+replay_thread (void *arg)
+{
+  Replay *replay = (Replay *)arg;
+  struct timespec ts;
+  int64_t total  = (int64_t)replay->numpackets * replay->repeat;
+  int64_t start  = bench_clock ();
+  int64_t packet = 0;
+  int64_t due;
+  int64_t now;
+  ssize_t written;
+  size_t offset;
+  size_t length;
+  int count;
+  int idx;
+
+  while (packet < total)
+  {
+    /* Packets are sent in chunks that do not cross the end of a pass */
+    count = replay->numpackets - (int)(packet % replay->numpackets);
+
+    if (count > CHUNK_PACKETS)
+      count = CHUNK_PACKETS;
+
+    if (replay->rate > 0.0)
+    {
+      due = start + (int64_t) ((double)packet * 1e9 / replay->rate);
+      now = bench_clock ();
+
+      if (due > now)
+      {
+        ts.tv_sec  = (due - now) / 1000000000;
+        ts.tv_nsec = (due - now) % 1000000000;
+        nanosleep (&ts, NULL);
+        now = bench_clock ();
+      }
+
+      /* Send all packets that are due */
+      for (idx = 1; idx < count; idx++)
+      {
+        if (start + (int64_t) ((double)(packet + idx) * 1e9 / replay->rate) > now)
+          break;
+      }
+
+      count = idx;
+    }
+
+    now = bench_clock ();
+
+    for (idx = 0; idx < count; idx++)
+      __atomic_store_n (&replay->sendtimes[packet + idx], now, __ATOMIC_RELEASE);
+
+    offset = replay->offsets[packet % replay->numpackets];
+    length = replay->offsets[packet % replay->numpackets + count] - offset;
+
+    while (length > 0)
+    {
+      if ((written = write (replay->fd, replay->stream + offset, length)) < 0)
+      {
+        if (errno == EINTR)
+          continue;
+
+        fprintf (stderr, "write(): %s\n", strerror (errno));
+        close (replay->fd);
+        return NULL;
+      }
+
+      offset += written;
+      length -= written;
+    }
+
+    packet += count;
+  }
+
+  close (replay->fd);
+
+  return NULL;
+} /* End of replay_thread() */
+
+/***************************************************************************
+ * load_recording:
+ *
+ * Read a recording of Mini-SEED records, or of SeedLink packets, and
+ * prepare the packets of one pass.  The length of each record is
+ * detected from its Blockette 1000, records without one are taken to
+ * be 512 bytes.  A stream entry is added to the connection for each
+ * station in the recording.
+ *
+ * Returns 0 on success and -1 on error.
+ ***************************************************************************/
+static int
+load_recording (const char *path, Replay *replay, SLCD *slconn)
+{
+  const struct sl_fsdh_s *fsdh;
+  char *stations;
+  char *data;
+  char net[3];
+  char sta[6];
+  size_t offset;
+  size_t streamsize;
+  long size;
+  int slpackets;
+  int headsize;
+  int reclen;
+  int count;
+  int idx;
+  FILE *fp;
+
+  if ((fp = fopen (path, "rb")) == NULL)
+  {
+    fprintf (stderr, "cannot open %s: %s\n", path, strerror (errno));
+    return -1;
+  }
+
+  fseek (fp, 0, SEEK_END);
+  size = ftell (fp);
+  rewind (fp);
+
+  if (size <= 0 || (data = (char *)malloc (size)) == NULL ||
+      fread (data, size, 1, fp) != 1)
+  {
+    fprintf (stderr, "cannot read %s\n", path);
+    fclose (fp);
+    return -1;
+  }
+
+  fclose (fp);
+
+  /* A file of SeedLink packets is used as is */
+  slpackets = !strncmp (data, "SL", 2);
+  headsize  = (slpackets) ? SLHEADSIZE : 0;
+
+  /* Find the packets and their lengths */
+  if ((replay->offsets = (size_t *)malloc ((size / (headsize + 128) + 1) * sizeof (size_t))) == NULL)
+  {
+    fprintf (stderr, "cannot allocate memory\n");
+    return -1;
+  }
+
+  for (offset = 0, streamsize = 0, count = 0; offset < (size_t)size; count++)
+  {
+    if ((size_t)size - offset < (size_t)headsize + 48)
+      break;
+
+    reclen = sl_reclen (data + offset + headsize, (int)(size - offset - headsize));
+
+    if (reclen <= 0)
+      reclen = SLRECSIZE;
+
+    if (offset + headsize + reclen > (size_t)size)
+      break;
+
+    replay->offsets[count] = offset;
+    offset += headsize + reclen;
+    streamsize += SLHEADSIZE + reclen;
+  }
+
+  replay->numpackets = count;
+
+  if (replay->numpackets == 0 || offset != (size_t)size)
+  {
+    fprintf (stderr, "%s is not a recording of Mini-SEED records\n", path);
+    return -1;
+  }
+
+  /* Frame the records as SeedLink packets of one pass */
+  if ((replay->stream = (char *)malloc (streamsize)) == NULL)
+  {
+    fprintf (stderr, "cannot allocate memory\n");
+    return -1;
+  }
+
+  for (idx = 0, offset = 0; idx < replay->numpackets; idx++)
+  {
+    reclen = (int)(((idx + 1 < replay->numpackets) ? replay->offsets[idx + 1] : (size_t)size) -
+                   replay->offsets[idx]) - headsize;
+
+    if (slpackets)
+      memcpy (replay->stream + offset, data + replay->offsets[idx], SLHEADSIZE);
+    else
+      snprintf (replay->stream + offset, SLHEADSIZE + 1, "SL%06X", (idx + 1) & 0xFFFFFF);
+
+    memcpy (replay->stream + offset + SLHEADSIZE,
+            data + replay->offsets[idx] + headsize, reclen);
+
+    replay->offsets[idx] = offset;
+    offset += SLHEADSIZE + reclen;
+  }
+
+  replay->offsets[replay->numpackets] = offset;
+
+  free (data);
+
+  if ((replay->sendtimes = (int64_t *)calloc ((size_t)replay->numpackets * replay->repeat,
+                                              sizeof (int64_t))) == NULL)
+  {
+    fprintf (stderr, "cannot allocate memory\n");
+    return -1;
+  }
+
+  /* Collect the distinct stations, station and network codes */
+  if ((stations = (char *)malloc ((size_t)replay->numpackets * 7)) == NULL)
+  {
+    fprintf (stderr, "cannot allocate memory\n");
+    return -1;
+  }
+
+  for (idx = 0; idx < replay->numpackets; idx++)
+  {
+    fsdh = (const struct sl_fsdh_s *)(replay->stream + replay->offsets[idx] + SLHEADSIZE);
+    memcpy (stations + idx * 7, fsdh->station, 5);
+    memcpy (stations + idx * 7 + 5, fsdh->network, 2);
+  }
+
+  qsort (stations, replay->numpackets, 7, compare_station);
+
+  for (count = 0, idx = 0; idx < replay->numpackets; idx++)
+  {
+    if (idx && !memcmp (stations + idx * 7, stations + (idx - 1) * 7, 7))
+      continue;
+
+    sl_strncpclean (sta, stations + idx * 7, 5);
+    sl_strncpclean (net, stations + idx * 7 + 5, 2);
+
+    if (sl_addstream (slconn, net, sta, NULL, -1, NULL))
+      return -1;
+
+    count++;
+  }
+
+  free (stations);
+
+  printf ("Recording: %s, %d packets, %d stations, %.0f bytes per record, %d passes\n",
+          path, replay->numpackets, count,
+          (double)replay->offsets[replay->numpackets] / replay->numpackets - SLHEADSIZE,
+          replay->repeat);
+
+  return 0;
+} /* End of load_recording() */
+
+/***************************************************************************
+ * bench_replay:
+ *
+ * Replay the recording through the packet path and report the time of
+ * each stage, allocations and latency percentiles.
+ *
+ * Returns 0 on success and -1 on error.
+ ***************************************************************************/
+static int
+bench_replay (Replay *replay, SLCD *slconn, const char *sdsdir,
+              int sampleformat)
+{
+  SLMSrecord *msr = NULL;
+  FILE *output    = NULL;
+  SLMSheader msh;
+  SLpacket *slpack;
+  pthread_t thread;
+  int64_t stagetime[STAGE_COUNT] = {0};
+  int64_t total = (int64_t)replay->numpackets * replay->repeat;
+  int64_t *process;
+  int64_t *latency;
+  int64_t packets = 0;
+  int64_t samples = 0;
+  int64_t allocstart;
+  int64_t start;
+  int64_t elapsed;
+  int64_t t0, t1, t2, t3, t4, t5;
+  int fds[2];
+  int archflag;
+  int parsed;
+  int reclen;
+  int retval;
+  int idx;
+
+  if ((process = (int64_t *)malloc (total * sizeof (int64_t))) == NULL ||
+      (latency = (int64_t *)malloc (total * sizeof (int64_t))) == NULL)
+  {
+    fprintf (stderr, "cannot allocate memory\n");
+    return -1;
+  }
+
+  if (socketpair (AF_UNIX, SOCK_STREAM, 0, fds))
+  {
+    fprintf (stderr, "socketpair(): %s\n", strerror (errno));
+    return -1;
+  }
+
+  /* The connection reads from the socket pair as if negotiated */
+  slconn->link           = fds[0];
+  slconn->stat->sl_state = SL_DATA;
+  replay->fd             = fds[1];
+
+  if (sampleformat && (output = fopen ("/dev/null", "w")) == NULL)
+  {
+    fprintf (stderr, "cannot open /dev/null: %s\n", strerror (errno));
+    return -1;
+  }
+
+  /* Parse one record in advance so the SLMSrecord is allocated */
+  sl_msr_parse (slconn->log, replay->stream + SLHEADSIZE, &msr, 1, 1);
+
+  allocstart = __atomic_load_n (&allocations, __ATOMIC_RELAXED);
+  start      = bench_clock ();
+
+  if (pthread_create (&thread, NULL, replay_thread, replay))
+  {
+    fprintf (stderr, "cannot start replay thread\n");
+    return -1;
+  }
+
+  while (packets < total)
+  {
+    t0     = bench_clock ();
+    retval = sl_collect_nb_size (slconn, &slpack, SLRECVARIABLE);
+    t1     = bench_clock ();
+
+    if (retval == SLTERMINATE || (retval == SLNOPACKET && slconn->link == -1))
+      break;
+
+    if (retval != SLPACKET)
+    {
+      stagetime[STAGE_RECEIVE] += t1 - t0;
+      continue;
+    }
+
+    stagetime[STAGE_COLLECT] += t1 - t0;
+
+    /* Route as packet_handler() of slinktool */
+    reclen = sl_packetreclen (slpack);
+    sl_msh_init (&msh, (char *)&slpack->msrecord);
+    archflag = !(sl_msh_sampratefact (&msh) == 0 && sl_msh_numsamples (&msh) == 0);
+    t2       = bench_clock ();
+
+    parsed = (sl_msr_parse_size (slconn->log, (char *)&slpack->msrecord, &msr, 1, 1, reclen) != NULL);
+    if (parsed && msr->numsamples > 0)
+      samples += msr->numsamples;
+    t3 = bench_clock ();
+
+    if (sdsdir && archflag &&
+        sds_streamproc (sdsdir, &msh, reclen, SLDATA, 120))
+      fprintf (stderr, "cannot write data to SDS at %s\n", sdsdir);
+    t4 = bench_clock ();
+
+    if (output && parsed && sf_write (output, sampleformat, msr))
+      fprintf (stderr, "cannot write samples\n");
+    t5 = bench_clock ();
+
+    stagetime[STAGE_ROUTE] += t2 - t1;
+    stagetime[STAGE_PARSE] += t3 - t2;
+    stagetime[STAGE_ARCHIVE] += t4 - t3;
+    stagetime[STAGE_OUTPUT] += t5 - t4;
+
+    process[packets] = t5 - t0;
+    latency[packets] = t5 - __atomic_load_n (&replay->sendtimes[packets],
+                                             __ATOMIC_ACQUIRE);
+    packets++;
+  }
+
+  if (sdsdir)
+    sds_streamproc (NULL, NULL, 0, 0, 0);
+
+  if (output)
+    fclose (output);
+
+  elapsed = bench_clock () - start;
+
+  if (slconn->link != -1)
+    slconn->link = sl_disconnect (slconn);
+
+  pthread_join (thread, NULL);
+
+  if (packets < total)
+    fprintf (stderr, "only %lld of %lld packets were received\n",
+             (long long)packets, (long long)total);
+
+  if (packets == 0)
+    return -1;
+
+  printf ("Replayed %lld packets in %.3f s, %.0f packets/s%s\n",
+          (long long)packets, elapsed / 1e9, packets / (elapsed / 1e9),
+          (replay->rate > 0.0) ? " (rate limited)" : "");
+  printf ("Allocations: %.3f per packet\n",
+          (double)(__atomic_load_n (&allocations, __ATOMIC_RELAXED) - allocstart) / packets);
+  printf ("Samples: %.1f per packet, %.1f ns/sample processing\n",
+          (double)samples / packets,
+          (samples) ? (double)(stagetime[STAGE_COLLECT] + stagetime[STAGE_ROUTE] +
+                               stagetime[STAGE_PARSE] + stagetime[STAGE_ARCHIVE] +
+                               stagetime[STAGE_OUTPUT]) / samples : 0.0);
+
+  for (idx = 0; idx < STAGE_COUNT; idx++)
+  {
+    if ((idx == STAGE_ARCHIVE && !sdsdir) || (idx == STAGE_OUTPUT && !output))
+      continue;
+
+    printf ("  %-8s %10.1f ns/packet\n", stagenames[idx],
+            (double)stagetime[idx] / packets);
+  }
+
+  report_percentiles ("process", process, (int)packets);
+  report_percentiles ("latency", latency, (int)packets);
+
+  sl_msr_free (&msr);
+  free (process);
+  free (latency);
+
+  return 0;
+} /* End of bench_replay() */
+
+/***************************************************************************
+ * bench_steim:
+ *
+ * Decode synthetic Steim-1 and Steim-2 records of several sample rates
+ * with the scalar and the vectorized decoders and report the time per
+ * record and per sample.  The time to parse the header alone is
+ * subtracted.
+ ***************************************************************************/
+static void
+bench_steim (int iterations)
+{
+  const double rates[] = {1.0, 20.0, 40.0, 100.0, 200.0};
+  const int encodings[] = {10, 11};
+  const char *simdnames[] = {"scalar", "SSE4.1", "AVX2", "NEON"};
+  SLMSrecord *msr = NULL;
+  int32_t samples[2000];
+  char record[SLRECSIZE];
+  double rectime[2];
+  double headtime;
+  int64_t start;
+  int simd;
+  int count;
+  int ridx;
+  int eidx;
+  int iter;
+  int idx;
+
+  simd = sl_msr_simd (1);
+
+  printf ("Steim decoding, %d iterations, vectorized decoder: %s\n",
+          iterations, simdnames[simd]);
+  printf ("  %-8s %6s %8s %12s %12s %10s\n", "encoding", "rate", "samples",
+          "scalar ns", "simd ns", "Msamples/s");
+
+  for (eidx = 0; eidx < 2; eidx++)
+  {
+    for (ridx = 0; ridx < (int) (sizeof (rates) / sizeof (rates[0])); ridx++)
+    {
+      generate_signal (samples, 2000, rates[ridx]);
+      count = build_record (record, encodings[eidx], rates[ridx], samples, 2000);
+
+      /* Verify the decoders before timing them */
+      for (simd = 0; simd <= 1; simd++)
+      {
+        sl_msr_simd (simd);
+
+        if (!sl_msr_parse (NULL, record, &msr, 1, 1) || msr->numsamples != count ||
+            memcmp (msr->datasamples, samples, count * sizeof (int32_t)))
+        {
+          fprintf (stderr, "Steim-%d record at %g sps decoded incorrectly\n",
+                   eidx + 1, rates[ridx]);
+          sl_msr_free (&msr);
+          return;
+        }
+      }
+
+      start = bench_clock ();
+      for (iter = 0; iter < iterations; iter++)
+        sl_msr_parse (NULL, record, &msr, 1, 0);
+      headtime = (double)(bench_clock () - start) / iterations;
+
+      for (simd = 0; simd <= 1; simd++)
+      {
+        sl_msr_simd (simd);
+
+        start = bench_clock ();
+        for (iter = 0; iter < iterations; iter++)
+          sl_msr_parse (NULL, record, &msr, 1, 1);
+        rectime[simd] = (double)(bench_clock () - start) / iterations - headtime;
+      }
+
+      printf ("  Steim-%-2d %6g %8d %12.1f %12.1f %10.1f\n", eidx + 1,
+              rates[ridx], count, rectime[0], rectime[1],
+              (rectime[1] > 0.0) ? count / rectime[1] * 1000.0 : 0.0);
+    }
+  }
+
+  sl_msr_simd (1);
+
+  /* Keep the decoded samples so the loops are not optimized away */
+  for (idx = 0, count = 0; idx < msr->numsamples; idx++)
+    count ^= msr->datasamples[idx];
+
+  if (count == 0x7fffffff)
+    printf ("\n");
+
+  sl_msr_free (&msr);
+} /* End of bench_steim() */
+
+/***************************************************************************
+ * bench_startup:
+ *
+ * Time the startup steps for a large number of streams: reading a
+ * stream list file, parsing a stream list string, saving the state in
+ * the text and binary formats and recovering both, and report the time
+ * per stream.  The recovered sequence numbers are verified.
+ *
+ * Returns 0 on success and -1 on error.
+ ***************************************************************************/
+static int
+bench_startup (int numstreams)
+{
+  const char *formats[] = {"text", "binary"};
+  char listfile[]  = "/tmp/slbenchlistXXXXXX";
+  char statefile[] = "/tmp/slbenchstateXXXXXX";
+  SLCD *slconn[2];
+  SLstream *curstream;
+  char *streamlist;
+  char net[3];
+  char sta[6];
+  FILE *fp;
+  int64_t start;
+  int errors = 0;
+  int count;
+  int fd;
+  int fmt;
+  int idx;
+
+  /* Write a stream list file and a stream list string */
+  if ((streamlist = (char *)malloc ((size_t)numstreams * 9 + 1)) == NULL ||
+      (fd = mkstemp (listfile)) < 0 || (fp = fdopen (fd, "w")) == NULL)
+  {
+    fprintf (stderr, "Cannot create stream list: %s\n", strerror (errno));
+    free (streamlist);
+    return -1;
+  }
+
+  for (idx = 0, count = 0; idx < numstreams; idx++)
+  {
+    stream_codes (idx, net, sta);
+    fprintf (fp, "%s %s\n", net, sta);
+    count += sprintf (streamlist + count, "%s%s_%s", (idx) ? "," : "", net, sta);
+  }
+
+  fclose (fp);
+
+  if ((fd = mkstemp (statefile)) < 0)
+  {
+    fprintf (stderr, "Cannot create state file: %s\n", strerror (errno));
+    unlink (listfile);
+    free (streamlist);
+    return -1;
+  }
+
+  close (fd);
+
+  printf ("Startup with %d streams\n", numstreams);
+
+  slconn[0] = sl_newslcd ();
+  slconn[1] = sl_newslcd ();
+
+  start = bench_clock ();
+  if (sl_read_streamlist (slconn[0], listfile, "BH?") != numstreams + 1)
+    errors++;
+  printf ("  %-16s %10.1f ns/stream\n", "read streamlist",
+          (double)(bench_clock () - start) / numstreams);
+
+  start = bench_clock ();
+  if (sl_parse_streamlist (slconn[1], streamlist, "BH?") != numstreams)
+    errors++;
+  printf ("  %-16s %10.1f ns/stream\n", "parse streamlist",
+          (double)(bench_clock () - start) / numstreams);
+
+  for (fmt = 0; fmt < 2; fmt++)
+  {
+    for (curstream = slconn[0]->streams, idx = 0; curstream; curstream = curstream->next, idx++)
+      curstream->seqnum = (idx * 7 + fmt) % 0xFFFFFF;
+
+    start = bench_clock ();
+    if ((fmt) ? sl_savestate_binary (slconn[0], statefile) : sl_savestate (slconn[0], statefile))
+      errors++;
+    printf ("  save %-11s %10.1f ns/stream\n", formats[fmt],
+            (double)(bench_clock () - start) / numstreams);
+
+    start = bench_clock ();
+    if (sl_recoverstate (slconn[1], statefile))
+      errors++;
+    printf ("  recover %-8s %10.1f ns/stream\n", formats[fmt],
+            (double)(bench_clock () - start) / numstreams);
+
+    for (curstream = slconn[1]->streams, idx = 0; curstream; curstream = curstream->next, idx++)
+      if (curstream->seqnum != (idx * 7 + fmt) % 0xFFFFFF)
+        errors++;
+  }
+
+  sl_freeslcd (slconn[0]);
+  sl_freeslcd (slconn[1]);
+  unlink (listfile);
+  unlink (statefile);
+  free (streamlist);
+
+  if (errors)
+  {
+    fprintf (stderr, "Startup benchmark failed, %d errors\n", errors);
+    return -1;
+  }
+
+  return 0;
+} /* End of bench_startup() */
+
+/***************************************************************************
+ * stream_codes:
+ *
+ * Generate unique network and station codes for a stream index.
+ ***************************************************************************/
+static void
+stream_codes (int index, char *net, char *sta)
+{
+  const char *digits = "ABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789";
+  int idx;
+
+  net[0] = digits[index % 26];
+  net[1] = digits[(index / 26) % 36];
+  net[2] = '\0';
+
+  index /= 26 * 36;
+
+  for (idx = 4; idx >= 0; idx--)
+  {
+    sta[idx] = digits[index % 36];
+    index /= 36;
+  }
+
+  sta[5] = '\0';
+} /* End of stream_codes() */
+
+/***************************************************************************
+ * encode_steim:
+ *
+ * Encode samples as Steim-1 (encoding 10) or Steim-2 (encoding 11)
+ * frames in host byte order, filling as many of 'numframes' frames as
+ * possible.  Each word packs the most differences that fit.
+ *
+ * Returns the number of samples encoded.
+ ***************************************************************************/
+static int
+encode_steim (int encoding, const int32_t *samples, int count,
+              int32_t *frames, int numframes)
+{
+  /* Packings: nibble, dnib, differences per word, bits per difference */
+  static const int steim1[][4] = {{1, -1, 4, 8}, {2, -1, 2, 16}, {3, -1, 1, 32}};
+  static const int steim2[][4] = {{3, 2, 7, 4}, {3, 1, 6, 5}, {3, 0, 5, 6},
+                                  {1, -1, 4, 8}, {2, 3, 3, 10}, {2, 2, 2, 15},
+                                  {2, 1, 1, 30}};
+  const int (*packings)[4] = (encoding == 10) ? steim1 : steim2;
+  int numpackings = (encoding == 10) ? 3 : 7;
+  uint32_t word;
+  uint32_t nibbles;
+  int64_t diff;
+  int64_t limit;
+  int sample = 0;
+  int frame;
+  int widx;
+  int pidx;
+  int idx;
+  int k;
+  int bits;
+
+  memset (frames, 0, numframes * 64);
+
+  for (frame = 0; frame < numframes && sample < count; frame++)
+  {
+    nibbles = 0;
+
+    for (widx = (frame == 0) ? 3 : 1; widx < 16 && sample < count; widx++)
+    {
+      /* Find the densest packing the next differences fit */
+      for (pidx = 0; pidx < numpackings; pidx++)
+      {
+        k     = packings[pidx][2];
+        bits  = packings[pidx][3];
+        limit = (int64_t)1 << (bits - 1);
+
+        if (sample + k > count)
+          continue;
+
+        for (idx = 0; idx < k; idx++)
+        {
+          diff = (sample + idx) ? (int64_t)samples[sample + idx] - samples[sample + idx - 1] : 0;
+
+          if (diff < -limit || diff >= limit)
+            break;
+        }
+
+        if (idx == k)
+          break;
+      }
+
+      if (pidx == numpackings)
+        return sample;
+
+      word = (packings[pidx][1] >= 0) ? (uint32_t)packings[pidx][1] << 30 : 0;
+
+      for (idx = 0; idx < k; idx++)
+      {
+        diff = (sample + idx) ? (int64_t)samples[sample + idx] - samples[sample + idx - 1] : 0;
+
+        if (bits == 32)
+          word = (uint32_t)diff;
+        else
+          word |= ((uint32_t)diff & ((1u << bits) - 1)) << ((k - 1 - idx) * bits);
+      }
+
+      frames[frame * 16 + widx] = (int32_t)word;
+      nibbles |= (uint32_t)packings[pidx][0] << (30 - 2 * widx);
+      sample += k;
+    }
+
+    frames[frame * 16] = (int32_t)nibbles;
+  }
+
+  /* Forward and reverse integration constants */
+  frames[1] = samples[0];
+  frames[2] = samples[sample - 1];
+
+  return sample;
+} /* End of encode_steim() */
+
+/***************************************************************************
+ * build_record:
+ *
+ * Build a big-endian 512-byte record with a Blockette 1000 of Steim
+ * encoded samples.
+ *
+ * Returns the number of samples in the record.
+ ***************************************************************************/
+static int
+build_record (char *record, int encoding, double samprate,
+              const int32_t *samples, int count)
+{
+  struct sl_fsdh_s *fsdh = (struct sl_fsdh_s *)record;
+  struct sl_blkt_1000_s *blkt = (struct sl_blkt_1000_s *)(record + 48);
+  const uint16_t endiantest = 1;
+  int32_t frames[7 * 16];
+  int numsamples;
+  int idx;
+
+  memset (record, 0, SLRECSIZE);
+  memcpy (fsdh->sequence_number, "000001", 6);
+  fsdh->dhq_indicator = 'D';
+  fsdh->reserved      = ' ';
+  memcpy (fsdh->station, "BENCH", 5);
+  memcpy (fsdh->location, "00", 2);
+  memcpy (fsdh->channel, (samprate >= 80.0) ? "HHZ" : (samprate >= 10.0) ? "BHZ" : "LHZ", 3);
+  memcpy (fsdh->network, "XX", 2);
+
+  fsdh->start_time.year = 2026;
+  fsdh->start_time.day  = 287;
+  fsdh->num_samples     = 0;
+  fsdh->samprate_fact   = (int16_t)samprate;
+  fsdh->samprate_mult   = 1;
+  fsdh->num_blockettes  = 1;
+  fsdh->begin_data      = 64;
+  fsdh->begin_blockette = 48;
+
+  blkt->blkt_type  = 1000;
+  blkt->next_blkt  = 0;
+  blkt->encoding   = encoding;
+  blkt->word_swap  = 1;
+  blkt->rec_len    = 9;
+
+  numsamples        = encode_steim (encoding, samples, count, frames, 7);
+  fsdh->num_samples = numsamples;
+
+  /* Records are big-endian */
+  if (*(const uint8_t *)&endiantest == 1)
+  {
+    for (idx = 0; idx < 7 * 16; idx++)
+      sl_gswap4a (&frames[idx]);
+
+    sl_gswap2a (&fsdh->start_time.year);
+    sl_gswap2a (&fsdh->start_time.day);
+    sl_gswap2a (&fsdh->num_samples);
+    sl_gswap2a (&fsdh->samprate_fact);
+    sl_gswap2a (&fsdh->samprate_mult);
+    sl_gswap2a (&fsdh->begin_data);
+    sl_gswap2a (&fsdh->begin_blockette);
+    sl_gswap2a (&blkt->blkt_type);
+  }
+
+  memcpy (record + 64, frames, sizeof (frames));
+
+  return numsamples;
+} /* End of build_record() */
+
+/***************************************************************************
+ * generate_signal:
+ *
+ * Generate samples of a broadband channel: microseisms of about 0.2 Hz
+ * and 20000 counts, a longer period swell and noise.  At low sample
+ * rates the differences are large, at high rates they are small and
+ * dominated by the noise, like in real data.
+ ***************************************************************************/
+static void
+generate_signal (int32_t *samples, int count, double samprate)
+{
+  uint32_t seed = 12345;
+  double noise;
+  double t;
+  int idx;
+  int n;
+
+  for (idx = 0; idx < count; idx++)
+  {
+    t = idx / samprate;
+
+    /* Approximately normal noise from a sum of uniform values */
+    for (noise = 0.0, n = 0; n < 4; n++)
+    {
+      seed = seed * 1664525u + 1013904223u;
+      noise += (double)(seed >> 8) / 16777216.0 - 0.5;
+    }
+
+    samples[idx] = (int32_t) (20000.0 * sin (2.0 * M_PI * 0.2 * t) +
+                              5000.0 * sin (2.0 * M_PI * 0.013 * t + 1.0) +
+                              60.0 * noise);
+  }
+} /* End of generate_signal() */
+
+/***************************************************************************
+ * compare_station:
+ *
+ * Comparison of station and network codes for qsort().
+ ***************************************************************************/
+static int
+compare_station (const void *a, const void *b)
+{
+  return memcmp (a, b, 7);
+} /* End of compare_station() */
+
+/***************************************************************************
+ * compare_int64:
+ *
+ * Comparison of int64_t values for qsort().
+ ***************************************************************************/
+static int
+compare_int64 (const void *a, const void *b)
+{
+  int64_t va = *(const int64_t *)a;
+  int64_t vb = *(const int64_t *)b;
+
+  return (va > vb) - (va < vb);
+} /* End of compare_int64() */
+
+/***************************************************************************
+ * report_percentiles:
+ *
+ * Sort the values, in nanoseconds, and print the 50th, 99th and 99.9th
+ * percentiles and the maximum.
+ ***************************************************************************/
+static void
+report_percentiles (const char *name, int64_t *values, int count)
+{
+  qsort (values, count, sizeof (int64_t), compare_int64);
+
+  printf ("  %-8s p50 %.1f us, p99 %.1f us, p999 %.1f us, max %.1f us\n", name,
+          values[(int64_t)count * 50 / 100] / 1e3,
+          values[(int64_t)count * 99 / 100] / 1e3,
+          values[(int64_t)count * 999 / 1000] / 1e3,
+          values[count - 1] / 1e3);
+} /* End of report_percentiles() */
+
+/***************************************************************************
+ * usage:
+ * Print the usage message and exit.
+ ***************************************************************************/
+static void
+usage (void)
+{
+  fprintf (stderr, "%s version %s\n\n", PACKAGE, VERSION);
+  fprintf (stderr, "Usage: %s [options] recording\n", PACKAGE);
+  fprintf (stderr, "       %s -steim [-i iterations]\n", PACKAGE);
+  fprintf (stderr, "       %s -startup [-n streams]\n\n", PACKAGE);
+  fprintf (stderr,
+           " -h              show this usage message\n"
+           " -r count        replay the recording this many times, default 1\n"
+           " -R rate         replay at this many packets per second, default maximum\n"
+           " -SDS SDSdir     write the records to a SDS archive in the archive stage\n"
+           " -wb bytes       buffer up to this many bytes per archive stream\n"
+           " -uf format      format the samples to /dev/null in the output stage,\n"
+           "                   a sample output format of slinktool\n"
+           " -steim          only run the Steim decoder benchmarks\n"
+           " -i iterations   decoding iterations per Steim benchmark, default %d\n"
+           " -startup        only run the startup benchmark\n"
+           " -n streams      number of streams of the startup benchmark, default %d\n"
+           "\n"
+           " recording       a file of Mini-SEED records, e.g. written with\n"
+           "                   'slinktool -o', or of SeedLink packets\n",
+           STEIM_ITERATIONS, STARTUP_STREAMS);
+} /* End of usage() */
@@ -23,6 +23,7 @@ INCS = -I.
 
 OBJS=	gswap.obj	&
 	unpack.obj	&
+	unpacksimd.obj	&
 	msrecord.obj	&
 	genutils.obj	&
 	strutils.obj	&
@@ -32,6 +33,7 @@ OBJS=	gswap.obj	&
 	config.obj	&
 	slplatform.obj	&
 	slutils.obj     &
+	connset.obj     &
 	globmatch.obj
 
 all: lib
@@ -45,8 +47,10 @@ dll:	$(OBJS) .SYMBOLIC
 # Source dependencies:
 gswap.obj:	gswap.c libslink.h
 unpack.obj:	unpack.c unpack.h libslink.h 
+unpacksimd.obj:	unpacksimd.c unpack.h libslink.h 
 msrecord.obj:	msrecord.c libslink.h
 slutils.obj:	slutils.c libslink.h
+connset.obj:	connset.c libslink.h
 strutils.obj:	strutils.c libslink.h
 logging.obj:	logging.c libslink.h
 network.obj:	network.c libslink.h
@@ -6,11 +6,12 @@
  *
  * Written by Chad Trabant, ORFEUS/EC-Project MEREDIAN
  *
- * modified: 2013.305
+ * modified: 2026.287
  ***************************************************************************/
 
 #include <errno.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "libslink.h"
@@ -43,7 +44,10 @@ sl_read_streamlist (SLCD *slconn, const char *streamfile,
   char net[3];
   char sta[6];
   char selectors[100];
-  char line[100];
+  char *buffer;
+  char *line;
+  char *lineend;
+  size_t length;
   int streamfd;
   int fields;
   int count;
@@ -70,11 +74,24 @@ sl_read_streamlist (SLCD *slconn, const char *streamfile,
 
   sl_log_r (slconn, 1, 1, "Reading stream list from %s\n", streamfile);
 
+  /* Read the complete file, parsing is done line by line in place */
+  if ((buffer = sl_readfile (streamfd, &length)) == NULL)
+  {
+    sl_log_r (slconn, 2, 0, "reading stream list file, %s\n", strerror (errno));
+    close (streamfd);
+    return -1;
+  }
+
   count    = 1;
   stacount = 0;
 
-  while ((sl_readline (streamfd, line, sizeof (line))) >= 0)
+  for (line = buffer; line < buffer + length; line = lineend + 1)
   {
+    if ((lineend = memchr (line, '\n', buffer + length - line)) == NULL)
+      lineend = buffer + length;
+
+    *lineend = '\0';
+
     fields = sscanf (line, "%2s %5s %99[a-zA-Z0-9!?. ]\n",
                      net, sta, selectors);
 
@@ -102,6 +119,8 @@ sl_read_streamlist (SLCD *slconn, const char *streamfile,
     count++;
   }
 
+  free (buffer);
+
   if (stacount == 0)
   {
     sl_log_r (slconn, 2, 0, "no streams defined in %s\n", streamfile);
@@ -0,0 +1,441 @@
+/***************************************************************************
+ * connset.c:
+ *
+ * Routines to collect packets from a set of SeedLink connections.
+ *
+ * The connections are managed with the non-blocking collection
+ * routine, sl_collect_nb_size(), and the sockets are multiplexed
+ * using epoll on Linux, kqueue on BSD and macOS or select() on other
+ * platforms.
+ *
+ * modified: 2026.287
+ ***************************************************************************/
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "libslink.h"
+
+#if defined(SLP_LINUX) && !defined(__CYGWIN__)
+  #define SLSET_EPOLL 1
+  #include <sys/epoll.h>
+#elif defined(SLP_BSD)
+  #define SLSET_KQUEUE 1
+  #include <sys/event.h>
+#elif !defined(SLP_WIN)
+  #include <sys/select.h>
+#endif
+
+/* Maximum time to wait for data before servicing connection timers */
+#define SLSET_MAXWAIT 500
+
+static int sl_waitset (SLCDset *slset, int timeout);
+static void sl_unwatch (SLCDset *slset, int idx);
+
+/***************************************************************************
+ * sl_newslcdset:
+ *
+ * Allocate and initialize a new, empty connection set.
+ *
+ * Returns a pointer to a new SLCDset or NULL on error.
+ ***************************************************************************/
+SLCDset *
+sl_newslcdset (void)
+{
+  SLCDset *slset;
+
+  slset = (SLCDset *)calloc (1, sizeof (SLCDset));
+
+  if (slset == NULL)
+  {
+    sl_log_r (NULL, 2, 0, "sl_newslcdset(): error allocating memory\n");
+    return NULL;
+  }
+
+#if defined(SLSET_EPOLL)
+  slset->pollfd = epoll_create (16);
+#elif defined(SLSET_KQUEUE)
+  slset->pollfd = kqueue ();
+#else
+  slset->pollfd = -1;
+#endif
+
+#if defined(SLSET_EPOLL) || defined(SLSET_KQUEUE)
+  if (slset->pollfd < 0)
+  {
+    sl_log_r (NULL, 2, 0, "sl_newslcdset(): cannot create event queue: %s\n",
+              strerror (errno));
+    free (slset);
+    return NULL;
+  }
+#endif
+
+  return slset;
+} /* End of sl_newslcdset() */
+
+/***************************************************************************
+ * sl_freeslcdset:
+ *
+ * Free all memory associated with a connection set.  The SLCDs in the
+ * set are not freed.
+ ***************************************************************************/
+void
+sl_freeslcdset (SLCDset *slset)
+{
+  if (slset == NULL)
+    return;
+
+#if defined(SLSET_EPOLL) || defined(SLSET_KQUEUE)
+  close (slset->pollfd);
+#endif
+
+  free (slset->slconns);
+  free (slset->watched);
+  free (slset->done);
+  free (slset);
+} /* End of sl_freeslcdset() */
+
+/***************************************************************************
+ * sl_addslcdset:
+ *
+ * Add a SeedLink connection description to a connection set.  The SLCD
+ * must be fully configured.
+ *
+ * Returns 0 on success and -1 on error.
+ ***************************************************************************/
+int
+sl_addslcdset (SLCDset *slset, SLCD *slconn)
+{
+  SLCD **slconns;
+  SOCKET *watched;
+  int8_t *done;
+  int count = slset->numconns + 1;
+
+  slconns = (SLCD **)realloc (slset->slconns, sizeof (SLCD *) * count);
+  if (slconns)
+    slset->slconns = slconns;
+
+  watched = (SOCKET *)realloc (slset->watched, sizeof (SOCKET) * count);
+  if (watched)
+    slset->watched = watched;
+
+  done = (int8_t *)realloc (slset->done, sizeof (int8_t) * count);
+  if (done)
+    slset->done = done;
+
+  if (!slconns || !watched || !done)
+  {
+    sl_log_r (slconn, 2, 0, "sl_addslcdset(): error allocating memory\n");
+    return -1;
+  }
+
+  slset->slconns[slset->numconns] = slconn;
+  slset->watched[slset->numconns] = -1;
+  slset->done[slset->numconns]    = 0;
+  slset->numconns                 = count;
+  slset->active++;
+
+  return 0;
+} /* End of sl_addslcdset() */
+
+/***************************************************************************
+ * sl_collect_set:
+ *
+ * Collect packets one at a time from all connections in a set, see
+ * sl_collect_set_batch() for details.
+ *
+ * When a packet is received the connection it was received on is
+ * returned in 'slconn' and 'slpack' is set to the packet, which is
+ * valid until the next call for that connection.
+ *
+ * Returns SLPACKET when a packet is received, SLNOPACKET when no packet
+ * was received before the timeout and SLTERMINATE when all connections
+ * have terminated.
+ ***************************************************************************/
+int
+sl_collect_set (SLCDset *slset, SLCD **slconn, SLpacket **slpack,
+                int slrecsize, int timeout)
+{
+  int npacks;
+
+  *slpack = NULL;
+
+  return sl_collect_set_batch (slset, slconn, slpack, 1, &npacks,
+                               slrecsize, timeout);
+} /* End of sl_collect_set() */
+
+/***************************************************************************
+ * sl_collect_set_batch:
+ *
+ * Collect batches of packets from all connections in a set.  Each
+ * connection is managed as with sl_collect_batch(), including
+ * keepalives, network timeouts and re-connection delays, and
+ * connections are visited in turn so that a busy connection cannot
+ * starve the others.
+ *
+ * If no packets are available wait up to 'timeout' milliseconds for
+ * data to arrive; a timeout of 0 returns immediately and a negative
+ * timeout waits until a packet is received.
+ *
+ * When packets are received from a connection, up to 'maxpacks' of
+ * them are returned in the 'slpacks' array and 'npacks' is set to the
+ * number of packets.  The connection they were received on is returned
+ * in 'slconn'.  The packets are valid until the next call for that
+ * connection.
+ *
+ * Returns SLPACKET when packets are received, SLNOPACKET when no packet
+ * was received before the timeout and SLTERMINATE when all connections
+ * have terminated.
+ ***************************************************************************/
+int
+sl_collect_set_batch (SLCDset *slset, SLCD **slconn, SLpacket **slpacks,
+                      int maxpacks, int *npacks, int slrecsize, int timeout)
+{
+  SLCD *conn;
+  double deadline = 0.0;
+  double now;
+  int retval;
+  int count;
+  int wait;
+  int idx;
+
+  *slconn = NULL;
+  *npacks = 0;
+
+  if (timeout > 0)
+    deadline = sl_dtime () + timeout / 1000.0;
+
+  for (;;)
+  {
+    if (slset->active <= 0)
+      return SLTERMINATE;
+
+    /* Visit each connection once starting after the last one returned */
+    for (count = 0; count < slset->numconns; count++)
+    {
+      idx         = slset->next;
+      slset->next = (slset->next + 1) % slset->numconns;
+
+      if (slset->done[idx])
+        continue;
+
+      conn = slset->slconns[idx];
+
+      /* A closed socket is no longer being watched */
+      if (conn->link == -1)
+      {
+        slset->watched[idx] = -1;
+
+        /* Skip connections waiting for the re-connect delay,
+           avoiding the delay throttle in sl_collect_nb_size() */
+        if (!conn->terminate && conn->netdly &&
+            conn->stat->sl_state == SL_DOWN && conn->stat->netdly_trig == 1)
+        {
+          if ((sl_dtime () - conn->stat->netdly_time) <= conn->netdly)
+            continue;
+
+          conn->stat->netdly_trig = 0;
+        }
+      }
+
+      retval = sl_collect_batch (conn, slpacks, maxpacks, npacks, slrecsize);
+
+      if (retval == SLPACKET)
+      {
+        *slconn = conn;
+        return SLPACKET;
+      }
+      else if (retval == SLTERMINATE)
+      {
+        sl_unwatch (slset, idx);
+        slset->done[idx] = 1;
+        slset->active--;
+      }
+    }
+
+    if (slset->active <= 0)
+      return SLTERMINATE;
+
+    /* Determine how long to wait for data */
+    wait = SLSET_MAXWAIT;
+
+    if (timeout == 0)
+      return SLNOPACKET;
+
+    if (timeout > 0)
+    {
+      now = sl_dtime ();
+
+      if (now >= deadline)
+        return SLNOPACKET;
+
+      if ((deadline - now) * 1000.0 < wait)
+        wait = (int)((deadline - now) * 1000.0) + 1;
+    }
+
+    sl_waitset (slset, wait);
+  }
+} /* End of sl_collect_set_batch() */
+
+/***************************************************************************
+ * sl_terminate_set:
+ *
+ * Set the terminate flag for all connections in a set, subsequent calls
+ * to sl_collect_set() will return the remaining packets and then
+ * SLTERMINATE.
+ ***************************************************************************/
+void
+sl_terminate_set (SLCDset *slset)
+{
+  int idx;
+
+  for (idx = 0; idx < slset->numconns; idx++)
+    sl_terminate (slset->slconns[idx]);
+} /* End of sl_terminate_set() */
+
+/***************************************************************************
+ * sl_waitset:
+ *
+ * Wait up to 'timeout' milliseconds for data on any of the open
+ * connections of a set.  Sockets of new connections are added to the
+ * event queue as needed.
+ *
+ * Returns the number of sockets with data available, 0 on timeout or
+ * -1 on error.
+ ***************************************************************************/
+static int
+sl_waitset (SLCDset *slset, int timeout)
+{
+  int retval;
+  int idx;
+
+#if defined(SLSET_EPOLL)
+  struct epoll_event events[16];
+
+  for (idx = 0; idx < slset->numconns; idx++)
+  {
+    SOCKET link = slset->slconns[idx]->link;
+
+    if (slset->done[idx] || link == -1 || link == slset->watched[idx])
+      continue;
+
+    sl_unwatch (slset, idx);
+
+    memset (&events[0], 0, sizeof (struct epoll_event));
+    events[0].events  = EPOLLIN;
+    events[0].data.fd = link;
+
+    if (epoll_ctl (slset->pollfd, EPOLL_CTL_ADD, link, &events[0]) && errno != EEXIST)
+    {
+      sl_log_r (slset->slconns[idx], 2, 0, "sl_waitset(): epoll_ctl(): %s\n",
+                strerror (errno));
+      continue;
+    }
+
+    slset->watched[idx] = link;
+  }
+
+  retval = epoll_wait (slset->pollfd, events, 16, timeout);
+
+#elif defined(SLSET_KQUEUE)
+  struct kevent events[16];
+  struct timespec ts;
+
+  for (idx = 0; idx < slset->numconns; idx++)
+  {
+    SOCKET link = slset->slconns[idx]->link;
+
+    if (slset->done[idx] || link == -1 || link == slset->watched[idx])
+      continue;
+
+    sl_unwatch (slset, idx);
+
+    EV_SET (&events[0], link, EVFILT_READ, EV_ADD, 0, 0, NULL);
+
+    if (kevent (slset->pollfd, &events[0], 1, NULL, 0, NULL) == -1)
+    {
+      sl_log_r (slset->slconns[idx], 2, 0, "sl_waitset(): kevent(): %s\n",
+                strerror (errno));
+      continue;
+    }
+
+    slset->watched[idx] = link;
+  }
+
+  ts.tv_sec  = timeout / 1000;
+  ts.tv_nsec = (timeout % 1000) * 1000000;
+
+  retval = kevent (slset->pollfd, NULL, 0, events, 16, &ts);
+
+#else
+  struct timeval tv;
+  fd_set readfds;
+  SOCKET maxfd = -1;
+
+  FD_ZERO (&readfds);
+
+  for (idx = 0; idx < slset->numconns; idx++)
+  {
+    SOCKET link = slset->slconns[idx]->link;
+
+    if (slset->done[idx] || link == -1)
+      continue;
+
+    FD_SET (link, &readfds);
+
+    if (link > maxfd)
+      maxfd = link;
+  }
+
+  /* Nothing to wait on, e.g. all connections in re-connect delay */
+  if (maxfd == -1)
+  {
+    slp_usleep (timeout * 1000);
+    return 0;
+  }
+
+  tv.tv_sec  = timeout / 1000;
+  tv.tv_usec = (timeout % 1000) * 1000;
+
+  retval = select (maxfd + 1, &readfds, NULL, NULL, &tv);
+#endif
+
+  if (retval < 0 && errno != EINTR)
+  {
+    sl_log_r (NULL, 2, 0, "sl_waitset(): error waiting for data: %s\n",
+              strerror (errno));
+  }
+
+  return retval;
+} /* End of sl_waitset() */
+
+/***************************************************************************
+ * sl_unwatch:
+ *
+ * Remove the socket of a connection from the event queue if it is
+ * still open.  Sockets are removed from the queue automatically when
+ * closed.
+ ***************************************************************************/
+static void
+sl_unwatch (SLCDset *slset, int idx)
+{
+  if (slset->watched[idx] == -1)
+    return;
+
+  if (slset->watched[idx] == slset->slconns[idx]->link)
+  {
+#if defined(SLSET_EPOLL)
+    struct epoll_event event;
+
+    epoll_ctl (slset->pollfd, EPOLL_CTL_DEL, slset->watched[idx], &event);
+#elif defined(SLSET_KQUEUE)
+    struct kevent event;
+
+    EV_SET (&event, slset->watched[idx], EVFILT_READ, EV_DELETE, 0, 0, NULL);
+    kevent (slset->pollfd, &event, 1, NULL, 0, NULL);
+#endif
+  }
+
+  slset->watched[idx] = -1;
+} /* End of sl_unwatch() */
@@ -168,3 +168,59 @@ sl_readline (int fd, char *buffer, int buflen)
 
   return nread;
 } /* End of sl_readline() */
+
+/***************************************************************************
+ * sl_readfile:
+ *
+ * Read all remaining data from a stream (specified as a file
+ * descriptor) into an allocated buffer.  The buffer is always NULL
+ * terminated, the terminator is not included in 'length'.  The caller
+ * is responsible for freeing the buffer.
+ *
+ * Returns a pointer to the buffer on success and NULL on error.
+ ***************************************************************************/
+char *
+sl_readfile (int fd, size_t *length)
+{
+  char *buffer = NULL;
+  char *newbuffer;
+  size_t buffersize = 0;
+  size_t nread = 0;
+  int rv;
+
+  for (;;)
+  {
+    if (buffersize - nread < 4096)
+    {
+      buffersize = (buffersize) ? buffersize * 2 : 65536;
+
+      if ((newbuffer = (char *)realloc (buffer, buffersize + 1)) == NULL)
+      {
+        free (buffer);
+        return NULL;
+      }
+
+      buffer = newbuffer;
+    }
+
+    rv = read (fd, buffer + nread, buffersize - nread);
+
+    if (rv < 0)
+    {
+      free (buffer);
+      return NULL;
+    }
+
+    if (rv == 0)
+      break;
+
+    nread += rv;
+  }
+
+  buffer[nread] = '\0';
+
+  if (length)
+    *length = nread;
+
+  return buffer;
+} /* End of sl_readfile() */
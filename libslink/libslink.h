@@ -38,10 +38,15 @@ extern "C" {
 #define MAX_HEADER_SIZE     128      /* Max record header size */
 #define SLHEADSIZE          8        /* SeedLink header size */
 #define SELSIZE             8        /* Maximum selector size */
-#define BUFSIZE             8192     /* Size of receiving buffer */
+#define BUFSIZE             8192     /* Minimum size of receiving buffer */
+#define SLDEFBUFSIZE        1048576  /* Default size of receiving buffer */
+#define SLMAXBUFSIZE        16777216 /* Maximum size of receiving buffer */
+#define SLMAXRECSIZE        8192     /* Maximum Mini-SEED record size */
+#define SLRECVARIABLE       0        /* Record size: detect for each packet */
 #define SIGNATURE           "SL"     /* SeedLink header signature */
 #define INFOSIGNATURE       "SLINFO" /* SeedLink INFO packet signature */
 #define MAX_LOG_MSG_LENGTH  200      /* Maximum length of log messages */
+#define SLLOGSLOTS          4096     /* Default slots of the asynchronous log ring */
 
 /* Return values for sl_collect() and sl_collect_nb() */
 #define SLPACKET    1
@@ -144,7 +149,9 @@ struct sl_fsdh_s
   uint16_t    begin_blockette;
 } SLP_PACKED;
 
-/* SeedLink packet, sequence number followed by miniSEED record */
+/* SeedLink packet, sequence number followed by miniSEED record.  Records
+ * of packets collected with SLRECVARIABLE may be up to SLMAXRECSIZE bytes,
+ * see sl_packetreclen() */
 typedef struct slpacket_s
 {
   char    slhead[SLHEADSIZE];   /* SeedLink header */
@@ -159,15 +166,48 @@ typedef struct slstream_s
   char   *selectors;	        /* SeedLink style selectors for this station */
   int     seqnum;	        /* SeedLink sequence number for this station */
   char    timestamp[20];        /* Time stamp of last packet received */
+  struct sl_btime_s lasttime;   /* Start time of last packet received */
+  int8_t  timestale;            /* Flag: timestamp not yet updated from lasttime */
+  int     stateslot;            /* Slot in the binary state file, -1 if none */
+  uint32_t stategen;            /* Generation of the last saved binary state */
+  int     stateseq;             /* Sequence number of the last saved binary state */
   struct  slstream_s *next;     /* The next station in the chain */
 } SLstream;
 
+/* Index of a stream chain for matching received packets to streams */
+typedef struct slstreamidx_s
+{
+  SLstream  **table;            /* Hash table of streams with exact codes */
+  int         tablesize;        /* Size of the hash table, a power of 2 */
+  int         numstreams;       /* Number of streams in the hash table */
+  SLstream  **wildcards;        /* Streams with wildcarded codes */
+  int         numwildcards;     /* Number of wildcarded streams */
+  int         maxwildcards;     /* Size of the wildcarded stream list */
+} SLstreamidx;
+
+/* Connection statistics, see sl_connstats() */
+typedef struct slconnstats_s
+{
+  int64_t connattempts;         /* Number of connection attempts */
+  int64_t connects;             /* Number of established connections */
+  int64_t negfailures;          /* Number of failed negotiations */
+  int64_t timeouts;             /* Number of network timeouts */
+  int64_t packets;              /* Number of packets received */
+  int64_t bytes;                /* Number of bytes received */
+  double  connecttime;          /* Time the last connection was established */
+  double  negtime;              /* Duration of the last negotiation (seconds) */
+  double  negtimetotal;         /* Total duration of negotiations (seconds) */
+} SLconnstats;
+
 /* Persistent connection state information */
 typedef struct stat_s
 {
-  char    databuf[BUFSIZE];     /* Data buffer for received packets */
-  int     recptr;               /* Receive pointer for databuf */
-  int     sendptr;              /* Send pointer for databuf */
+  char   *databuf;              /* Ring buffer for received packets */
+  int     bufsize;              /* Size of databuf ring, excluding spill area */
+  int64_t recptr;               /* Receive pointer for databuf, total bytes */
+  int64_t sendptr;              /* Send pointer for databuf, total bytes */
+  SLstreamidx *streamidx;       /* Index of the stream chain, built on demand */
+  SLstream *streamtail;         /* Last entry of the stream chain */
   int8_t  expect_info;          /* Do we expect an INFO response? */
 
   int8_t  netto_trig;           /* Network timeout trigger */
@@ -189,7 +229,12 @@ typedef struct stat_s
       NoQuery, InfoQuery, KeepAliveQuery
     }
   query_mode;
-    
+
+  SLconnstats stats;            /* Connection statistics */
+
+  int     statefd;              /* Open binary state file, -1 if none */
+  char   *statefile;            /* Path of the open binary state file */
+  int     stateslots;           /* Number of stream slots in the binary state file */
 } SLstat;
 
 /* Logging parameters */
@@ -214,6 +259,7 @@ typedef struct slcd_s
   int8_t      multistation;     /* Boolean flag to indicate multistation mode */
   int8_t      dialup;           /* Boolean flag to indicate dial-up mode */
   int8_t      batchmode;        /* Batch mode (1 - requested, 2 - activated) */
+  int8_t      pipeline;         /* Boolean flag to pipeline multi-station negotiation */
   int8_t      lastpkttime;      /* Boolean flag to control last packet time usage */
   int8_t      terminate;        /* Boolean flag to control connection termination */
 
@@ -228,22 +274,52 @@ typedef struct slcd_s
   SLlog      *log;              /* Logging parameters */
 } SLCD;
 
+/* Set of SeedLink connections collected together */
+typedef struct slcdset_s
+{
+  SLCD      **slconns;          /* The connections in the set */
+  SOCKET     *watched;          /* Socket in the event queue for each connection */
+  int8_t     *done;             /* Flag for each terminated connection */
+  int         numconns;         /* Number of connections in the set */
+  int         active;           /* Number of connections not terminated */
+  int         next;             /* Next connection to collect from */
+  int         pollfd;           /* Event queue descriptor (epoll, kqueue) */
+} SLCDset;
+
 /* slutils.c */
 extern int    sl_collect (SLCD * slconn, SLpacket ** slpack);
 extern int    sl_collect_nb (SLCD * slconn, SLpacket ** slpack);
 extern int    sl_collect_nb_size (SLCD * slconn, SLpacket ** slpack, int slrecsize);
+extern int    sl_collect_batch (SLCD * slconn, SLpacket ** slpacks, int maxpacks,
+				int *npacks, int slrecsize);
 extern SLCD * sl_newslcd (void);
 extern void   sl_freeslcd (SLCD * slconn);
+extern int    sl_setbuffersize (SLCD * slconn, int size);
 extern int    sl_addstream (SLCD * slconn, const char *net, const char *sta,
 			    const char *selectors, int seqnum,
 			    const char *timestamp);
+extern int    sl_setstreams (SLCD * slconn, SLstream * streams);
 extern int    sl_setuniparams (SLCD * slconn, const char *selectors,
 			       int seqnum, const char *timestamp);
+extern const char * sl_streamtimestamp (SLstream * stream);
+extern const SLconnstats * sl_connstats (SLCD * slconn);
 extern int    sl_request_info (SLCD * slconn, const char * infostr);
 extern int    sl_sequence (const SLpacket *);
 extern int    sl_packettype (const SLpacket *);
+extern int    sl_packetreclen (const SLpacket *);
 extern void   sl_terminate (SLCD * slconn);
 
+/* connset.c */
+extern SLCDset * sl_newslcdset (void);
+extern void   sl_freeslcdset (SLCDset * slset);
+extern int    sl_addslcdset (SLCDset * slset, SLCD * slconn);
+extern int    sl_collect_set (SLCDset * slset, SLCD ** slconn,
+			      SLpacket ** slpack, int slrecsize, int timeout);
+extern int    sl_collect_set_batch (SLCDset * slset, SLCD ** slconn,
+				    SLpacket ** slpacks, int maxpacks, int *npacks,
+				    int slrecsize, int timeout);
+extern void   sl_terminate_set (SLCDset * slset);
+
 /* config.c */
 extern int   sl_read_streamlist (SLCD *slconn, const char *streamfile,
 				 const char *defselect);
@@ -271,6 +347,7 @@ extern int    sl_doy2md (int year, int jday, int *month, int *mday);
 extern int    sl_checkversion (const SLCD * slconn, float version);
 extern int    sl_checkslcd (const SLCD * slconn);
 extern int    sl_readline (int fd, char *buffer, int buflen);
+extern char  *sl_readfile (int fd, size_t *length);
 
 /* logging.c */
 extern int    sl_log (int level, int verb, ...);
@@ -285,10 +362,14 @@ extern void   sl_loginit_r (SLCD * slconn, int verbosity,
 extern SLlog *sl_loginit_rl (SLlog * log, int verbosity,
 			     void (*log_print)(const char*), const char * logprefix,
 			     void (*diag_print)(const char*), const char * errprefix);
+extern int    sl_log_enabled (const SLlog * log, int verb);
+extern int    sl_logasync (int slots);
+extern void   sl_logsync (void);
 
 /* statefile.c */
 extern int   sl_recoverstate (SLCD *slconn, const char *statefile);
 extern int   sl_savestate (SLCD *slconn, const char *statefile);
+extern int   sl_savestate_binary (SLCD *slconn, const char *statefile);
 
 
 /* msrecord.c */
@@ -300,6 +381,7 @@ extern int   sl_savestate (SLCD *slconn, const char *statefile);
 #define MSD_BADSAMPCOUNT    -4        /* Sample count is bad, negative? */
 #define MSD_STBADLASTMATCH  -5        /* Steim, last sample does not match */
 #define MSD_STBADCOMPFLAG   -6        /* Steim, invalid compression flag(s) */
+#define MSD_BUFTOOSMALL     -7        /* Supplied sample buffer is too small */
 
 typedef struct SLMSrecord_s {
   const char            *msrecord;    /* Pointer to original record */
@@ -310,11 +392,44 @@ typedef struct SLMSrecord_s {
   int32_t               *datasamples; /* Unpacked 32-bit data samples */
   int32_t                numsamples;  /* Number of unpacked samples */
   int8_t                 unpackerr;   /* Unpacking/decompression error flag */
+  int32_t               *samplebuf;   /* Buffer for unpacked samples, reused */
+  int32_t                samplebufsize; /* Size of sample buffer in bytes */
+  int8_t                 userbuf;     /* Flag: sample buffer is supplied by caller */
+  struct sl_blkt_100_s   blkt100;     /* Storage for Blockette 100 */
+  struct sl_blkt_1000_s  blkt1000;    /* Storage for Blockette 1000 */
+  struct sl_blkt_1001_s  blkt1001;    /* Storage for Blockette 1001 */
 }
 SLMSrecord;
 
+/* Lazily decoded view of the fixed header of a Mini-SEED record, the
+ * numeric fields are decoded on first request by the sl_msh_* accessors */
+typedef struct SLMSheader_s {
+  const char            *msrecord;    /* Pointer to original record */
+  const struct sl_fsdh_s *fsdh;       /* Fixed header in the record, not swapped */
+  struct sl_btime_s      start_time;  /* Start time, if decoded */
+  uint16_t               num_samples; /* Number of samples, if decoded */
+  int16_t                samprate_fact; /* Sample rate factor, if decoded */
+  uint8_t                decoded;     /* Flags of decoded fields, SL_MSH_* */
+  int8_t                 swapflag;    /* Flag: header needs byte swapping */
+}
+SLMSheader;
+
+/* Decoded field flags for SLMSheader */
+#define SL_MSH_SWAP        0x01
+#define SL_MSH_STARTTIME   0x02
+#define SL_MSH_NUMSAMPLES  0x04
+#define SL_MSH_SAMPRATE    0x08
+
+extern int         sl_reclen (const char * msrecord, int length);
+extern void        sl_msh_init (SLMSheader * msh, const char * msrecord);
+extern const struct sl_btime_s * sl_msh_starttime (SLMSheader * msh);
+extern uint16_t    sl_msh_numsamples (SLMSheader * msh);
+extern int16_t     sl_msh_sampratefact (SLMSheader * msh);
+extern double      sl_msh_depochetime (SLMSheader * msh);
+
 extern SLMSrecord* sl_msr_new (void);
 extern void        sl_msr_free (SLMSrecord ** msr);
+extern int         sl_msr_setbuffer (SLMSrecord * msr, int32_t * buffer, int maxsamples);
 extern SLMSrecord* sl_msr_parse (SLlog * log, const char * msrecord, SLMSrecord ** msr,
 			         int8_t blktflag, int8_t unpackflag);
 extern SLMSrecord* sl_msr_parse_size (SLlog * log, const char * msrecord, SLMSrecord ** msr,
@@ -325,6 +440,16 @@ extern int         sl_msr_dsamprate (SLMSrecord * msr, double * samprate);
 extern double      sl_msr_dnomsamprate (SLMSrecord * msr);
 extern double      sl_msr_depochstime (SLMSrecord * msr);
 
+/* unpacksimd.c */
+
+/* Vectorized Steim decoder implementations */
+#define SL_SIMD_NONE   0              /* Scalar decoders */
+#define SL_SIMD_SSE41  1              /* x86 SSE4.1 */
+#define SL_SIMD_AVX2   2              /* x86 AVX2 */
+#define SL_SIMD_NEON   3              /* ARM NEON */
+
+extern int         sl_msr_simd (int flag);
+
 
 /* strutils.c */
 
@@ -5,7 +5,7 @@
  *
  * Written by Chad Trabant, ORFEUS/EC-Project MEREDIAN
  *
- * modified: 2005.332
+ * modified: 2026.287
  ***************************************************************************/
 
 #include <stdarg.h>
@@ -15,6 +15,11 @@
 
 #include "libslink.h"
 
+#ifndef SLP_WIN
+#include <pthread.h>
+#include <time.h>
+#endif
+
 void sl_loginit_main (SLlog *logp, int verbosity,
                       void (*log_print) (const char *), const char *logprefix,
                       void (*diag_print) (const char *), const char *errprefix);
@@ -24,6 +29,66 @@ int sl_log_main (SLlog *logp, int level, int verb, va_list *varlist);
 /* Initialize the global logging parameters */
 SLlog gSLlog = {NULL, NULL, NULL, NULL, 0};
 
+#ifndef SLP_WIN
+
+/* Repeated identical error messages are suppressed for this long (seconds) */
+#define SL_LOGREPEAT 10
+
+/* Logging parameters whose dropped messages are counted separately */
+#define SL_LOGDROPS 8
+
+/* A formatted message in the asynchronous logging ring */
+typedef struct sllogslot_s
+{
+  uint64_t sequence;            /* Position this slot is ready for */
+  void (*print)();              /* Printing function, NULL for the stream */
+  FILE   *stream;               /* Stream to print to without a function */
+  int     level;                /* Message level */
+  int     presize;              /* Length of the prefix in the message */
+  char    message[MAX_LOG_MSG_LENGTH];
+} SLlogslot;
+
+/* Messages dropped for logging parameters, identified by their error
+ * printing function and prefix, which are copied so that the report
+ * does not depend on the parameters still existing */
+typedef struct sllogdrop_s
+{
+  void (*print)();              /* Error printing function, NULL for stderr */
+  char    prefix[MAX_LOG_MSG_LENGTH];
+  int64_t count;                /* Messages dropped since the last report */
+} SLlogdrop;
+
+/* State of asynchronous logging, see sl_logasync() */
+static struct
+{
+  SLlogslot *slots;             /* Ring of message slots */
+  uint64_t   mask;              /* Number of slots minus 1, a power of 2 */
+  uint64_t   head;              /* Next position to reserve by writers */
+  uint64_t   tail;              /* Next position to print by the thread */
+  int        active;            /* Messages are queued when set */
+  int        writers;           /* Number of writers using the ring */
+  int        sleeping;          /* The thread waits for messages */
+  int        stop;              /* The thread should exit when drained */
+  int64_t    dropped;           /* Dropped messages without an entry in drops */
+  SLlogdrop  drops[SL_LOGDROPS]; /* Dropped messages per logging parameters */
+  int        numdrops;
+  pthread_t  thread;
+  pthread_mutex_t lock;
+  pthread_cond_t  wakeup;
+} slasync = {NULL, 0, 0, 0, 0, 0, 0, 0, 0};
+
+/* Protects the counts of dropped messages */
+static pthread_mutex_t sldroplock = PTHREAD_MUTEX_INITIALIZER;
+
+static int sl_logreserve (SLlogslot **slot, int wait);
+static void sl_logdropped (const SLlog *logp);
+static void sl_logdrops (void);
+static void sl_logpublish (SLlogslot *slot);
+static void *sl_logthread (void *arg);
+static void sl_logrepeated (SLlogslot *last, int repeats);
+
+#endif
+
 /***************************************************************************
  * sl_loginit:
  *
@@ -186,6 +251,9 @@ sl_log (int level, int verb, ...)
   int retval;
   va_list varlist;
 
+  if (verb > gSLlog.verbosity)
+    return 0;
+
   va_start (varlist, verb);
 
   retval = sl_log_main (&gSLlog, level, verb, &varlist);
@@ -218,6 +286,9 @@ sl_log_r (const SLCD *slconn, int level, int verb, ...)
   else
     logp = slconn->log;
 
+  if (verb > logp->verbosity)
+    return 0;
+
   va_start (varlist, verb);
 
   retval = sl_log_main (logp, level, verb, &varlist);
@@ -248,6 +319,9 @@ sl_log_rl (SLlog *log, int level, int verb, ...)
   else
     logp = log;
 
+  if (verb > logp->verbosity)
+    return 0;
+
   va_start (varlist, verb);
 
   retval = sl_log_main (logp, level, verb, &varlist);
@@ -257,6 +331,25 @@ sl_log_rl (SLlog *log, int level, int verb, ...)
   return retval;
 } /* End of sl_log_rl() */
 
+/***************************************************************************
+ * sl_log_enabled:
+ *
+ * Check if messages of the verbosity level verb would be emitted with
+ * the logging parameters in a supplied SLlog.  If the supplied pointer
+ * is NULL the global logging parameters are checked.  Use this to skip
+ * preparing the arguments of messages that are not emitted.
+ *
+ * Returns 1 if messages are emitted and 0 otherwise.
+ ***************************************************************************/
+int
+sl_log_enabled (const SLlog *log, int verb)
+{
+  if (!log)
+    log = &gSLlog;
+
+  return (verb <= log->verbosity);
+} /* End of sl_log_enabled() */
+
 /***************************************************************************
  * sl_log_main:
  *
@@ -291,98 +384,552 @@ sl_log_rl (SLlog *log, int level, int verb, ...)
  * All messages will be truncated to the MAX_LOG_MSG_LENGTH, this includes
  * any set prefix.
  *
+ * When asynchronous logging is active (see sl_logasync()) the message
+ * is formatted into the logging ring and printed by the logging thread.
+ *
  * Returns the number of characters formatted on success, and a
  * a negative value on error.
  ***************************************************************************/
 int
 sl_log_main (SLlog *logp, int level, int verb, va_list *varlist)
 {
-  static char message[MAX_LOG_MSG_LENGTH];
-  int retvalue = 0;
+  char buffer[MAX_LOG_MSG_LENGTH];
+  char *message = buffer;
+  const char *format;
+  const char *prefix;
+  void (*print)();
+  FILE *stream;
+  int presize;
+  int retvalue;
+#ifndef SLP_WIN
+  SLlogslot *slot = NULL;
+#endif
+
+  if (verb > logp->verbosity || level < 0)
+    return 0;
+
+  format = va_arg (*varlist, const char *);
+
+  if (level >= 2) /* Error message */
+  {
+    prefix = (logp->errprefix != NULL) ? logp->errprefix : "error: ";
+    print  = logp->diag_print;
+    stream = stderr;
+  }
+  else if (level == 1) /* Diagnostic message */
+  {
+    prefix = logp->logprefix;
+    print  = logp->diag_print;
+    stream = stderr;
+  }
+  else /* Normal log message */
+  {
+    prefix = logp->logprefix;
+    print  = logp->log_print;
+    stream = stdout;
+  }
+
+#ifndef SLP_WIN
+  /* Format directly into a slot of the ring when logging asynchronously,
+     diagnostic and error messages that do not fit in the ring are dropped */
+  if (sl_logreserve (&slot, (level == 0)) < 0)
+  {
+    sl_logdropped (logp);
+    return 0;
+  }
+
+  if (slot)
+    message = slot->message;
+#endif
 
   message[0] = '\0';
 
-  if (verb <= logp->verbosity)
+  if (prefix != NULL)
+    strncpy (message, prefix, MAX_LOG_MSG_LENGTH);
+
+  message[MAX_LOG_MSG_LENGTH - 1] = '\0';
+
+  presize  = strlen (message);
+  retvalue = vsnprintf (&message[presize],
+                        MAX_LOG_MSG_LENGTH - presize,
+                        format, *varlist);
+
+  message[MAX_LOG_MSG_LENGTH - 1] = '\0';
+
+#ifndef SLP_WIN
+  if (slot)
   {
-    int presize;
-    const char *format;
+    slot->print   = print;
+    slot->stream  = stream;
+    slot->level   = level;
+    slot->presize = presize;
 
-    format = va_arg (*varlist, const char *);
+    sl_logpublish (slot);
 
-    if (level >= 2) /* Error message */
-    {
-      if (logp->errprefix != NULL)
-      {
-        strncpy (message, logp->errprefix, MAX_LOG_MSG_LENGTH);
-      }
-      else
-      {
-        strncpy (message, "error: ", MAX_LOG_MSG_LENGTH);
-      }
+    return retvalue;
+  }
+#endif
 
-      presize  = strlen (message);
-      retvalue = vsnprintf (&message[presize],
-                            MAX_LOG_MSG_LENGTH - presize,
-                            format, *varlist);
+  if (print != NULL)
+  {
+    print ((const char *)message);
+  }
+  else
+  {
+    fprintf (stream, "%s", message);
+  }
 
-      message[MAX_LOG_MSG_LENGTH - 1] = '\0';
+  return retvalue;
+} /* End of sl_log_main() */
 
-      if (logp->diag_print != NULL)
-      {
-        logp->diag_print ((const char *)message);
-      }
-      else
+#ifndef SLP_WIN
+
+/***************************************************************************
+ * sl_logasync:
+ *
+ * Start asynchronous logging.  Messages are formatted by the caller
+ * into a ring of slots messages, SLLOGSLOTS if slots is 0 or less,
+ * and printed by a background thread so callers do not wait for the
+ * printing functions.  Diagnostic and error messages are dropped, and
+ * counted, when the ring is full, callers of normal messages (level 0)
+ * wait for a free slot.  The number of dropped messages is reported
+ * with the error printing function and prefix of the logging
+ * parameters they were logged with.  Identical error messages repeated within
+ * SL_LOGREPEAT seconds are suppressed and summarized by the number of
+ * repeats.
+ *
+ * The printing functions set with sl_loginit() and related functions
+ * are called from the logging thread.  Queued messages are printed
+ * by sl_logsync(), which is also called at program exit.
+ *
+ * Returns 0 on success and -1 on error.
+ ***************************************************************************/
+int
+sl_logasync (int slots)
+{
+  static int registered = 0;
+  uint64_t count;
+  uint64_t idx;
+
+  if (slasync.slots)
+    return 0;
+
+  if (slots <= 0)
+    slots = SLLOGSLOTS;
+
+  /* Round the number of slots up to a power of 2 */
+  for (count = 16; count < (uint64_t)slots && count < (1 << 20); count <<= 1)
+    ;
+
+  if ((slasync.slots = (SLlogslot *)malloc (count * sizeof (SLlogslot))) == NULL)
+  {
+    sl_log (2, 0, "sl_logasync(): error allocating memory\n");
+    return -1;
+  }
+
+  for (idx = 0; idx < count; idx++)
+    slasync.slots[idx].sequence = idx;
+
+  slasync.mask    = count - 1;
+  slasync.head    = 0;
+  slasync.tail    = 0;
+  slasync.stop    = 0;
+
+  pthread_mutex_lock (&sldroplock);
+  slasync.dropped  = 0;
+  slasync.numdrops = 0;
+  pthread_mutex_unlock (&sldroplock);
+
+  pthread_mutex_init (&slasync.lock, NULL);
+  pthread_cond_init (&slasync.wakeup, NULL);
+
+  if (pthread_create (&slasync.thread, NULL, sl_logthread, NULL))
+  {
+    sl_log (2, 0, "sl_logasync(): cannot start logging thread\n");
+    pthread_mutex_destroy (&slasync.lock);
+    pthread_cond_destroy (&slasync.wakeup);
+    free (slasync.slots);
+    slasync.slots = NULL;
+    return -1;
+  }
+
+  if (!registered)
+  {
+    atexit (sl_logsync);
+    registered = 1;
+  }
+
+  __atomic_store_n (&slasync.active, 1, __ATOMIC_SEQ_CST);
+
+  return 0;
+} /* End of sl_logasync() */
+
+/***************************************************************************
+ * sl_logsync:
+ *
+ * Stop asynchronous logging, print all queued messages and return to
+ * printing messages when they are logged.
+ ***************************************************************************/
+void
+sl_logsync (void)
+{
+  if (!slasync.slots)
+    return;
+
+  __atomic_store_n (&slasync.active, 0, __ATOMIC_SEQ_CST);
+
+  /* Wait for writers that reserved a slot before the ring was closed */
+  while (__atomic_load_n (&slasync.writers, __ATOMIC_SEQ_CST))
+    slp_usleep (100);
+
+  pthread_mutex_lock (&slasync.lock);
+  slasync.stop = 1;
+  pthread_cond_signal (&slasync.wakeup);
+  pthread_mutex_unlock (&slasync.lock);
+
+  pthread_join (slasync.thread, NULL);
+
+  pthread_mutex_destroy (&slasync.lock);
+  pthread_cond_destroy (&slasync.wakeup);
+
+  free (slasync.slots);
+  slasync.slots = NULL;
+} /* End of sl_logsync() */
+
+/***************************************************************************
+ * sl_logreserve:
+ *
+ * Reserve the next slot of the ring for a message, this is the
+ * lock-free bounded queue of Dmitry Vyukov: a slot is free for the
+ * writer reserving the position its sequence holds and ready for the
+ * logging thread when its sequence is one more.  If the ring is full
+ * and wait is set this waits for a free slot.
+ *
+ * Returns:
+ * -1 : the ring is full and wait is not set
+ *  0 : logging is not asynchronous, slot is set to NULL
+ *  1 : a slot was reserved and returned in slot
+ ***************************************************************************/
+static int
+sl_logreserve (SLlogslot **slot, int wait)
+{
+  SLlogslot *next;
+  uint64_t position;
+  uint64_t sequence;
+
+  *slot = NULL;
+
+  if (!__atomic_load_n (&slasync.active, __ATOMIC_RELAXED))
+    return 0;
+
+  __atomic_add_fetch (&slasync.writers, 1, __ATOMIC_SEQ_CST);
+
+  if (!__atomic_load_n (&slasync.active, __ATOMIC_SEQ_CST))
+  {
+    __atomic_sub_fetch (&slasync.writers, 1, __ATOMIC_SEQ_CST);
+    return 0;
+  }
+
+  position = __atomic_load_n (&slasync.head, __ATOMIC_RELAXED);
+
+  for (;;)
+  {
+    next     = &slasync.slots[position & slasync.mask];
+    sequence = __atomic_load_n (&next->sequence, __ATOMIC_ACQUIRE);
+
+    if (sequence == position)
+    {
+      if (__atomic_compare_exchange_n (&slasync.head, &position, position + 1,
+                                       1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
       {
-        fprintf (stderr, "%s", message);
+        *slot = next;
+        return 1;
       }
     }
-    else if (level == 1) /* Diagnostic message */
+    else if ((int64_t)(sequence - position) < 0 && wait)
     {
-      if (logp->logprefix != NULL)
-      {
-        strncpy (message, logp->logprefix, MAX_LOG_MSG_LENGTH);
-      }
+      slp_usleep (100);
+      position = __atomic_load_n (&slasync.head, __ATOMIC_RELAXED);
+    }
+    else if ((int64_t)(sequence - position) < 0)
+    {
+      __atomic_sub_fetch (&slasync.writers, 1, __ATOMIC_SEQ_CST);
+      return -1;
+    }
+    else
+    {
+      position = __atomic_load_n (&slasync.head, __ATOMIC_RELAXED);
+    }
+  }
+} /* End of sl_logreserve() */
 
-      presize  = strlen (message);
-      retvalue = vsnprintf (&message[presize],
-                            MAX_LOG_MSG_LENGTH - presize,
-                            format, *varlist);
+/***************************************************************************
+ * sl_logdropped:
+ *
+ * Count a message dropped for the logging parameters 'logp'.  The
+ * count is kept with the error printing function and prefix of the
+ * parameters, after SL_LOGDROPS different ones it is kept with the
+ * global parameters.
+ ***************************************************************************/
+static void
+sl_logdropped (const SLlog *logp)
+{
+  const char *prefix = (logp->errprefix != NULL) ? logp->errprefix : "error: ";
+  SLlogdrop *drop;
+  int idx;
+
+  pthread_mutex_lock (&sldroplock);
+
+  for (idx = 0; idx < slasync.numdrops; idx++)
+  {
+    drop = &slasync.drops[idx];
 
-      message[MAX_LOG_MSG_LENGTH - 1] = '\0';
+    if (drop->print == logp->diag_print && !strcmp (drop->prefix, prefix))
+      break;
+  }
+
+  if (idx < slasync.numdrops)
+  {
+    slasync.drops[idx].count++;
+  }
+  else if (idx < SL_LOGDROPS)
+  {
+    drop        = &slasync.drops[idx];
+    drop->print = logp->diag_print;
+    drop->count = 1;
+    strncpy (drop->prefix, prefix, sizeof (drop->prefix) - 1);
+    drop->prefix[sizeof (drop->prefix) - 1] = '\0';
+    slasync.numdrops++;
+  }
+  else
+  {
+    slasync.dropped++;
+  }
 
-      if (logp->diag_print != NULL)
+  pthread_mutex_unlock (&sldroplock);
+} /* End of sl_logdropped() */
+
+/***************************************************************************
+ * sl_logdrops:
+ *
+ * Report the messages dropped since the last report, with the error
+ * printing function and prefix they were logged with.  Called by the
+ * logging thread.
+ ***************************************************************************/
+static void
+sl_logdrops (void)
+{
+  char report[MAX_LOG_MSG_LENGTH];
+  int64_t counts[SL_LOGDROPS];
+  int64_t dropped;
+  int numdrops;
+  int idx;
+
+  pthread_mutex_lock (&sldroplock);
+
+  numdrops = slasync.numdrops;
+
+  for (idx = 0; idx < numdrops; idx++)
+  {
+    counts[idx]              = slasync.drops[idx].count;
+    slasync.drops[idx].count = 0;
+  }
+
+  dropped         = slasync.dropped;
+  slasync.dropped = 0;
+
+  pthread_mutex_unlock (&sldroplock);
+
+  /* Entries are only added, their function and prefix do not change */
+  for (idx = 0; idx < numdrops; idx++)
+  {
+    if (!counts[idx])
+      continue;
+
+    snprintf (report, sizeof (report), "%s%lld log messages dropped, logging too slow\n",
+              slasync.drops[idx].prefix, (long long)counts[idx]);
+
+    if (slasync.drops[idx].print != NULL)
+      slasync.drops[idx].print ((const char *)report);
+    else
+      fprintf (stderr, "%s", report);
+  }
+
+  if (dropped)
+  {
+    snprintf (report, sizeof (report), "%s%lld log messages dropped, logging too slow\n",
+              (gSLlog.errprefix) ? gSLlog.errprefix : "error: ", (long long)dropped);
+
+    if (gSLlog.diag_print != NULL)
+      gSLlog.diag_print ((const char *)report);
+    else
+      fprintf (stderr, "%s", report);
+  }
+} /* End of sl_logdrops() */
+
+/***************************************************************************
+ * sl_logpublish:
+ *
+ * Mark a reserved slot as ready and wake up the logging thread if it
+ * is waiting.
+ ***************************************************************************/
+static void
+sl_logpublish (SLlogslot *slot)
+{
+  __atomic_store_n (&slot->sequence, slot->sequence + 1, __ATOMIC_SEQ_CST);
+
+  if (__atomic_load_n (&slasync.sleeping, __ATOMIC_SEQ_CST))
+  {
+    pthread_mutex_lock (&slasync.lock);
+    pthread_cond_signal (&slasync.wakeup);
+    pthread_mutex_unlock (&slasync.lock);
+  }
+
+  __atomic_sub_fetch (&slasync.writers, 1, __ATOMIC_SEQ_CST);
+} /* End of sl_logpublish() */
+
+/***************************************************************************
+ * sl_logthread:
+ *
+ * Print the messages of the ring in order until stopped and the ring
+ * is empty.  An error message identical to the last error message
+ * printed less than SL_LOGREPEAT seconds before is only counted, the
+ * count is printed when a different error message is printed or the
+ * time has passed.
+ ***************************************************************************/
+static void *
+sl_logthread (void *arg)
+{
+  SLlogslot *slot;
+  SLlogslot last;
+  struct timespec deadline;
+  time_t lasttime = 0;
+  time_t now;
+  int repeats = 0;
+  int suppress;
+  int ready;
+
+  last.level = -1;
+
+  for (;;)
+  {
+    slot  = &slasync.slots[slasync.tail & slasync.mask];
+    ready = (__atomic_load_n (&slot->sequence, __ATOMIC_SEQ_CST) == slasync.tail + 1);
+
+    if (ready)
+    {
+      suppress = 0;
+
+      if (slot->level >= 2)
       {
-        logp->diag_print ((const char *)message);
+        now = time (NULL);
+
+        if (last.level >= 2 && now - lasttime < SL_LOGREPEAT &&
+            slot->print == last.print && slot->stream == last.stream &&
+            !strcmp (slot->message, last.message))
+        {
+          repeats++;
+          suppress = 1;
+        }
+        else
+        {
+          if (repeats)
+            sl_logrepeated (&last, repeats);
+
+          repeats  = 0;
+          last     = *slot;
+          lasttime = now;
+        }
       }
-      else
+
+      if (!suppress)
       {
-        fprintf (stderr, "%s", message);
+        if (slot->print != NULL)
+          slot->print ((const char *)slot->message);
+        else
+          fprintf (slot->stream, "%s", slot->message);
       }
+
+      /* Free the slot for the writer one round later */
+      __atomic_store_n (&slot->sequence, slasync.tail + slasync.mask + 1,
+                        __ATOMIC_RELEASE);
+      slasync.tail++;
+      continue;
     }
-    else if (level == 0) /* Normal log message */
+
+    if (repeats && time (NULL) - lasttime >= SL_LOGREPEAT)
     {
-      if (logp->logprefix != NULL)
-      {
-        strncpy (message, logp->logprefix, MAX_LOG_MSG_LENGTH);
-      }
+      sl_logrepeated (&last, repeats);
+      repeats = 0;
+    }
 
-      presize  = strlen (message);
-      retvalue = vsnprintf (&message[presize],
-                            MAX_LOG_MSG_LENGTH - presize,
-                            format, *varlist);
+    sl_logdrops ();
 
-      message[MAX_LOG_MSG_LENGTH - 1] = '\0';
+    /* Wait for messages, writers wake the thread when sleeping is set */
+    pthread_mutex_lock (&slasync.lock);
+    __atomic_store_n (&slasync.sleeping, 1, __ATOMIC_SEQ_CST);
 
-      if (logp->log_print != NULL)
-      {
-        logp->log_print ((const char *)message);
-      }
-      else
-      {
-        fprintf (stdout, "%s", message);
-      }
+    ready = (__atomic_load_n (&slot->sequence, __ATOMIC_SEQ_CST) == slasync.tail + 1);
+
+    if (!ready && slasync.stop)
+    {
+      pthread_mutex_unlock (&slasync.lock);
+      break;
+    }
+
+    if (!ready)
+    {
+      clock_gettime (CLOCK_REALTIME, &deadline);
+      deadline.tv_sec += 1;
+      pthread_cond_timedwait (&slasync.wakeup, &slasync.lock, &deadline);
     }
+
+    __atomic_store_n (&slasync.sleeping, 0, __ATOMIC_SEQ_CST);
+    pthread_mutex_unlock (&slasync.lock);
   }
 
-  return retvalue;
-} /* End of sl_log_main() */
+  if (repeats)
+    sl_logrepeated (&last, repeats);
+
+  return NULL;
+} /* End of sl_logthread() */
+
+/***************************************************************************
+ * sl_logrepeated:
+ *
+ * Print the number of times the last message was repeated, with the
+ * prefix of the message.
+ ***************************************************************************/
+static void
+sl_logrepeated (SLlogslot *last, int repeats)
+{
+  char report[MAX_LOG_MSG_LENGTH];
+
+  snprintf (report, sizeof (report), "%.*slast message repeated %d times\n",
+            last->presize, last->message, repeats);
+
+  if (last->print != NULL)
+    last->print ((const char *)report);
+  else
+    fprintf (last->stream, "%s", report);
+} /* End of sl_logrepeated() */
+
+#else /* SLP_WIN */
+
+/***************************************************************************
+ * Asynchronous logging is not supported on Windows, messages are
+ * printed when they are logged.
+ ***************************************************************************/
+int
+sl_logasync (int slots)
+{
+  sl_log (2, 0, "asynchronous logging is not supported on this platform\n");
+  return -1;
+}
+
+void
+sl_logsync (void)
+{
+}
+
+#endif /* SLP_WIN */
@@ -14,7 +14,13 @@
  *
  * Written by Chad Trabant, IRIS Data Managment Center
  *
- * modified: 2016.288
+ * Parsing does not allocate memory once a SLMSrecord has been used,
+ * blockettes are stored in the struct and the sample buffer is reused
+ * or may be supplied by the caller.  No global state is modified, a
+ * SLMSrecord may be used by one thread while others are used by other
+ * threads.
+ *
+ * modified: 2026.287
  ***************************************************************************/
 
 #include <stdio.h>
@@ -30,6 +36,243 @@
 /* Declare routines only used in this source file */
 void encoding_hash (char enc, char *encstr);
 double host_latency (SLMSrecord *msr);
+int sl_msh_swapflag (SLMSheader *msh);
+
+/***************************************************************************
+ * sl_msh_init:
+ *
+ * Initialize a lazily decoded header view of a Mini-SEED record.
+ * Nothing is decoded, the character fields (station, location,
+ * channel and network) of SLMSheader->fsdh can be used directly while
+ * the numeric fields must be retrieved with the sl_msh_* accessors,
+ * each decodes and byte swaps its field on first request.
+ *
+ * The record must remain valid while the header view is used.
+ ***************************************************************************/
+void
+sl_msh_init (SLMSheader *msh, const char *msrecord)
+{
+  msh->msrecord = msrecord;
+  msh->fsdh     = (const struct sl_fsdh_s *)msrecord;
+  msh->decoded  = 0;
+  msh->swapflag = 0;
+} /* End of sl_msh_init() */
+
+/***************************************************************************
+ * sl_msh_swapflag:
+ *
+ * Determine if the header of a record needs byte swapping by testing
+ * the year and day, the same test used by sl_msr_parse_size().
+ *
+ * Returns 1 if swapping is needed, otherwise 0.
+ ***************************************************************************/
+int
+sl_msh_swapflag (SLMSheader *msh)
+{
+  struct sl_btime_s btime;
+
+  if (!(msh->decoded & SL_MSH_SWAP))
+  {
+    memcpy (&btime, &msh->fsdh->start_time, sizeof (struct sl_btime_s));
+
+    msh->swapflag = (SL_ISVALIDYEARDAY (btime.year, btime.day)) ? 0 : 1;
+    msh->decoded |= SL_MSH_SWAP;
+  }
+
+  return msh->swapflag;
+} /* End of sl_msh_swapflag() */
+
+/***************************************************************************
+ * sl_reclen:
+ *
+ * Determine the length of a Mini-SEED record from its Blockette 1000.
+ * Only the first 'length' bytes of the record are examined, the
+ * blockette chain is followed within them.  Blockettes must follow
+ * each other in the record and the length must be between 128 and
+ * SLMAXRECSIZE bytes.
+ *
+ * Returns the record length in bytes, 0 if more than 'length' bytes
+ * are needed to find the Blockette 1000 or -1 if the record has no
+ * valid Blockette 1000 or is not a Mini-SEED record.
+ ***************************************************************************/
+int
+sl_reclen (const char *msrecord, int length)
+{
+  const struct sl_fsdh_s *fsdh = (const struct sl_fsdh_s *)msrecord;
+  struct sl_btime_s btime;
+  uint16_t offset;
+  uint16_t blkt_type;
+  uint16_t next_blkt;
+  uint8_t exponent;
+  int swapflag;
+
+  if (length < 48)
+    return 0;
+
+  if (fsdh->dhq_indicator != 'D' && fsdh->dhq_indicator != 'R' &&
+      fsdh->dhq_indicator != 'Q' && fsdh->dhq_indicator != 'M')
+    return -1;
+
+  memcpy (&btime, &fsdh->start_time, sizeof (struct sl_btime_s));
+  swapflag = (SL_ISVALIDYEARDAY (btime.year, btime.day)) ? 0 : 1;
+
+  memcpy (&offset, &fsdh->begin_blockette, sizeof (uint16_t));
+  if (swapflag)
+    sl_gswap2 (&offset);
+
+  while (offset != 0)
+  {
+    if (offset < 48 || offset > SLMAXRECSIZE - 8)
+      return -1;
+
+    if (offset + 8 > length)
+      return 0;
+
+    memcpy (&blkt_type, msrecord + offset, sizeof (uint16_t));
+    memcpy (&next_blkt, msrecord + offset + 2, sizeof (uint16_t));
+    if (swapflag)
+    {
+      sl_gswap2 (&blkt_type);
+      sl_gswap2 (&next_blkt);
+    }
+
+    if (blkt_type == 1000)
+    {
+      exponent = (uint8_t)msrecord[offset + 6];
+
+      if (exponent < 7 || exponent > 13 || (1 << exponent) > SLMAXRECSIZE ||
+          offset + 8 > (1 << exponent))
+        return -1;
+
+      return 1 << exponent;
+    }
+
+    if (next_blkt != 0 && next_blkt <= offset)
+      return -1;
+
+    offset = next_blkt;
+  }
+
+  return -1;
+} /* End of sl_reclen() */
+
+/***************************************************************************
+ * sl_msh_starttime:
+ *
+ * Returns a pointer to the start time of the record in host byte order.
+ ***************************************************************************/
+const struct sl_btime_s *
+sl_msh_starttime (SLMSheader *msh)
+{
+  if (!(msh->decoded & SL_MSH_STARTTIME))
+  {
+    memcpy (&msh->start_time, &msh->fsdh->start_time, sizeof (struct sl_btime_s));
+
+    if (sl_msh_swapflag (msh))
+    {
+      SL_SWAPBTIME (&msh->start_time);
+    }
+
+    msh->decoded |= SL_MSH_STARTTIME;
+  }
+
+  return &msh->start_time;
+} /* End of sl_msh_starttime() */
+
+/***************************************************************************
+ * sl_msh_numsamples:
+ *
+ * Returns the number of samples of the record in host byte order.
+ ***************************************************************************/
+uint16_t
+sl_msh_numsamples (SLMSheader *msh)
+{
+  if (!(msh->decoded & SL_MSH_NUMSAMPLES))
+  {
+    memcpy (&msh->num_samples, &msh->fsdh->num_samples, sizeof (uint16_t));
+
+    if (sl_msh_swapflag (msh))
+      sl_gswap2 (&msh->num_samples);
+
+    msh->decoded |= SL_MSH_NUMSAMPLES;
+  }
+
+  return msh->num_samples;
+} /* End of sl_msh_numsamples() */
+
+/***************************************************************************
+ * sl_msh_sampratefact:
+ *
+ * Returns the sample rate factor of the record in host byte order.
+ ***************************************************************************/
+int16_t
+sl_msh_sampratefact (SLMSheader *msh)
+{
+  if (!(msh->decoded & SL_MSH_SAMPRATE))
+  {
+    memcpy (&msh->samprate_fact, &msh->fsdh->samprate_fact, sizeof (int16_t));
+
+    if (sl_msh_swapflag (msh))
+      sl_gswap2 (&msh->samprate_fact);
+
+    msh->decoded |= SL_MSH_SAMPRATE;
+  }
+
+  return msh->samprate_fact;
+} /* End of sl_msh_sampratefact() */
+
+/***************************************************************************
+ * sl_msh_depochetime:
+ *
+ * Calculate the end of the time covered by the record, the start time
+ * plus the number of samples at the nominal sample rate, as a double
+ * precision (Unix/POSIX) epoch time.  The microsecond offset of a
+ * blockette 1001 is not included.
+ *
+ * Returns double precision epoch time, the start time if the record
+ * has no samples or no sample rate.
+ ***************************************************************************/
+double
+sl_msh_depochetime (SLMSheader *msh)
+{
+  const struct sl_btime_s *btime;
+  double dtime;
+  double srcalc = 0.0;
+  int16_t multiplier;
+  int factor;
+
+  btime = sl_msh_starttime (msh);
+
+  dtime = (double)(btime->year - 1970) * 31536000 +
+          ((btime->year - 1969) / 4) * 86400 +
+          (btime->day - 1) * 86400 +
+          btime->hour * 3600 +
+          btime->min * 60 +
+          btime->sec +
+          (double)btime->fract / 10000.0;
+
+  memcpy (&multiplier, &msh->fsdh->samprate_mult, sizeof (int16_t));
+
+  if (sl_msh_swapflag (msh))
+    sl_gswap2 (&multiplier);
+
+  factor = sl_msh_sampratefact (msh);
+
+  if (factor > 0)
+    srcalc = (double)factor;
+  else if (factor < 0)
+    srcalc = -1.0 / (double)factor;
+
+  if (multiplier > 0)
+    srcalc = srcalc * (double)multiplier;
+  else if (multiplier < 0)
+    srcalc = -1.0 * (srcalc / (double)multiplier);
+
+  if (srcalc > 0.0)
+    dtime += (double)sl_msh_numsamples (msh) / srcalc;
+
+  return dtime;
+} /* End of sl_msh_depochetime() */
 
 /***************************************************************************
  * sl_msr_new:
@@ -81,10 +324,13 @@ sl_msr_new (void)
   msr->Blkt1000 = NULL;
   msr->Blkt1001 = NULL;
 
-  msr->msrecord    = NULL;
-  msr->datasamples = NULL;
-  msr->numsamples  = -1;
-  msr->unpackerr   = MSD_NOERROR;
+  msr->msrecord      = NULL;
+  msr->datasamples   = NULL;
+  msr->numsamples    = -1;
+  msr->unpackerr     = MSD_NOERROR;
+  msr->samplebuf     = NULL;
+  msr->samplebufsize = 0;
+  msr->userbuf       = 0;
 
   return msr;
 } /* End of sl_msr_new() */
@@ -93,19 +339,16 @@ sl_msr_new (void)
  * sl_msr_free:
  *
  * Free all memory associated with a SLMSrecord struct, except the original
- * record indicated by the element 'msrecord'.
+ * record indicated by the element 'msrecord' and a sample buffer supplied
+ * with sl_msr_setbuffer().
  ***************************************************************************/
 void
 sl_msr_free (SLMSrecord **msr)
 {
   if (msr != NULL && *msr != NULL)
   {
-    free ((*msr)->Blkt100);
-    free ((*msr)->Blkt1000);
-    free ((*msr)->Blkt1001);
-
-    if ((*msr)->datasamples != NULL)
-      free ((*msr)->datasamples);
+    if (!(*msr)->userbuf)
+      free ((*msr)->samplebuf);
 
     free (*msr);
 
@@ -113,6 +356,47 @@ sl_msr_free (SLMSrecord **msr)
   }
 } /* End of sl_msr_free() */
 
+/***************************************************************************
+ * sl_msr_setbuffer:
+ *
+ * Set a caller supplied buffer of 'maxsamples' 32-bit integers for the
+ * samples unpacked by sl_msr_parse_size(), the buffer is not free'd by
+ * the library.  Records with more samples than fit in the buffer are
+ * not unpacked and SLMSrecord->unpackerr is set to MSD_BUFTOOSMALL.
+ *
+ * If 'buffer' is NULL the library allocates the sample buffer as
+ * needed, it is grown but not shrunk as records are parsed.
+ *
+ * Returns 0 on success and -1 on error.
+ ***************************************************************************/
+int
+sl_msr_setbuffer (SLMSrecord *msr, int32_t *buffer, int maxsamples)
+{
+  if (msr == NULL || (buffer != NULL && maxsamples <= 0))
+    return -1;
+
+  if (!msr->userbuf)
+    free (msr->samplebuf);
+
+  msr->datasamples = NULL;
+  msr->numsamples  = -1;
+
+  if (buffer != NULL)
+  {
+    msr->samplebuf     = buffer;
+    msr->samplebufsize = maxsamples * sizeof (int32_t);
+    msr->userbuf       = 1;
+  }
+  else
+  {
+    msr->samplebuf     = NULL;
+    msr->samplebufsize = 0;
+    msr->userbuf       = 0;
+  }
+
+  return 0;
+} /* End of sl_msr_setbuffer() */
+
 /***************************************************************************
  * sl_littleendianhost:
  *
@@ -138,7 +422,7 @@ SLMSrecord *
 sl_msr_parse (SLlog *log, const char *msrecord, SLMSrecord **ppmsr,
               int8_t blktflag, int8_t unpackflag)
 {
-  return sl_msr_parse_size (log, msrecord, ppmsr, blktflag, unpackflag, SLRECSIZE);
+  return sl_msr_parse_size (log, msrecord, ppmsr, blktflag, unpackflag, 0);
 }
 
 /***************************************************************************
@@ -161,7 +445,9 @@ sl_msr_parse (SLlog *log, const char *msrecord, SLMSrecord **ppmsr,
  * the data samples.
  *
  * All header values, blockette values and data samples will be overwritten
- * by subsequent calls to this function.
+ * by subsequent calls to this function.  The blockettes are stored in the
+ * SLMSrecord struct and the sample buffer is reused, see sl_msr_setbuffer(),
+ * so reusing a SLMSrecord does not allocate memory.
  *
  * If the msr struct is NULL it will be allocated.
  *
@@ -173,6 +459,12 @@ sl_msr_parse (SLlog *log, const char *msrecord, SLMSrecord **ppmsr,
  * packet size.  Possible values for slrecsize are 128, 256, 512.
  * There is no error checking, so the value of slrecsize must be
  * checked before passing it to sl_msr_parse_size().
+ *
+ * Any record length up to SLMAXRECSIZE may be given as 'slrecsize', e.g.
+ * as returned by sl_reclen() or sl_packetreclen().  Samples of a record
+ * whose Blockette 1000 indicates a length larger than 'slrecsize' are
+ * not unpacked.  With sl_msr_parse() the length is not known and the
+ * samples are unpacked according to the Blockette 1000.
  ***************************************************************************/
 SLMSrecord *
 sl_msr_parse_size (SLlog *log, const char *msrecord, SLMSrecord **ppmsr,
@@ -181,6 +473,7 @@ sl_msr_parse_size (SLlog *log, const char *msrecord, SLMSrecord **ppmsr,
   uint8_t headerswapflag = 0; /* is swapping needed? */
   uint8_t dataswapflag   = 0;
   SLMSrecord *msr        = NULL;
+  int blktlimit          = (slrecsize > 0) ? slrecsize : SLRECSIZE;
 
   if (ppmsr == NULL)
   {
@@ -200,28 +493,17 @@ sl_msr_parse_size (SLlog *log, const char *msrecord, SLMSrecord **ppmsr,
   }
   else
   {
-    if (msr->Blkt100 != NULL)
-    {
-      free (msr->Blkt100);
-      msr->Blkt100 = NULL;
-    }
-    if (msr->Blkt1000 != NULL)
-    {
-      free (msr->Blkt1000);
-      msr->Blkt1000 = NULL;
-    }
-
-    if (msr->Blkt1001 != NULL)
-    {
-      free (msr->Blkt1001);
-      msr->Blkt1001 = NULL;
-    }
+    msr->Blkt100     = NULL;
+    msr->Blkt1000    = NULL;
+    msr->Blkt1001    = NULL;
+    msr->datasamples = NULL;
+    msr->unpackerr   = MSD_NOERROR;
+  }
 
-    if (msr->datasamples != NULL)
-    {
-      free (msr->datasamples);
-      msr->datasamples = NULL;
-    }
+  if (msr == NULL)
+  {
+    *ppmsr = NULL;
+    return NULL;
   }
 
   msr->msrecord = msrecord;
@@ -260,15 +542,15 @@ sl_msr_parse_size (SLlog *log, const char *msrecord, SLMSrecord **ppmsr,
   /* Parse the blockettes if requested */
   if (blktflag)
   {
-    /* Define some structures */
-    struct sl_blkt_head_s *blkt_head;
+    /* Define some structures, blockettes are stored in the SLMSrecord */
+    struct sl_blkt_head_s blkt_head_s;
+    struct sl_blkt_head_s *blkt_head = &blkt_head_s;
     struct sl_blkt_100_s *blkt_100;
     struct sl_blkt_1000_s *blkt_1000;
     struct sl_blkt_1001_s *blkt_1001;
     uint16_t begin_blockette; /* byte offset for next blockette */
 
     /* Initialize the blockette structures */
-    blkt_head = (struct sl_blkt_head_s *)malloc (sizeof (struct sl_blkt_head_s));
     blkt_100  = NULL;
     blkt_1000 = NULL;
     blkt_1001 = NULL;
@@ -277,7 +559,7 @@ sl_msr_parse_size (SLlog *log, const char *msrecord, SLMSrecord **ppmsr,
     begin_blockette = msr->fsdh.begin_blockette;
 
     while ((begin_blockette != 0) &&
-           (begin_blockette <= slrecsize))
+           (begin_blockette <= blktlimit))
     {
 
       memcpy ((void *)blkt_head, msrecord + begin_blockette,
@@ -290,7 +572,7 @@ sl_msr_parse_size (SLlog *log, const char *msrecord, SLMSrecord **ppmsr,
 
       if (blkt_head->blkt_type == 100)
       { /* found a 100 blockette */
-        blkt_100 = (struct sl_blkt_100_s *)malloc (sizeof (struct sl_blkt_100_s));
+        blkt_100 = &msr->blkt100;
         memcpy ((void *)blkt_100, msrecord + begin_blockette,
                 sizeof (struct sl_blkt_100_s));
 
@@ -308,8 +590,7 @@ sl_msr_parse_size (SLlog *log, const char *msrecord, SLMSrecord **ppmsr,
       if (blkt_head->blkt_type == 1000)
 
       { /* found the 1000 blockette */
-        blkt_1000 =
-            (struct sl_blkt_1000_s *)malloc (sizeof (struct sl_blkt_1000_s));
+        blkt_1000 = &msr->blkt1000;
         memcpy ((void *)blkt_1000, msrecord + begin_blockette,
                 sizeof (struct sl_blkt_1000_s));
 
@@ -321,8 +602,7 @@ sl_msr_parse_size (SLlog *log, const char *msrecord, SLMSrecord **ppmsr,
 
       if (blkt_head->blkt_type == 1001)
       { /* found a 1001 blockette */
-        blkt_1001 =
-            (struct sl_blkt_1001_s *)malloc (sizeof (struct sl_blkt_1001_s));
+        blkt_1001 = &msr->blkt1001;
         memcpy ((void *)blkt_1001, msrecord + begin_blockette,
                 sizeof (struct sl_blkt_1001_s));
 
@@ -351,12 +631,17 @@ sl_msr_parse_size (SLlog *log, const char *msrecord, SLMSrecord **ppmsr,
       else if (!sl_littleendianhost () && blkt_1000->word_swap == 1)
         dataswapflag = 0;
     }
-
-    free (blkt_head);
   }
 
-  /* Unpack the data samples if requested */
-  if (unpackflag)
+  /* Unpack the data samples if requested and contained in the record */
+  if (unpackflag && slrecsize > 0 && msr->Blkt1000 &&
+      (msr->Blkt1000->rec_len > 30 || (1 << msr->Blkt1000->rec_len) > slrecsize))
+  {
+    sl_log_rl (log, 2, 0, "record length of Blockette 1000 (2^%d) exceeds %d bytes\n",
+               msr->Blkt1000->rec_len, slrecsize);
+    msr->numsamples = -1;
+  }
+  else if (unpackflag)
   {
     msr->numsamples = sl_msr_unpack (log, msr, dataswapflag);
   }
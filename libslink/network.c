@@ -25,6 +25,9 @@ int sl_sayhello (SLCD *slconn);
 int sl_batchmode (SLCD *slconn);
 int sl_negotiate_uni (SLCD *slconn);
 int sl_negotiate_multi (SLCD *slconn);
+int sl_negotiate_pipelined (SLCD *slconn);
+int sl_buildaction (SLCD *slconn, SLstream *curstream, const char *slring,
+                    char *sendstr);
 
 /***************************************************************************
  * sl_configlink:
@@ -40,12 +43,16 @@ int
 sl_configlink (SLCD *slconn)
 {
   int ret = -1;
+  double negstart = slp_dtime ();
 
   if (slconn->multistation)
   {
     if (sl_checkversion (slconn, 2.5) >= 0)
     {
-      ret = sl_negotiate_multi (slconn);
+      if (slconn->pipeline)
+        ret = sl_negotiate_pipelined (slconn);
+      else
+        ret = sl_negotiate_multi (slconn);
     }
     else
     {
@@ -58,6 +65,12 @@ sl_configlink (SLCD *slconn)
   else
     ret = sl_negotiate_uni (slconn);
 
+  slconn->stat->stats.negtime = slp_dtime () - negstart;
+  slconn->stat->stats.negtimetotal += slconn->stat->stats.negtime;
+
+  if (ret == -1)
+    slconn->stat->stats.negfailures++;
+
   return ret;
 } /* End of sl_configlink() */
 
@@ -216,7 +229,7 @@ sl_negotiate_uni (SLCD *slconn)
     /* Append the last packet time if the feature is enabled and server is >= 2.93 */
     if (slconn->lastpkttime &&
         sl_checkversion (slconn, (float)2.93) >= 0 &&
-        strlen (curstream->timestamp))
+        strlen (sl_streamtimestamp (curstream)))
     {
       /* Increment sequence number by 1 */
       sprintf (sendstr, "%s %06X %.25s\r", cmd,
@@ -418,7 +431,7 @@ sl_negotiate_multi (SLCD *slconn)
       /* Fail if none of the given selectors were accepted */
       if (!acceptsel)
       {
-        sl_log_r (slconn, 2, 0, "[%s] no data stream selector(s) accepted",
+        sl_log_r (slconn, 2, 0, "[%s] no data stream selector(s) accepted\n",
                   slring);
         return -1;
       }
@@ -432,80 +445,10 @@ sl_negotiate_multi (SLCD *slconn)
 
     } /* End of selector processing */
 
-    /* Issue the DATA, FETCH or TIME action commands.  A specified start (and
-	 optionally, stop time) takes precedence over the resumption from any
-	 previous sequence number. */
-    if (slconn->begin_time != NULL)
-    {
-      if (sl_checkversion (slconn, (float)2.92) >= 0)
-      {
-        if (slconn->end_time == NULL)
-        {
-          sprintf (sendstr, "TIME %.25s\r", slconn->begin_time);
-        }
-        else
-        {
-          sprintf (sendstr, "TIME %.25s %.25s\r", slconn->begin_time,
-                   slconn->end_time);
-        }
-        sl_log_r (slconn, 1, 1, "[%s] requesting specified time window\n",
-                  slring);
-      }
-      else
-      {
-        sl_log_r (slconn, 2, 0,
-                  "[%s] detected SeedLink version (%.3f) does not support TIME windows\n",
-                  slring, slconn->protocol_ver);
-      }
-    }
-    else if (curstream->seqnum != -1 && slconn->resume)
-    {
-      char cmd[10];
-
-      if (slconn->dialup)
-      {
-        sprintf (cmd, "FETCH");
-      }
-      else
-      {
-        sprintf (cmd, "DATA");
-      }
-
-      /* Append the last packet time if the feature is enabled and server is >= 2.93 */
-      if (slconn->lastpkttime &&
-          sl_checkversion (slconn, (float)2.93) >= 0 &&
-          strlen (curstream->timestamp))
-      {
-        /* Increment sequence number by 1 */
-        sprintf (sendstr, "%s %06X %.25s\r", cmd,
-                 (curstream->seqnum + 1) & 0xffffff, curstream->timestamp);
-
-        sl_log_r (slconn, 1, 1, "[%s] resuming data from %06X (Dec %d) at %.25s\n",
-                  slconn->sladdr, (curstream->seqnum + 1) & 0xffffff,
-                  (curstream->seqnum + 1), curstream->timestamp);
-      }
-      else
-      { /* Increment sequence number by 1 */
-        sprintf (sendstr, "%s %06X\r", cmd,
-                 (curstream->seqnum + 1) & 0xffffff);
-
-        sl_log_r (slconn, 1, 1, "[%s] resuming data from %06X (Dec %d)\n", slring,
-                  (curstream->seqnum + 1) & 0xffffff,
-                  (curstream->seqnum + 1));
-      }
-    }
-    else
+    /* Build the DATA, FETCH or TIME action command */
+    if (sl_buildaction (slconn, curstream, slring, sendstr) < 0)
     {
-      if (slconn->dialup)
-      {
-        sprintf (sendstr, "FETCH\r");
-      }
-      else
-      {
-        sprintf (sendstr, "DATA\r");
-      }
-
-      sl_log_r (slconn, 1, 1, "[%s] requesting next available data\n", slring);
+      return -1;
     }
 
     /* Send the TIME/DATA/FETCH command and receive response */
@@ -524,8 +467,6 @@ sl_negotiate_multi (SLCD *slconn)
     {
       if ((term2 = memchr (term1 + 1, '\r', bytesread - (readbuf - term1) - 1)))
       {
-        fprintf (stderr, "term2: '%s'\n", term2);
-
         *term2   = '\0';
         extreply = term1 + 1;
       }
@@ -579,6 +520,550 @@ sl_negotiate_multi (SLCD *slconn)
   return slconn->link;
 } /* End of sl_negotiate_multi() */
 
+/***************************************************************************
+ * sl_buildaction:
+ *
+ * Build the DATA, FETCH or TIME action command for a stream in
+ * multi-station mode into 'sendstr', which must be at least 100 bytes.
+ *
+ * Returns -1 on errors, otherwise 0.
+ ***************************************************************************/
+int
+sl_buildaction (SLCD *slconn, SLstream *curstream, const char *slring,
+                char *sendstr)
+{
+  /* A specified start (and optionally, stop time) takes precedence
+     over the resumption from any previous sequence number. */
+  if (slconn->begin_time != NULL)
+  {
+    if (sl_checkversion (slconn, (float)2.92) >= 0)
+    {
+      if (slconn->end_time == NULL)
+      {
+        sprintf (sendstr, "TIME %.25s\r", slconn->begin_time);
+      }
+      else
+      {
+        sprintf (sendstr, "TIME %.25s %.25s\r", slconn->begin_time,
+                 slconn->end_time);
+      }
+      sl_log_r (slconn, 1, 1, "[%s] requesting specified time window\n",
+                slring);
+    }
+    else
+    {
+      sl_log_r (slconn, 2, 0,
+                "[%s] detected SeedLink version (%.3f) does not support TIME windows\n",
+                slring, slconn->protocol_ver);
+      return -1;
+    }
+  }
+  else if (curstream->seqnum != -1 && slconn->resume)
+  {
+    char cmd[10];
+
+    if (slconn->dialup)
+    {
+      sprintf (cmd, "FETCH");
+    }
+    else
+    {
+      sprintf (cmd, "DATA");
+    }
+
+    /* Append the last packet time if the feature is enabled and server is >= 2.93 */
+    if (slconn->lastpkttime &&
+        sl_checkversion (slconn, (float)2.93) >= 0 &&
+        strlen (sl_streamtimestamp (curstream)))
+    {
+      /* Increment sequence number by 1 */
+      sprintf (sendstr, "%s %06X %.25s\r", cmd,
+               (curstream->seqnum + 1) & 0xffffff, curstream->timestamp);
+
+      sl_log_r (slconn, 1, 1, "[%s] resuming data from %06X (Dec %d) at %.25s\n",
+                slconn->sladdr, (curstream->seqnum + 1) & 0xffffff,
+                (curstream->seqnum + 1), curstream->timestamp);
+    }
+    else
+    { /* Increment sequence number by 1 */
+      sprintf (sendstr, "%s %06X\r", cmd,
+               (curstream->seqnum + 1) & 0xffffff);
+
+      sl_log_r (slconn, 1, 1, "[%s] resuming data from %06X (Dec %d)\n", slring,
+                (curstream->seqnum + 1) & 0xffffff,
+                (curstream->seqnum + 1));
+    }
+  }
+  else
+  {
+    if (slconn->dialup)
+    {
+      sprintf (sendstr, "FETCH\r");
+    }
+    else
+    {
+      sprintf (sendstr, "DATA\r");
+    }
+
+    sl_log_r (slconn, 1, 1, "[%s] requesting next available data\n", slring);
+  }
+
+  return 0;
+} /* End of sl_buildaction() */
+
+/* Command types for pipelined negotiation */
+#define SLPIPE_STATION 1
+#define SLPIPE_SELECT  2
+#define SLPIPE_ACTION  3
+
+/* A command sent during pipelined negotiation, its response is
+ * matched by position in the list of commands */
+typedef struct slpipecmd_s
+{
+  SLstream *stream;   /* Stream the command is for */
+  char     *selector; /* Selector for SELECT commands */
+  int       sellen;   /* Length of selector */
+  int       type;     /* Command type, SLPIPE_* */
+} SLpipecmd;
+
+/***************************************************************************
+ * sl_pipecommands:
+ *
+ * Send the pipelined negotiation commands in 'sendbuf' while reading
+ * the responses and matching them to the list of 'cmds'.  Sending and
+ * receiving are interleaved so that a server which does not read more
+ * commands until responses have been read cannot cause a deadlock.
+ *
+ * Returns -1 on errors, otherwise the number of accepted stations.
+ ***************************************************************************/
+int
+sl_pipecommands (SLCD *slconn, SLpipecmd *cmds, int numcmds,
+                 char *sendbuf, int sendlen)
+{
+  SLpipecmd *cmd;
+  char *line;
+  char *term;
+  char *extreply;
+  char *cmdname = NULL;
+  char *readbuf;     /* Buffered responses */
+  char fakeok[5];    /* Response assumed in batch mode */
+  char slring[12];   /* Keep track of the ring name */
+  SLstat *stat  = slconn->stat;
+  int respcnt   = 0;
+  int sent      = 0;
+  int readlen   = 0;
+  int linelen;
+  int acceptsta = 0; /* Count of accepted stations */
+  int acceptsel = 0; /* Count of accepted selectors */
+  int rejected  = 0; /* Current station was not accepted */
+  int status;
+  double progress;
+  fd_set readset;
+  fd_set writeset;
+  struct timeval to;
+
+  /* Send the commands while reading and checking the responses, which
+     are buffered in the connection data buffer */
+  progress = sl_dtime ();
+  strcpy (fakeok, "OK\r\n");
+
+  while (respcnt < numcmds)
+  {
+    /* Trap door for termination */
+    if (slconn->terminate)
+      return -1;
+
+    /* Send as much of the pending commands as possible */
+    if (sent < sendlen)
+    {
+      if ((status = send (slconn->link, sendbuf + sent, sendlen - sent, 0)) < 0)
+      {
+        if (slp_noblockcheck ())
+        {
+          sl_log_r (slconn, 2, 0, "[%s] error sending negotiation commands: %s\n",
+                    slconn->sladdr, slp_strerror ());
+          return -1;
+        }
+      }
+      else if (status > 0)
+      {
+        sent += status;
+        progress = sl_dtime ();
+      }
+    }
+
+    if (slconn->batchmode == 2)
+    {
+      /* Fake OK responses for all commands when everything is sent */
+      readbuf = fakeok;
+      readlen = (sent == sendlen) ? 4 : 0;
+    }
+    else
+    {
+      /* Receive available responses */
+      cmdname = (cmds[respcnt].type == SLPIPE_STATION) ? "STATION" :
+                (cmds[respcnt].type == SLPIPE_SELECT) ? "SELECT" : "DATA/FETCH/TIME";
+
+      if (stat->recptr < stat->bufsize)
+      {
+        if ((status = sl_recvdata (slconn, stat->databuf + stat->recptr,
+                                   stat->bufsize - stat->recptr, slconn->sladdr)) < 0)
+        {
+          sl_log_r (slconn, 2, 0, "[%s] bad response to %s command\n",
+                    slconn->sladdr, cmdname);
+          return -1;
+        }
+        else if (status > 0)
+        {
+          stat->recptr += status;
+          progress = sl_dtime ();
+        }
+      }
+
+      readbuf = stat->databuf + stat->sendptr;
+      readlen = stat->recptr - stat->sendptr;
+    }
+
+    /* Check each complete response */
+    line = readbuf;
+    while (respcnt < numcmds &&
+           (term = memchr (line, '\n', readlen - (line - readbuf))))
+    {
+      linelen = term - line + 1;
+
+      /* Responses are terminated with '\r\n' */
+      if (linelen < 2 || line[linelen - 2] != '\r')
+      {
+        sl_log_r (slconn, 2, 0, "[%s] invalid response during negotiation: %.*s\n",
+                  slconn->sladdr, linelen, line);
+        return -1;
+      }
+
+      /* Search for 2nd "\r" indicating extended reply message present */
+      extreply = 0;
+      if ((term = memchr (line, '\r', linelen)) && term < line + linelen - 2)
+      {
+        line[linelen - 2] = '\0';
+        extreply          = term + 1;
+      }
+
+      if (!strncmp (line, "OK\r", 3) && linelen >= 4)
+        status = 1;
+      else if (!strncmp (line, "ERROR\r", 6) && linelen >= 7)
+        status = 0;
+      else
+        status = -1;
+
+      cmd = &cmds[respcnt++];
+      snprintf (slring, sizeof (slring), "%s_%s",
+                cmd->stream->net, cmd->stream->sta);
+
+      if (cmd->type == SLPIPE_STATION)
+      {
+        rejected  = 0;
+        acceptsel = 0;
+
+        if (status == 1)
+        {
+          sl_log_r (slconn, 1, 2, "[%s] station is OK %s%s%s\n", slring,
+                    (extreply) ? "{" : "", (extreply) ? extreply : "", (extreply) ? "}" : "");
+          acceptsta++;
+        }
+        else if (status == 0)
+        {
+          sl_log_r (slconn, 2, 0, "[%s] station not accepted %s%s%s\n", slring,
+                    (extreply) ? "{" : "", (extreply) ? extreply : "", (extreply) ? "}" : "");
+          rejected = 1;
+
+          if (acceptsta)
+            sl_log_r (slconn, 1, 0, "[%s] its pipelined commands may have changed the "
+                                    "previous station\n", slring);
+        }
+        else
+        {
+          sl_log_r (slconn, 2, 0, "[%s] invalid response to STATION command: %.*s\n",
+                    slring, linelen, line);
+          return -1;
+        }
+      }
+      else if (rejected)
+      {
+        /* Ignore responses to the remaining commands of a rejected station,
+           they were sent before the rejection and a server keeping the
+           previous station selected has applied them to that station */
+        if (status < 0)
+        {
+          sl_log_r (slconn, 2, 0, "[%s] invalid response during negotiation: %.*s\n",
+                    slring, linelen, line);
+          return -1;
+        }
+      }
+      else if (cmd->type == SLPIPE_SELECT)
+      {
+        if (status == 1)
+        {
+          sl_log_r (slconn, 1, 2, "[%s] selector %.*s is OK %s%s%s\n", slring,
+                    cmd->sellen, cmd->selector, (extreply) ? "{" : "", (extreply) ? extreply : "", (extreply) ? "}" : "");
+          acceptsel++;
+        }
+        else if (status == 0)
+        {
+          sl_log_r (slconn, 2, 0, "[%s] selector %.*s not accepted %s%s%s\n", slring,
+                    cmd->sellen, cmd->selector, (extreply) ? "{" : "", (extreply) ? extreply : "", (extreply) ? "}" : "");
+        }
+        else
+        {
+          sl_log_r (slconn, 2, 0,
+                    "[%s] invalid response to SELECT command: %.*s\n",
+                    slring, linelen, line);
+          return -1;
+        }
+      }
+      else
+      {
+        /* Fail if none of the given selectors were accepted */
+        if (cmd->stream->selectors != 0)
+        {
+          if (!acceptsel)
+          {
+            sl_log_r (slconn, 2, 0, "[%s] no data stream selector(s) accepted\n",
+                      slring);
+            return -1;
+          }
+
+          sl_log_r (slconn, 1, 2, "[%s] %d selector(s) accepted\n", slring,
+                    acceptsel);
+        }
+
+        if (status == 1)
+        {
+          sl_log_r (slconn, 1, 2, "[%s] DATA/FETCH/TIME command is OK %s%s%s\n", slring,
+                    (extreply) ? "{" : "", (extreply) ? extreply : "", (extreply) ? "}" : "");
+        }
+        else if (status == 0)
+        {
+          sl_log_r (slconn, 2, 0, "[%s] DATA/FETCH/TIME command is not accepted %s%s%s\n", slring,
+                    (extreply) ? "{" : "", (extreply) ? extreply : "", (extreply) ? "}" : "");
+        }
+        else
+        {
+          sl_log_r (slconn, 2, 0, "[%s] invalid response to DATA/FETCH/TIME command: %.*s\n",
+                    slring, linelen, line);
+          return -1;
+        }
+      }
+
+      if (slconn->batchmode == 2)
+        continue;
+
+      line += linelen;
+    }
+
+    /* Consume the checked responses, moving any partial response to
+       the beginning of the buffer when it is full */
+    if (slconn->batchmode != 2)
+    {
+      stat->sendptr += line - readbuf;
+
+      if (stat->sendptr == stat->recptr)
+      {
+        stat->sendptr = stat->recptr = 0;
+      }
+      else if (stat->recptr == stat->bufsize)
+      {
+        /* A single response should never fill the buffer */
+        if (stat->sendptr == 0)
+        {
+          sl_log_r (slconn, 2, 0, "[%s] response too long during negotiation\n",
+                    slconn->sladdr);
+          return -1;
+        }
+
+        memmove (stat->databuf, stat->databuf + stat->sendptr,
+                 stat->recptr - stat->sendptr);
+        stat->recptr -= stat->sendptr;
+        stat->sendptr = 0;
+      }
+    }
+
+    if (respcnt >= numcmds)
+      break;
+
+    /* Trap door if 30 seconds has elapsed without progress */
+    if ((sl_dtime () - progress) > 30.0)
+    {
+      sl_log_r (slconn, 2, 0, "[%s] timeout waiting for response to %s command\n",
+                slconn->sladdr, (cmdname) ? cmdname : "STATION");
+      return -1;
+    }
+
+    /* Wait for the socket to be ready for reading or writing */
+    FD_ZERO (&readset);
+    FD_ZERO (&writeset);
+    FD_SET (slconn->link, &readset);
+    if (sent < sendlen)
+      FD_SET (slconn->link, &writeset);
+
+    to.tv_sec  = 0;
+    to.tv_usec = 50000;
+
+    select (slconn->link + 1, &readset, &writeset, NULL, &to);
+  }
+
+  return acceptsta;
+} /* End of sl_pipecommands() */
+
+/***************************************************************************
+ * sl_negotiate_pipelined:
+ *
+ * Negotiate a SeedLink connection using multi-station mode with the
+ * STATION, SELECT and DATA/FETCH/TIME commands of all stations sent
+ * without waiting for each response.  The responses, which the server
+ * returns in order, are then matched to the commands and checked as
+ * in sl_negotiate_multi() before the END action command is issued.
+ *
+ * Responses to the SELECT and action commands of a station that was
+ * not accepted are read and ignored.
+ *
+ * In batch mode no responses are returned by the server and all
+ * commands are assumed to be accepted.
+ *
+ * Returns -1 on errors, otherwise returns the link descriptor.
+ ***************************************************************************/
+int
+sl_negotiate_pipelined (SLCD *slconn)
+{
+  SLstream *curstream;
+  SLpipecmd *cmds = NULL;
+  char *sendbuf   = NULL;
+  char *selptr;
+  char sendstr[100]; /* A buffer for command strings */
+  char slring[12];   /* Keep track of the ring name */
+  int numcmds     = 0;
+  int sendlen     = 0;
+  int sellen;
+  int acceptsta;     /* Count of accepted stations */
+
+  /* Count the commands, each station has STATION, SELECT(s) and an action */
+  for (curstream = slconn->streams; curstream; curstream = curstream->next)
+  {
+    numcmds += 2;
+
+    if ((selptr = curstream->selectors))
+    {
+      while (*(selptr += strspn (selptr, " ")))
+      {
+        numcmds++;
+        selptr += strcspn (selptr, " ");
+      }
+    }
+  }
+
+  if (!(cmds = (SLpipecmd *)malloc (sizeof (SLpipecmd) * numcmds)) ||
+      !(sendbuf = (char *)malloc (sizeof (sendstr) * numcmds)))
+  {
+    sl_log_r (slconn, 2, 0, "[%s] error allocating memory for negotiation\n",
+              slconn->sladdr);
+    free (cmds);
+    return -1;
+  }
+
+  /* Build all commands into the send buffer */
+  numcmds = 0;
+  for (curstream = slconn->streams; curstream; curstream = curstream->next)
+  {
+    snprintf (slring, sizeof (slring), "%s_%s",
+              curstream->net, curstream->sta);
+
+    sl_log_r (slconn, 1, 2, "[%s] sending: STATION %s %s\n",
+              slring, curstream->sta, curstream->net);
+    sendlen += sprintf (sendbuf + sendlen, "STATION %s %s\r",
+                        curstream->sta, curstream->net);
+
+    cmds[numcmds].stream   = curstream;
+    cmds[numcmds].selector = NULL;
+    cmds[numcmds].sellen   = 0;
+    cmds[numcmds].type     = SLPIPE_STATION;
+    numcmds++;
+
+    if ((selptr = curstream->selectors))
+    {
+      while (*(selptr += strspn (selptr, " ")))
+      {
+        sellen = strcspn (selptr, " ");
+
+        if (sellen > SELSIZE)
+        {
+          sl_log_r (slconn, 2, 0, "[%s] invalid selector: %.*s\n",
+                    slring, sellen, selptr);
+        }
+        else
+        {
+          sl_log_r (slconn, 1, 2, "[%s] sending: SELECT %.*s\n", slring, sellen,
+                    selptr);
+          sendlen += sprintf (sendbuf + sendlen, "SELECT %.*s\r", sellen, selptr);
+
+          cmds[numcmds].stream   = curstream;
+          cmds[numcmds].selector = selptr;
+          cmds[numcmds].sellen   = sellen;
+          cmds[numcmds].type     = SLPIPE_SELECT;
+          numcmds++;
+        }
+
+        selptr += sellen;
+      }
+    }
+
+    if (sl_buildaction (slconn, curstream, slring, sendstr) < 0)
+    {
+      free (cmds);
+      free (sendbuf);
+      return -1;
+    }
+
+    sendlen += sprintf (sendbuf + sendlen, "%s", sendstr);
+
+    cmds[numcmds].stream   = curstream;
+    cmds[numcmds].selector = NULL;
+    cmds[numcmds].sellen   = 0;
+    cmds[numcmds].type     = SLPIPE_ACTION;
+    numcmds++;
+  }
+
+  /* Send the commands and check the responses */
+  acceptsta = sl_pipecommands (slconn, cmds, numcmds, sendbuf, sendlen);
+
+  free (cmds);
+  free (sendbuf);
+
+  if (acceptsta < 0)
+    return -1;
+
+  /* Fail if no stations were accepted */
+  if (!acceptsta)
+  {
+    sl_log_r (slconn, 2, 0, "[%s] no station(s) accepted\n", slconn->sladdr);
+    return -1;
+  }
+  else
+  {
+    sl_log_r (slconn, 1, 1, "[%s] %d station(s) accepted\n",
+              slconn->sladdr, acceptsta);
+  }
+
+  /* Issue END action command */
+  sprintf (sendstr, "END\r");
+  sl_log_r (slconn, 1, 2, "[%s] sending: END\n", slconn->sladdr);
+  if (sl_senddata (slconn, (void *)sendstr, strlen (sendstr),
+                   slconn->sladdr, (void *)NULL, 0) < 0)
+  {
+    sl_log_r (slconn, 2, 0, "[%s] error sending END command\n", slconn->sladdr);
+    return -1;
+  }
+
+  return slconn->link;
+} /* End of sl_negotiate_pipelined() */
+
 /***************************************************************************
  * sl_send_info:
  *
@@ -653,6 +1138,8 @@ sl_connect (SLCD *slconn, int sayhello)
   size_t addrlen;
   struct sockaddr addr;
 
+  slconn->stat->stats.connattempts++;
+
   if (slp_sockstartup ())
   {
     sl_log_r (slconn, 2, 0, "could not initialize network sockets\n");
@@ -751,6 +1238,10 @@ sl_connect (SLCD *slconn, int sayhello)
 
     slconn->link = sock;
 
+    /* Discard any buffered data from a previous connection */
+    slconn->stat->recptr  = 0;
+    slconn->stat->sendptr = 0;
+
     if (slconn->batchmode)
       slconn->batchmode = 1;
 
@@ -774,6 +1265,9 @@ sl_connect (SLCD *slconn, int sayhello)
       }
     }
 
+    slconn->stat->stats.connects++;
+    slconn->stat->stats.connecttime = slp_dtime ();
+
     return sock;
   }
 
@@ -1251,20 +1745,26 @@ sl_recvdata (SLCD *slconn, void *buffer, size_t maxbytes,
     return 0;
   }
 
+  slconn->stat->stats.bytes += bytesread;
+
   return bytesread;
 } /* End of sl_recvdata() */
 
 /***************************************************************************
  * sl_recvresp:
  *
- * To receive a response to a command recv() one byte at a time until
- * '\r\n' or up to 'maxbytes' is read from 'slconn->link' into a
+ * To receive a response to a command read a line terminated by
+ * '\r\n' from 'slconn->link' and copy up to 'maxbytes' of it into a
  * specified 'buffer'.  The function will wait up to 30 seconds for a
  * response to be recv'd.  'command' is a string to be included in
  * error messages indicating which command the response is
  * for. 'ident' is a string to be included in error messages for
  * identification, usually the address of the remote server.
  *
+ * Data are recv'd in blocks into the connection data buffer
+ * (SLstat.databuf), any bytes following the response are left in the
+ * buffer for the next response or for sl_collect_nb_size().
+ *
  * It should not be assumed that the populated buffer contains a
  * terminated string.
  *
@@ -1274,11 +1774,14 @@ int
 sl_recvresp (SLCD *slconn, void *buffer, size_t maxbytes,
              const char *command, const char *ident)
 {
-
-  int bytesread = 0;     /* total bytes read */
-  int recvret   = 0;     /* return from sl_recvdata */
-  int ackcnt    = 0;     /* counter for the read loop */
-  int ackpoll   = 50000; /* poll at 0.05 seconds for reading */
+  SLstat *stat = slconn->stat;
+  char *line;
+  char *term;
+  int linelen;
+  int recvret = 0; /* return from sl_recvdata */
+  double deadline;
+  fd_set readset;
+  struct timeval to;
 
   if (buffer == NULL)
   {
@@ -1288,10 +1791,54 @@ sl_recvresp (SLCD *slconn, void *buffer, size_t maxbytes,
   /* Clear the receiving buffer */
   memset (buffer, 0, maxbytes);
 
-  /* Recv a byte at a time and wait up to 30 seconds for a response */
-  while (bytesread < maxbytes)
+  deadline = sl_dtime () + 30.0;
+
+  /* Read blocks into the data buffer and wait up to 30 seconds for a response */
+  while (1)
   {
-    recvret = sl_recvdata (slconn, (char *)buffer + bytesread, 1, ident);
+    /* Search the buffered data for a '\r\n' terminated line */
+    line = stat->databuf + stat->sendptr;
+    term = line;
+    while ((term = memchr (term, '\n', stat->databuf + stat->recptr - term)))
+    {
+      if (term > line && *(term - 1) == '\r')
+        break;
+
+      term++;
+    }
+
+    /* Trap door if '\r\n' is recv'd, return the line and consume it */
+    if (term)
+    {
+      linelen = term - line + 1;
+      memcpy (buffer, line, (linelen < maxbytes) ? linelen : maxbytes);
+
+      stat->sendptr += linelen;
+      if (stat->sendptr == stat->recptr)
+        stat->sendptr = stat->recptr = 0;
+
+      return (linelen < maxbytes) ? linelen : maxbytes;
+    }
+
+    /* Move a partial response to the beginning of the buffer if full */
+    if (stat->recptr == stat->bufsize)
+    {
+      if (stat->sendptr == 0)
+      {
+        sl_log_r (slconn, 2, 0, "[%s] response too long for '%.*s'\n",
+                  ident, strcspn ((char *)command, "\r\n"),
+                  (char *)command);
+        return -1;
+      }
+
+      memmove (stat->databuf, stat->databuf + stat->sendptr,
+               stat->recptr - stat->sendptr);
+      stat->recptr -= stat->sendptr;
+      stat->sendptr = 0;
+    }
+
+    recvret = sl_recvdata (slconn, stat->databuf + stat->recptr,
+                           stat->bufsize - stat->recptr, ident);
 
     /* Trap door for termination */
     if (slconn->terminate)
@@ -1301,7 +1848,8 @@ sl_recvresp (SLCD *slconn, void *buffer, size_t maxbytes,
 
     if (recvret > 0)
     {
-      bytesread += recvret;
+      stat->recptr += recvret;
+      continue;
     }
     else if (recvret < 0)
     {
@@ -1311,16 +1859,8 @@ sl_recvresp (SLCD *slconn, void *buffer, size_t maxbytes,
       return -1;
     }
 
-    /* Trap door if '\r\n' is recv'd */
-    if (bytesread >= 2 &&
-        *(char *)((char *)buffer + bytesread - 2) == '\r' &&
-        *(char *)((char *)buffer + bytesread - 1) == '\n')
-    {
-      return bytesread;
-    }
-
-    /* Trap door if 30 seconds has elapsed, (ackpoll x 600) */
-    if (ackcnt > 600)
+    /* Trap door if 30 seconds has elapsed */
+    if (sl_dtime () > deadline)
     {
       sl_log_r (slconn, 2, 0, "[%s] timeout waiting for response to '%.*s'\n",
                 ident, strcspn ((char *)command, "\r\n"),
@@ -1328,13 +1868,12 @@ sl_recvresp (SLCD *slconn, void *buffer, size_t maxbytes,
       return -1;
     }
 
-    /* Delay if no data received */
-    if (recvret == 0)
-    {
-      slp_usleep (ackpoll);
-      ackcnt++;
-    }
-  }
+    /* Wait up to 0.05 seconds for data if none received */
+    FD_ZERO (&readset);
+    FD_SET (slconn->link, &readset);
+    to.tv_sec  = 0;
+    to.tv_usec = 50000;
 
-  return bytesread;
+    select (slconn->link + 1, &readset, NULL, NULL, &to);
+  }
 } /* End of sl_recvresp() */
@@ -240,6 +240,78 @@ slp_openfile (const char *filename, char perm)
   return open (filename, flags, mode);
 } /* End of slp_openfile() */
 
+/***************************************************************************
+ * slp_syncfile:
+ *
+ * Flush the data of an open file to the storage device.
+ *
+ * Returns 0 on success and -1 on error.
+ ***************************************************************************/
+int
+slp_syncfile (int fd)
+{
+#if defined(SLP_WIN)
+  return _commit (fd);
+#else
+  return fsync (fd);
+#endif
+} /* End of slp_syncfile() */
+
+/***************************************************************************
+ * slp_replacefile:
+ *
+ * Rename the source file to the target file, atomically replacing the
+ * target if it exists, and flush the rename to the storage device.  On
+ * POSIX systems the directory of the target is synced, file systems
+ * that do not support syncing a directory are accepted.
+ *
+ * Returns 0 on success and -1 on error.
+ ***************************************************************************/
+int
+slp_replacefile (const char *source, const char *target)
+{
+#if defined(SLP_WIN)
+  if (!MoveFileExA (source, target, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH))
+    return -1;
+
+  return 0;
+#else
+  char *directory;
+  char *slash;
+  int dirfd;
+  int rv = 0;
+
+  if (rename (source, target))
+    return -1;
+
+  if ((directory = strdup (target)) == NULL)
+    return -1;
+
+  if ((slash = strrchr (directory, '/')) == NULL)
+    strcpy (directory, ".");
+  else if (slash == directory)
+    slash[1] = '\0';
+  else
+    *slash = '\0';
+
+  if ((dirfd = open (directory, O_RDONLY)) < 0)
+  {
+    rv = -1;
+  }
+  else
+  {
+    if (fsync (dirfd) && errno != EINVAL)
+      rv = -1;
+
+    close (dirfd);
+  }
+
+  free (directory);
+
+  return rv;
+#endif
+} /* End of slp_replacefile() */
+
 /***************************************************************************
  * slp_strerror:
  *
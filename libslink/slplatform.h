@@ -145,6 +145,8 @@ extern int slp_noblockcheck (void);
 extern int slp_getaddrinfo (char * nodename, char * nodeport,
 			    struct sockaddr * addr, size_t * addrlen);
 extern int slp_openfile (const char *filename, char perm);
+extern int slp_syncfile (int fd);
+extern int slp_replacefile (const char *source, const char *target);
 extern const char *slp_strerror(void);
 extern double slp_dtime(void);
 extern void slp_usleep(unsigned long int useconds);
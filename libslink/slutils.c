@@ -17,8 +17,20 @@
 
 #include "globmatch.h"
 
+/* Size of the area following the receive ring buffer used to make
+ * packets that wrap around the end of the ring contiguous */
+#define SLSPILLSIZE (SLHEADSIZE + SLMAXRECSIZE)
+
 /* Function(s) only used in this source file */
 int update_stream (SLCD *slconn, SLpacket *slpack);
+uint32_t sl_streamhash (const char *net, const char *sta);
+int sl_buildstreamidx (SLCD *slconn);
+int sl_indexstream (SLstreamidx *idx, SLstream *stream);
+void sl_freestreamidx (SLCD *slconn);
+SLstream *sl_findstream (SLCD *slconn, const char *net, const char *sta);
+int sl_nextpacket (SLCD *slconn, SLpacket **slpack, int slrecsize);
+char *sl_ringdata (SLstat *stat, int length);
+char *sl_ringspace (SLstat *stat, int *space);
 
 /***************************************************************************
  * sl_collect:
@@ -38,8 +50,9 @@ int
 sl_collect (SLCD *slconn, SLpacket **slpack)
 {
   int bytesread;
+  int space;
   double current_time;
-  char retpacket;
+  char *recvptr;
 
   /* For select()ing during the read loop */
   struct timeval select_tv;
@@ -82,6 +95,7 @@ sl_collect (SLCD *slconn, SLpacket **slpack)
       {
         sl_log_r (slconn, 1, 0, "network timeout (%ds), reconnecting in %ds\n",
                   slconn->netto, slconn->netdly);
+        slconn->stat->stats.timeouts++;
         slconn->link              = sl_disconnect (slconn);
         slconn->stat->sl_state    = SL_DOWN;
         slconn->stat->netto_trig  = -1;
@@ -167,8 +181,7 @@ sl_collect (SLCD *slconn, SLpacket **slpack)
 
         if (slconfret != -1)
         {
-          slconn->stat->recptr   = 0; /* initialize the data buffer pointers */
-          slconn->stat->sendptr  = 0;
+          /* Data received after the negotiation responses remain buffered */
           slconn->stat->sl_state = SL_DATA;
         }
         else
@@ -195,68 +208,10 @@ sl_collect (SLCD *slconn, SLpacket **slpack)
 		(slconn->stat->recptr - slconn->stat->sendptr) );
       */
 
-    /* Process data in buffer */
-    while (slconn->stat->recptr - slconn->stat->sendptr >= SLHEADSIZE + SLRECSIZE)
+    /* Return the next packet in the buffer */
+    if (sl_nextpacket (slconn, slpack, SLRECSIZE))
     {
-      retpacket = 1;
-
-      /* Check for an INFO packet */
-      if (!strncmp (&slconn->stat->databuf[slconn->stat->sendptr], INFOSIGNATURE, 6))
-      {
-        char terminator;
-
-        terminator = (slconn->stat->databuf[slconn->stat->sendptr + SLHEADSIZE - 1] != '*');
-
-        if (!slconn->stat->expect_info)
-        {
-          sl_log_r (slconn, 2, 0, "unexpected INFO packet received, skipping\n");
-        }
-        else
-        {
-          if (terminator)
-          {
-            slconn->stat->expect_info = 0;
-          }
-
-          /* Keep alive packets are not returned */
-          if (slconn->stat->query_mode == KeepAliveQuery)
-          {
-            retpacket = 0;
-
-            if (!terminator)
-            {
-              sl_log_r (slconn, 2, 0, "non-terminated keep-alive packet received!?!\n");
-            }
-            else
-            {
-              sl_log_r (slconn, 1, 2, "keepalive packet received\n");
-            }
-          }
-        }
-
-        if (slconn->stat->query_mode != NoQuery)
-        {
-          slconn->stat->query_mode = NoQuery;
-        }
-      }
-      else /* Update the stream chain entry if not an INFO packet */
-      {
-        if ((update_stream (slconn, (SLpacket *)&slconn->stat->databuf[slconn->stat->sendptr])) == -1)
-        {
-          /* If updating didn't work the packet is broken */
-          retpacket = 0;
-        }
-      }
-
-      /* Increment the send pointer */
-      slconn->stat->sendptr += (SLHEADSIZE + SLRECSIZE);
-
-      /* Return packet */
-      if (retpacket)
-      {
-        *slpack = (SLpacket *)&slconn->stat->databuf[slconn->stat->sendptr - (SLHEADSIZE + SLRECSIZE)];
-        return SLPACKET;
-      }
+      return SLPACKET;
     }
 
     /* A trap door for terminating, all complete data packets from the buffer
@@ -266,20 +221,16 @@ sl_collect (SLCD *slconn, SLpacket **slpack)
       return SLTERMINATE;
     }
 
-    /* After processing the packet buffer shift the data */
-    if (slconn->stat->sendptr)
+    /* Restart at the beginning of the ring when all data are processed */
+    if (slconn->stat->sendptr == slconn->stat->recptr)
     {
-      memmove (slconn->stat->databuf,
-               &slconn->stat->databuf[slconn->stat->sendptr],
-               slconn->stat->recptr - slconn->stat->sendptr);
-
-      slconn->stat->recptr -= slconn->stat->sendptr;
+      slconn->stat->recptr  = 0;
       slconn->stat->sendptr = 0;
     }
 
     /* Catch cases where the data stream stopped */
     if ((slconn->stat->recptr - slconn->stat->sendptr) == 7 &&
-        !strncmp (&slconn->stat->databuf[slconn->stat->sendptr], "ERROR\r\n", 7))
+        !strncmp (sl_ringdata (slconn->stat, 7), "ERROR\r\n", 7))
     {
       sl_log_r (slconn, 2, 0, "SeedLink server reported an error with the last command\n");
       slconn->link = sl_disconnect (slconn);
@@ -287,7 +238,7 @@ sl_collect (SLCD *slconn, SLpacket **slpack)
     }
 
     if ((slconn->stat->recptr - slconn->stat->sendptr) == 3 &&
-        !strncmp (&slconn->stat->databuf[slconn->stat->sendptr], "END", 3))
+        !strncmp (sl_ringdata (slconn->stat, 3), "END", 3))
     {
       sl_log_r (slconn, 1, 1, "End of buffer or selected time window\n");
       slconn->link = sl_disconnect (slconn);
@@ -319,8 +270,8 @@ sl_collect (SLCD *slconn, SLpacket **slpack)
         }
         else
         {
-          bytesread = sl_recvdata (slconn, (void *)&slconn->stat->databuf[slconn->stat->recptr],
-                                   BUFSIZE - slconn->stat->recptr, slconn->sladdr);
+          recvptr   = sl_ringspace (slconn->stat, &space);
+          bytesread = sl_recvdata (slconn, (void *)recvptr, space, slconn->sladdr);
         }
       }
       else if (select_ret < 0 && !slconn->terminate)
@@ -428,13 +379,24 @@ sl_collect_nb (SLCD *slconn, SLpacket **slpack)
  * packet size.  Possible values for slrecsize are 128, 256, 512.
  * There is no error checking, so the value of slrecsize must be
  * checked before passing it to sl_collect_nb_size().
+ *
+ * Packets are returned in place from the receive ring buffer, a packet
+ * that wraps around the end of the ring is made contiguous in the spill
+ * area following the ring, so slrecsize may not exceed SLMAXRECSIZE.
+ * The returned packet is valid until the next call.
+ *
+ * If slrecsize is SLRECVARIABLE the record length of each packet is
+ * detected from its Blockette 1000, records without a valid Blockette
+ * 1000 are taken to be SLRECSIZE bytes.  The length of a returned
+ * packet is available from sl_packetreclen().
  ***************************************************************************/
 int
 sl_collect_nb_size (SLCD *slconn, SLpacket **slpack, int slrecsize)
 {
   int bytesread;
+  int space;
   double current_time;
-  char retpacket;
+  char *recvptr;
 
   *slpack = NULL;
 
@@ -471,6 +433,7 @@ sl_collect_nb_size (SLCD *slconn, SLpacket **slpack, int slrecsize)
     {
       sl_log_r (slconn, 1, 0, "network timeout (%ds), reconnecting in %ds\n",
                 slconn->netto, slconn->netdly);
+      slconn->stat->stats.timeouts++;
       slconn->link              = sl_disconnect (slconn);
       slconn->stat->sl_state    = SL_DOWN;
       slconn->stat->netto_trig  = -1;
@@ -557,8 +520,7 @@ sl_collect_nb_size (SLCD *slconn, SLpacket **slpack, int slrecsize)
 
       if (slconfret != -1)
       {
-        slconn->stat->recptr   = 0; /* initialize the data buffer pointers */
-        slconn->stat->sendptr  = 0;
+        /* Data received after the negotiation responses remain buffered */
         slconn->stat->sl_state = SL_DATA;
       }
       else
@@ -585,68 +547,10 @@ sl_collect_nb_size (SLCD *slconn, SLpacket **slpack, int slrecsize)
      (slconn->stat->recptr - slconn->stat->sendptr) );
   */
 
-  /* Process data in buffer */
-  while (slconn->stat->recptr - slconn->stat->sendptr >= SLHEADSIZE + slrecsize)
+  /* Return the next packet in the buffer */
+  if (sl_nextpacket (slconn, slpack, slrecsize))
   {
-    retpacket = 1;
-
-    /* Check for an INFO packet */
-    if (!strncmp (&slconn->stat->databuf[slconn->stat->sendptr], INFOSIGNATURE, 6))
-    {
-      char terminator;
-
-      terminator = (slconn->stat->databuf[slconn->stat->sendptr + SLHEADSIZE - 1] != '*');
-
-      if (!slconn->stat->expect_info)
-      {
-        sl_log_r (slconn, 2, 0, "unexpected INFO packet received, skipping\n");
-      }
-      else
-      {
-        if (terminator)
-        {
-          slconn->stat->expect_info = 0;
-        }
-
-        /* Keep alive packets are not returned */
-        if (slconn->stat->query_mode == KeepAliveQuery)
-        {
-          retpacket = 0;
-
-          if (!terminator)
-          {
-            sl_log_r (slconn, 2, 0, "non-terminated keep-alive packet received!?!\n");
-          }
-          else
-          {
-            sl_log_r (slconn, 1, 2, "keepalive packet received\n");
-          }
-        }
-      }
-
-      if (slconn->stat->query_mode != NoQuery)
-      {
-        slconn->stat->query_mode = NoQuery;
-      }
-    }
-    else /* Update the stream chain entry if not an INFO packet */
-    {
-      if ((update_stream (slconn, (SLpacket *)&slconn->stat->databuf[slconn->stat->sendptr])) == -1)
-      {
-        /* If updating didn't work the packet is broken */
-        retpacket = 0;
-      }
-    }
-
-    /* Increment the send pointer */
-    slconn->stat->sendptr += (SLHEADSIZE + slrecsize);
-
-    /* Return packet */
-    if (retpacket)
-    {
-      *slpack = (SLpacket *)&slconn->stat->databuf[slconn->stat->sendptr - (SLHEADSIZE + slrecsize)];
-      return SLPACKET;
-    }
+    return SLPACKET;
   }
 
   /* A trap door for terminating, all complete data packets from the buffer
@@ -656,20 +560,16 @@ sl_collect_nb_size (SLCD *slconn, SLpacket **slpack, int slrecsize)
     return SLTERMINATE;
   }
 
-  /* After processing the packet buffer shift the data */
-  if (slconn->stat->sendptr)
+  /* Restart at the beginning of the ring when all data are processed */
+  if (slconn->stat->sendptr == slconn->stat->recptr)
   {
-    memmove (slconn->stat->databuf,
-             &slconn->stat->databuf[slconn->stat->sendptr],
-             slconn->stat->recptr - slconn->stat->sendptr);
-
-    slconn->stat->recptr -= slconn->stat->sendptr;
+    slconn->stat->recptr  = 0;
     slconn->stat->sendptr = 0;
   }
 
   /* Catch cases where the data stream stopped */
   if ((slconn->stat->recptr - slconn->stat->sendptr) == 7 &&
-      !strncmp (&slconn->stat->databuf[slconn->stat->sendptr], "ERROR\r\n", 7))
+      !strncmp (sl_ringdata (slconn->stat, 7), "ERROR\r\n", 7))
   {
     sl_log_r (slconn, 2, 0, "SeedLink server reported an error with the last command\n");
     slconn->link = sl_disconnect (slconn);
@@ -677,7 +577,7 @@ sl_collect_nb_size (SLCD *slconn, SLpacket **slpack, int slrecsize)
   }
 
   if ((slconn->stat->recptr - slconn->stat->sendptr) == 3 &&
-      !strncmp (&slconn->stat->databuf[slconn->stat->sendptr], "END", 3))
+      !strncmp (sl_ringdata (slconn->stat, 3), "END", 3))
   {
     sl_log_r (slconn, 1, 1, "End of buffer or selected time window\n");
     slconn->link = sl_disconnect (slconn);
@@ -690,8 +590,8 @@ sl_collect_nb_size (SLCD *slconn, SLpacket **slpack, int slrecsize)
     /* Check for more available data from the socket */
     bytesread = 0;
 
-    bytesread = sl_recvdata (slconn, (void *)&slconn->stat->databuf[slconn->stat->recptr],
-                             BUFSIZE - slconn->stat->recptr, slconn->sladdr);
+    recvptr   = sl_ringspace (slconn->stat, &space);
+    bytesread = sl_recvdata (slconn, (void *)recvptr, space, slconn->sladdr);
 
     if (bytesread < 0 && !slconn->terminate) /* read() failed */
     {
@@ -761,22 +661,187 @@ sl_collect_nb_size (SLCD *slconn, SLpacket **slpack, int slrecsize)
 
 } /* End of sl_collect_nb() */
 
+/***************************************************************************
+ * sl_nextpacket:
+ *
+ * Find the next complete packet of 'slrecsize', or of the length
+ * detected from the record for SLRECVARIABLE, in the receive buffer,
+ * update the stream chain or INFO query state and advance the send
+ * pointer.  Keepalive packets and broken packets are skipped.  The
+ * packet is returned in place and is valid until the next call to
+ * receive data for the connection.
+ *
+ * Returns 1 and sets 'slpack' when a packet is found, otherwise 0.
+ ***************************************************************************/
+int
+sl_nextpacket (SLCD *slconn, SLpacket **slpack, int slrecsize)
+{
+  char retpacket;
+  char *packet;
+  int64_t available;
+  int packetsize;
+  int reclen;
+
+  for (;;)
+  {
+    available = slconn->stat->recptr - slconn->stat->sendptr;
+
+    if (slrecsize == SLRECVARIABLE)
+    {
+      if (available < SLHEADSIZE + 48)
+        return 0;
+
+      /* Detect the record length from the buffered part of the record */
+      if (available > SLHEADSIZE + SLMAXRECSIZE)
+        available = SLHEADSIZE + SLMAXRECSIZE;
+
+      packet = sl_ringdata (slconn->stat, (int)available);
+
+      if ((reclen = sl_reclen (packet + SLHEADSIZE, (int)available - SLHEADSIZE)) == 0)
+        return 0;
+
+      packetsize = SLHEADSIZE + ((reclen > 0) ? reclen : SLRECSIZE);
+
+      if (available < packetsize)
+        return 0;
+    }
+    else
+    {
+      packetsize = SLHEADSIZE + slrecsize;
+
+      if (available < packetsize)
+        return 0;
+
+      packet = sl_ringdata (slconn->stat, packetsize);
+    }
+
+    retpacket = 1;
+
+    /* Check for an INFO packet */
+    if (!strncmp (packet, INFOSIGNATURE, 6))
+    {
+      char terminator;
+
+      terminator = (packet[SLHEADSIZE - 1] != '*');
+
+      if (!slconn->stat->expect_info)
+      {
+        sl_log_r (slconn, 2, 0, "unexpected INFO packet received, skipping\n");
+      }
+      else
+      {
+        if (terminator)
+        {
+          slconn->stat->expect_info = 0;
+        }
+
+        /* Keep alive packets are not returned */
+        if (slconn->stat->query_mode == KeepAliveQuery)
+        {
+          retpacket = 0;
+
+          if (!terminator)
+          {
+            sl_log_r (slconn, 2, 0, "non-terminated keep-alive packet received!?!\n");
+          }
+          else
+          {
+            sl_log_r (slconn, 1, 2, "keepalive packet received\n");
+          }
+        }
+      }
+
+      if (slconn->stat->query_mode != NoQuery)
+      {
+        slconn->stat->query_mode = NoQuery;
+      }
+    }
+    else /* Update the stream chain entry if not an INFO packet */
+    {
+      if ((update_stream (slconn, (SLpacket *)packet)) == -1)
+      {
+        /* If updating didn't work the packet is broken */
+        retpacket = 0;
+      }
+    }
+
+    /* Increment the send pointer */
+    slconn->stat->sendptr += packetsize;
+
+    /* Return packet */
+    if (retpacket)
+    {
+      *slpack = (SLpacket *)packet;
+      slconn->stat->stats.packets++;
+      return 1;
+    }
+  }
+} /* End of sl_nextpacket() */
+
+/***************************************************************************
+ * sl_collect_batch:
+ *
+ * Collect a batch of packets with a single call.  The connection is
+ * managed and data are received as with sl_collect_nb_size(), then
+ * all complete packets in the receive buffer, up to 'maxpacks', are
+ * returned in the caller-supplied 'slpacks' array.  The packets are not
+ * copied, each entry points into the receive buffer and is valid
+ * until the next call for the connection.
+ *
+ * Returns SLPACKET when packets are returned and sets 'npacks' to the
+ * number of packets.  Otherwise SLNOPACKET or SLTERMINATE is returned
+ * as from sl_collect_nb_size() and 'npacks' is set to 0.
+ ***************************************************************************/
+int
+sl_collect_batch (SLCD *slconn, SLpacket **slpacks, int maxpacks,
+                  int *npacks, int slrecsize)
+{
+  int retval;
+
+  *npacks = 0;
+
+  if (maxpacks <= 0)
+    return SLNOPACKET;
+
+  retval = sl_collect_nb_size (slconn, &slpacks[0], slrecsize);
+
+  if (retval != SLPACKET)
+    return retval;
+
+  /* Add the rest of the buffered packets without managing the connection */
+  *npacks = 1;
+  while (*npacks < maxpacks &&
+         sl_nextpacket (slconn, &slpacks[*npacks], slrecsize))
+    (*npacks)++;
+
+  return SLPACKET;
+} /* End of sl_collect_batch() */
+
 /***************************************************************************
  * update_stream:
  *
  * Update the appropriate stream chain entries given a Mini-SEED
  * record.
  *
+ * Matching entries are found with the stream index, entries with
+ * exact network and station codes are looked up in a hash table and
+ * only the wildcarded entries are glob matched.  The record start time
+ * is stored in binary form, see sl_streamtimestamp().
+ *
  * Returns 0 if successfully updated and -1 if not found or error.
  ***************************************************************************/
 int
 update_stream (SLCD *slconn, SLpacket *slpack)
 {
   SLstream *curstream;
+  SLstreamidx *idx;
+  struct sl_btime_s *btime;
   struct sl_fsdh_s fsdh;
+  uint32_t slot;
   int seqnum;
   int swapflag = 0;
   int updates  = 0;
+  int count;
   char net[3];
   char sta[6];
 
@@ -800,6 +865,8 @@ update_stream (SLCD *slconn, SLpacket *slpack)
     sl_gswap2 (&fsdh.start_time.day);
   }
 
+  btime = &fsdh.start_time;
+
   curstream = slconn->streams;
 
   /* Generate some "clean" net and sta strings */
@@ -815,57 +882,54 @@ update_stream (SLCD *slconn, SLpacket *slpack)
     if (strcmp (curstream->net, UNINETWORK) == 0 &&
         strcmp (curstream->sta, UNISTATION) == 0)
     {
-      int month = 0;
-      int mday  = 0;
-
-      sl_doy2md (fsdh.start_time.year,
-                 fsdh.start_time.day,
-                 &month, &mday);
-
-      curstream->seqnum = seqnum;
-
-      snprintf (curstream->timestamp, 20,
-                "%04d,%02d,%02d,%02d,%02d,%02d",
-                fsdh.start_time.year,
-                month,
-                mday,
-                fsdh.start_time.hour,
-                fsdh.start_time.min,
-                fsdh.start_time.sec);
+      curstream->seqnum    = seqnum;
+      curstream->lasttime  = *btime;
+      curstream->timestale = 1;
 
       return 0;
     }
   }
 
-  /* For multi-station mode, search the stream chain and update all matching entries */
-  while (curstream != NULL)
+  /* For multi-station mode, update all matching entries */
+  if (curstream != NULL)
   {
-    /* Use glob matching to match wildcarded network and station codes */
-    if (sl_globmatch (net, curstream->net) &&
-        sl_globmatch (sta, curstream->sta))
-    {
-      int month = 0;
-      int mday  = 0;
+    if (!slconn->stat->streamidx && sl_buildstreamidx (slconn))
+      return -1;
 
-      sl_doy2md (fsdh.start_time.year,
-                 fsdh.start_time.day,
-                 &month, &mday);
+    idx = slconn->stat->streamidx;
 
-      curstream->seqnum = seqnum;
+    /* Exact entries, duplicates occupy consecutive slots */
+    slot = sl_streamhash (net, sta) & (idx->tablesize - 1);
+
+    while ((curstream = idx->table[slot]) != NULL)
+    {
+      if (!strcmp (net, curstream->net) && !strcmp (sta, curstream->sta))
+      {
+        curstream->seqnum    = seqnum;
+        curstream->lasttime  = *btime;
+        curstream->timestale = 1;
 
-      snprintf (curstream->timestamp, 20,
-                "%04d,%02d,%02d,%02d,%02d,%02d",
-                fsdh.start_time.year,
-                month,
-                mday,
-                fsdh.start_time.hour,
-                fsdh.start_time.min,
-                fsdh.start_time.sec);
+        updates++;
+      }
 
-      updates++;
+      slot = (slot + 1) & (idx->tablesize - 1);
     }
 
-    curstream = curstream->next;
+    /* Use glob matching to match wildcarded network and station codes */
+    for (count = 0; count < idx->numwildcards; count++)
+    {
+      curstream = idx->wildcards[count];
+
+      if (sl_globmatch (net, curstream->net) &&
+          sl_globmatch (sta, curstream->sta))
+      {
+        curstream->seqnum    = seqnum;
+        curstream->lasttime  = *btime;
+        curstream->timestale = 1;
+
+        updates++;
+      }
+    }
   }
 
   /* If no updates then no match was found */
@@ -875,6 +939,294 @@ update_stream (SLCD *slconn, SLpacket *slpack)
   return (updates == 0) ? -1 : 0;
 } /* End of update_stream() */
 
+/***************************************************************************
+ * sl_streamhash:
+ *
+ * Compute a hash (FNV-1a) of network and station codes.
+ *
+ * Returns the hash value.
+ ***************************************************************************/
+uint32_t
+sl_streamhash (const char *net, const char *sta)
+{
+  uint32_t hash = 2166136261U;
+
+  while (*net)
+    hash = (hash ^ (uint8_t)*net++) * 16777619U;
+
+  hash = (hash ^ (uint8_t)'_') * 16777619U;
+
+  while (*sta)
+    hash = (hash ^ (uint8_t)*sta++) * 16777619U;
+
+  return hash;
+} /* End of sl_streamhash() */
+
+/***************************************************************************
+ * sl_buildstreamidx:
+ *
+ * Build the index of the stream chain used to match received packets
+ * and state file entries to stream entries.  Entries with exact network
+ * and station codes are added to an open addressing hash table, entries
+ * containing glob pattern characters to a list of wildcarded entries.
+ *
+ * The index is extended as streams are added while it has room and
+ * rebuilt on demand otherwise.
+ *
+ * Returns 0 on success and -1 on error.
+ ***************************************************************************/
+int
+sl_buildstreamidx (SLCD *slconn)
+{
+  SLstreamidx *idx;
+  SLstream *curstream;
+  int count = 0;
+
+  sl_freestreamidx (slconn);
+
+  for (curstream = slconn->streams; curstream != NULL; curstream = curstream->next)
+    count++;
+
+  if ((idx = (SLstreamidx *)calloc (1, sizeof (SLstreamidx))) == NULL)
+  {
+    sl_log_r (slconn, 2, 0, "sl_buildstreamidx(): error allocating memory\n");
+    return -1;
+  }
+
+  /* Keep the table at most half full, leaving room for added streams */
+  idx->tablesize = 16;
+  while (idx->tablesize < count * 4)
+    idx->tablesize *= 2;
+
+  idx->maxwildcards = idx->tablesize / 2;
+
+  idx->table     = (SLstream **)calloc (idx->tablesize, sizeof (SLstream *));
+  idx->wildcards = (SLstream **)malloc (sizeof (SLstream *) * idx->maxwildcards);
+
+  if (idx->table == NULL || idx->wildcards == NULL)
+  {
+    sl_log_r (slconn, 2, 0, "sl_buildstreamidx(): error allocating memory\n");
+    free (idx->table);
+    free (idx->wildcards);
+    free (idx);
+    return -1;
+  }
+
+  for (curstream = slconn->streams; curstream != NULL; curstream = curstream->next)
+    sl_indexstream (idx, curstream);
+
+  slconn->stat->streamidx = idx;
+
+  return 0;
+} /* End of sl_buildstreamidx() */
+
+/***************************************************************************
+ * sl_indexstream:
+ *
+ * Add a stream entry to the index of the stream chain.  Entries with
+ * the same codes are found in the order they were added.
+ *
+ * Returns 0 on success and -1 if the index has no room for the entry.
+ ***************************************************************************/
+int
+sl_indexstream (SLstreamidx *idx, SLstream *stream)
+{
+  uint32_t slot;
+
+  if (strpbrk (stream->net, "*?[\\") || strpbrk (stream->sta, "*?[\\"))
+  {
+    if (idx->numwildcards >= idx->maxwildcards)
+      return -1;
+
+    idx->wildcards[idx->numwildcards++] = stream;
+    return 0;
+  }
+
+  if ((idx->numstreams + 1) * 2 > idx->tablesize)
+    return -1;
+
+  slot = sl_streamhash (stream->net, stream->sta) & (idx->tablesize - 1);
+
+  while (idx->table[slot] != NULL)
+    slot = (slot + 1) & (idx->tablesize - 1);
+
+  idx->table[slot] = stream;
+  idx->numstreams++;
+
+  return 0;
+} /* End of sl_indexstream() */
+
+/***************************************************************************
+ * sl_freestreamidx:
+ *
+ * Free the index of the stream chain, it is rebuilt when needed.
+ ***************************************************************************/
+void
+sl_freestreamidx (SLCD *slconn)
+{
+  SLstreamidx *idx = slconn->stat->streamidx;
+
+  if (idx == NULL)
+    return;
+
+  free (idx->table);
+  free (idx->wildcards);
+  free (idx);
+
+  slconn->stat->streamidx = NULL;
+} /* End of sl_freestreamidx() */
+
+/***************************************************************************
+ * sl_findstream:
+ *
+ * Find the first entry of the stream chain with exactly the given
+ * network and station codes, wildcarded entries are compared as
+ * strings, using the index of the stream chain.
+ *
+ * Returns a pointer to the stream entry or NULL if not found.
+ ***************************************************************************/
+SLstream *
+sl_findstream (SLCD *slconn, const char *net, const char *sta)
+{
+  SLstreamidx *idx;
+  SLstream *curstream;
+  uint32_t slot;
+  int widx;
+
+  if (!slconn->stat->streamidx && sl_buildstreamidx (slconn))
+  {
+    /* Fall back to searching the stream chain */
+    for (curstream = slconn->streams; curstream != NULL; curstream = curstream->next)
+      if (!strcmp (net, curstream->net) && !strcmp (sta, curstream->sta))
+        return curstream;
+
+    return NULL;
+  }
+
+  idx = slconn->stat->streamidx;
+
+  if (strpbrk (net, "*?[\\") || strpbrk (sta, "*?[\\"))
+  {
+    for (widx = 0; widx < idx->numwildcards; widx++)
+    {
+      curstream = idx->wildcards[widx];
+
+      if (!strcmp (net, curstream->net) && !strcmp (sta, curstream->sta))
+        return curstream;
+    }
+
+    return NULL;
+  }
+
+  slot = sl_streamhash (net, sta) & (idx->tablesize - 1);
+
+  while ((curstream = idx->table[slot]) != NULL)
+  {
+    if (!strcmp (net, curstream->net) && !strcmp (sta, curstream->sta))
+      return curstream;
+
+    slot = (slot + 1) & (idx->tablesize - 1);
+  }
+
+  return NULL;
+} /* End of sl_findstream() */
+
+/***************************************************************************
+ * sl_streamtimestamp:
+ *
+ * Update the 'timestamp' of a stream with the start time of the last
+ * packet received if needed.  Received start times are stored in
+ * binary form and only formatted when the time stamp is used, e.g. to
+ * save the state or resume the stream.
+ *
+ * Returns a pointer to the time stamp of the stream.
+ ***************************************************************************/
+const char *
+sl_streamtimestamp (SLstream *stream)
+{
+  int month = 0;
+  int mday  = 0;
+
+  if (stream->timestale)
+  {
+    sl_doy2md (stream->lasttime.year,
+               stream->lasttime.day,
+               &month, &mday);
+
+    snprintf (stream->timestamp, 20,
+              "%04d,%02d,%02d,%02d,%02d,%02d",
+              stream->lasttime.year,
+              month,
+              mday,
+              stream->lasttime.hour,
+              stream->lasttime.min,
+              stream->lasttime.sec);
+
+    stream->timestale = 0;
+  }
+
+  return stream->timestamp;
+} /* End of sl_streamtimestamp() */
+
+/***************************************************************************
+ * sl_connstats:
+ *
+ * Return the statistics of a connection: the number of connection
+ * attempts, established connections, failed negotiations and network
+ * timeouts, the number of packets and bytes received and the time
+ * spent negotiating.  The counters are updated by the thread running
+ * the connection and are never reset.
+ *
+ * Returns a pointer to the connection statistics.
+ ***************************************************************************/
+const SLconnstats *
+sl_connstats (SLCD *slconn)
+{
+  return &slconn->stat->stats;
+} /* End of sl_connstats() */
+
+/***************************************************************************
+ * sl_ringdata:
+ *
+ * Return a pointer to 'length' contiguous bytes of buffered data
+ * starting at the send pointer of the receive ring buffer.  The data
+ * are returned in place unless they wrap around the end of the ring,
+ * in which case the wrapped part is copied to the spill area following
+ * the ring.  'length' may not be more than SLSPILLSIZE.
+ ***************************************************************************/
+char *
+sl_ringdata (SLstat *stat, int length)
+{
+  int offset = (int)(stat->sendptr % stat->bufsize);
+
+  if (offset + length > stat->bufsize)
+    memcpy (stat->databuf + stat->bufsize, stat->databuf,
+            offset + length - stat->bufsize);
+
+  return stat->databuf + offset;
+} /* End of sl_ringdata() */
+
+/***************************************************************************
+ * sl_ringspace:
+ *
+ * Determine the free space in the receive ring buffer that can be
+ * filled contiguously starting at the receive pointer.
+ *
+ * Returns a pointer to the free space and sets 'space' to its size.
+ ***************************************************************************/
+char *
+sl_ringspace (SLstat *stat, int *space)
+{
+  int offset = (int)(stat->recptr % stat->bufsize);
+
+  *space = stat->bufsize - (int)(stat->recptr - stat->sendptr);
+
+  if (*space > stat->bufsize - offset)
+    *space = stat->bufsize - offset;
+
+  return stat->databuf + offset;
+} /* End of sl_ringspace() */
+
 /***************************************************************************
  * sl_newslcd:
  *
@@ -905,6 +1257,7 @@ sl_newslcd (void)
   slconn->multistation = 0;
   slconn->dialup       = 0;
   slconn->batchmode    = 0;
+  slconn->pipeline     = 0;
   slconn->lastpkttime  = 1;
   slconn->terminate    = 0;
 
@@ -926,8 +1279,22 @@ sl_newslcd (void)
     return NULL;
   }
 
+  /* Allocate the receive ring buffer and spill area */
+  slconn->stat->bufsize = SLDEFBUFSIZE;
+  slconn->stat->databuf = (char *)malloc (SLDEFBUFSIZE + SLSPILLSIZE);
+
+  if (slconn->stat->databuf == NULL)
+  {
+    sl_log_r (NULL, 2, 0, "new_slconn(): error allocating memory\n");
+    free (slconn->stat);
+    free (slconn);
+    return NULL;
+  }
+
   slconn->stat->recptr      = 0;
   slconn->stat->sendptr     = 0;
+  slconn->stat->streamidx   = NULL;
+  slconn->stat->streamtail  = NULL;
   slconn->stat->expect_info = 0;
 
   slconn->stat->netto_trig     = -1;
@@ -941,6 +1308,12 @@ sl_newslcd (void)
   slconn->stat->sl_state   = SL_DOWN;
   slconn->stat->query_mode = NoQuery;
 
+  memset (&slconn->stat->stats, 0, sizeof (SLconnstats));
+
+  slconn->stat->statefd    = -1;
+  slconn->stat->statefile  = NULL;
+  slconn->stat->stateslots = 0;
+
   slconn->log = NULL;
 
   return slconn;
@@ -983,7 +1356,14 @@ sl_freeslcd (SLCD *slconn)
     free (slconn->end_time);
 
   if (slconn->stat != NULL)
+  {
+    sl_freestreamidx (slconn);
+    if (slconn->stat->statefd >= 0)
+      close (slconn->stat->statefd);
+    free (slconn->stat->statefile);
+    free (slconn->stat->databuf);
     free (slconn->stat);
+  }
 
   if (slconn->log != NULL)
     free (slconn->log);
@@ -991,6 +1371,49 @@ sl_freeslcd (SLCD *slconn)
   free (slconn);
 } /* End of sl_freeslcd() */
 
+/***************************************************************************
+ * sl_setbuffersize:
+ *
+ * Set the size of the receive ring buffer for the given SLCD struct.
+ * The size must be between BUFSIZE and SLMAXBUFSIZE bytes and can only
+ * be changed while no data are buffered, i.e. before connecting or
+ * when the connection is down.
+ *
+ * Returns 0 on success and -1 on error.
+ ***************************************************************************/
+int
+sl_setbuffersize (SLCD *slconn, int size)
+{
+  char *databuf;
+
+  /* The ring must hold at least one packet of the maximum record size */
+  if (size < BUFSIZE || size < SLSPILLSIZE || size > SLMAXBUFSIZE)
+  {
+    sl_log_r (slconn, 2, 0, "sl_setbuffersize(): size must be between %d and %d bytes\n",
+              (BUFSIZE > SLSPILLSIZE) ? BUFSIZE : SLSPILLSIZE, SLMAXBUFSIZE);
+    return -1;
+  }
+
+  if (slconn->stat->recptr != slconn->stat->sendptr)
+  {
+    sl_log_r (slconn, 2, 0, "sl_setbuffersize(): cannot resize buffer containing data\n");
+    return -1;
+  }
+
+  if ((databuf = (char *)realloc (slconn->stat->databuf, size + SLSPILLSIZE)) == NULL)
+  {
+    sl_log_r (slconn, 2, 0, "sl_setbuffersize(): error allocating memory\n");
+    return -1;
+  }
+
+  slconn->stat->databuf = databuf;
+  slconn->stat->bufsize = size;
+  slconn->stat->recptr  = 0;
+  slconn->stat->sendptr = 0;
+
+  return 0;
+} /* End of sl_setbuffersize() */
+
 /***************************************************************************
  * sl_addstream:
  *
@@ -1010,7 +1433,6 @@ sl_addstream (SLCD *slconn, const char *net, const char *sta,
 {
   SLstream *curstream;
   SLstream *newstream;
-  SLstream *laststream = NULL;
 
   curstream = slconn->streams;
 
@@ -1025,13 +1447,6 @@ sl_addstream (SLCD *slconn, const char *net, const char *sta,
     }
   }
 
-  /* Search the stream chain */
-  while (curstream != NULL)
-  {
-    laststream = curstream;
-    curstream  = curstream->next;
-  }
-
   newstream = (SLstream *)malloc (sizeof (SLstream));
 
   if (newstream == NULL)
@@ -1055,22 +1470,86 @@ sl_addstream (SLCD *slconn, const char *net, const char *sta,
   else
     strncpy (newstream->timestamp, timestamp, 20);
 
+  newstream->timestale = 0;
+
+  newstream->stateslot = -1;
+  newstream->stategen  = 0;
+  newstream->stateseq  = -1;
+
   newstream->next = NULL;
 
+  /* Add to an existing index, otherwise it is rebuilt when needed */
+  if (slconn->stat->streamidx &&
+      sl_indexstream (slconn->stat->streamidx, newstream))
+    sl_freestreamidx (slconn);
+
+  /* Append to the end of the stream chain */
   if (slconn->streams == NULL)
   {
     slconn->streams = newstream;
   }
-  else if (laststream)
+  else
   {
-    laststream->next = newstream;
+    if (slconn->stat->streamtail == NULL)
+      for (slconn->stat->streamtail = slconn->streams;
+           slconn->stat->streamtail->next != NULL;
+           slconn->stat->streamtail = slconn->stat->streamtail->next)
+        ;
+
+    slconn->stat->streamtail->next = newstream;
   }
 
+  slconn->stat->streamtail = newstream;
+
   slconn->multistation = 1;
 
   return 0;
 } /* End of sl_addstream() */
 
+/***************************************************************************
+ * sl_setstreams:
+ *
+ * Replace the stream chain of the given SLCD struct with 'streams',
+ * used to move stream entries between connections.  The previous
+ * chain is not freed, it is owned by the caller.  If the connection
+ * is open it is closed and immediately reconnected to negotiate the
+ * new chain, starting from the sequence numbers of the entries.
+ *
+ * Returns the number of stream entries in the new chain.
+ ***************************************************************************/
+int
+sl_setstreams (SLCD *slconn, SLstream *streams)
+{
+  SLstream *curstream;
+  int count = 0;
+
+  sl_freestreamidx (slconn);
+
+  slconn->streams          = streams;
+  slconn->stat->streamtail = NULL;
+
+  for (curstream = streams; curstream; curstream = curstream->next)
+  {
+    slconn->stat->streamtail = curstream;
+    count++;
+  }
+
+  slconn->multistation = (streams) ? 1 : 0;
+
+  if (slconn->link != -1)
+  {
+    slconn->link                 = sl_disconnect (slconn);
+    slconn->stat->sl_state       = SL_DOWN;
+    slconn->stat->query_mode     = NoQuery;
+    slconn->stat->expect_info    = 0;
+    slconn->stat->netto_trig     = -1;
+    slconn->stat->keepalive_trig = -1;
+    slconn->stat->netdly_trig    = 0;
+  }
+
+  return count;
+} /* End of sl_setstreams() */
+
 /***************************************************************************
  * sl_setuniparams:
  *
@@ -1125,9 +1604,18 @@ sl_setuniparams (SLCD *slconn, const char *selectors,
   else
     strncpy (newstream->timestamp, timestamp, 20);
 
+  newstream->timestale = 0;
+
+  newstream->stateslot = -1;
+  newstream->stategen  = 0;
+  newstream->stateseq  = -1;
+
   newstream->next = NULL;
 
-  slconn->streams = newstream;
+  sl_freestreamidx (slconn);
+
+  slconn->streams          = newstream;
+  slconn->stat->streamtail = newstream;
 
   slconn->multistation = 0;
 
@@ -1266,6 +1754,25 @@ sl_packettype (const SLpacket *slpack)
   return SLDATA;
 } /* End of sl_packettype() */
 
+/***************************************************************************
+ * sl_packetreclen:
+ *
+ * Determine the record length of a packet collected with SLRECVARIABLE
+ * from its Blockette 1000, the same way the packet was framed.
+ *
+ * Returns the record length in bytes, SLRECSIZE if the record has no
+ * valid Blockette 1000.
+ ***************************************************************************/
+int
+sl_packetreclen (const SLpacket *slpack)
+{
+  int reclen;
+
+  reclen = sl_reclen (slpack->msrecord, SLMAXRECSIZE);
+
+  return (reclen > 0) ? reclen : SLRECSIZE;
+} /* End of sl_packetreclen() */
+
 /***************************************************************************
  * sl_terminate:
  *
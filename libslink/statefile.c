@@ -3,22 +3,70 @@
  *
  * Routines to save and recover SeedLink sequence numbers to/from a file.
  *
+ * Two formats are supported: a text format with one line per stream
+ * and a binary format with fixed size slots.  The text format is
+ * always written completely to a temporary file which atomically
+ * replaces the state file.  The binary format is written completely
+ * once and afterwards only the slots of streams that changed are
+ * updated in place.  Each stream has two slots that are written
+ * alternately, each with a generation count and a checksum, so an
+ * interrupted update leaves the previously saved state of the stream.
+ *
  * Written by Chad Trabant, ORFEUS/EC-Project MEREDIAN
  *
- * modified: 2008.028
+ * modified: 2026.287
  ***************************************************************************/
 
 #include <errno.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "libslink.h"
 
+/* Layout of the binary state file, all integers are big-endian:
+ *
+ * Header (STATEHEADER bytes):
+ *   0: magic "SLSTATE" and version byte
+ *   8: uint32 number of streams
+ *  12: uint32 slot size
+ *  16: reserved, zero
+ *
+ * Followed by two slots per stream (STATESLOT bytes each):
+ *   0: network code, NULL padded
+ *   8: station code, NULL padded
+ *  16: int32 sequence number
+ *  20: uint32 generation, 0 for an unused slot
+ *  24: time stamp, NULL padded
+ *  44: reserved, zero
+ *  60: uint32 checksum of bytes 0-59
+ */
+#define STATEMAGIC "SLSTATE\001"
+#define STATEHEADER 32
+#define STATESLOT 64
+
+/* Number of streams read at a time when recovering a binary state file */
+#define STATEBATCH 64
+
+static void sl_dropstate (SLCD *slconn);
+static int sl_writestate (SLCD *slconn, const char *statefile,
+                          const char *buffer, size_t length, int *statefd);
+static int sl_writeslots (SLCD *slconn, const char *statefile);
+static int sl_recoverbinary (SLCD *slconn, int statefd);
+static void sl_packslot (char *slot, SLstream *stream, uint32_t generation);
+static uint32_t sl_statechecksum (const char *buffer, int length);
+static void sl_putuint32 (char *buffer, uint32_t value);
+static uint32_t sl_getuint32 (const char *buffer);
+
+/* Function(s) from slutils.c */
+SLstream *sl_findstream (SLCD *slconn, const char *net, const char *sta);
+
 /***************************************************************************
  * sl_savestate:
  *
  * Save the all the current the sequence numbers and time stamps into the
- * given state file.
+ * given state file in the text format.  The state is written to a
+ * temporary file that replaces the state file when complete.
  *
  * Returns:
  * -1 : error
@@ -28,51 +76,359 @@ int
 sl_savestate (SLCD *slconn, const char *statefile)
 {
   SLstream *curstream;
-  char line[100];
+  char *buffer = NULL;
+  char *newbuffer;
+  size_t buffersize = 0;
+  size_t length = 0;
   int linelen;
-  int statefd;
+  int retval;
 
   curstream = slconn->streams;
 
-  /* Open the state file */
-  if ((statefd = slp_openfile (statefile, 'w')) < 0)
-  {
-    sl_log_r (slconn, 2, 0, "cannot open state file for writing\n");
-    return -1;
-  }
-
   sl_log_r (slconn, 1, 2, "saving connection state to state file\n");
 
-  /* Traverse stream chain and write sequence numbers */
+  /* Traverse stream chain and format sequence numbers */
   while (curstream != NULL)
   {
-    linelen = snprintf (line, sizeof (line), "%s %s %d %s\n",
+    if (buffersize - length < 100)
+    {
+      buffersize = (buffersize) ? buffersize * 2 : 4096;
+
+      if ((newbuffer = (char *)realloc (buffer, buffersize)) == NULL)
+      {
+        sl_log_r (slconn, 2, 0, "cannot allocate memory for state file\n");
+        free (buffer);
+        return -1;
+      }
+
+      buffer = newbuffer;
+    }
+
+    linelen = snprintf (buffer + length, buffersize - length, "%s %s %d %s\n",
                         curstream->net, curstream->sta,
-                        curstream->seqnum, curstream->timestamp);
+                        curstream->seqnum, sl_streamtimestamp (curstream));
 
-    if (write (statefd, line, linelen) != linelen)
+    if (linelen < 0 || (size_t)linelen >= buffersize - length)
     {
-      sl_log_r (slconn, 2, 0, "cannot write to state file, %s\n", strerror (errno));
+      sl_log_r (slconn, 2, 0, "cannot format state file entry for %s_%s\n",
+                curstream->net, curstream->sta);
+      free (buffer);
       return -1;
     }
 
+    length += linelen;
     curstream = curstream->next;
   }
 
-  if (close (statefd))
+  /* An open binary state file for the same path is replaced */
+  if (slconn->stat->statefile && !strcmp (slconn->stat->statefile, statefile))
+    sl_dropstate (slconn);
+
+  retval = sl_writestate (slconn, statefile, buffer, length, NULL);
+
+  free (buffer);
+
+  return retval;
+} /* End of sl_savestate() */
+
+/***************************************************************************
+ * sl_savestate_binary:
+ *
+ * Save the all the current the sequence numbers and time stamps into the
+ * given state file in the binary format.  The first save, and any save
+ * after the stream chain or the file name changed, writes the complete
+ * file to a temporary file that replaces the state file.  Later saves
+ * only update the slots of streams with a changed sequence number.
+ *
+ * Returns:
+ * -1 : error
+ *  0 : completed successfully
+ ***************************************************************************/
+int
+sl_savestate_binary (SLCD *slconn, const char *statefile)
+{
+  SLstream *curstream;
+  char *buffer;
+  size_t length;
+  int streamcount = 0;
+  int rewrite = 0;
+  int statefd;
+  int retval;
+
+  sl_log_r (slconn, 1, 2, "saving connection state to state file\n");
+
+  /* Check if the open file still matches the stream chain */
+  for (curstream = slconn->streams; curstream; curstream = curstream->next)
+  {
+    if (curstream->stateslot != streamcount)
+      rewrite = 1;
+
+    streamcount++;
+  }
+
+  if (slconn->stat->statefd < 0 ||
+      slconn->stat->stateslots != streamcount ||
+      strcmp (slconn->stat->statefile, statefile))
+    rewrite = 1;
+
+  if (!rewrite)
+    return sl_writeslots (slconn, statefile);
+
+  sl_dropstate (slconn);
+
+  length = STATEHEADER + (size_t)streamcount * 2 * STATESLOT;
+
+  if ((buffer = (char *)calloc (1, length)) == NULL)
+  {
+    sl_log_r (slconn, 2, 0, "cannot allocate memory for state file\n");
+    return -1;
+  }
+
+  memcpy (buffer, STATEMAGIC, 8);
+  sl_putuint32 (buffer + 8, (uint32_t)streamcount);
+  sl_putuint32 (buffer + 12, STATESLOT);
+
+  /* Generation 1 in the second slot of each stream, first slot unused */
+  streamcount = 0;
+  for (curstream = slconn->streams; curstream; curstream = curstream->next)
+  {
+    sl_packslot (buffer + STATEHEADER + (streamcount * 2 + 1) * STATESLOT,
+                 curstream, 1);
+    streamcount++;
+  }
+
+  retval = sl_writestate (slconn, statefile, buffer, length, &statefd);
+
+  free (buffer);
+
+  if (retval)
+    return retval;
+
+  /* Keep the file open for in place updates */
+  if ((slconn->stat->statefile = strdup (statefile)) == NULL)
+  {
+    close (statefd);
+    return 0;
+  }
+
+  slconn->stat->statefd    = statefd;
+  slconn->stat->stateslots = streamcount;
+
+  streamcount = 0;
+  for (curstream = slconn->streams; curstream; curstream = curstream->next)
+  {
+    curstream->stateslot = streamcount++;
+    curstream->stategen  = 1;
+    curstream->stateseq  = curstream->seqnum;
+  }
+
+  return 0;
+} /* End of sl_savestate_binary() */
+
+/***************************************************************************
+ * sl_dropstate:
+ *
+ * Close the open binary state file and forget the slots of the streams.
+ ***************************************************************************/
+static void
+sl_dropstate (SLCD *slconn)
+{
+  SLstream *curstream;
+
+  if (slconn->stat->statefd >= 0)
+    close (slconn->stat->statefd);
+
+  free (slconn->stat->statefile);
+
+  slconn->stat->statefd    = -1;
+  slconn->stat->statefile  = NULL;
+  slconn->stat->stateslots = 0;
+
+  for (curstream = slconn->streams; curstream; curstream = curstream->next)
+    curstream->stateslot = -1;
+} /* End of sl_dropstate() */
+
+/***************************************************************************
+ * sl_writestate:
+ *
+ * Write the buffer to a temporary file, flush it to the storage device
+ * and rename it to the state file, flushing the rename as well.  If statefd is not NULL the file is
+ * left open and the descriptor returned there, otherwise it is closed.
+ *
+ * Returns:
+ * -1 : error
+ *  0 : completed successfully
+ ***************************************************************************/
+static int
+sl_writestate (SLCD *slconn, const char *statefile,
+               const char *buffer, size_t length, int *statefd)
+{
+  char *tempfile;
+  size_t written;
+  int nwritten;
+  int tempfd;
+
+  if ((tempfile = (char *)malloc (strlen (statefile) + 5)) == NULL)
+  {
+    sl_log_r (slconn, 2, 0, "cannot allocate memory for state file\n");
+    return -1;
+  }
+
+  sprintf (tempfile, "%s.tmp", statefile);
+
+  /* Remove any left over temporary file, opening does not truncate */
+  remove (tempfile);
+
+  if ((tempfd = slp_openfile (tempfile, 'w')) < 0)
+  {
+    sl_log_r (slconn, 2, 0, "cannot open state file for writing, %s: %s\n",
+              tempfile, strerror (errno));
+    free (tempfile);
+    return -1;
+  }
+
+  /* Continue after a short write */
+  for (written = 0; written < length; written += nwritten)
+  {
+    if ((nwritten = write (tempfd, buffer + written, length - written)) <= 0)
+    {
+      if (nwritten < 0 && errno == EINTR)
+      {
+        nwritten = 0;
+        continue;
+      }
+
+      sl_log_r (slconn, 2, 0, "cannot write to state file, %s\n",
+                (nwritten < 0) ? strerror (errno) : "no space written");
+      close (tempfd);
+      remove (tempfile);
+      free (tempfile);
+      return -1;
+    }
+  }
+
+  if (slp_syncfile (tempfd))
+  {
+    sl_log_r (slconn, 2, 0, "cannot flush state file, %s\n", strerror (errno));
+    close (tempfd);
+    remove (tempfile);
+    free (tempfile);
+    return -1;
+  }
+
+  if (!statefd && close (tempfd))
   {
     sl_log_r (slconn, 2, 0, "cannot close state file, %s\n", strerror (errno));
+    remove (tempfile);
+    free (tempfile);
     return -1;
   }
 
+  if (slp_replacefile (tempfile, statefile))
+  {
+    sl_log_r (slconn, 2, 0, "cannot rename %s to %s, %s\n",
+              tempfile, statefile, strerror (errno));
+    if (statefd)
+      close (tempfd);
+    remove (tempfile);
+    free (tempfile);
+    return -1;
+  }
+
+  if (statefd)
+    *statefd = tempfd;
+
+  free (tempfile);
+
   return 0;
-} /* End of sl_savestate() */
+} /* End of sl_writestate() */
+
+/***************************************************************************
+ * sl_writeslots:
+ *
+ * Update the slots of the open binary state file for all streams with
+ * a sequence number changed since the last save.  The older slot of a
+ * stream is overwritten so the other remains valid until the update
+ * has been flushed.
+ *
+ * Returns:
+ * -1 : error
+ *  0 : completed successfully
+ ***************************************************************************/
+static int
+sl_writeslots (SLCD *slconn, const char *statefile)
+{
+  SLstream *curstream;
+  char slot[STATESLOT];
+  uint32_t generation;
+  long offset;
+  int statefd = slconn->stat->statefd;
+  int updated = 0;
+
+  for (curstream = slconn->streams; curstream; curstream = curstream->next)
+  {
+    if (curstream->seqnum == curstream->stateseq)
+      continue;
+
+    /* Skip 0 on wrap around, keeping the alternation of the slots */
+    generation = curstream->stategen + 1;
+
+    if (generation == 0)
+      generation = 2;
+
+    sl_packslot (slot, curstream, generation);
+
+    offset = STATEHEADER + ((long)curstream->stateslot * 2 + (generation & 1)) * STATESLOT;
+
+    if (lseek (statefd, offset, SEEK_SET) != offset ||
+        write (statefd, slot, STATESLOT) != STATESLOT)
+    {
+      sl_log_r (slconn, 2, 0, "cannot write to state file %s, %s\n",
+                statefile, strerror (errno));
+      sl_dropstate (slconn);
+      return -1;
+    }
+
+    curstream->stategen = generation;
+    curstream->stateseq = curstream->seqnum;
+    updated++;
+  }
+
+  if (updated && slp_syncfile (statefd))
+  {
+    sl_log_r (slconn, 2, 0, "cannot flush state file %s, %s\n",
+              statefile, strerror (errno));
+    sl_dropstate (slconn);
+    return -1;
+  }
+
+  return 0;
+} /* End of sl_writeslots() */
+
+/***************************************************************************
+ * sl_packslot:
+ *
+ * Pack the state of a stream into a binary state file slot.
+ ***************************************************************************/
+static void
+sl_packslot (char *slot, SLstream *stream, uint32_t generation)
+{
+  memset (slot, 0, STATESLOT);
+
+  strncpy (slot, stream->net, 7);
+  strncpy (slot + 8, stream->sta, 7);
+  sl_putuint32 (slot + 16, (uint32_t)stream->seqnum);
+  sl_putuint32 (slot + 20, generation);
+  strncpy (slot + 24, sl_streamtimestamp (stream), 19);
+  sl_putuint32 (slot + 60, sl_statechecksum (slot, 60));
+} /* End of sl_packslot() */
 
 /***************************************************************************
  * sl_recoverstate:
  *
  * Recover the state file and put the sequence numbers and time stamps into
- * the pre-existing stream chain entries.
+ * the pre-existing stream chain entries.  Both the text and the binary
+ * formats are recognized.
  *
  * Returns:
  * -1 : error
@@ -87,10 +443,15 @@ sl_recoverstate (SLCD *slconn, const char *statefile)
   char net[3];
   char sta[6];
   char timestamp[20];
-  char line[100];
+  char magic[8];
+  char *buffer;
+  char *line;
+  char *lineend;
+  size_t length;
   int seqnum;
   int fields;
   int count;
+  int retval = 0;
 
   net[0]       = '\0';
   sta[0]       = '\0';
@@ -113,40 +474,59 @@ sl_recoverstate (SLCD *slconn, const char *statefile)
 
   sl_log_r (slconn, 1, 1, "recovering connection state from state file\n");
 
-  count = 1;
-
-  while ((sl_readline (statefd, line, sizeof (line))) >= 0)
+  /* Binary state file if it starts with the magic, otherwise text */
+  if (read (statefd, magic, 8) == 8 && !memcmp (magic, STATEMAGIC, 8))
   {
-    fields = sscanf (line, "%2s %5s %d %19[0-9,]\n",
-                     net, sta, &seqnum, timestamp);
-
-    if (fields < 0)
-      continue;
+    retval = sl_recoverbinary (slconn, statefd);
+  }
+  else if (lseek (statefd, 0, SEEK_SET) != 0)
+  {
+    sl_log_r (slconn, 2, 0, "could not read state file, %s\n", strerror (errno));
+    retval = -1;
+  }
+  else if ((buffer = sl_readfile (statefd, &length)) == NULL)
+  {
+    sl_log_r (slconn, 2, 0, "could not read state file, %s\n", strerror (errno));
+    retval = -1;
+  }
+  else
+  {
+    count = 1;
 
-    if (fields < 3)
+    for (line = buffer; line < buffer + length; line = lineend + 1)
     {
-      sl_log_r (slconn, 2, 0, "could not parse line %d of state file\n", count);
-    }
+      if ((lineend = memchr (line, '\n', buffer + length - line)) == NULL)
+        lineend = buffer + length;
 
-    /* Search for a matching NET and STA in the stream chain */
-    curstream = slconn->streams;
-    while (curstream != NULL)
-    {
-      if (!strcmp (net, curstream->net) &&
-          !strcmp (sta, curstream->sta))
+      *lineend = '\0';
+
+      fields = sscanf (line, "%2s %5s %d %19[0-9,]\n",
+                       net, sta, &seqnum, timestamp);
+
+      if (fields < 0)
+        continue;
+
+      if (fields < 3)
+      {
+        sl_log_r (slconn, 2, 0, "could not parse line %d of state file\n", count);
+      }
+
+      /* Search for a matching NET and STA in the stream chain */
+      if ((curstream = sl_findstream (slconn, net, sta)) != NULL)
       {
         curstream->seqnum = seqnum;
 
         if (fields == 4)
+        {
           strncpy (curstream->timestamp, timestamp, 20);
-
-        break;
+          curstream->timestale = 0;
+        }
       }
 
-      curstream = curstream->next;
+      count++;
     }
 
-    count++;
+    free (buffer);
   }
 
   if (close (statefd))
@@ -155,5 +535,158 @@ sl_recoverstate (SLCD *slconn, const char *statefile)
     return -1;
   }
 
-  return 0;
+  return retval;
 } /* End of sl_recoverstate() */
+
+/***************************************************************************
+ * sl_recoverbinary:
+ *
+ * Recover the state from a binary state file, the file position is
+ * just after the magic.  For each stream the valid slot with the
+ * highest generation is used.
+ *
+ * Returns:
+ * -1 : error
+ *  0 : completed successfully
+ ***************************************************************************/
+static int
+sl_recoverbinary (SLCD *slconn, int statefd)
+{
+  SLstream *curstream;
+  char header[STATEHEADER - 8];
+  char slots[STATEBATCH * 2 * STATESLOT];
+  char *slot;
+  char *valid;
+  uint32_t streamcount;
+  uint32_t generation;
+  uint32_t available = 0;
+  uint32_t first = 0;
+  uint32_t idx;
+  int nread;
+  int copy;
+
+  if (read (statefd, header, sizeof (header)) != sizeof (header))
+  {
+    sl_log_r (slconn, 2, 0, "could not read state file header\n");
+    return -1;
+  }
+
+  streamcount = sl_getuint32 (header);
+
+  if (sl_getuint32 (header + 4) != STATESLOT)
+  {
+    sl_log_r (slconn, 2, 0, "unsupported state file slot size: %u\n",
+              (unsigned int)sl_getuint32 (header + 4));
+    return -1;
+  }
+
+  for (idx = 0; idx < streamcount; idx++)
+  {
+    /* Read the slots of the following streams when needed */
+    if (idx == available)
+    {
+      nread = read (statefd, slots, sizeof (slots));
+
+      if (nread < 2 * STATESLOT)
+      {
+        sl_log_r (slconn, 2, 0, "state file truncated at stream %u\n",
+                  (unsigned int)idx + 1);
+        return -1;
+      }
+
+      first     = idx;
+      available = idx + nread / (2 * STATESLOT);
+    }
+
+    /* Select the valid slot with the highest generation */
+    valid      = NULL;
+    generation = 0;
+    for (copy = 0; copy < 2; copy++)
+    {
+      slot = slots + ((idx - first) * 2 + copy) * STATESLOT;
+
+      if (sl_getuint32 (slot + 20) == 0 ||
+          sl_getuint32 (slot + 60) != sl_statechecksum (slot, 60))
+        continue;
+
+      if (valid == NULL || sl_getuint32 (slot + 20) - generation < 0x80000000U)
+      {
+        valid      = slot;
+        generation = sl_getuint32 (slot + 20);
+      }
+    }
+
+    if (valid == NULL)
+    {
+      sl_log_r (slconn, 2, 0, "no valid entry for stream %u of state file\n",
+                (unsigned int)idx + 1);
+      continue;
+    }
+
+    valid[7]  = '\0';
+    valid[15] = '\0';
+    valid[43] = '\0';
+
+    /* Search for a matching NET and STA in the stream chain */
+    if ((curstream = sl_findstream (slconn, valid, valid + 8)) != NULL)
+    {
+      curstream->seqnum = (int32_t)sl_getuint32 (valid + 16);
+
+      if (valid[24])
+      {
+        strncpy (curstream->timestamp, valid + 24, 20);
+        curstream->timestale = 0;
+      }
+    }
+  }
+
+  return 0;
+} /* End of sl_recoverbinary() */
+
+/***************************************************************************
+ * sl_statechecksum:
+ *
+ * Calculate the FNV-1a hash of a buffer.
+ ***************************************************************************/
+static uint32_t
+sl_statechecksum (const char *buffer, int length)
+{
+  uint32_t hash = 2166136261U;
+  int idx;
+
+  for (idx = 0; idx < length; idx++)
+  {
+    hash ^= (uint8_t)buffer[idx];
+    hash *= 16777619U;
+  }
+
+  return hash;
+} /* End of sl_statechecksum() */
+
+/***************************************************************************
+ * sl_putuint32:
+ *
+ * Store a 32-bit unsigned integer in big-endian byte order.
+ ***************************************************************************/
+static void
+sl_putuint32 (char *buffer, uint32_t value)
+{
+  buffer[0] = (char)(value >> 24);
+  buffer[1] = (char)(value >> 16);
+  buffer[2] = (char)(value >> 8);
+  buffer[3] = (char)value;
+} /* End of sl_putuint32() */
+
+/***************************************************************************
+ * sl_getuint32:
+ *
+ * Read a 32-bit unsigned integer in big-endian byte order.
+ ***************************************************************************/
+static uint32_t
+sl_getuint32 (const char *buffer)
+{
+  return ((uint32_t)(uint8_t)buffer[0] << 24) |
+         ((uint32_t)(uint8_t)buffer[1] << 16) |
+         ((uint32_t)(uint8_t)buffer[2] << 8) |
+         (uint32_t)(uint8_t)buffer[3];
+} /* End of sl_getuint32() */
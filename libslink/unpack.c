@@ -4,7 +4,10 @@
  * These are routines extracted from libmseed 2.18 and adapted for use
  * in this code base.
  *
- * modified: 2016.288
+ * Vectorized Steim decoders are in unpacksimd.c, the scalar decoders
+ * here are the reference implementation.
+ *
+ * modified: 2026.287
  ************************************************************************/
 
 #include <memory.h>
@@ -12,6 +15,7 @@
 #include <stdlib.h>
 
 #include "libslink.h"
+#include "unpack.h"
 
 /* Supported SEED data encodings */
 #define DE_ASCII 0
@@ -28,14 +32,15 @@ static int decode_int16 (int16_t *input, int samplecount, int32_t *output,
 static int decode_int32 (int32_t *input, int samplecount, int32_t *output,
                          int outputlength, int swapflag);
 static int decode_steim1 (int32_t *input, int inputlength, int samplecount,
-                          int32_t *output, int outputlength, char *srcname,
+                          int32_t *output, int outputlength, SLMSrecord *msr,
                           int swapflag, SLlog *log);
 static int decode_steim2 (int32_t *input, int inputlength, int samplecount,
-                          int32_t *output, int outputlength, char *srcname,
+                          int32_t *output, int outputlength, SLMSrecord *msr,
                           int swapflag, SLlog *log);
 
-/* Control for printing debugging information */
-static int decodedebug = 0;
+/* Control for printing debugging information, constant so that
+ * decoding does not depend on modifiable global state */
+static const int decodedebug = 0;
 
 /* Extract bit range and shift to start */
 #define EXTRACTBITRANGE(VALUE, STARTBIT, LENGTH) ((VALUE & (((1 << LENGTH) - 1) << STARTBIT)) >> STARTBIT)
@@ -53,12 +58,12 @@ int
 sl_msr_unpack (SLlog *log, SLMSrecord *msr, int swapflag)
 {
   const char *dbuf; /* Encoded data buffer */
-  char srcname[50]; /* Source name, "Net_Sta_Loc_Chan[_Qual] */
   int blksize;      /* byte size of Mini-SEED record */
   int format;       /* SEED data encoding */
   int datasize;     /* byte size of data samples in record */
   int nsamples;     /* number of samples unpacked */
   int unpacksize;   /* byte size of unpacked samples */
+  int32_t *samplebuf;
   int i;
 
   /* Reset the error flag */
@@ -80,11 +85,32 @@ sl_msr_unpack (SLlog *log, SLMSrecord *msr, int swapflag)
   /* Calculate buffer size needed for unpacked samples */
   unpacksize = msr->fsdh.num_samples * sizeof (int32_t);
 
-  /* Allocate space for the unpacked data */
-  if (msr->datasamples != NULL)
-    msr->datasamples = (int32_t *)malloc (unpacksize);
-  else
-    msr->datasamples = (int32_t *)realloc (msr->datasamples, unpacksize);
+  /* Grow the sample buffer if needed, a caller supplied buffer is fixed */
+  if (unpacksize > msr->samplebufsize || msr->samplebuf == NULL)
+  {
+    if (msr->userbuf)
+    {
+      sl_log_rl (log, 2, 0, "msr_unpack(): sample buffer too small for %d samples\n",
+                 msr->fsdh.num_samples);
+      msr->unpackerr = MSD_BUFTOOSMALL;
+      return (-1);
+    }
+
+    /* Always allocate a buffer, even for no samples */
+    samplebuf = (int32_t *)realloc (msr->samplebuf,
+                                   (unpacksize > 0) ? unpacksize : sizeof (int32_t));
+
+    if (samplebuf == NULL)
+    {
+      sl_log_rl (log, 2, 0, "msr_unpack(): error allocating memory\n");
+      return (-1);
+    }
+
+    msr->samplebuf     = samplebuf;
+    msr->samplebufsize = unpacksize;
+  }
+
+  msr->datasamples = msr->samplebuf;
 
   datasize = blksize - msr->fsdh.begin_data;
   dbuf     = msr->msrecord + msr->fsdh.begin_data;
@@ -96,20 +122,16 @@ sl_msr_unpack (SLlog *log, SLMSrecord *msr, int swapflag)
   case DE_STEIM1:
     sl_log_rl (log, 1, 2, "Unpacking Steim1 data frames\n");
 
-    sl_msr_srcname (msr, srcname, 0);
-
     nsamples = decode_steim1 ((int32_t *)dbuf, datasize, msr->fsdh.num_samples,
-                              msr->datasamples, unpacksize, srcname, swapflag, log);
+                              msr->datasamples, unpacksize, msr, swapflag, log);
 
     break;
 
   case DE_STEIM2:
     sl_log_rl (log, 1, 2, "Unpacking Steim2 data frames\n");
 
-    sl_msr_srcname (msr, srcname, 0);
-
     nsamples = decode_steim2 ((int32_t *)dbuf, datasize, msr->fsdh.num_samples,
-                              msr->datasamples, unpacksize, srcname, swapflag, log);
+                              msr->datasamples, unpacksize, msr, swapflag, log);
 
     break;
 
@@ -233,9 +255,10 @@ decode_int32 (int32_t *input, int samplecount, int32_t *output,
  ************************************************************************/
 static int
 decode_steim1 (int32_t *input, int inputlength, int samplecount,
-               int32_t *output, int outputlength, char *srcname,
+               int32_t *output, int outputlength, SLMSrecord *msr,
                int swapflag, SLlog *log)
 {
+  char srcname[50];            /* Source name, only formatted for messages */
   int32_t *outputptr = output; /* Pointer to next output sample location */
   uint32_t frame[16];          /* Frame, 16 x 32-bit quantities = 64 bytes */
   int32_t X0    = 0;           /* Forward integration constant, aka first sample */
@@ -260,9 +283,14 @@ decode_steim1 (int32_t *input, int inputlength, int samplecount,
   if (!input || !output || outputlength <= 0 || maxframes <= 0)
     return -1;
 
+  /* Use the vectorized decoder for big-endian data unless debugging */
+  if (swapflag && !decodedebug && sl_msr_simd (-1) != SL_SIMD_NONE)
+    return sl_decode_steim_simd (1, input, inputlength, samplecount, output,
+                                 outputlength, msr, log);
+
   if (decodedebug)
     sl_log_rl (log, 1, 0, "Decoding %d Steim1 frames, swapflag: %d, srcname: %s\n",
-               maxframes, swapflag, (srcname) ? srcname : "");
+               maxframes, swapflag, sl_msr_srcname (msr, srcname, 0));
 
   for (frameidx = 0; frameidx < maxframes && samplecount > 0; frameidx++)
   {
@@ -370,7 +398,7 @@ decode_steim1 (int32_t *input, int inputlength, int samplecount,
   if (outputptr != output && *(outputptr - 1) != Xn)
   {
     sl_log_rl (log, 1, 0, "%s: Warning: Data integrity check for Steim1 failed, Last sample=%d, Xn=%d\n",
-               srcname, *(outputptr - 1), Xn);
+               sl_msr_srcname (msr, srcname, 0), *(outputptr - 1), Xn);
   }
 
   return (outputptr - output);
@@ -386,9 +414,10 @@ decode_steim1 (int32_t *input, int inputlength, int samplecount,
  ************************************************************************/
 static int
 decode_steim2 (int32_t *input, int inputlength, int samplecount,
-               int32_t *output, int outputlength, char *srcname,
+               int32_t *output, int outputlength, SLMSrecord *msr,
                int swapflag, SLlog *log)
 {
+  char srcname[50];            /* Source name, only formatted for messages */
   int32_t *outputptr = output; /* Pointer to next output sample location */
   uint32_t frame[16];          /* Frame, 16 x 32-bit quantities = 64 bytes */
   int32_t X0 = 0;              /* Forward integration constant, aka first sample */
@@ -415,9 +444,14 @@ decode_steim2 (int32_t *input, int inputlength, int samplecount,
   if (!input || !output || outputlength <= 0 || maxframes <= 0)
     return -1;
 
+  /* Use the vectorized decoder for big-endian data unless debugging */
+  if (swapflag && !decodedebug && sl_msr_simd (-1) != SL_SIMD_NONE)
+    return sl_decode_steim_simd (2, input, inputlength, samplecount, output,
+                                 outputlength, msr, log);
+
   if (decodedebug)
     sl_log_rl (log, 1, 0, "Decoding %d Steim2 frames, swapflag: %d, srcname: %s\n",
-               maxframes, swapflag, (srcname) ? srcname : "");
+               maxframes, swapflag, sl_msr_srcname (msr, srcname, 0));
 
   for (frameidx = 0; frameidx < maxframes && samplecount > 0; frameidx++)
   {
@@ -489,7 +523,8 @@ decode_steim2 (int32_t *input, int inputlength, int samplecount,
         switch (dnib)
         {
         case 0: /* nibble=10, dnib=00: Error, undefined value */
-          sl_log_rl (log, 2, 0, "%s: Impossible Steim2 dnib=00 for nibble=10\n", srcname);
+          sl_log_rl (log, 2, 0, "%s: Impossible Steim2 dnib=00 for nibble=10\n",
+                     sl_msr_srcname (msr, srcname, 0));
 
           return -1;
           break;
@@ -583,7 +618,8 @@ decode_steim2 (int32_t *input, int inputlength, int samplecount,
           break;
 
         case 3: /* nibble=11, dnib=11: Error, undefined value */
-          sl_log_rl (log, 2, 0, "%s: Impossible Steim2 dnib=11 for nibble=11\n", srcname);
+          sl_log_rl (log, 2, 0, "%s: Impossible Steim2 dnib=11 for nibble=11\n",
+                     sl_msr_srcname (msr, srcname, 0));
 
           return -1;
           break;
@@ -612,7 +648,7 @@ decode_steim2 (int32_t *input, int inputlength, int samplecount,
   if (outputptr != output && *(outputptr - 1) != Xn)
   {
     sl_log_rl (log, 1, 0, "%s: Warning: Data integrity check for Steim2 failed, Last sample=%d, Xn=%d\n",
-               srcname, *(outputptr - 1), Xn);
+               sl_msr_srcname (msr, srcname, 0), *(outputptr - 1), Xn);
   }
 
   return (outputptr - output);
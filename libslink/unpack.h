@@ -5,7 +5,7 @@
  *
  * Written by Chad Trabant, ORFEUS/EC-Project MEREDIAN
  *
- * modified: 2006.336
+ * modified: 2026.287
  ***************************************************************************/
 
 
@@ -19,6 +19,9 @@ extern "C" {
 #endif
 
 extern int sl_msr_unpack (SLlog * log, SLMSrecord * msr, int swapflag);
+extern int sl_decode_steim_simd (int steim, int32_t *input, int inputlength,
+                                 int samplecount, int32_t *output, int outputlength,
+                                 SLMSrecord *msr, SLlog *log);
 
 #ifdef __cplusplus
 }
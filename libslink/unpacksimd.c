@@ -0,0 +1,495 @@
+/************************************************************************
+ * Vectorized routines for decoding STEIM1 and STEIM2 encoded data.
+ *
+ * Each 64-byte frame is byte swapped into host order, the nibble
+ * coded 32-bit words are expanded into a buffer of differences with
+ * per-lane variable shifts and the differences are integrated with
+ * SIMD prefix sums.  The implementation is selected at run time
+ * from those supported by the CPU: SSE4.1 or AVX2 on x86 and NEON on
+ * 64-bit ARM.  The scalar routines in unpack.c are the reference,
+ * results of these routines are identical.
+ *
+ * Only little-endian hosts are supported, the caller must only use
+ * these routines for big-endian (i.e. swapped) data.
+ *
+ * modified: 2026.287
+ ************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+
+#include "libslink.h"
+#include "unpack.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SL_SIMD_X86 1
+#include <immintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_NEON) && !defined(__ARM_BIG_ENDIAN)
+#define SL_SIMD_ARM 1
+#include <arm_neon.h>
+#endif
+
+/* Size of the difference buffer, maximum differences in a frame
+ * (15 words x 7 differences) plus slack for full vector stores */
+#define STEIMDIFFS 128
+
+/* Decoding of a nibble coded 32-bit word:
+ * difference N = (word << lshift[N]) >> rshift, as arithmetic shift */
+typedef struct SteimCode_s
+{
+  int32_t count;     /* Number of differences, -1 if code is invalid */
+  int32_t rshift;    /* Right shift to sign extend differences */
+  int32_t lshift[8]; /* Left shift to move each difference to the top */
+  int32_t lmult[8];  /* Left shift as multiplier, 1 << lshift */
+} SteimCode;
+
+#define STMULT(A, B, C, D, E, F, G, H)                          \
+  {                                                             \
+    (int32_t)(1U << (A)), (int32_t)(1U << (B)),                 \
+    (int32_t)(1U << (C)), (int32_t)(1U << (D)),                 \
+    (int32_t)(1U << (E)), (int32_t)(1U << (F)),                 \
+    (int32_t)(1U << (G)), (int32_t)(1U << (H))                  \
+  }
+#define STCODE(COUNT, WIDTH, A, B, C, D, E, F, G)                      \
+  {                                                                    \
+    COUNT, 32 - (WIDTH), {A, B, C, D, E, F, G, 0},                     \
+    STMULT (A, B, C, D, E, F, G, 0)                                    \
+  }
+#define STNONE STCODE (0, 32, 0, 0, 0, 0, 0, 0, 0)
+#define STBAD STCODE (-1, 32, 0, 0, 0, 0, 0, 0, 0)
+#define ST4X8 STCODE (4, 8, 0, 8, 16, 24, 0, 0, 0)
+
+/* Steim1 codes, indexed by nibble */
+static const SteimCode steim1codes[4] = {
+    STNONE,                                /* 00: Special flag */
+    ST4X8,                                 /* 01: Four 1-byte differences */
+    STCODE (2, 16, 0, 16, 0, 0, 0, 0, 0),  /* 10: Two 2-byte differences */
+    STCODE (1, 32, 0, 0, 0, 0, 0, 0, 0)};  /* 11: One 4-byte difference */
+
+/* Steim2 codes, indexed by nibble << 2 | dnib */
+static const SteimCode steim2codes[16] = {
+    STNONE, STNONE, STNONE, STNONE,            /* 00: Special flag */
+    ST4X8, ST4X8, ST4X8, ST4X8,                /* 01: Four 1-byte differences */
+    STBAD,                                     /* 10,00: Undefined */
+    STCODE (1, 30, 2, 0, 0, 0, 0, 0, 0),       /* 10,01: One 30-bit difference */
+    STCODE (2, 15, 2, 17, 0, 0, 0, 0, 0),      /* 10,10: Two 15-bit differences */
+    STCODE (3, 10, 2, 12, 22, 0, 0, 0, 0),     /* 10,11: Three 10-bit differences */
+    STCODE (5, 6, 2, 8, 14, 20, 26, 0, 0),     /* 11,00: Five 6-bit differences */
+    STCODE (6, 5, 2, 7, 12, 17, 22, 27, 0),    /* 11,01: Six 5-bit differences */
+    STCODE (7, 4, 4, 8, 12, 16, 20, 24, 28),   /* 11,10: Seven 4-bit differences */
+    STBAD};                                    /* 11,11: Undefined */
+
+/* Steim code of word W given the nibbles, the dnib is only used for Steim2 */
+#define STEIMCODE(STEIM, NIBBLES, WORDS, W)                       \
+  (((STEIM) == 1) ? (((NIBBLES) >> (30 - 2 * (W))) & 0x3)        \
+                  : (((((NIBBLES) >> (30 - 2 * (W))) & 0x3) << 2) | ((WORDS)[W] >> 30)))
+
+/* Expand the differences of a frame, returns count or -1 on bad code */
+typedef int (*SteimExpand) (const int32_t *input, int steim, int startword,
+                            int maxdiffs, uint32_t *words, int32_t *diff,
+                            int *badcode);
+/* Integrate differences in place, returns last sample */
+typedef int32_t (*SteimIntegrate) (int32_t *diff, int count, int32_t last);
+
+typedef struct SteimISA_s
+{
+  int level;
+  SteimExpand expand;
+  SteimIntegrate integrate;
+} SteimISA;
+
+/* Scalar decoders, i.e. no vectorized implementation */
+static const SteimISA steimscalar = {SL_SIMD_NONE, NULL, NULL};
+
+/* Selected implementation, NULL until selected.  A single pointer so
+ * that concurrent selection by multiple threads is harmless */
+static const SteimISA *volatile steimisa = NULL;
+
+
+#if defined(SL_SIMD_X86)
+/************************************************************************
+ * SSE4.1 implementation, variable left shifts are done by multiplying.
+ ************************************************************************/
+__attribute__ ((target ("sse4.1"))) static int
+expand_sse41 (const int32_t *input, int steim, int startword, int maxdiffs,
+              uint32_t *words, int32_t *diff, int *badcode)
+{
+  const __m128i bswap = _mm_set_epi8 (12, 13, 14, 15, 8, 9, 10, 11,
+                                      4, 5, 6, 7, 0, 1, 2, 3);
+  const SteimCode *codes = (steim == 1) ? steim1codes : steim2codes;
+  const SteimCode *sc;
+  __m128i word;
+  __m128i rshift;
+  uint32_t nibbles;
+  int ndiffs = 0;
+  int widx;
+
+  /* Swap each 32-bit quantity of the frame to host order */
+  for (widx = 0; widx < 4; widx++)
+  {
+    word = _mm_loadu_si128 ((const __m128i *)input + widx);
+    _mm_storeu_si128 ((__m128i *)words + widx, _mm_shuffle_epi8 (word, bswap));
+  }
+
+  nibbles = words[0];
+
+  for (widx = startword; widx < 16 && ndiffs < maxdiffs; widx++)
+  {
+    sc = &codes[STEIMCODE (steim, nibbles, words, widx)];
+
+    if (sc->count <= 0)
+    {
+      if (sc->count < 0)
+      {
+        *badcode = STEIMCODE (steim, nibbles, words, widx);
+        return -1;
+      }
+
+      continue;
+    }
+
+    word   = _mm_set1_epi32 ((int32_t)words[widx]);
+    rshift = _mm_cvtsi32_si128 (sc->rshift);
+
+    _mm_storeu_si128 ((__m128i *)(diff + ndiffs),
+                      _mm_sra_epi32 (_mm_mullo_epi32 (word, _mm_loadu_si128 ((const __m128i *)sc->lmult)),
+                                     rshift));
+
+    if (sc->count > 4)
+      _mm_storeu_si128 ((__m128i *)(diff + ndiffs + 4),
+                        _mm_sra_epi32 (_mm_mullo_epi32 (word, _mm_loadu_si128 ((const __m128i *)(sc->lmult + 4))),
+                                       rshift));
+
+    ndiffs += sc->count;
+  }
+
+  return ndiffs;
+} /* End of expand_sse41() */
+
+__attribute__ ((target ("sse4.1"))) static int32_t
+integrate_sse41 (int32_t *diff, int count, int32_t last)
+{
+  __m128i carry = _mm_set1_epi32 (last);
+  __m128i sum;
+  int idx;
+
+  for (idx = 0; idx < count; idx += 4)
+  {
+    sum   = _mm_loadu_si128 ((const __m128i *)(diff + idx));
+    sum   = _mm_add_epi32 (sum, _mm_slli_si128 (sum, 4));
+    sum   = _mm_add_epi32 (sum, _mm_slli_si128 (sum, 8));
+    sum   = _mm_add_epi32 (sum, carry);
+    carry = _mm_shuffle_epi32 (sum, 0xFF);
+    _mm_storeu_si128 ((__m128i *)(diff + idx), sum);
+  }
+
+  return diff[count - 1];
+} /* End of integrate_sse41() */
+
+/************************************************************************
+ * AVX2 implementation, all differences of a word in one vector.
+ ************************************************************************/
+__attribute__ ((target ("avx2"))) static int
+expand_avx2 (const int32_t *input, int steim, int startword, int maxdiffs,
+             uint32_t *words, int32_t *diff, int *badcode)
+{
+  const __m256i bswap = _mm256_set_epi8 (12, 13, 14, 15, 8, 9, 10, 11,
+                                         4, 5, 6, 7, 0, 1, 2, 3,
+                                         12, 13, 14, 15, 8, 9, 10, 11,
+                                         4, 5, 6, 7, 0, 1, 2, 3);
+  const SteimCode *codes = (steim == 1) ? steim1codes : steim2codes;
+  const SteimCode *sc;
+  __m256i word;
+  uint32_t nibbles;
+  int ndiffs = 0;
+  int widx;
+
+  /* Swap each 32-bit quantity of the frame to host order */
+  for (widx = 0; widx < 2; widx++)
+  {
+    word = _mm256_loadu_si256 ((const __m256i *)input + widx);
+    _mm256_storeu_si256 ((__m256i *)words + widx, _mm256_shuffle_epi8 (word, bswap));
+  }
+
+  nibbles = words[0];
+
+  for (widx = startword; widx < 16 && ndiffs < maxdiffs; widx++)
+  {
+    sc = &codes[STEIMCODE (steim, nibbles, words, widx)];
+
+    if (sc->count <= 0)
+    {
+      if (sc->count < 0)
+      {
+        *badcode = STEIMCODE (steim, nibbles, words, widx);
+        return -1;
+      }
+
+      continue;
+    }
+
+    word = _mm256_sllv_epi32 (_mm256_set1_epi32 ((int32_t)words[widx]),
+                              _mm256_loadu_si256 ((const __m256i *)sc->lshift));
+
+    _mm256_storeu_si256 ((__m256i *)(diff + ndiffs),
+                         _mm256_srav_epi32 (word, _mm256_set1_epi32 (sc->rshift)));
+
+    ndiffs += sc->count;
+  }
+
+  return ndiffs;
+} /* End of expand_avx2() */
+
+__attribute__ ((target ("avx2"))) static int32_t
+integrate_avx2 (int32_t *diff, int count, int32_t last)
+{
+  const __m256i top = _mm256_set1_epi32 (7);
+  __m256i carry     = _mm256_set1_epi32 (last);
+  __m256i sum;
+  __m256i low;
+  int idx;
+
+  for (idx = 0; idx < count; idx += 8)
+  {
+    /* Prefix sums within each 128-bit lane */
+    sum = _mm256_loadu_si256 ((const __m256i *)(diff + idx));
+    sum = _mm256_add_epi32 (sum, _mm256_slli_si256 (sum, 4));
+    sum = _mm256_add_epi32 (sum, _mm256_slli_si256 (sum, 8));
+
+    /* Add the total of the low lane to the high lane */
+    low = _mm256_shuffle_epi32 (sum, 0xFF);
+    sum = _mm256_add_epi32 (sum, _mm256_permute2x128_si256 (low, low, 0x08));
+
+    sum   = _mm256_add_epi32 (sum, carry);
+    carry = _mm256_permutevar8x32_epi32 (sum, top);
+    _mm256_storeu_si256 ((__m256i *)(diff + idx), sum);
+  }
+
+  return diff[count - 1];
+} /* End of integrate_avx2() */
+
+static const SteimISA steimsse41 = {SL_SIMD_SSE41, expand_sse41, integrate_sse41};
+static const SteimISA steimavx2  = {SL_SIMD_AVX2, expand_avx2, integrate_avx2};
+#endif /* SL_SIMD_X86 */
+
+
+#if defined(SL_SIMD_ARM)
+/************************************************************************
+ * NEON implementation, right shifts are done by negative left shifts.
+ ************************************************************************/
+static int
+expand_neon (const int32_t *input, int steim, int startword, int maxdiffs,
+             uint32_t *words, int32_t *diff, int *badcode)
+{
+  const SteimCode *codes = (steim == 1) ? steim1codes : steim2codes;
+  const SteimCode *sc;
+  uint32x4_t word;
+  int32x4_t rshift;
+  uint32_t nibbles;
+  int ndiffs = 0;
+  int widx;
+
+  /* Swap each 32-bit quantity of the frame to host order */
+  for (widx = 0; widx < 4; widx++)
+    vst1q_u8 ((uint8_t *)(words + 4 * widx),
+              vrev32q_u8 (vld1q_u8 ((const uint8_t *)(input + 4 * widx))));
+
+  nibbles = words[0];
+
+  for (widx = startword; widx < 16 && ndiffs < maxdiffs; widx++)
+  {
+    sc = &codes[STEIMCODE (steim, nibbles, words, widx)];
+
+    if (sc->count <= 0)
+    {
+      if (sc->count < 0)
+      {
+        *badcode = STEIMCODE (steim, nibbles, words, widx);
+        return -1;
+      }
+
+      continue;
+    }
+
+    word   = vdupq_n_u32 (words[widx]);
+    rshift = vdupq_n_s32 (-sc->rshift);
+
+    vst1q_s32 (diff + ndiffs,
+               vshlq_s32 (vreinterpretq_s32_u32 (vshlq_u32 (word, vld1q_s32 (sc->lshift))), rshift));
+
+    if (sc->count > 4)
+      vst1q_s32 (diff + ndiffs + 4,
+                 vshlq_s32 (vreinterpretq_s32_u32 (vshlq_u32 (word, vld1q_s32 (sc->lshift + 4))), rshift));
+
+    ndiffs += sc->count;
+  }
+
+  return ndiffs;
+} /* End of expand_neon() */
+
+static int32_t
+integrate_neon (int32_t *diff, int count, int32_t last)
+{
+  const int32x4_t zero = vdupq_n_s32 (0);
+  int32x4_t carry      = vdupq_n_s32 (last);
+  int32x4_t sum;
+  int idx;
+
+  for (idx = 0; idx < count; idx += 4)
+  {
+    sum   = vld1q_s32 (diff + idx);
+    sum   = vaddq_s32 (sum, vextq_s32 (zero, sum, 3));
+    sum   = vaddq_s32 (sum, vextq_s32 (zero, sum, 2));
+    sum   = vaddq_s32 (sum, carry);
+    carry = vdupq_laneq_s32 (sum, 3);
+    vst1q_s32 (diff + idx, sum);
+  }
+
+  return diff[count - 1];
+} /* End of integrate_neon() */
+
+static const SteimISA steimneon = {SL_SIMD_NEON, expand_neon, integrate_neon};
+#endif /* SL_SIMD_ARM */
+
+
+/************************************************************************
+ * sl_msr_simd:
+ *
+ * Control the use of the vectorized Steim decoders.  If flag is 0
+ * the scalar decoders are used, if flag is 1 the best implementation
+ * supported by the CPU is selected and if flag is -1 the current
+ * selection is not changed.  The implementation is selected on first
+ * use unless disabled.
+ *
+ * The selection is shared by all threads, changing it while other
+ * threads are decoding data is not supported.
+ *
+ * Returns the implementation in use, one of the SL_SIMD_* values.
+ ************************************************************************/
+int
+sl_msr_simd (int flag)
+{
+  const SteimISA *isa = &steimscalar;
+
+  if (flag < 0)
+  {
+    if ((isa = steimisa) != NULL)
+      return isa->level;
+
+    isa  = &steimscalar;
+    flag = 1;
+  }
+
+  if (flag > 0)
+  {
+#if defined(SL_SIMD_X86)
+    __builtin_cpu_init ();
+
+    if (__builtin_cpu_supports ("avx2"))
+      isa = &steimavx2;
+    else if (__builtin_cpu_supports ("sse4.1"))
+      isa = &steimsse41;
+#elif defined(SL_SIMD_ARM)
+    isa = &steimneon;
+#endif
+  }
+
+  steimisa = isa;
+
+  return isa->level;
+} /* End of sl_msr_simd() */
+
+/************************************************************************
+ * sl_decode_steim_simd:
+ *
+ * Decode Steim1 or Steim2 (steim = 1 or 2) big-endian encoded
+ * miniSEED data and place in supplied buffer as 32-bit integers
+ * using the selected vectorized implementation, see sl_msr_simd().
+ *
+ * Return number of samples in output buffer on success, -1 on error.
+ ************************************************************************/
+int
+sl_decode_steim_simd (int steim, int32_t *input, int inputlength, int samplecount,
+                      int32_t *output, int outputlength, SLMSrecord *msr,
+                      SLlog *log)
+{
+  char srcname[50];            /* Source name, only formatted for messages */
+  const SteimISA *isa;
+  int32_t *outputptr = output; /* Pointer to next output sample location */
+  int32_t diff[STEIMDIFFS];    /* Differences of a frame */
+  uint32_t words[16];          /* Frame in host byte order */
+  int32_t X0    = 0;           /* Forward integration constant, aka first sample */
+  int32_t Xn    = 0;           /* Reverse integration constant, aka last sample */
+  int32_t last  = 0;           /* Last sample decoded */
+  int maxframes = inputlength / 64;
+  int frameidx;
+  int badcode = 0;
+  int ndiffs;
+  int count;
+
+  if (sl_msr_simd (-1) == SL_SIMD_NONE || (isa = steimisa)->expand == NULL)
+    return -1;
+
+  if (inputlength <= 0)
+    return 0;
+
+  if (!input || !output || outputlength <= 0 || maxframes <= 0)
+    return -1;
+
+  /* Vector loads may read past the differences of a frame */
+  memset (diff, 0, sizeof (diff));
+
+  for (frameidx = 0; frameidx < maxframes && samplecount > 0; frameidx++)
+  {
+    /* First frame: skip nibbles, X0, and Xn.  Subsequent frames: skip nibbles */
+    ndiffs = isa->expand (input + (16 * frameidx), steim, (frameidx == 0) ? 3 : 1,
+                          samplecount, words, diff, &badcode);
+
+    if (ndiffs < 0)
+    {
+      if (badcode == 8)
+        sl_log_rl (log, 2, 0, "%s: Impossible Steim2 dnib=00 for nibble=10\n",
+                   sl_msr_srcname (msr, srcname, 0));
+      else
+        sl_log_rl (log, 2, 0, "%s: Impossible Steim2 dnib=11 for nibble=11\n",
+                   sl_msr_srcname (msr, srcname, 0));
+
+      return -1;
+    }
+
+    /* Save forward integration constant (X0) and reverse integration constant (Xn) */
+    if (frameidx == 0)
+    {
+      X0 = (int32_t)words[1];
+      Xn = (int32_t)words[2];
+    }
+
+    if (ndiffs == 0)
+      continue;
+
+    count = (ndiffs < samplecount) ? ndiffs : samplecount;
+
+    /* Ignore first difference, instead store X0 */
+    if (outputptr == output)
+    {
+      diff[0] = X0;
+      last    = 0;
+    }
+
+    last = isa->integrate (diff, count, last);
+
+    memcpy (outputptr, diff, count * sizeof (int32_t));
+
+    outputptr += count;
+    samplecount -= count;
+  } /* Done looping over frames */
+
+  /* Check data integrity by comparing last sample to Xn (reverse integration constant) */
+  if (outputptr != output && *(outputptr - 1) != Xn)
+  {
+    sl_log_rl (log, 1, 0, "%s: Warning: Data integrity check for Steim%d failed, Last sample=%d, Xn=%d\n",
+               sl_msr_srcname (msr, srcname, 0), steim, *(outputptr - 1), Xn);
+  }
+
+  return (outputptr - output);
+} /* End of sl_decode_steim_simd() */
@@ -13,34 +13,116 @@
 
 #include "dsarchive.h"
 
+/* The archive state is kept per thread, each archive worker thread
+ * writes the files of its own streams */
+#if defined(SLP_WIN)
+#define ARCH_TLS __declspec(thread)
+#else
+#define ARCH_TLS __thread
+#endif
+
+/***************************************************************************
+ * arch_setbuffersize():
+ * Set the size of the per-stream write buffer used by all archive
+ * types, 0 disables buffering.  Buffered records are written when a
+ * buffer is full, when flushed or when the archive is shut down.
+ ***************************************************************************/
+void
+arch_setbuffersize (int bufsize)
+{
+  ds_setbuffersize (bufsize);
+} /* End of arch_setbuffersize() */
+
+/***************************************************************************
+ * arch_setasync():
+ * Set the asynchronous I/O backend used to write archive files by all
+ * archive types: "uring" for io_uring, falling back to I/O threads if
+ * not available, "threads" for a pool of I/O threads or "none" to
+ * write directly.
+ *
+ * Returns 0 on success, -1 on an unknown backend.
+ ***************************************************************************/
+int
+arch_setasync (const char *backend)
+{
+  if (!strcmp (backend, "uring"))
+    ds_setasync (DSA_URING);
+  else if (!strcmp (backend, "threads"))
+    ds_setasync (DSA_THREADS);
+  else if (!strcmp (backend, "none"))
+    ds_setasync (DSA_NONE);
+  else
+    return -1;
+
+  return 0;
+} /* End of arch_setasync() */
+
+/***************************************************************************
+ * arch_setprealloc():
+ * Set the preallocation of newly opened archive files by all archive
+ * types: "fallocate" to reserve space beyond the end of each file,
+ * "mmap" to extend each file and append through a mapped window or
+ * "none" to let files grow with each write.  Files are truncated to
+ * their records when closed.
+ *
+ * Returns 0 on success, -1 on an unknown or unsupported mode.
+ ***************************************************************************/
+int
+arch_setprealloc (const char *mode)
+{
+  if (!strcmp (mode, "fallocate"))
+    return ds_setprealloc (DS_PREALLOC_KEEP);
+  else if (!strcmp (mode, "mmap"))
+    return ds_setprealloc (DS_PREALLOC_MMAP);
+  else if (!strcmp (mode, "none"))
+    return ds_setprealloc (DS_PREALLOC_NONE);
+
+  return -1;
+} /* End of arch_setprealloc() */
+
 /***************************************************************************
  * arch_streamproc():
  * Save MiniSEED records in a custom directory/file structure.  The
  * appropriate directories and files are created if nesecessary.  If
  * files already exist they are appended to.  If both 'archformat' and
- * 'msr' are NULL then ds_shutdown() will be called to close all open files
- * and free all associated memory.
+ * 'msh' are NULL then ds_shutdown() will be called to close all open files
+ * and free all associated memory.  If only 'msh' is NULL
+ * then all buffered records are written.
  *
  * Returns 0 on success, -1 on error.
  ***************************************************************************/
 int
-arch_streamproc (const char *archformat, const SLMSrecord *msr, int reclen,
+arch_streamproc (const char *archformat, SLMSheader *msh, int reclen,
                  int type, int idletimeout)
 {
-  static DataStream *streamroot = NULL;
-  char format[400];
+  static ARCH_TLS DataStream *streamroot = NULL;
+  static ARCH_TLS DSFormat *format       = NULL;
 
   /* Check if this is a call to shut everything down */
-  if (archformat == NULL && msr == NULL)
+  if (archformat == NULL && msh == NULL)
   {
     sl_log (0, 1, "Shutting down stream archiving\n");
     ds_streamproc (&streamroot, NULL, NULL, 0, 0, 0);
+    ds_freeformat (format);
+    streamroot = NULL;
+    format     = NULL;
     return 0;
   }
 
-  strncpy (format, archformat, sizeof (format) - 1);
+  /* Check if this is a call to flush buffered records */
+  if (msh == NULL)
+    return (format) ? ds_streamproc (&streamroot, format, NULL, 0, 0, 0) : 0;
+
+  /* Compile the path format on first use or if it has changed */
+  if (format == NULL || strcmp (format->pathformat, archformat))
+  {
+    ds_freeformat (format);
+
+    if ((format = ds_compileformat (archformat)) == NULL)
+      return -1;
+  }
 
-  return ds_streamproc (&streamroot, format, msr, reclen, type, idletimeout);
+  return ds_streamproc (&streamroot, format, msh, reclen, type, idletimeout);
 } /* End of arch_streamproc() */
 
 /***************************************************************************
@@ -48,63 +130,95 @@ arch_streamproc (const char *archformat, const SLMSrecord *msr, int reclen,
  * Save MiniSEED records in an SDS directory/file structure.  The
  * appropriate directories and files are created if nesecessary.  If
  * files already exist they are appended to.  If both 'basedir' and
- * 'msr' are NULL then ds_shutdown() will be called to close all open files
- * and free all associated memory.
+ * 'msh' are NULL then ds_shutdown() will be called to close all open files
+ * and free all associated memory.  If only 'msh' is NULL
+ * then all buffered records are written.
  *
  * Returns 0 on success, -1 on error.
  ***************************************************************************/
 int
-sds_streamproc (const char *basedir, const SLMSrecord *msr, int reclen,
+sds_streamproc (const char *basedir, SLMSheader *msh, int reclen,
                 int type, int idletimeout)
 {
-  static DataStream *streamroot = NULL;
-  char format[400];
+  static ARCH_TLS DataStream *streamroot = NULL;
+  static ARCH_TLS DSFormat *format       = NULL;
+  char pathformat[400];
 
   /* Check if this is a call to shut everything down */
-  if (basedir == NULL && msr == NULL)
+  if (basedir == NULL && msh == NULL)
   {
     sl_log (0, 1, "Shutting down SDS archiving\n");
     ds_streamproc (&streamroot, NULL, NULL, 0, 0, 0);
+    ds_freeformat (format);
+    streamroot = NULL;
+    format     = NULL;
     return 0;
   }
 
-  snprintf (format, sizeof (format),
-            "%s/%%Y/%%n/%%s/%%c.%%t/%%n.%%s.%%l.%%c.%%t.%%Y.%%j",
-            basedir);
+  /* Check if this is a call to flush buffered records */
+  if (msh == NULL)
+    return (format) ? ds_streamproc (&streamroot, format, NULL, 0, 0, 0) : 0;
+
+  /* Compile the path format on first use, the base directory is fixed */
+  if (format == NULL)
+  {
+    snprintf (pathformat, sizeof (pathformat),
+              "%s/%%Y/%%n/%%s/%%c.%%t/%%n.%%s.%%l.%%c.%%t.%%Y.%%j",
+              basedir);
 
-  return ds_streamproc (&streamroot, format, msr, reclen, type, idletimeout);
+    if ((format = ds_compileformat (pathformat)) == NULL)
+      return -1;
+  }
+
+  return ds_streamproc (&streamroot, format, msh, reclen, type, idletimeout);
 } /* End of sds_streamproc() */
 
 /***************************************************************************
  * bud_streamproc():
  * Save MiniSEED records in a BUD directory/file structure.  The
  * appropriate directories and files are created if nesecessary.  If
- * files already exist they are appended to.  If both 'basedir' and 'msr'
+ * files already exist they are appended to.  If both 'basedir' and 'msh'
  * are NULL then ds_shutdown() will be called to close all open files and
- * free all associated memory.
+ * free all associated memory.  If only 'msh' is NULL
+ * then all buffered records are written.
  *
  * Returns 0 on success, -1 on error.
  ***************************************************************************/
 int
-bud_streamproc (const char *basedir, const SLMSrecord *msr, int reclen,
+bud_streamproc (const char *basedir, SLMSheader *msh, int reclen,
                 int idletimeout)
 {
-  static DataStream *streamroot = NULL;
-  char format[400];
+  static ARCH_TLS DataStream *streamroot = NULL;
+  static ARCH_TLS DSFormat *format       = NULL;
+  char pathformat[400];
 
   /* Check if this is a call to shut everything down */
-  if (basedir == NULL && msr == NULL)
+  if (basedir == NULL && msh == NULL)
   {
     sl_log (0, 1, "Shutting down BUD archiving\n");
     ds_streamproc (&streamroot, NULL, NULL, 0, 0, 0);
+    ds_freeformat (format);
+    streamroot = NULL;
+    format     = NULL;
     return 0;
   }
 
-  snprintf (format, sizeof (format),
-            "%s/%%n/%%s/%%s.%%n.%%l.%%c.%%Y.%%j",
-            basedir);
+  /* Check if this is a call to flush buffered records */
+  if (msh == NULL)
+    return (format) ? ds_streamproc (&streamroot, format, NULL, 0, 0, 0) : 0;
+
+  /* Compile the path format on first use, the base directory is fixed */
+  if (format == NULL)
+  {
+    snprintf (pathformat, sizeof (pathformat),
+              "%s/%%n/%%s/%%s.%%n.%%l.%%c.%%Y.%%j",
+              basedir);
 
-  return ds_streamproc (&streamroot, format, msr, reclen, SLDATA, idletimeout);
+    if ((format = ds_compileformat (pathformat)) == NULL)
+      return -1;
+  }
+
+  return ds_streamproc (&streamroot, format, msh, reclen, SLDATA, idletimeout);
 } /* End of bud_streamproc() */
 
 /***************************************************************************
@@ -112,39 +226,65 @@ bud_streamproc (const char *basedir, const SLMSrecord *msr, int reclen,
  * Save MiniSEED records in an old style SeisComP/datalog
  * directory/file structure.  The appropriate directories and files
  * are created if nesecessary.  If files already exist they are
- * appended to.  If both 'basedir' and 'msr' are NULL then
+ * appended to.  If both 'basedir' and 'msh' are NULL then
  * ds_shutdown() will be called to close all open files and free all
- * associated memory.
+ * associated memory.  If only 'msh' is NULL
+ * then all buffered records are written.
  *
  * Returns 0 on success, -1 on error.
  ***************************************************************************/
 int
-dlog_streamproc (const char *basedir, const SLMSrecord *msr, int reclen,
+dlog_streamproc (const char *basedir, SLMSheader *msh, int reclen,
                  int type, int idletimeout)
 {
-  static DataStream *streamroot = NULL;
-  char format[400];
+  static ARCH_TLS DataStream *streamroot = NULL;
+  static ARCH_TLS DSFormat *format       = NULL;
+  static ARCH_TLS DSFormat *locformat    = NULL;
+  char pathformat[400];
 
   /* Check if this is a call to shut everything down */
-  if (basedir == NULL && msr == NULL)
+  if (basedir == NULL && msh == NULL)
   {
     sl_log (0, 1, "Shutting down SC/datalog archiving\n");
     ds_streamproc (&streamroot, NULL, NULL, 0, 0, 0);
+    ds_freeformat (format);
+    ds_freeformat (locformat);
+    streamroot = NULL;
+    format     = NULL;
+    locformat  = NULL;
     return 0;
   }
 
-  if (!strncmp (msr->fsdh.location, "  ", 2))
-  { /* No location code */
-    snprintf (format, sizeof (format),
+  /* Check if this is a call to flush buffered records */
+  if (msh == NULL)
+    return (format) ? ds_streamproc (&streamroot, format, NULL, 0, 0, 0) : 0;
+
+  /* Compile both path formats on first use, the base directory is fixed */
+  if (format == NULL)
+  {
+    /* No location code */
+    snprintf (pathformat, sizeof (pathformat),
               "%s/%%s/%%c.%%t/%%s.%%n.%%c.%%t.%%Y.%%j.#H#M",
               basedir);
-  }
-  else
-  { /* Location code present */
-    snprintf (format, sizeof (format),
+
+    if ((format = ds_compileformat (pathformat)) == NULL)
+      return -1;
+
+    /* Location code present */
+    snprintf (pathformat, sizeof (pathformat),
               "%s/%%s/%%l.%%c.%%t/%%s.%%n.%%c.%%t.%%Y.%%j.#H#M",
               basedir);
+
+    if ((locformat = ds_compileformat (pathformat)) == NULL)
+    {
+      ds_freeformat (format);
+      format = NULL;
+      return -1;
+    }
   }
 
-  return ds_streamproc (&streamroot, format, msr, reclen, type, idletimeout);
+  if (!strncmp (msh->fsdh->location, "  ", 2))
+    return ds_streamproc (&streamroot, format, msh, reclen, type, idletimeout);
+  else
+    return ds_streamproc (&streamroot, locformat, msh, reclen, type, idletimeout);
 } /* End of dlog_streamproc() */
@@ -4,12 +4,15 @@
 
 #include <libslink.h>
 
-extern int  arch_streamproc (const char *archformat, const SLMSrecord *msr,
+extern void arch_setbuffersize (int bufsize);
+extern int  arch_setasync (const char *backend);
+extern int  arch_setprealloc (const char *mode);
+extern int  arch_streamproc (const char *archformat, SLMSheader *msh,
 			     int reclen, int type, int idletimeout);
-extern int  sds_streamproc (const char *sdsdir, const SLMSrecord *msr,
+extern int  sds_streamproc (const char *sdsdir, SLMSheader *msh,
 			    int reclen, int type, int idletimeout);
-extern int  bud_streamproc (const char *buddir, const SLMSrecord *msr,
+extern int  bud_streamproc (const char *buddir, SLMSheader *msh,
 			    int reclen, int idletimeout);
-extern int  dlog_streamproc (const char *sdsdir, const SLMSrecord *msr,
+extern int  dlog_streamproc (const char *sdsdir, SLMSheader *msh,
 			     int reclen, int type, int idletimeout);
 #endif
@@ -0,0 +1,585 @@
+/***************************************************************************
+ * archqueue.c
+ *
+ * A bounded queue of packets handed from the network thread to archive
+ * worker threads.
+ *
+ * The queue is a ring of packet slots with a single producer and
+ * multiple consumers.  The producer publishes the position of the
+ * next free slot and each worker advances its own position over every
+ * slot, handling only the packets of its shard.  Packets are sharded by
+ * network and station code so that the records of a stream are always
+ * written by the same worker, in the order they were received.  A slot
+ * is reused once every worker has passed it.
+ *
+ * Positions are exchanged with atomic operations, the mutex and
+ * condition variables are only used to sleep when the queue is empty
+ * or full.  Each worker also publishes the position up to which its
+ * records have been written to files, i.e. including buffered writes
+ * (see aq_durable()).
+ *
+ * modified: 2026.287
+ ***************************************************************************/
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <libslink.h>
+
+#include "archqueue.h"
+
+#ifndef SLP_WIN
+#include <pthread.h>
+#include <sys/time.h>
+
+/* A packet slot, the record follows the slot header */
+typedef struct AQSlot_s
+{
+  int     packet_type;
+  int     seqnum;
+  int     packet_size;
+  int     archflag;
+  int     dumpflag;
+  int     shard;
+}
+AQSlot;
+
+/* A worker thread, padded to avoid sharing cache lines */
+typedef struct AQWorker_s
+{
+  struct ArchQueue_s *queue;
+  pthread_t thread;
+  int     id;
+  int64_t position;      /* Slots before this position were handled */
+  int64_t durable;       /* Slots before this position were written */
+  int64_t packets;       /* Number of packets handled */
+  char    pad[64];
+}
+AQWorker;
+
+struct ArchQueue_s
+{
+  char   *slots;         /* Packet slots, 'slotsize' bytes each */
+  int     numslots;      /* Number of slots, a power of 2 */
+  int     slotsize;
+  int     recsize;       /* Maximum record size */
+  int64_t head;          /* Position of the next slot to fill */
+  int     numworkers;
+  AQWorker *workers;
+  AQHandler handler;
+  AQCallback flush;
+  AQCallback shutdown;
+  int     flushage;      /* Flush interval in milliseconds, 0 to disable */
+  int     stop;          /* Flag: stop workers once the queue is empty */
+  int     sleepers;      /* Number of workers waiting for packets */
+  int     fullwait;      /* Flag: producer is waiting for a free slot */
+  pthread_mutex_t lock;
+  pthread_cond_t  dataready;
+  pthread_cond_t  spaceready;
+
+  /* Statistics, only modified by the producer */
+  int64_t highwater;     /* Maximum number of queued packets */
+  int64_t fullwaits;     /* Number of waits for a free slot */
+  double  fullwaittime;  /* Total time waiting for free slots */
+};
+
+/* Functions internal to this source file */
+static void *aq_worker (void *arg);
+static AQSlot *aq_reserve (ArchQueue *queue);
+static void aq_publish (ArchQueue *queue);
+static int64_t aq_minposition (ArchQueue *queue);
+static void aq_wait (pthread_cond_t *cond, pthread_mutex_t *lock, int msec);
+
+/***************************************************************************
+ * aq_new():
+ * Create an archive queue of 'numslots' packet slots, rounded up to a
+ * power of 2, for records of up to 'recsize' bytes and start
+ * 'numworkers' worker threads.
+ *
+ * The workers call 'handler' for each packet, 'flush' every
+ * 'flushage' milliseconds to write buffered records (if 'flushage' is
+ * greater than 0) and 'shutdown' when stopped.
+ *
+ * Returns a pointer to the queue on success and NULL on error.
+ ***************************************************************************/
+ArchQueue *
+aq_new (int numworkers, int numslots, int recsize, AQHandler handler,
+        AQCallback flush, AQCallback shutdown, int flushage)
+{
+  ArchQueue *queue;
+  int idx;
+
+  if (numworkers <= 0 || numslots <= 0 || recsize <= 0)
+  {
+    sl_log (2, 0, "aq_new(): invalid queue parameters\n");
+    return NULL;
+  }
+
+  if ((queue = (ArchQueue *)calloc (1, sizeof (ArchQueue))) == NULL)
+  {
+    sl_log (2, 0, "aq_new(): error allocating memory\n");
+    return NULL;
+  }
+
+  for (queue->numslots = 1; queue->numslots < numslots; queue->numslots *= 2)
+    ;
+
+  queue->recsize    = recsize;
+  queue->slotsize   = (sizeof (AQSlot) + recsize + 63) & ~63;
+  queue->numworkers = numworkers;
+  queue->handler    = handler;
+  queue->flush      = flush;
+  queue->shutdown   = shutdown;
+  queue->flushage   = (flush && flushage > 0) ? flushage : 0;
+
+  queue->slots   = (char *)malloc ((size_t)queue->numslots * queue->slotsize);
+  queue->workers = (AQWorker *)calloc (numworkers, sizeof (AQWorker));
+
+  if (queue->slots == NULL || queue->workers == NULL)
+  {
+    sl_log (2, 0, "aq_new(): error allocating memory\n");
+    free (queue->slots);
+    free (queue->workers);
+    free (queue);
+    return NULL;
+  }
+
+  pthread_mutex_init (&queue->lock, NULL);
+  pthread_cond_init (&queue->dataready, NULL);
+  pthread_cond_init (&queue->spaceready, NULL);
+
+  for (idx = 0; idx < numworkers; idx++)
+  {
+    queue->workers[idx].queue = queue;
+    queue->workers[idx].id    = idx;
+
+    if (pthread_create (&queue->workers[idx].thread, NULL, aq_worker,
+                        &queue->workers[idx]))
+    {
+      sl_log (2, 0, "aq_new(): cannot create worker thread: %s\n", strerror (errno));
+
+      /* Stop the workers already started */
+      queue->numworkers = idx;
+      aq_stop (queue);
+      return NULL;
+    }
+  }
+
+  return queue;
+} /* End of aq_new() */
+
+/***************************************************************************
+ * aq_put():
+ * Copy a packet into the next free slot of the queue and make it
+ * available to the workers.  If the queue is full this waits until a
+ * slot is free, applying backpressure to the network thread.
+ *
+ * Returns 0 on success and -1 on error.
+ ***************************************************************************/
+int
+aq_put (ArchQueue *queue, const char *msrecord, int packet_type,
+        int seqnum, int packet_size, int archflag, int dumpflag)
+{
+  const struct sl_fsdh_s *fsdh = (const struct sl_fsdh_s *)msrecord;
+  AQSlot *slot;
+  uint32_t hash = 2166136261U;
+  int idx;
+
+  if (packet_size <= 0 || packet_size > queue->recsize)
+  {
+    sl_log (2, 0, "aq_put(): invalid packet size %d, slot size is %d\n",
+            packet_size, queue->recsize);
+    return -1;
+  }
+
+  slot = aq_reserve (queue);
+
+  slot->packet_type = packet_type;
+  slot->seqnum      = seqnum;
+  slot->packet_size = packet_size;
+  slot->archflag    = archflag;
+  slot->dumpflag    = dumpflag;
+
+  memcpy ((char *)slot + sizeof (AQSlot), msrecord, packet_size);
+
+  /* Shard on the network and station codes */
+  for (idx = 0; idx < 5; idx++)
+    hash = (hash ^ (uint8_t)fsdh->station[idx]) * 16777619U;
+  for (idx = 0; idx < 2; idx++)
+    hash = (hash ^ (uint8_t)fsdh->network[idx]) * 16777619U;
+
+  slot->shard = hash % queue->numworkers;
+
+  aq_publish (queue);
+
+  return 0;
+} /* End of aq_put() */
+
+/***************************************************************************
+ * aq_flush():
+ * Add a flush marker to the queue, each worker writes all buffered
+ * records when reaching it.  Once every worker has passed the marker
+ * aq_durable() includes all packets added before it.
+ ***************************************************************************/
+void
+aq_flush (ArchQueue *queue)
+{
+  AQSlot *slot;
+
+  slot = aq_reserve (queue);
+
+  slot->packet_type = -1;
+  slot->packet_size = 0;
+  slot->archflag    = 0;
+  slot->dumpflag    = 0;
+  slot->shard       = -1;
+
+  aq_publish (queue);
+} /* End of aq_flush() */
+
+/***************************************************************************
+ * aq_position():
+ * Returns the position of the next packet added to the queue,
+ * i.e. the number of packets added so far.
+ ***************************************************************************/
+int64_t
+aq_position (ArchQueue *queue)
+{
+  return queue->head;
+} /* End of aq_position() */
+
+/***************************************************************************
+ * aq_durable():
+ * Returns the position before which all packets have been written to
+ * their files by every worker including buffered records.
+ ***************************************************************************/
+int64_t
+aq_durable (ArchQueue *queue)
+{
+  int64_t durable = queue->head;
+  int64_t value;
+  int idx;
+
+  for (idx = 0; idx < queue->numworkers; idx++)
+  {
+    value = __atomic_load_n (&queue->workers[idx].durable, __ATOMIC_ACQUIRE);
+
+    if (value < durable)
+      durable = value;
+  }
+
+  return durable;
+} /* End of aq_durable() */
+
+/***************************************************************************
+ * aq_report():
+ * Log the queue statistics at the specified verbosity.
+ ***************************************************************************/
+void
+aq_report (ArchQueue *queue, int verbosity)
+{
+  int idx;
+
+  sl_log (1, verbosity, "Archive queue: %lld packets, %lld queued, high-water %lld of %d slots\n",
+          (long long)queue->head, (long long)(queue->head - aq_minposition (queue)),
+          (long long)queue->highwater, queue->numslots);
+  sl_log (1, verbosity, "Archive queue: waited for free slots %lld times, %.3f seconds\n",
+          (long long)queue->fullwaits, queue->fullwaittime);
+
+  for (idx = 0; idx < queue->numworkers; idx++)
+    sl_log (1, verbosity, "Archive worker %d: %lld packets, %lld behind\n", idx,
+            (long long)__atomic_load_n (&queue->workers[idx].packets, __ATOMIC_RELAXED),
+            (long long)(queue->head - __atomic_load_n (&queue->workers[idx].position,
+                                                       __ATOMIC_RELAXED)));
+} /* End of aq_report() */
+
+/***************************************************************************
+ * aq_stop():
+ * Stop the workers once all queued packets have been handled and free
+ * all memory associated with the queue.
+ ***************************************************************************/
+void
+aq_stop (ArchQueue *queue)
+{
+  int idx;
+
+  if (queue == NULL)
+    return;
+
+  pthread_mutex_lock (&queue->lock);
+  __atomic_store_n (&queue->stop, 1, __ATOMIC_SEQ_CST);
+  pthread_cond_broadcast (&queue->dataready);
+  pthread_mutex_unlock (&queue->lock);
+
+  for (idx = 0; idx < queue->numworkers; idx++)
+    pthread_join (queue->workers[idx].thread, NULL);
+
+  aq_report (queue, 1);
+
+  pthread_cond_destroy (&queue->spaceready);
+  pthread_cond_destroy (&queue->dataready);
+  pthread_mutex_destroy (&queue->lock);
+
+  free (queue->slots);
+  free (queue->workers);
+  free (queue);
+} /* End of aq_stop() */
+
+/***************************************************************************
+ * aq_worker():
+ * The worker thread, handles the packets of its shard and periodically
+ * flushes buffered records until stopped.
+ ***************************************************************************/
+static void *
+aq_worker (void *arg)
+{
+  AQWorker *worker  = (AQWorker *)arg;
+  ArchQueue *queue  = worker->queue;
+  AQSlot *slot;
+  int64_t position  = 0;
+  int64_t head;
+  double lastflush  = sl_dtime ();
+  int owner;
+  int dumpflag;
+
+  for (;;)
+  {
+    head = __atomic_load_n (&queue->head, __ATOMIC_ACQUIRE);
+
+    while (position < head)
+    {
+      slot  = (AQSlot *)(queue->slots + (position & (queue->numslots - 1)) * queue->slotsize);
+      owner = (slot->shard == worker->id);
+
+      if (slot->packet_size == 0)
+      {
+        /* A flush marker, all previous packets are durable once written */
+        if (queue->flush)
+          queue->flush ();
+
+        position++;
+        lastflush = sl_dtime ();
+        __atomic_store_n (&worker->durable, position, __ATOMIC_RELEASE);
+      }
+      else
+      {
+        dumpflag = (worker->id == 0 && slot->dumpflag);
+
+        if (owner || dumpflag)
+        {
+          queue->handler ((char *)slot + sizeof (AQSlot), slot->packet_type,
+                          slot->seqnum, slot->packet_size,
+                          owner && slot->archflag, dumpflag);
+
+          if (owner)
+            __atomic_store_n (&worker->packets, worker->packets + 1, __ATOMIC_RELAXED);
+        }
+
+        position++;
+      }
+
+      /* Release slots in groups to limit cache line traffic */
+      if ((position & 31) == 0 || position == head)
+      {
+        __atomic_store_n (&worker->position, position, __ATOMIC_SEQ_CST);
+
+        /* Without buffering records are durable once handled */
+        if (!queue->flush)
+          __atomic_store_n (&worker->durable, position, __ATOMIC_RELEASE);
+
+        if (__atomic_load_n (&queue->fullwait, __ATOMIC_SEQ_CST))
+        {
+          pthread_mutex_lock (&queue->lock);
+          pthread_cond_signal (&queue->spaceready);
+          pthread_mutex_unlock (&queue->lock);
+        }
+      }
+    }
+
+    /* Flush buffered records, they are durable once written */
+    if (queue->flushage && (sl_dtime () - lastflush) * 1000.0 >= queue->flushage)
+    {
+      queue->flush ();
+      __atomic_store_n (&worker->durable, position, __ATOMIC_RELEASE);
+      lastflush = sl_dtime ();
+    }
+
+    if (__atomic_load_n (&queue->stop, __ATOMIC_SEQ_CST) &&
+        position == __atomic_load_n (&queue->head, __ATOMIC_SEQ_CST))
+      break;
+
+    /* Wait for more packets */
+    pthread_mutex_lock (&queue->lock);
+    __atomic_add_fetch (&queue->sleepers, 1, __ATOMIC_SEQ_CST);
+
+    if (position == __atomic_load_n (&queue->head, __ATOMIC_SEQ_CST) &&
+        !__atomic_load_n (&queue->stop, __ATOMIC_SEQ_CST))
+      aq_wait (&queue->dataready, &queue->lock,
+               (queue->flushage) ? queue->flushage : 1000);
+
+    __atomic_sub_fetch (&queue->sleepers, 1, __ATOMIC_SEQ_CST);
+    pthread_mutex_unlock (&queue->lock);
+  }
+
+  if (queue->flush)
+    queue->flush ();
+
+  __atomic_store_n (&worker->durable, position, __ATOMIC_RELEASE);
+
+  if (queue->shutdown)
+    queue->shutdown ();
+
+  return NULL;
+} /* End of aq_worker() */
+
+/***************************************************************************
+ * aq_reserve():
+ * Returns the next free slot of the queue, waiting until a worker
+ * releases it if the queue is full.  Only called by the producer.
+ ***************************************************************************/
+static AQSlot *
+aq_reserve (ArchQueue *queue)
+{
+  int64_t head = queue->head;
+  double start;
+
+  if ((head - aq_minposition (queue)) >= queue->numslots)
+  {
+    queue->fullwaits++;
+    start = sl_dtime ();
+
+    pthread_mutex_lock (&queue->lock);
+    __atomic_store_n (&queue->fullwait, 1, __ATOMIC_SEQ_CST);
+
+    while ((head - aq_minposition (queue)) >= queue->numslots)
+      aq_wait (&queue->spaceready, &queue->lock, 10);
+
+    __atomic_store_n (&queue->fullwait, 0, __ATOMIC_SEQ_CST);
+    pthread_mutex_unlock (&queue->lock);
+
+    queue->fullwaittime += sl_dtime () - start;
+  }
+
+  return (AQSlot *)(queue->slots + (head & (queue->numslots - 1)) * queue->slotsize);
+} /* End of aq_reserve() */
+
+/***************************************************************************
+ * aq_publish():
+ * Make the slot returned by aq_reserve() available to the workers and
+ * wake up any sleeping workers.
+ ***************************************************************************/
+static void
+aq_publish (ArchQueue *queue)
+{
+  int64_t depth;
+
+  __atomic_store_n (&queue->head, queue->head + 1, __ATOMIC_SEQ_CST);
+
+  depth = queue->head - aq_minposition (queue);
+  if (depth > queue->highwater)
+    queue->highwater = depth;
+
+  if (__atomic_load_n (&queue->sleepers, __ATOMIC_SEQ_CST))
+  {
+    pthread_mutex_lock (&queue->lock);
+    pthread_cond_broadcast (&queue->dataready);
+    pthread_mutex_unlock (&queue->lock);
+  }
+} /* End of aq_publish() */
+
+/***************************************************************************
+ * aq_minposition():
+ * Returns the lowest position of all workers, slots before it are free.
+ ***************************************************************************/
+static int64_t
+aq_minposition (ArchQueue *queue)
+{
+  int64_t minpos = queue->head;
+  int64_t value;
+  int idx;
+
+  for (idx = 0; idx < queue->numworkers; idx++)
+  {
+    value = __atomic_load_n (&queue->workers[idx].position, __ATOMIC_SEQ_CST);
+
+    if (value < minpos)
+      minpos = value;
+  }
+
+  return minpos;
+} /* End of aq_minposition() */
+
+/***************************************************************************
+ * aq_wait():
+ * Wait on a condition variable for at most 'msec' milliseconds, the
+ * mutex must be locked.
+ ***************************************************************************/
+static void
+aq_wait (pthread_cond_t *cond, pthread_mutex_t *lock, int msec)
+{
+  struct timeval now;
+  struct timespec deadline;
+
+  gettimeofday (&now, NULL);
+
+  deadline.tv_sec  = now.tv_sec + msec / 1000;
+  deadline.tv_nsec = now.tv_usec * 1000L + (msec % 1000) * 1000000L;
+
+  if (deadline.tv_nsec >= 1000000000L)
+  {
+    deadline.tv_sec++;
+    deadline.tv_nsec -= 1000000000L;
+  }
+
+  pthread_cond_timedwait (cond, lock, &deadline);
+} /* End of aq_wait() */
+
+#else /* SLP_WIN */
+
+/***************************************************************************
+ * Archive worker threads are not supported on Windows.
+ ***************************************************************************/
+ArchQueue *
+aq_new (int numworkers, int numslots, int recsize, AQHandler handler,
+        AQCallback flush, AQCallback shutdown, int flushage)
+{
+  sl_log (2, 0, "archive worker threads are not supported on this platform\n");
+  return NULL;
+}
+
+int
+aq_put (ArchQueue *queue, const char *msrecord, int packet_type,
+        int seqnum, int packet_size, int archflag, int dumpflag)
+{
+  return -1;
+}
+
+void
+aq_flush (ArchQueue *queue)
+{
+}
+
+int64_t
+aq_position (ArchQueue *queue)
+{
+  return 0;
+}
+
+int64_t
+aq_durable (ArchQueue *queue)
+{
+  return 0;
+}
+
+void
+aq_report (ArchQueue *queue, int verbosity)
+{
+}
+
+void
+aq_stop (ArchQueue *queue)
+{
+}
+
+#endif /* SLP_WIN */
@@ -0,0 +1,41 @@
+/***************************************************************************
+ * archqueue.h
+ *
+ * Interface declarations for the archive queue, a bounded queue of
+ * packets handed from the network thread to archive worker threads.
+ *
+ * modified: 2026.287
+ ***************************************************************************/
+
+#ifndef ARCHQUEUE_H
+#define ARCHQUEUE_H
+
+#include <stdint.h>
+
+/* Default number of packet slots in the queue */
+#define AQ_DEFSLOTS 4096
+
+/* Handler for a queued packet, called by the worker threads.  Workers
+ * own the packets of their shard, 'archflag' is only set for those.
+ * 'dumpflag' is set for the packets queued for the dumpfile in the
+ * first worker. */
+typedef void (*AQHandler) (char *msrecord, int packet_type, int seqnum,
+                           int packet_size, int archflag, int dumpflag);
+
+/* Flush or shut down the archives of a worker thread */
+typedef void (*AQCallback) (void);
+
+typedef struct ArchQueue_s ArchQueue;
+
+extern ArchQueue *aq_new (int numworkers, int numslots, int recsize,
+                          AQHandler handler, AQCallback flush,
+                          AQCallback shutdown, int flushage);
+extern int aq_put (ArchQueue *queue, const char *msrecord, int packet_type,
+                   int seqnum, int packet_size, int archflag, int dumpflag);
+extern void aq_flush (ArchQueue *queue);
+extern int64_t aq_position (ArchQueue *queue);
+extern int64_t aq_durable (ArchQueue *queue);
+extern void aq_report (ArchQueue *queue, int verbosity);
+extern void aq_stop (ArchQueue *queue);
+
+#endif
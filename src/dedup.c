@@ -0,0 +1,548 @@
+/***************************************************************************
+ * dedup.c
+ *
+ * Suppression of records that were already archived, e.g. resent
+ * after a reconnect or received both from a time window backfill and
+ * the live stream.
+ *
+ * Each station of a server keeps a sliding bitmap of its DD_WINDOW
+ * most recent sequence numbers, a record with a sequence number in the
+ * bitmap is a duplicate.  Records further behind than the window,
+ * e.g. from a time window backfill, are only checked by their time
+ * span.  They are taken as a restart of the sequence on the server
+ * when their sequence number is within the window of 0 or after
+ * DD_RESTART consecutive records without a newer one between them.  The
+ * sequence numbers of different servers are unrelated, servers are
+ * identified by their address so that the connections to the same
+ * server, e.g. for a time window and the live stream, share them.
+ *
+ * Each channel keeps the span of contiguous data ending with the
+ * latest archived record, a data record within that span, within half
+ * a sample period, overlaps archived data.  The spans are shared by
+ * all servers, data of a channel received from several servers is
+ * archived once.  Records before the span,
+ * e.g. filling an earlier gap, are not suppressed.
+ *
+ * Records are checked by the thread handling the packets, the counters
+ * are read by the statistics exporter with atomic loads.
+ *
+ * modified: 2026.287
+ ***************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "dedup.h"
+
+/* Sequence numbers are 24 bits */
+#define DD_SEQMASK 0xFFFFFF
+#define DD_SEQHALF 0x800000
+
+/* Update a counter only modified by a single thread */
+#ifndef SLP_WIN
+#define DD_ADD(C) __atomic_store_n (&(C), (C) + 1, __ATOMIC_RELAXED)
+#define DD_LOAD(C) __atomic_load_n (&(C), __ATOMIC_RELAXED)
+#else
+#define DD_ADD(C) ((C)++)
+#define DD_LOAD(C) (C)
+#endif
+
+/* Consecutive records far behind the latest taken as a restart */
+#define DD_RESTART DD_WINDOW
+
+/* Key length of a station, the codes followed by the server index */
+#define DD_STATIONKEY (7 + sizeof (int))
+
+/* A station of a server, the key is the station and network codes and
+ * the index of the server */
+typedef struct DdStation_s
+{
+  char     key[DD_STATIONKEY];
+  int      highseq;      /* Latest sequence number or -1 */
+  int      behindseq;    /* Latest sequence number far behind it */
+  int      behindrun;    /* Consecutive records far behind it */
+  uint64_t seen[DD_WINDOW / 64]; /* Bitmap of archived sequence numbers */
+}
+DdStation;
+
+/* A channel, the key is the station, location, channel and network codes */
+typedef struct DdChannel_s
+{
+  char    key[12];
+  int     valid;         /* Flag: a span has been archived */
+  int64_t segstart;      /* Start of the contiguous span (1e-4 s) */
+  int64_t lastend;       /* End of the latest archived record (1e-4 s) */
+}
+DdChannel;
+
+/* A hash table of entries starting with their key */
+typedef struct DdTable_s
+{
+  void  **slots;
+  int     size;          /* Number of slots, a power of 2 */
+  int     count;
+  int     keylen;
+}
+DdTable;
+
+static struct
+{
+  int     enabled;
+  DdTable stations;
+  DdTable channels;
+  DdCounters counters;
+  char  **servers;       /* Addresses of the servers */
+  int     numservers;
+  const char *lastserver; /* Address of the last record and its index */
+  int     lastindex;
+} dd = {0};
+
+static int dd_server (const char *server);
+static int dd_sequence (DdStation *station, int seqnum);
+static int dd_span (DdChannel *channel, SLMSheader *msh);
+static int64_t dd_ticks (const struct sl_btime_s *btime);
+static void *dd_lookup (DdTable *table, const char *key);
+static int dd_insert (DdTable *table, void *entry);
+static void dd_free (DdTable *table);
+
+/***************************************************************************
+ * dd_start:
+ *
+ * Start checking records for duplicates.
+ *
+ * Returns 0 on success and -1 on error.
+ ***************************************************************************/
+int
+dd_start (void)
+{
+  dd.stations.keylen = DD_STATIONKEY;
+  dd.channels.keylen = 12;
+  dd.enabled         = 1;
+
+  return 0;
+} /* End of dd_start() */
+
+/***************************************************************************
+ * dd_stop:
+ *
+ * Stop checking records and free all entries.
+ ***************************************************************************/
+void
+dd_stop (void)
+{
+  if (!dd.enabled)
+    return;
+
+  dd.enabled = 0;
+
+  dd_free (&dd.stations);
+  dd_free (&dd.channels);
+
+  while (dd.numservers > 0)
+    free (dd.servers[--dd.numservers]);
+
+  free (dd.servers);
+  dd.servers    = NULL;
+  dd.lastserver = NULL;
+} /* End of dd_stop() */
+
+/***************************************************************************
+ * dd_check:
+ *
+ * Check if a record to be archived was archived before, by the
+ * sequence number of its station on the server with address 'server'
+ * and by the time span of its channel.
+ * Records that are not duplicates are remembered as archived.  Records
+ * without a sequence number are only checked by time, the time of
+ * records without samples is not checked.
+ *
+ * Returns DD_NEW, DD_DUPLICATE or DD_OVERLAP.
+ ***************************************************************************/
+int
+dd_check (SLMSheader *msh, int packet_type, int seqnum, const char *server)
+{
+  DdStation *station;
+  DdChannel *channel;
+  char key[DD_STATIONKEY];
+  int result = DD_NEW;
+  int index;
+
+  if (!dd.enabled)
+    return DD_NEW;
+
+  DD_ADD (dd.counters.records);
+
+  if (seqnum >= 0)
+  {
+    if ((index = dd_server (server)) < 0)
+      return DD_NEW;
+
+    memcpy (key, msh->fsdh->station, 5);
+    memcpy (key + 5, msh->fsdh->network, 2);
+    memcpy (key + 7, &index, sizeof (index));
+
+    if ((station = dd_lookup (&dd.stations, key)) == NULL)
+    {
+      if ((station = (DdStation *)calloc (1, sizeof (DdStation))) == NULL ||
+          dd_insert (&dd.stations, memcpy (station->key, key, DD_STATIONKEY)))
+      {
+        sl_log (2, 0, "dd_check(): error allocating memory\n");
+        free (station);
+        return DD_NEW;
+      }
+
+      station->highseq = -1;
+    }
+
+    if ((result = dd_sequence (station, seqnum)) != DD_NEW)
+    {
+      DD_ADD (dd.counters.duplicates);
+      return result;
+    }
+  }
+
+  if (packet_type != SLDATA || sl_msh_numsamples (msh) == 0)
+    return DD_NEW;
+
+  if ((channel = dd_lookup (&dd.channels, msh->fsdh->station)) == NULL)
+  {
+    if ((channel = (DdChannel *)calloc (1, sizeof (DdChannel))) == NULL ||
+        dd_insert (&dd.channels, memcpy (channel->key, msh->fsdh->station, 12)))
+    {
+      sl_log (2, 0, "dd_check(): error allocating memory\n");
+      free (channel);
+      return DD_NEW;
+    }
+  }
+
+  if ((result = dd_span (channel, msh)) != DD_NEW)
+    DD_ADD (dd.counters.overlaps);
+
+  return result;
+} /* End of dd_check() */
+
+/***************************************************************************
+ * dd_counters:
+ *
+ * Copy the suppression counters to 'counters'.  May be called by any
+ * thread.
+ *
+ * Returns 0 on success or -1 if records are not checked.
+ ***************************************************************************/
+int
+dd_counters (DdCounters *counters)
+{
+  if (!dd.enabled)
+    return -1;
+
+  counters->records    = DD_LOAD (dd.counters.records);
+  counters->duplicates = DD_LOAD (dd.counters.duplicates);
+  counters->overlaps   = DD_LOAD (dd.counters.overlaps);
+  counters->outoforder = DD_LOAD (dd.counters.outoforder);
+  counters->gaps       = DD_LOAD (dd.counters.gaps);
+
+  return 0;
+} /* End of dd_counters() */
+
+/***************************************************************************
+ * dd_server:
+ *
+ * Find the index of a server by its address, adding new servers.  The
+ * address of the previous record is compared first.
+ *
+ * Returns the index of the server or -1 on error.
+ ***************************************************************************/
+static int
+dd_server (const char *server)
+{
+  char **servers;
+  int idx;
+
+  if (!server)
+    server = "";
+
+  if (server == dd.lastserver)
+    return dd.lastindex;
+
+  for (idx = 0; idx < dd.numservers && strcmp (dd.servers[idx], server); idx++)
+    ;
+
+  if (idx == dd.numservers)
+  {
+    if ((servers = (char **)realloc (dd.servers, (idx + 1) * sizeof (char *))) == NULL ||
+        (servers[idx] = strdup (server)) == NULL)
+    {
+      sl_log (2, 0, "dd_server(): error allocating memory\n");
+
+      if (servers)
+        dd.servers = servers;
+
+      return -1;
+    }
+
+    dd.servers = servers;
+    dd.numservers++;
+  }
+
+  dd.lastserver = server;
+  dd.lastindex  = idx;
+
+  return idx;
+} /* End of dd_server() */
+
+/***************************************************************************
+ * dd_sequence:
+ *
+ * Check a sequence number against the bitmap of a station and add it.
+ * The bitmap covers the DD_WINDOW sequence numbers up to the latest,
+ * moving forward clears the bits of the skipped numbers.  A sequence
+ * number further behind only restarts the bitmap when it looks like a
+ * restart of the sequence on the server, otherwise it is left to the
+ * check of the time span.
+ *
+ * Returns DD_NEW or DD_DUPLICATE.
+ ***************************************************************************/
+static int
+dd_sequence (DdStation *station, int seqnum)
+{
+  uint64_t mask;
+  int diff;
+  int bit;
+
+  seqnum &= DD_SEQMASK;
+  bit  = seqnum & (DD_WINDOW - 1);
+  mask = (uint64_t)1 << (bit & 63);
+
+  if (station->highseq < 0)
+  {
+    station->highseq         = seqnum;
+    station->seen[bit >> 6] |= mask;
+    return DD_NEW;
+  }
+
+  /* Distance from the latest sequence number, with wrapping */
+  diff = (seqnum - station->highseq) & DD_SEQMASK;
+  if (diff >= DD_SEQHALF)
+    diff -= DD_SEQMASK + 1;
+
+  if (diff == 0)
+    return DD_DUPLICATE;
+
+  /* Far behind, e.g. a backfill of the same server or a restart */
+  if (diff < 0 && -diff >= DD_WINDOW)
+  {
+    if (station->behindrun > 0 && seqnum == ((station->behindseq + 1) & DD_SEQMASK))
+      station->behindrun++;
+    else
+      station->behindrun = 1;
+
+    station->behindseq = seqnum;
+
+    if (seqnum >= DD_WINDOW && station->behindrun < DD_RESTART)
+      return DD_NEW;
+  }
+
+  if (diff > 0 || -diff >= DD_WINDOW)
+  {
+    station->behindrun = 0;
+
+    if (diff != 1)
+      DD_ADD (dd.counters.gaps);
+
+    /* Forget the numbers leaving the window, all of them after a restart */
+    if (diff < 0 || diff >= DD_WINDOW)
+    {
+      memset (station->seen, 0, sizeof (station->seen));
+    }
+    else
+    {
+      int skipped;
+
+      for (skipped = station->highseq + 1; diff > 0; skipped++, diff--)
+        station->seen[(skipped & (DD_WINDOW - 1)) >> 6] &=
+            ~((uint64_t)1 << (skipped & 63));
+    }
+
+    station->highseq         = seqnum;
+    station->seen[bit >> 6] |= mask;
+    return DD_NEW;
+  }
+
+  /* Behind the latest sequence number, within the window */
+  if (station->seen[bit >> 6] & mask)
+    return DD_DUPLICATE;
+
+  DD_ADD (dd.counters.outoforder);
+  station->seen[bit >> 6] |= mask;
+
+  return DD_NEW;
+} /* End of dd_sequence() */
+
+/***************************************************************************
+ * dd_span:
+ *
+ * Check the time span of a data record against the archived span of
+ * its channel and extend that span if the record continues it.
+ *
+ * Returns DD_NEW or DD_OVERLAP.
+ ***************************************************************************/
+static int
+dd_span (DdChannel *channel, SLMSheader *msh)
+{
+  int64_t start;
+  int64_t end;
+  int64_t tolerance;
+
+  start = dd_ticks (sl_msh_starttime (msh));
+  end   = (int64_t)(sl_msh_depochetime (msh) * 10000.0 + 0.5);
+
+  /* Not checked without a sample rate */
+  if (end <= start)
+    return DD_NEW;
+
+  tolerance = (end - start) / (2 * sl_msh_numsamples (msh));
+
+  if (!channel->valid)
+  {
+    channel->valid    = 1;
+    channel->segstart = start;
+    channel->lastend  = end;
+    return DD_NEW;
+  }
+
+  if (start >= channel->segstart - tolerance && end <= channel->lastend + tolerance)
+    return DD_OVERLAP;
+
+  if (start > channel->lastend + tolerance)
+  {
+    /* A new span after a gap */
+    channel->segstart = start;
+    channel->lastend  = end;
+  }
+  else if (end > channel->lastend)
+  {
+    channel->lastend = end;
+  }
+  else if (end >= channel->segstart - tolerance)
+  {
+    /* Extends the span backwards, e.g. a backfill */
+    channel->segstart = start;
+  }
+
+  return DD_NEW;
+} /* End of dd_span() */
+
+/***************************************************************************
+ * dd_ticks:
+ *
+ * Returns a start time in ten-thousandths of a second since the epoch,
+ * calculated like sl_msh_depochetime().
+ ***************************************************************************/
+static int64_t
+dd_ticks (const struct sl_btime_s *btime)
+{
+  int64_t seconds;
+
+  seconds = (int64_t)(btime->year - 1970) * 31536000 +
+            (int64_t)((btime->year - 1969) / 4) * 86400 +
+            (int64_t)(btime->day - 1) * 86400 +
+            btime->hour * 3600 + btime->min * 60 + btime->sec;
+
+  return seconds * 10000 + btime->fract;
+} /* End of dd_ticks() */
+
+/***************************************************************************
+ * dd_lookup:
+ *
+ * Find the entry for 'key' in a hash table.
+ *
+ * Returns the entry or NULL if not found.
+ ***************************************************************************/
+static void *
+dd_lookup (DdTable *table, const char *key)
+{
+  uint32_t hash = 2166136261u;
+  int idx;
+
+  if (!table->size)
+    return NULL;
+
+  for (idx = 0; idx < table->keylen; idx++)
+    hash = (hash ^ (uint8_t)key[idx]) * 16777619u;
+
+  for (idx = hash & (table->size - 1); table->slots[idx];
+       idx = (idx + 1) & (table->size - 1))
+  {
+    if (!memcmp (table->slots[idx], key, table->keylen))
+      return table->slots[idx];
+  }
+
+  return NULL;
+} /* End of dd_lookup() */
+
+/***************************************************************************
+ * dd_insert:
+ *
+ * Insert an entry in a hash table, growing the table to keep it at most
+ * half full.
+ *
+ * Returns 0 on success and -1 on error.
+ ***************************************************************************/
+static int
+dd_insert (DdTable *table, void *entry)
+{
+  DdTable grown;
+  uint32_t hash = 2166136261u;
+  int idx;
+
+  if ((table->count + 1) * 2 > table->size)
+  {
+    grown.size   = (table->size) ? table->size * 2 : 256;
+    grown.count  = 0;
+    grown.keylen = table->keylen;
+
+    if ((grown.slots = (void **)calloc (grown.size, sizeof (void *))) == NULL)
+      return -1;
+
+    for (idx = 0; idx < table->size; idx++)
+    {
+      if (table->slots[idx])
+        dd_insert (&grown, table->slots[idx]);
+    }
+
+    free (table->slots);
+    *table = grown;
+  }
+
+  for (idx = 0; idx < table->keylen; idx++)
+    hash = (hash ^ (uint8_t) ((char *)entry)[idx]) * 16777619u;
+
+  for (idx = hash & (table->size - 1); table->slots[idx];
+       idx = (idx + 1) & (table->size - 1))
+    ;
+
+  table->slots[idx] = entry;
+  table->count++;
+
+  return 0;
+} /* End of dd_insert() */
+
+/***************************************************************************
+ * dd_free:
+ *
+ * Free all entries of a hash table and the table.
+ ***************************************************************************/
+static void
+dd_free (DdTable *table)
+{
+  int idx;
+
+  for (idx = 0; idx < table->size; idx++)
+    free (table->slots[idx]);
+
+  free (table->slots);
+
+  table->slots = NULL;
+  table->size  = 0;
+  table->count = 0;
+} /* End of dd_free() */
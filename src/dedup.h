@@ -0,0 +1,42 @@
+/***************************************************************************
+ * dedup.h
+ *
+ * Interface declarations for the suppression of duplicate and
+ * overlapping records before archiving.
+ *
+ * modified: 2026.287
+ ***************************************************************************/
+
+#ifndef DEDUP_H
+#define DEDUP_H
+
+#include <stdint.h>
+
+#include <libslink.h>
+
+/* Number of recent sequence numbers remembered per station, a power of 2 */
+#define DD_WINDOW 1024
+
+/* Results of dd_check() */
+#define DD_NEW       0 /* Not archived before */
+#define DD_DUPLICATE 1 /* Sequence number already archived */
+#define DD_OVERLAP   2 /* Time span already archived */
+
+/* Suppression counters, see dd_counters() */
+typedef struct DdCounters_s
+{
+  int64_t records;       /* Records checked */
+  int64_t duplicates;    /* Records dropped for their sequence number */
+  int64_t overlaps;      /* Records dropped for their time span */
+  int64_t outoforder;    /* Records with a sequence number below the latest */
+  int64_t gaps;          /* Breaks in the sequence numbers of a station */
+}
+DdCounters;
+
+extern int dd_start (void);
+extern void dd_stop (void);
+extern int dd_check (SLMSheader *msh, int packet_type, int seqnum,
+                     const char *server);
+extern int dd_counters (DdCounters *counters);
+
+#endif
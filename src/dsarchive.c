@@ -3,9 +3,14 @@
  *
  * Written by Chad Trabant, ORFEUS/EC-Project MEREDIAN
  *
- * modified: 2006.355
+ * modified: 2026.287
  ***************************************************************************/
 
+/* Needed for fallocate() with FALLOC_FL_KEEP_SIZE */
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+
 #include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -16,349 +21,639 @@
 
 #include "dsarchive.h"
 
+#if !defined(SLP_WIN)
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+
+/* Size of the per-stream write buffers, 0 to write each record directly */
+static int bufsize = 0;
+
+/* Asynchronous I/O backend for new stream tables, DSA_NONE to write directly */
+static int asyncmode = DSA_NONE;
+
+/* Preallocation of newly opened files, DS_PREALLOC_NONE to grow with writes */
+static int preallocmode = DS_PREALLOC_NONE;
+
 /* Functions internal to this source file */
-static DataStream *ds_getstream (DataStream **dstream, const SLMSrecord *msr,
-                                 const char *defkey, const char *filename,
+static int ds_expandformat (DSFormat *format, SLMSheader *msh, int type,
+                            char *filename, char *definition);
+static const DSIdent *ds_getident (DSFormat *format, SLMSheader *msh);
+static int ds_formatint (char *dest, int value, int width);
+static int ds_makedirs (DSFormat *format, char *filename);
+static void ds_cleardircache (DSFormat *format);
+static DataStream *ds_getstream (DataStream **streamroot, DSFormat *format,
+                                 SLMSheader *msh, int reclen,
+                                 const char *defkey, char *filename,
                                  int type, int idletimeout);
-static void ds_shutdown (DataStream *dstream);
+static DataStream *ds_addstream (DataStream **streamroot, const char *defkey,
+                                 uint32_t hash);
+static void ds_touchstream (DataStream **streamroot, DataStream *stream,
+                            time_t modtime);
+static void ds_removestream (DataStream **streamroot, DataStream *stream);
+static uint32_t ds_hashkey (const char *defkey);
+static int ds_writerecord (DataStream *stream, const char *record, int reclen);
+static int ds_flushstream (DataStream *stream);
+static int ds_writefile (DataStream *stream, const char *data, int length);
+static void ds_preallocate (DataStream *stream, SLMSheader *msh, int reclen);
+static int ds_extend (DataStream *stream, off_t end);
+static off_t ds_recover (int fd, off_t size);
+static void ds_trim (DataStream *stream);
+static int ds_flush (DataStream *streamroot);
+static void ds_shutdown (DataStream **streamroot);
 static char sl_typecode (int type);
 
+/***************************************************************************
+ * ds_compileformat():
+ * Compile a path format string into a list of operations that can be
+ * expanded for each record by ds_streamproc() without re-parsing the
+ * format.  The format is split into literal text, directory
+ * separators and the defining (%) and non-defining (#) field flags.
+ *
+ * Returns a new DSFormat on success and NULL on error.  The returned
+ * format should be released with ds_freeformat().
+ ***************************************************************************/
+DSFormat *
+ds_compileformat (const char *pathformat)
+{
+  DSFormat *format;
+  const char *fptr;
+  int fmtlen;
+  int litlen = 0;
+  int litstart;
+
+  if (pathformat == NULL || *pathformat == '\0')
+  {
+    sl_log (1, 0, "ds_compileformat(): empty path format\n");
+    return NULL;
+  }
+
+  fmtlen = strlen (pathformat);
+
+  if (pathformat[fmtlen - 1] == '/')
+  {
+    sl_log (1, 0, "ds_compileformat(): no file name specified, only %s\n",
+            pathformat);
+    return NULL;
+  }
+
+  if ((format = (DSFormat *)calloc (1, sizeof (DSFormat))) == NULL)
+  {
+    sl_log (1, 0, "ds_compileformat(): error allocating memory\n");
+    return NULL;
+  }
+
+  /* Each character of the format results in at most one operation and
+     at most one character of literal text */
+  format->pathformat = strdup (pathformat);
+  format->literals   = (char *)malloc (fmtlen + 1);
+  format->ops        = (DSFormatOp *)malloc (sizeof (DSFormatOp) * fmtlen);
+  format->idcache    = (DSIdent *)calloc (DS_IDCACHESIZE, sizeof (DSIdent));
+  format->dircache   = (DSDirEntry *)calloc (DS_DIRCACHESIZE, sizeof (DSDirEntry));
+
+  if (!format->pathformat || !format->literals || !format->ops ||
+      !format->idcache || !format->dircache)
+  {
+    sl_log (1, 0, "ds_compileformat(): error allocating memory\n");
+    ds_freeformat (format);
+    return NULL;
+  }
+
+  litstart = 0;
+
+  for (fptr = pathformat; *fptr != '\0'; fptr++)
+  {
+    DSFormatOp *op = NULL;
+
+    /* Absolute path, leading separator is literal text */
+    if (*fptr == '/' && fptr != pathformat)
+    {
+      op         = &format->ops[format->numops++];
+      op->opcode = DSOP_DIRSEP;
+      format->numdirs++;
+    }
+    else if (*fptr == '%' || *fptr == '#')
+    {
+      char flag = *(fptr + 1);
+
+      switch (flag)
+      {
+      case 't':
+      case 'n':
+      case 's':
+      case 'l':
+      case 'c':
+      case 'Y':
+      case 'y':
+      case 'j':
+      case 'H':
+      case 'M':
+      case 'S':
+      case 'F':
+        op           = &format->ops[format->numops++];
+        op->opcode   = DSOP_FIELD;
+        op->field    = flag;
+        op->defining = (*fptr == '%');
+        fptr++;
+        break;
+      case '%':
+      case '#':
+        format->literals[litlen++] = flag;
+        fptr++;
+        continue;
+      default:
+        /* The flag character, if any, is used as literal text */
+        sl_log (1, 0, "Unknown file name format code: %c\n", flag);
+        continue;
+      }
+    }
+    else
+    {
+      format->literals[litlen++] = *fptr;
+      continue;
+    }
+
+    /* Insert any pending literal text before the new operation */
+    if (litlen > litstart)
+    {
+      *(op + 1)            = *op;
+      op->opcode           = DSOP_LITERAL;
+      op->offset           = litstart;
+      op->length           = litlen - litstart;
+      litstart             = litlen;
+      format->numops++;
+    }
+  }
+
+  if (litlen > litstart)
+  {
+    DSFormatOp *op = &format->ops[format->numops++];
+
+    op->opcode = DSOP_LITERAL;
+    op->offset = litstart;
+    op->length = litlen - litstart;
+  }
+
+  format->literals[litlen] = '\0';
+
+  if (format->numdirs > 0)
+  {
+    format->dirends = (int *)malloc (sizeof (int) * format->numdirs);
+
+    if (format->dirends == NULL)
+    {
+      sl_log (1, 0, "ds_compileformat(): error allocating memory\n");
+      ds_freeformat (format);
+      return NULL;
+    }
+  }
+
+  return format;
+} /* End of ds_compileformat() */
+
+/***************************************************************************
+ * ds_freeformat():
+ * Free all memory associated with a DSFormat.
+ ***************************************************************************/
+void
+ds_freeformat (DSFormat *format)
+{
+  if (format == NULL)
+    return;
+
+  free (format->pathformat);
+  free (format->literals);
+  free (format->ops);
+  free (format->dirends);
+  free (format->idcache);
+  if (format->dircache)
+  {
+    ds_cleardircache (format);
+    free (format->dircache);
+  }
+  free (format);
+} /* End of ds_freeformat() */
+
 /***************************************************************************
  * ds_streamproc():
  * Save MiniSEED records in a custom directory/file structure.  The
  * appropriate directories and files are created if nesecessary.  If
- * files already exist they are appended to.  If both 'pathformat' and
- * 'msr' are NULL then ds_shutdown() will be called to close all open files
- * and free all associated memory.
+ * files already exist they are appended to.  If both 'format' and
+ * 'msh' are NULL then ds_shutdown() will be called to close all open files
+ * and free all associated memory.  If only 'msh' is NULL then all
+ * buffered records are written to their files.
+ *
+ * The path format must be compiled with ds_compileformat().
  *
  * Returns 0 on success, -1 on error.
  ***************************************************************************/
 extern int
-ds_streamproc (DataStream **streamroot, char *pathformat, const SLMSrecord *msr,
+ds_streamproc (DataStream **streamroot, DSFormat *format, SLMSheader *msh,
                int reclen, int type, int idletimeout)
 {
   DataStream *foundstream = NULL;
-  SLstrlist *fnlist, *fnptr;
-  char net[3], sta[6], loc[3], chan[4];
-  char filename[400];
-  char definition[400];
+  char filename[DS_MAXPATHLEN];
+  char definition[DS_MAXPATHLEN];
 
   /* Special case for stream shutdown */
-  if (pathformat == NULL && msr == NULL)
+  if (format == NULL && msh == NULL)
   {
-    ds_shutdown (*streamroot);
+    ds_shutdown (streamroot);
     return 0;
   }
 
-  /* Build file path and name from pathformat */
-  filename[0]   = '\0';
-  definition[0] = '\0';
-  sl_strparse (pathformat, "/", &fnlist);
+  /* Special case for flushing buffered records */
+  if (msh == NULL)
+    return ds_flush (*streamroot);
 
-  fnptr = fnlist;
+  /* Build file path and name from the compiled format */
+  if (ds_expandformat (format, msh, type, filename, definition))
+    return -1;
+
+  /* Check for previously used stream entry, otherwise create it */
+  foundstream = ds_getstream (streamroot, format, msh, reclen, definition, filename,
+                              type, idletimeout);
 
-  /* Special case of an absolute path (first entry is empty) */
-  if (*fnptr->element == '\0')
+  if (foundstream != NULL)
   {
-    if (fnptr->next != 0)
+    /*  Write the record to the appropriate file */
+    if (ds_writerecord (foundstream, msh->msrecord, reclen))
     {
-      strncat (filename, "/", sizeof (filename) - 1);
-      fnptr = fnptr->next;
+      sl_log (0, 1,
+              "ds_streamproc: failed to write record\n");
+      return -1;
     }
     else
     {
-      sl_log (1, 0, "ds_streamproc(): empty path format\n");
-      sl_strparse (NULL, NULL, &fnlist);
-      return -1;
+      ds_touchstream (streamroot, foundstream, time (NULL));
     }
+
+    /* Submit queued writes and collect completed ones */
+    if (foundstream->table->aio)
+      dsa_poll (foundstream->table->aio, 0);
+
+    return 0;
   }
 
-  while (fnptr != 0)
+  return -1;
+} /* End of ds_streamproc() */
+
+/***************************************************************************
+ * ds_expandformat():
+ * Expand a compiled path format for a record in a single pass.  The
+ * file name and definition key are written to 'filename' and
+ * 'definition', both of which must have room for DS_MAXPATHLEN
+ * characters.  The length of the file name at each directory
+ * separator is stored in format->dirends.
+ *
+ * Returns 0 on success, -1 on error.
+ ***************************************************************************/
+static int
+ds_expandformat (DSFormat *format, SLMSheader *msh, int type,
+                 char *filename, char *definition)
+{
+  const DSIdent *ident = NULL;
+  const char *vptr;
+  char value[20];
+  int vlen;
+  int fnlen  = 0;
+  int deflen = 0;
+  int diridx = 0;
+  int tdy;
+  int idx;
+
+  for (idx = 0; idx < format->numops; idx++)
   {
-    int tdy;
-    int fnlen = 0;
-    char *w, *p, def;
-    char tstr[20];
+    const DSFormatOp *op = &format->ops[idx];
 
-    p = fnptr->element;
+    vptr = value;
+    vlen = 0;
 
-    /* Special case of no file given */
-    if (*p == '\0' && fnptr->next == 0)
+    if (op->opcode == DSOP_LITERAL)
     {
-      sl_log (1, 0, "ds_streamproc(): no file name specified, only %s\n",
-              filename);
-      sl_strparse (NULL, NULL, &fnlist);
-      return -1;
+      vptr = format->literals + op->offset;
+      vlen = op->length;
     }
-
-    while ((w = strpbrk (p, "%#")) != NULL)
+    else if (op->opcode == DSOP_DIRSEP)
     {
-      def = (*w == '%');
-      *w  = '\0';
-      strncat (filename, p, (sizeof (filename) - fnlen));
-      fnlen = strlen (filename);
-
-      w += 1;
-
-      switch (*w)
+      format->dirends[diridx++] = fnlen;
+      vptr                      = "/";
+      vlen                      = 1;
+    }
+    else
+    {
+      switch (op->field)
       {
       case 't':
-        snprintf (tstr, sizeof (tstr), "%c", sl_typecode (type));
-        strncat (filename, tstr, (sizeof (filename) - fnlen));
-        if (def)
-          strncat (definition, tstr, (sizeof (definition) - fnlen));
-        fnlen = strlen (filename);
-        p     = w + 1;
+        value[0] = sl_typecode (type);
+        vlen     = 1;
         break;
       case 'n':
-        sl_strncpclean (net, msr->fsdh.network, 2);
-        strncat (filename, net, (sizeof (filename) - fnlen));
-        if (def)
-          strncat (definition, net, (sizeof (definition) - fnlen));
-        fnlen = strlen (filename);
-        p     = w + 1;
-        break;
       case 's':
-        sl_strncpclean (sta, msr->fsdh.station, 5);
-        strncat (filename, sta, (sizeof (filename) - fnlen));
-        if (def)
-          strncat (definition, sta, (sizeof (definition) - fnlen));
-        fnlen = strlen (filename);
-        p     = w + 1;
-        break;
       case 'l':
-        sl_strncpclean (loc, msr->fsdh.location, 2);
-        strncat (filename, loc, (sizeof (filename) - fnlen));
-        if (def)
-          strncat (definition, loc, (sizeof (definition) - fnlen));
-        fnlen = strlen (filename);
-        p     = w + 1;
-        break;
       case 'c':
-        sl_strncpclean (chan, msr->fsdh.channel, 3);
-        strncat (filename, chan, (sizeof (filename) - fnlen));
-        if (def)
-          strncat (definition, chan, (sizeof (definition) - fnlen));
-        fnlen = strlen (filename);
-        p     = w + 1;
+        if (ident == NULL)
+          ident = ds_getident (format, msh);
+
+        if (op->field == 'n')
+          vptr = ident->net;
+        else if (op->field == 's')
+          vptr = ident->sta;
+        else if (op->field == 'l')
+          vptr = ident->loc;
+        else
+          vptr = ident->chan;
+
+        vlen = strlen (vptr);
         break;
       case 'Y':
-        snprintf (tstr, sizeof (tstr), "%04d", (int)msr->fsdh.start_time.year);
-        strncat (filename, tstr, (sizeof (filename) - fnlen));
-        if (def)
-          strncat (definition, tstr, (sizeof (definition) - fnlen));
-        fnlen = strlen (filename);
-        p     = w + 1;
+        vlen = ds_formatint (value, sl_msh_starttime (msh)->year, 4);
         break;
       case 'y':
-        tdy = (int)msr->fsdh.start_time.year;
-        while (tdy > 100)
-        {
-          tdy -= 100;
-        }
-        snprintf (tstr, sizeof (tstr), "%02d", tdy);
-        strncat (filename, tstr, (sizeof (filename) - fnlen));
-        if (def)
-          strncat (definition, tstr, (sizeof (definition) - fnlen));
-        fnlen = strlen (filename);
-        p     = w + 1;
+        tdy = sl_msh_starttime (msh)->year;
+        if (tdy > 100)
+          tdy = ((tdy - 1) % 100) + 1;
+        vlen = ds_formatint (value, tdy, 2);
         break;
       case 'j':
-        snprintf (tstr, sizeof (tstr), "%03d", (int)msr->fsdh.start_time.day);
-        strncat (filename, tstr, (sizeof (filename) - fnlen));
-        if (def)
-          strncat (definition, tstr, (sizeof (definition) - fnlen));
-        fnlen = strlen (filename);
-        p     = w + 1;
+        vlen = ds_formatint (value, sl_msh_starttime (msh)->day, 3);
         break;
       case 'H':
-        snprintf (tstr, sizeof (tstr), "%02d", (int)msr->fsdh.start_time.hour);
-        strncat (filename, tstr, (sizeof (filename) - fnlen));
-        if (def)
-          strncat (definition, tstr, (sizeof (definition) - fnlen));
-        fnlen = strlen (filename);
-        p     = w + 1;
+        vlen = ds_formatint (value, sl_msh_starttime (msh)->hour, 2);
         break;
       case 'M':
-        snprintf (tstr, sizeof (tstr), "%02d", (int)msr->fsdh.start_time.min);
-        strncat (filename, tstr, (sizeof (filename) - fnlen));
-        if (def)
-          strncat (definition, tstr, (sizeof (definition) - fnlen));
-        fnlen = strlen (filename);
-        p     = w + 1;
+        vlen = ds_formatint (value, sl_msh_starttime (msh)->min, 2);
         break;
       case 'S':
-        snprintf (tstr, sizeof (tstr), "%02d", (int)msr->fsdh.start_time.sec);
-        strncat (filename, tstr, (sizeof (filename) - fnlen));
-        if (def)
-          strncat (definition, tstr, (sizeof (definition) - fnlen));
-        fnlen = strlen (filename);
-        p     = w + 1;
+        vlen = ds_formatint (value, sl_msh_starttime (msh)->sec, 2);
         break;
       case 'F':
-        snprintf (tstr, sizeof (tstr), "%04d", (int)msr->fsdh.start_time.fract);
-        strncat (filename, tstr, (sizeof (filename) - fnlen));
-        if (def)
-          strncat (definition, tstr, (sizeof (definition) - fnlen));
-        fnlen = strlen (filename);
-        p     = w + 1;
-        break;
-      case '%':
-        strncat (filename, "%", (sizeof (filename) - fnlen));
-        fnlen = strlen (filename);
-        p     = w + 1;
-        break;
-      case '#':
-        strncat (filename, "#", (sizeof (filename) - fnlen));
-        fnlen = strlen (filename);
-        p     = w + 1;
-        break;
-      default:
-        sl_log (1, 0, "Unknown file name format code: %c\n", *w);
-        p = w;
+        vlen = ds_formatint (value, sl_msh_starttime (msh)->fract, 4);
         break;
       }
     }
 
-    strncat (filename, p, (sizeof (filename) - fnlen));
-    fnlen = strlen (filename);
+    if ((fnlen + vlen) >= DS_MAXPATHLEN)
+    {
+      sl_log (1, 0, "ds_streamproc(): file name too long for format %s\n",
+              format->pathformat);
+      return -1;
+    }
+
+    memcpy (filename + fnlen, vptr, vlen);
+    fnlen += vlen;
 
-    /* If not the last entry then it should be a directory */
-    if (fnptr->next != 0)
+    if (op->opcode == DSOP_FIELD && op->defining)
     {
-      if (access (filename, F_OK))
+      memcpy (definition + deflen, vptr, vlen);
+      deflen += vlen;
+    }
+  }
+
+  filename[fnlen]    = '\0';
+  definition[deflen] = '\0';
+
+  return 0;
+} /* End of ds_expandformat() */
+
+/***************************************************************************
+ * ds_getident():
+ * Return the cleaned network, station, location and channel codes for
+ * a record.  The codes are cached in the format, keyed on the raw
+ * (space padded) codes in the fixed header, so that each stream is
+ * only cleaned when first seen or after its cache slot was reused.
+ *
+ * Returns a pointer to the cache entry for the record.
+ ***************************************************************************/
+static const DSIdent *
+ds_getident (DSFormat *format, SLMSheader *msh)
+{
+  DSIdent *ident;
+  const char *raw = msh->fsdh->station;
+  uint32_t hash   = 2166136261U;
+  int idx;
+
+  /* FNV-1a hash of the station, location, channel and network codes,
+     which are contiguous in the fixed header */
+  for (idx = 0; idx < (int)sizeof (ident->raw); idx++)
+  {
+    hash ^= (uint8_t)raw[idx];
+    hash *= 16777619U;
+  }
+
+  ident = &format->idcache[hash & (DS_IDCACHESIZE - 1)];
+
+  if (!ident->valid || memcmp (ident->raw, raw, sizeof (ident->raw)))
+  {
+    memcpy (ident->raw, raw, sizeof (ident->raw));
+    sl_strncpclean (ident->net, msh->fsdh->network, 2);
+    sl_strncpclean (ident->sta, msh->fsdh->station, 5);
+    sl_strncpclean (ident->loc, msh->fsdh->location, 2);
+    sl_strncpclean (ident->chan, msh->fsdh->channel, 3);
+    ident->valid = 1;
+  }
+
+  return ident;
+} /* End of ds_getident() */
+
+/***************************************************************************
+ * ds_formatint():
+ * Format a non-negative integer as decimal digits, zero padded to at
+ * least 'width' digits, equivalent to printf's "%0*d".  The result is
+ * not terminated.
+ *
+ * Returns the number of characters written to 'dest'.
+ ***************************************************************************/
+static int
+ds_formatint (char *dest, int value, int width)
+{
+  char digits[12];
+  int count = 0;
+  int idx;
+
+  do
+  {
+    digits[count++] = '0' + (value % 10);
+    value /= 10;
+  } while (value > 0);
+
+  while (count < width)
+    digits[count++] = '0';
+
+  for (idx = 0; idx < count; idx++)
+    dest[idx] = digits[count - idx - 1];
+
+  return count;
+} /* End of ds_formatint() */
+
+/***************************************************************************
+ * ds_makedirs():
+ * Check that each directory of a file name expanded from 'format'
+ * exists, creating it if needed.  Directories known to exist are kept
+ * in a cache so that the file system is only checked for directories
+ * not seen before; if the deepest directory is cached all of its
+ * parents are assumed to exist.
+ *
+ * Returns 0 on success, -1 on error.
+ ***************************************************************************/
+static int
+ds_makedirs (DSFormat *format, char *filename)
+{
+  DSDirEntry *entry;
+  uint32_t hashes[DS_MAXPATHLEN];
+  uint32_t hash = 2166136261U;
+  int dirlen;
+  int start;
+  int pos = 0;
+  int idx;
+
+  /* Hash of each directory path, each a prefix of the file name */
+  for (idx = 0; idx < format->numdirs; idx++)
+  {
+    for (; pos < format->dirends[idx]; pos++)
+    {
+      hash ^= (uint8_t)filename[pos];
+      hash *= 16777619U;
+    }
+
+    hashes[idx] = hash;
+  }
+
+  /* Find the deepest directory known to exist */
+  for (start = format->numdirs; start > 0; start--)
+  {
+    dirlen = format->dirends[start - 1];
+    entry  = &format->dircache[hashes[start - 1] & (DS_DIRCACHESIZE - 1)];
+
+    if (dirlen == 0 ||
+        (entry->path && entry->hash == hashes[start - 1] &&
+         !strncmp (entry->path, filename, dirlen) && entry->path[dirlen] == '\0'))
+      break;
+  }
+
+  /* Check each directory below that, creating it if needed */
+  for (idx = start; idx < format->numdirs; idx++)
+  {
+    dirlen = format->dirends[idx];
+
+    filename[dirlen] = '\0';
+
+    if (access (filename, F_OK))
+    {
+      if (errno == ENOENT)
       {
-        if (errno == ENOENT)
-        {
-          sl_log (0, 1, "Creating directory: %s\n", filename);
+        sl_log (0, 1, "Creating directory: %s\n", filename);
+
+        /* Another archive thread may create the directory concurrently */
 #if defined(SLP_WIN)
-          if (mkdir (filename))
-          {
-            sl_log (0, 1, "ds_streamproc: mkdir(%s) %s\n", filename,
-                    strerror (errno));
-            sl_strparse (NULL, NULL, &fnlist);
-            return -1;
-          }
-#else
-          if (mkdir (filename, S_IRWXU | S_IRGRP | S_IXGRP | S_IROTH | S_IXOTH))
-          {
-            sl_log (0, 1, "ds_streamproc: mkdir(%s) %s\n", filename,
-                    strerror (errno));
-            sl_strparse (NULL, NULL, &fnlist);
-            return -1;
-          }
-#endif
+        if (mkdir (filename) && errno != EEXIST)
+        {
+          sl_log (0, 1, "ds_streamproc: mkdir(%s) %s\n", filename,
+                  strerror (errno));
+          filename[dirlen] = '/';
+          return -1;
         }
-        else
+#else
+        if (mkdir (filename, S_IRWXU | S_IRGRP | S_IXGRP | S_IROTH | S_IXOTH) && errno != EEXIST)
         {
-          sl_log (1, 0, "%d: access denied, %s\n", filename, strerror (errno));
-          sl_strparse (NULL, NULL, &fnlist);
+          sl_log (0, 1, "ds_streamproc: mkdir(%s) %s\n", filename,
+                  strerror (errno));
+          filename[dirlen] = '/';
           return -1;
         }
+#endif
+      }
+      else
+      {
+        sl_log (1, 0, "%s: access denied, %s\n", filename, strerror (errno));
+        filename[dirlen] = '/';
+        return -1;
       }
-
-      strncat (filename, "/", (sizeof (filename) - fnlen));
-      fnlen++;
     }
 
-    fnptr = fnptr->next;
+    /* Add directory to the cache, replacing any previous entry */
+    entry = &format->dircache[hashes[idx] & (DS_DIRCACHESIZE - 1)];
+
+    free (entry->path);
+    entry->hash = hashes[idx];
+    entry->path = strdup (filename);
+
+    filename[dirlen] = '/';
   }
 
-  sl_strparse (NULL, NULL, &fnlist);
+  return 0;
+} /* End of ds_makedirs() */
 
-  /* Check for previously used stream entry, otherwise create it */
-  foundstream = ds_getstream (streamroot, msr, definition, filename,
-                              type, idletimeout);
+/***************************************************************************
+ * ds_cleardircache():
+ * Remove all entries from the directory cache of a format.
+ ***************************************************************************/
+static void
+ds_cleardircache (DSFormat *format)
+{
+  int idx;
 
-  if (foundstream != NULL)
+  for (idx = 0; idx < DS_DIRCACHESIZE; idx++)
   {
-    /*  Write the record to the appropriate file */
-    if (!fwrite (msr->msrecord, reclen, 1, foundstream->filep))
-    {
-      sl_log (0, 1,
-              "ds_streamproc: failed to write record\n");
-      return -1;
-    }
-    else
-    {
-      foundstream->modtime = time (NULL);
-    }
-    return 0;
+    free (format->dircache[idx].path);
+    format->dircache[idx].path = NULL;
   }
-
-  return -1;
-} /* End of ds_streamproc() */
+} /* End of ds_cleardircache() */
 
 /***************************************************************************
  * ds_getstream():
  * Find the DataStream entry that matches the definition key, if no matching
  * entries are found allocate a new entry and open the given file.
  *
- * The modification time of each stream, modtime, is compared to the current
- * time.  If the stream entry has been idle for 'idletimeout' seconds
- * (default 120) then the stream will be closed.  This will keep us from
- * having many "hanging" open files.
+ * Streams are found using a hash table on the definition key and are
+ * linked in order of modification time, oldest first.  Streams at the
+ * head of the chain that have been idle for more than 'idletimeout'
+ * seconds (default 120) are closed.  This will keep us from having many
+ * "hanging" open files without checking every stream for each record.
+ *
+ * The directories of the file are only checked when a file is opened,
+ * if the open fails because a directory has been removed the directory
+ * cache is cleared and the open is tried once more.  A newly opened file
+ * is preallocated for the record 'msh' if preallocation is enabled.
  *
  * Returns a pointer to DataStream on success or NULL on error.
  ***************************************************************************/
-DataStream *
-ds_getstream (DataStream **streamroot, const SLMSrecord *msr,
-              const char *defkey, const char *filename, int type,
+static DataStream *
+ds_getstream (DataStream **streamroot, DSFormat *format,
+              SLMSheader *msh, int reclen, const char *defkey, char *filename, int type,
               int idletimeout)
 {
+  DSStreamTable *table     = NULL;
   DataStream *foundstream  = NULL;
-  DataStream *searchstream = NULL;
-  DataStream *prevstream   = NULL;
+  const char *mode         = (preallocmode) ? "a+b" : "ab";
   time_t curtime;
+  uint32_t hash;
 
-  searchstream = *streamroot;
-  curtime      = time (NULL);
+  curtime = time (NULL);
+  hash    = ds_hashkey (defkey);
 
-  /* Traverse the stream chain */
-  while (searchstream != NULL)
+  if (*streamroot != NULL)
   {
-    DataStream *nextstream = (struct DataStream_s *)searchstream->next;
-
-    if (foundstream == NULL && !strcmp (searchstream->defkey, defkey))
-    {
-      sl_log (0, 3, "Found data stream entry for key %s\n", defkey);
+    table = (*streamroot)->table;
 
-      prevstream  = searchstream;
-      foundstream = searchstream;
-    }
-    else if ((curtime - searchstream->modtime) > idletimeout)
-    {
-      sl_log (0, 2, "Closing stream with key %s\n", searchstream->defkey);
+    foundstream = table->buckets[hash & (table->numbuckets - 1)];
 
-      /* Re-link the stream chain */
-      if (prevstream != NULL)
-      {
-        if (searchstream->next != NULL)
-          prevstream->next = searchstream->next;
-        else
-          prevstream->next = NULL;
-      }
-      else
-      {
-        if (searchstream->next != NULL)
-          *streamroot = searchstream->next;
-        else
-          *streamroot = NULL;
-      }
+    while (foundstream != NULL &&
+           (foundstream->hash != hash || strcmp (foundstream->defkey, defkey)))
+      foundstream = foundstream->hashnext;
+  }
 
-      if (fclose (searchstream->filep))
-        sl_log (1, 0, "ds_getstream(), closing data stream file, %s\n",
-                strerror (errno));
+  if (foundstream != NULL)
+    sl_log (0, 3, "Found data stream entry for key %s\n", defkey);
 
-      free (searchstream->defkey);
-      free (searchstream);
-    }
-    else
-    {
-      prevstream = searchstream;
-    }
+  /* Close idle streams, the oldest are at the head of the chain */
+  while (*streamroot != NULL && *streamroot != foundstream &&
+         (curtime - (*streamroot)->modtime) > idletimeout)
+  {
+    sl_log (0, 2, "Closing stream with key %s\n", (*streamroot)->defkey);
 
-    searchstream = nextstream;
+    ds_removestream (streamroot, *streamroot);
   }
 
   /* If not found, create a stream entry */
@@ -366,96 +661,775 @@ ds_getstream (DataStream **streamroot, const SLMSrecord *msr,
   {
     sl_log (0, 2, "Creating data stream entry for key %s\n", defkey);
 
-    foundstream = (DataStream *)malloc (sizeof (DataStream));
+    if ((foundstream = ds_addstream (streamroot, defkey, hash)) == NULL)
+      return NULL;
 
-    foundstream->defkey  = strdup (defkey);
-    foundstream->filep   = NULL;
     foundstream->modtime = curtime;
-    foundstream->next    = NULL;
+  }
 
-    /* Set the stream root if this is the first entry */
-    if (*streamroot == NULL)
-    {
-      *streamroot = (struct DataStream_s *)foundstream;
-    }
-    else if (prevstream != NULL)
-    {
-      prevstream->next = (struct DataStream_s *)foundstream;
-    }
-    else
-    {
-      sl_log (1, 0, "stream chain is broken!\n");
-      return NULL;
-    }
+  /* Re-open a file that failed to open asynchronously */
+  if (foundstream->afile && dsa_error (foundstream->afile))
+  {
+    dsa_close (foundstream->afile);
+    foundstream->afile = NULL;
   }
 
   /* If no file is open, well, open it */
-  if (foundstream->filep == NULL)
+  if (foundstream->filep == NULL && foundstream->afile == NULL)
   {
     sl_log (0, 2, "Creating new data stream file\n");
 
-    if ((foundstream->filep = fopen (filename, "ab")) == NULL)
-    {
-      sl_log (1, 0, "opening new data stream file, %s\n", strerror (errno));
+    if (ds_makedirs (format, filename))
       return NULL;
-    }
 
-    setvbuf (foundstream->filep, NULL, _IONBF, 0);
-  }
+    /* Queue the open, errors are reported when it completes */
+    if (foundstream->table->aio)
+    {
+      foundstream->afile = dsa_open (foundstream->table->aio, filename,
+                                     &foundstream->modtime);
 
-  /* If a file is open check that the definition key still matches,
-     if not close the previous file and open a new one */
-  else if (strcmp (defkey, foundstream->defkey))
-  {
-    sl_log (0, 2, "Opening new data stream file\n");
+      return (foundstream->afile) ? foundstream : NULL;
+    }
 
-    if (fclose (foundstream->filep))
+    if ((foundstream->filep = fopen (filename, mode)) == NULL && errno == ENOENT)
     {
-      sl_log (1, 0, "closing data stream file, %s\n", strerror (errno));
-      return NULL;
+      sl_log (0, 2, "Directory removed, clearing directory cache\n");
+
+      ds_cleardircache (format);
+
+      if (ds_makedirs (format, filename))
+        return NULL;
+
+      foundstream->filep = fopen (filename, mode);
     }
 
-    if ((foundstream->filep = fopen (filename, "ab")) == NULL)
+    if (foundstream->filep == NULL)
     {
-      sl_log (1, 0, "opening data stream file, %s\n", strerror (errno));
+      sl_log (1, 0, "opening new data stream file, %s\n", strerror (errno));
       return NULL;
     }
 
     setvbuf (foundstream->filep, NULL, _IONBF, 0);
+
+    if (preallocmode)
+      ds_preallocate (foundstream, msh, reclen);
   }
 
   return foundstream;
 } /* End of ds_getstream() */
 
 /***************************************************************************
- * ds_shutdown():
- * Close all stream files and release all of the DataStream memory
- * structures.
+ * ds_addstream():
+ * Allocate a new DataStream for the definition key, add it to the hash
+ * table and link it at the tail of the stream chain.  The stream table
+ * is created with the first stream and grown as needed.
+ *
+ * Returns a pointer to the new DataStream on success or NULL on error.
+ ***************************************************************************/
+static DataStream *
+ds_addstream (DataStream **streamroot, const char *defkey, uint32_t hash)
+{
+  DSStreamTable *table;
+  DataStream *newstream;
+  int bucket;
+
+  if (*streamroot == NULL)
+  {
+    if ((table = (DSStreamTable *)malloc (sizeof (DSStreamTable))) == NULL)
+    {
+      sl_log (1, 0, "ds_addstream(): error allocating memory\n");
+      return NULL;
+    }
+
+    table->numbuckets = DS_TABLESIZE;
+    table->numstreams = 0;
+    table->tail       = NULL;
+    table->aio        = (asyncmode) ? dsa_new (asyncmode) : NULL;
+    table->buckets    = (DataStream **)calloc (table->numbuckets, sizeof (DataStream *));
+
+    if (table->buckets == NULL)
+    {
+      sl_log (1, 0, "ds_addstream(): error allocating memory\n");
+      dsa_free (table->aio);
+      free (table);
+      return NULL;
+    }
+  }
+  else
+  {
+    table = (*streamroot)->table;
+
+    /* Double the number of buckets when the table is full */
+    if (table->numstreams >= table->numbuckets)
+    {
+      DataStream **buckets;
+      DataStream *stream;
+      int numbuckets = table->numbuckets * 2;
+
+      if ((buckets = (DataStream **)calloc (numbuckets, sizeof (DataStream *))) == NULL)
+      {
+        sl_log (1, 0, "ds_addstream(): error allocating memory\n");
+        return NULL;
+      }
+
+      for (stream = *streamroot; stream != NULL; stream = stream->next)
+      {
+        bucket           = stream->hash & (numbuckets - 1);
+        stream->hashnext = buckets[bucket];
+        buckets[bucket]  = stream;
+      }
+
+      free (table->buckets);
+      table->buckets    = buckets;
+      table->numbuckets = numbuckets;
+    }
+  }
+
+  if ((newstream = (DataStream *)malloc (sizeof (DataStream))) == NULL ||
+      (newstream->defkey = strdup (defkey)) == NULL)
+  {
+    sl_log (1, 0, "ds_addstream(): error allocating memory\n");
+    free (newstream);
+    if (*streamroot == NULL)
+    {
+      dsa_free (table->aio);
+      free (table->buckets);
+      free (table);
+    }
+    return NULL;
+  }
+
+  newstream->filep   = NULL;
+  newstream->afile   = NULL;
+  newstream->buffer  = NULL;
+  newstream->buflen  = 0;
+  newstream->prealloc = 0;
+  newstream->map     = NULL;
+  newstream->modtime = 0;
+  newstream->hash    = hash;
+  newstream->table   = table;
+
+  /* Add to hash bucket */
+  bucket                 = hash & (table->numbuckets - 1);
+  newstream->hashnext    = table->buckets[bucket];
+  table->buckets[bucket] = newstream;
+
+  /* Link at the tail of the stream chain */
+  newstream->next = NULL;
+  newstream->prev = table->tail;
+
+  if (table->tail != NULL)
+    table->tail->next = newstream;
+  else
+    *streamroot = newstream;
+
+  table->tail = newstream;
+  table->numstreams++;
+
+  return newstream;
+} /* End of ds_addstream() */
+
+/***************************************************************************
+ * ds_touchstream():
+ * Set the modification time of a stream and move it to the tail of the
+ * stream chain, keeping the chain in order of modification time.
+ ***************************************************************************/
+static void
+ds_touchstream (DataStream **streamroot, DataStream *stream, time_t modtime)
+{
+  DSStreamTable *table = stream->table;
+
+  stream->modtime = modtime;
+
+  if (table->tail == stream)
+    return;
+
+  /* Unlink from the chain */
+  if (stream->prev != NULL)
+    stream->prev->next = stream->next;
+  else
+    *streamroot = stream->next;
+
+  stream->next->prev = stream->prev;
+
+  /* Link at the tail */
+  stream->prev      = table->tail;
+  stream->next      = NULL;
+  table->tail->next = stream;
+  table->tail       = stream;
+} /* End of ds_touchstream() */
+
+/***************************************************************************
+ * ds_removestream():
+ * Close the file of a stream, remove it from the hash table and stream
+ * chain and free all associated memory.  The stream table is freed with
+ * the last stream.
+ ***************************************************************************/
+static void
+ds_removestream (DataStream **streamroot, DataStream *stream)
+{
+  DSStreamTable *table = stream->table;
+  DataStream **link;
+
+  /* Remove from hash bucket */
+  link = &table->buckets[stream->hash & (table->numbuckets - 1)];
+
+  while (*link != stream)
+    link = &(*link)->hashnext;
+
+  *link = stream->hashnext;
+
+  /* Re-link the stream chain */
+  if (stream->prev != NULL)
+    stream->prev->next = stream->next;
+  else
+    *streamroot = stream->next;
+
+  if (stream->next != NULL)
+    stream->next->prev = stream->prev;
+  else
+    table->tail = stream->prev;
+
+  ds_flushstream (stream);
+
+  free (stream->buffer);
+
+  if (stream->prealloc)
+    ds_trim (stream);
+
+  if (stream->filep && fclose (stream->filep))
+    sl_log (1, 0, "ds_removestream(), closing data stream file, %s\n",
+            strerror (errno));
+
+  if (stream->afile)
+    dsa_close (stream->afile);
+
+  free (stream->defkey);
+  free (stream);
+
+  /* Wait for all queued operations when freeing the table */
+  if (--table->numstreams == 0)
+  {
+    dsa_free (table->aio);
+    free (table->buckets);
+    free (table);
+  }
+} /* End of ds_removestream() */
+
+/***************************************************************************
+ * ds_setbuffersize():
+ * Set the size of the write buffer used for each stream.  Records are
+ * collected in the buffer and written to the file when the buffer is
+ * full, when flushed with ds_streamproc() or when the stream is closed.
+ * A size of 0, the default, writes each record directly to the file.
  ***************************************************************************/
 void
-ds_shutdown (DataStream *streamroot)
+ds_setbuffersize (int size)
 {
-  DataStream *curstream  = NULL;
-  DataStream *prevstream = NULL;
+  bufsize = (size > 0) ? size : 0;
+} /* End of ds_setbuffersize() */
 
-  curstream = streamroot;
+/***************************************************************************
+ * ds_setasync():
+ * Set the asynchronous I/O backend used to write stream files, one of
+ * DSA_NONE (the default), DSA_URING or DSA_THREADS.  Files are then
+ * opened, written and closed without waiting for the operations to
+ * complete, flushing waits until all queued writes are done.  The
+ * backend applies to archives started after this call.
+ ***************************************************************************/
+void
+ds_setasync (int backend)
+{
+  asyncmode = backend;
+} /* End of ds_setasync() */
 
-  if (curstream != NULL)
-    sl_log (0, 2, "Flushing and closing data stream structures\n");
+/***************************************************************************
+ * ds_setprealloc():
+ * Set the preallocation of newly opened files written synchronously,
+ * one of DS_PREALLOC_NONE (the default), DS_PREALLOC_KEEP or
+ * DS_PREALLOC_MMAP.  With DS_PREALLOC_KEEP space is reserved beyond the
+ * end of each file so that it is allocated in large extents while the
+ * length of the file is unchanged.  With DS_PREALLOC_MMAP the file is
+ * extended by the preallocation and records are copied to a mapped
+ * window of the file, readers see zeros after the records until the
+ * file is closed.  Files are truncated to their records when closed.
+ *
+ * Returns 0 on success, -1 if not supported on this platform.
+ ***************************************************************************/
+int
+ds_setprealloc (int mode)
+{
+#if defined(SLP_WIN)
+  if (mode != DS_PREALLOC_NONE)
+    return -1;
+#endif
+
+  preallocmode = mode;
+
+  return 0;
+} /* End of ds_setprealloc() */
+
+/***************************************************************************
+ * ds_writerecord():
+ * Write a record to the file of a stream, collecting records in the
+ * stream's write buffer if buffering is enabled.
+ *
+ * Returns 0 on success, -1 on error.
+ ***************************************************************************/
+static int
+ds_writerecord (DataStream *stream, const char *record, int reclen)
+{
+  char *copy;
+
+  /* Write directly if not buffering or the record does not fit */
+  if (bufsize < reclen)
+  {
+    if (ds_flushstream (stream))
+      return -1;
+
+    if (stream->afile)
+    {
+      if ((copy = (char *)malloc (reclen)) == NULL)
+      {
+        sl_log (1, 0, "ds_writerecord(): error allocating memory\n");
+        return -1;
+      }
+
+      memcpy (copy, record, reclen);
+
+      return dsa_write (stream->afile, copy, reclen);
+    }
+
+    return ds_writefile (stream, record, reclen);
+  }
+
+  if (stream->buffer == NULL)
+  {
+    if ((stream->buffer = (char *)malloc (bufsize)) == NULL)
+    {
+      sl_log (1, 0, "ds_writerecord(): error allocating memory\n");
+      return -1;
+    }
+  }
+  else if ((stream->buflen + reclen) > bufsize)
+  {
+    if (ds_flushstream (stream))
+      return -1;
+  }
+
+  memcpy (stream->buffer + stream->buflen, record, reclen);
+  stream->buflen += reclen;
+
+  if (stream->buflen >= bufsize)
+    return ds_flushstream (stream);
+
+  return 0;
+} /* End of ds_writerecord() */
+
+/***************************************************************************
+ * ds_flushstream():
+ * Write any buffered records of a stream to its file.
+ *
+ * Returns 0 on success, -1 on error.
+ ***************************************************************************/
+static int
+ds_flushstream (DataStream *stream)
+{
+  char *buffer;
+  int buflen = stream->buflen;
+
+  if (buflen == 0)
+    return 0;
+
+  stream->buflen = 0;
 
-  while (curstream != NULL)
+  /* The buffer is handed to the asynchronous write */
+  if (stream->afile)
   {
-    prevstream = curstream;
-    curstream  = (struct DataStream_s *)curstream->next;
+    buffer         = stream->buffer;
+    stream->buffer = NULL;
 
-    sl_log (0, 3, "Shutting down stream with key: %s\n", prevstream->defkey);
+    if (dsa_write (stream->afile, buffer, buflen))
+    {
+      sl_log (1, 0, "ds_flushstream(): error writing %d bytes for key %s\n",
+              buflen, stream->defkey);
+      return -1;
+    }
 
-    if (fclose (prevstream->filep))
-      sl_log (1, 0, "ds_shutdown(), closing data stream file, %s\n",
-              strerror (errno));
+    return 0;
+  }
+
+  if (stream->filep == NULL || ds_writefile (stream, stream->buffer, buflen))
+  {
+    sl_log (1, 0, "ds_flushstream(): error writing %d bytes for key %s\n",
+            buflen, stream->defkey);
+    return -1;
+  }
+
+  return 0;
+} /* End of ds_flushstream() */
+
+/***************************************************************************
+ * ds_writefile():
+ * Write data to the file of a stream that is written synchronously.
+ * Preallocated space is extended as needed, with DS_PREALLOC_MMAP the
+ * data are copied to the mapped window, which is moved forward when
+ * it is full.
+ *
+ * Returns 0 on success, -1 on error.
+ ***************************************************************************/
+static int
+ds_writefile (DataStream *stream, const char *data, int length)
+{
+  if (!stream->prealloc)
+    return (fwrite (data, length, 1, stream->filep)) ? 0 : -1;
+
+#if !defined(SLP_WIN)
+  if (preallocmode == DS_PREALLOC_MMAP)
+  {
+    if (!stream->map || stream->size + length > stream->mapstart + (off_t)stream->maplen)
+    {
+      long pagesize = sysconf (_SC_PAGESIZE);
+
+      if (stream->map)
+        munmap (stream->map, stream->maplen);
+
+      stream->map      = NULL;
+      stream->mapstart = stream->size & ~((off_t)pagesize - 1);
+      stream->maplen   = DS_MAPWINDOW;
+
+      if (stream->size - stream->mapstart + length > (off_t)stream->maplen)
+        stream->maplen = (stream->size - stream->mapstart + length + pagesize - 1) &
+                         ~((size_t)pagesize - 1);
+
+      /* Never map space that is not reserved, stores to it would fault
+         when the disk is full, continue with appends instead */
+      if (ds_extend (stream, stream->mapstart + stream->maplen))
+      {
+        sl_log (1, 0, "ds_writefile(): writing %s without mapping\n", stream->defkey);
+
+        ds_trim (stream);
+        stream->prealloc = 0;
+
+        if (!fwrite (data, length, 1, stream->filep))
+          return -1;
+
+        stream->size += length;
+
+        return 0;
+      }
+
+      if ((stream->map = (char *)mmap (NULL, stream->maplen, PROT_READ | PROT_WRITE,
+                                       MAP_SHARED, fileno (stream->filep),
+                                       stream->mapstart)) == MAP_FAILED)
+      {
+        sl_log (1, 0, "ds_writefile(): cannot map %s: %s\n", stream->defkey,
+                strerror (errno));
+        stream->map = NULL;
+        return -1;
+      }
+    }
+
+    memcpy (stream->map + (stream->size - stream->mapstart), data, length);
+    stream->size += length;
+
+    return 0;
+  }
+
+  /* Extending is best effort, appends proceed without preallocation */
+  ds_extend (stream, stream->size + length);
+#endif
+
+  if (!fwrite (data, length, 1, stream->filep))
+    return -1;
+
+  stream->size += length;
+
+  return 0;
+} /* End of ds_writefile() */
+
+/***************************************************************************
+ * ds_preallocate():
+ * Set up the preallocation of a newly opened file of a stream.  The
+ * size preallocated at a time is estimated from the first record: the
+ * record length times the number of records expected until the end of
+ * its day, from the time covered by the record, limited to
+ * DS_MINPREALLOC and DS_MAXPREALLOC.
+ *
+ * The end of the data in the file is found with ds_recover(), a file
+ * left extended by a crash is truncated to its records.  Preallocation
+ * is disabled for the stream if the file system does not support it.
+ ***************************************************************************/
+static void
+ds_preallocate (DataStream *stream, SLMSheader *msh, int reclen)
+{
+#if !defined(SLP_WIN)
+  const struct sl_btime_s *btime = sl_msh_starttime (msh);
+  struct stat st;
+  double start;
+  double end;
+  double duration;
+  double estimate;
+  off_t size;
+  int fd = fileno (stream->filep);
+
+  if (fstat (fd, &st))
+    return;
+
+  if ((size = ds_recover (fd, st.st_size)) < st.st_size)
+  {
+    sl_log (1, 0, "truncating %s from %lld to %lld bytes, preallocated space was not trimmed\n",
+            stream->defkey, (long long)st.st_size, (long long)size);
+
+    if (ftruncate (fd, size))
+      return;
+  }
+
+  /* Times of day, end times past midnight are taken to be on the next day */
+  start = btime->hour * 3600 + btime->min * 60 + btime->sec + btime->fract / 10000.0;
+  end   = sl_msh_depochetime (msh);
+  end  -= (double)((int64_t)end / 86400 * 86400);
+
+  if ((duration = end - start) < 0.0)
+    duration += 86400.0;
+
+  estimate = (duration > 0.0) ? reclen * (86400.0 - start) / duration : 0.0;
+
+  if (estimate > DS_MAXPREALLOC)
+    estimate = DS_MAXPREALLOC;
+
+  stream->prealloc  = ((int)estimate + DS_MINPREALLOC - 1) / DS_MINPREALLOC * DS_MINPREALLOC;
+  stream->size      = size;
+  stream->allocated = size;
+  stream->map       = NULL;
+
+  if (stream->prealloc < DS_MINPREALLOC)
+    stream->prealloc = DS_MINPREALLOC;
+
+  sl_log (0, 3, "Preallocating %d bytes at a time for key %s\n",
+          stream->prealloc, stream->defkey);
+#endif
+} /* End of ds_preallocate() */
+
+/***************************************************************************
+ * ds_extend():
+ * Preallocate the file of a stream up to at least 'end', in steps of
+ * the preallocation size of the stream.  DS_PREALLOC_KEEP reserves the
+ * space beyond the end of the file without changing its length,
+ * DS_PREALLOC_MMAP extends the file.
+ *
+ * Returns 0 on success, -1 on error.
+ ***************************************************************************/
+static int
+ds_extend (DataStream *stream, off_t end)
+{
+#if !defined(SLP_WIN)
+  int fd = fileno (stream->filep);
+  int retval;
+
+  while (stream->allocated < end)
+  {
+    if (preallocmode == DS_PREALLOC_MMAP)
+    {
+      /* The mapped window must be backed by reserved space */
+      if ((retval = posix_fallocate (fd, stream->allocated, stream->prealloc)))
+      {
+        sl_log (1, 0, "ds_extend(): cannot extend %s: %s\n", stream->defkey,
+                strerror (retval));
+        return -1;
+      }
+    }
+    else
+    {
+#if defined(FALLOC_FL_KEEP_SIZE)
+      retval = fallocate (fd, FALLOC_FL_KEEP_SIZE, stream->allocated, stream->prealloc);
+#else
+      retval = -1;
+      errno  = EOPNOTSUPP;
+#endif
+      if (retval)
+      {
+        sl_log (0, 2, "Preallocation not supported for key %s: %s\n",
+                stream->defkey, strerror (errno));
+        stream->allocated = (off_t)1 << 62;
+        return -1;
+      }
+    }
+
+    stream->allocated += stream->prealloc;
+  }
+#endif
+
+  return 0;
+} /* End of ds_extend() */
+
+/***************************************************************************
+ * ds_recover():
+ * Find the end of the records in a file of 'size' bytes.  A file that
+ * ends in zeros may have been left extended by a crash before its
+ * preallocated space was trimmed.  Only its tail is scanned: the last
+ * record is the one covering the last non-zero byte, found at the
+ * record boundaries (multiples of the minimum record length of 128
+ * bytes) before it.  Without such a record the file is scanned from
+ * the beginning using the record lengths until a record that is all
+ * zeros.
+ *
+ * Returns the length of the records in the file.
+ ***************************************************************************/
+static off_t
+ds_recover (int fd, off_t size)
+{
+#if !defined(SLP_WIN)
+  char header[256];
+  char block[16384];
+  off_t offset = 0;
+  off_t last   = -1;
+  off_t start;
+  ssize_t nread;
+  int reclen;
+  int idx;
+
+  if (size < 64 || pread (fd, header, 64, size - 64) != 64)
+    return size;
+
+  for (idx = 0; idx < 64 && !header[idx]; idx++)
+    ;
+
+  if (idx < 64)
+    return size;
+
+  /* Find the last non-zero byte, backwards from the end */
+  for (start = size; start > 0 && last < 0;)
+  {
+    start = (start > (off_t)sizeof (block)) ? start - sizeof (block) : 0;
+
+    if ((nread = pread (fd, block, sizeof (block), start)) <= 0)
+      return size;
+
+    for (idx = (int)nread - 1; idx >= 0 && !block[idx]; idx--)
+      ;
+
+    if (idx >= 0)
+      last = start + idx;
+  }
+
+  if (last < 0)
+    return 0;
+
+  /* The record covering the last non-zero byte ends the records */
+  for (start = last & ~(off_t)127; start >= 0 && last - start < SLMAXRECSIZE; start -= 128)
+  {
+    if ((nread = pread (fd, header, sizeof (header), start)) < 48)
+      break;
+
+    if ((reclen = sl_reclen (header, nread)) > 0 && start + reclen > last)
+      return (start + reclen < size) ? start + reclen : size;
+  }
+
+  while (offset < size)
+  {
+    if ((nread = pread (fd, header, sizeof (header), offset)) < 48)
+      break;
+
+    for (idx = 0; idx < 48 && !header[idx]; idx++)
+      ;
+
+    if (idx == 48)
+      break;
+
+    if ((reclen = sl_reclen (header, nread)) <= 0)
+      reclen = SLRECSIZE;
+
+    offset += reclen;
+  }
+
+  return (offset < size) ? offset : size;
+#else
+  return size;
+#endif
+} /* End of ds_recover() */
+
+/***************************************************************************
+ * ds_trim():
+ * Release the mapped window of a preallocated file and truncate the
+ * file to the length of its data, releasing preallocated space.
+ ***************************************************************************/
+static void
+ds_trim (DataStream *stream)
+{
+#if !defined(SLP_WIN)
+  if (stream->map)
+    munmap (stream->map, stream->maplen);
+
+  stream->map = NULL;
+
+  if (stream->filep && ftruncate (fileno (stream->filep), stream->size))
+    sl_log (1, 0, "ds_trim(): cannot truncate %s: %s\n", stream->defkey,
+            strerror (errno));
+#endif
+} /* End of ds_trim() */
+
+/***************************************************************************
+ * ds_flush():
+ * Write the buffered records of all streams to their files.
+ *
+ * Returns 0 on success, -1 on error.
+ ***************************************************************************/
+static int
+ds_flush (DataStream *streamroot)
+{
+  DataStream *stream;
+  int retval = 0;
+
+  for (stream = streamroot; stream != NULL; stream = stream->next)
+  {
+    if (ds_flushstream (stream))
+      retval = -1;
+  }
+
+  /* Records are written once all queued writes are complete */
+  if (streamroot && streamroot->table->aio && dsa_wait (streamroot->table->aio))
+    retval = -1;
+
+  return retval;
+} /* End of ds_flush() */
+
+/***************************************************************************
+ * ds_hashkey():
+ * Calculate the FNV-1a hash of a definition key.
+ *
+ * Returns the hash value.
+ ***************************************************************************/
+static uint32_t
+ds_hashkey (const char *defkey)
+{
+  uint32_t hash = 2166136261U;
+
+  while (*defkey)
+  {
+    hash ^= (uint8_t)*defkey++;
+    hash *= 16777619U;
+  }
+
+  return hash;
+} /* End of ds_hashkey() */
+
+/***************************************************************************
+ * ds_shutdown():
+ * Close all stream files and release all of the DataStream memory
+ * structures.
+ ***************************************************************************/
+static void
+ds_shutdown (DataStream **streamroot)
+{
+  if (*streamroot != NULL)
+    sl_log (0, 2, "Flushing and closing data stream structures\n");
+
+  while (*streamroot != NULL)
+  {
+    sl_log (0, 3, "Shutting down stream with key: %s\n", (*streamroot)->defkey);
 
-    free (prevstream->defkey);
-    free (prevstream);
+    ds_removestream (streamroot, *streamroot);
   }
 } /* End of ds_shutdown() */
 
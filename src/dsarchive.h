@@ -1,11 +1,13 @@
-
 #ifndef DSARCHIVE_H
 #define DSARCHIVE_H
 
 #include <stdio.h>
 #include <time.h>
+#include <sys/types.h>
 #include <libslink.h>
 
+#include "dsasync.h"
+
 #if defined (SLP_WIN)
   #include <io.h>
   #include <direct.h>
@@ -17,20 +19,125 @@
   #endif
 #endif
 
+/* Maximum length of an expanded file name or definition key */
+#define DS_MAXPATHLEN 400
+
+/* Size of the per-format cache of cleaned NET/STA/LOC/CHAN codes,
+ * must be a power of 2 */
+#define DS_IDCACHESIZE 1024
+
+/* Size of the per-format cache of directories known to exist,
+ * must be a power of 2 */
+#define DS_DIRCACHESIZE 1024
+
+/* Preallocation modes of newly opened files, see ds_setprealloc() */
+#define DS_PREALLOC_NONE 0 /* Files grow with each write */
+#define DS_PREALLOC_KEEP 1 /* Preallocate beyond the end of the file */
+#define DS_PREALLOC_MMAP 2 /* Extend the file and append through a mapping */
+
+/* Limits of a single preallocation and its alignment (bytes) */
+#define DS_MINPREALLOC 65536
+#define DS_MAXPREALLOC 268435456
+
+/* Size of the mapped window for DS_PREALLOC_MMAP (bytes) */
+#define DS_MAPWINDOW 4194304
+
+/* Path format operation codes */
+#define DSOP_LITERAL 0 /* Copy literal text */
+#define DSOP_DIRSEP  1 /* Directory separator */
+#define DSOP_FIELD   2 /* Expand a record field */
+
+/* A single operation of a compiled path format */
+typedef struct DSFormatOp_s
+{
+  int8_t  opcode;        /* Operation code, DSOP_* */
+  char    field;         /* Field flag for DSOP_FIELD, e.g. 'n', 'Y', 'j' */
+  int8_t  defining;      /* Field is part of the definition key ('%') */
+  int     offset;        /* Offset of DSOP_LITERAL text in literals */
+  int     length;        /* Length of DSOP_LITERAL text */
+}
+DSFormatOp;
+
+/* Cleaned stream codes of a record, keyed on the raw header codes */
+typedef struct DSIdent_s
+{
+  char    raw[12];       /* Raw STA, LOC, CHAN and NET from the FSDH */
+  int8_t  valid;         /* Entry is populated */
+  char    net[3];
+  char    sta[6];
+  char    loc[3];
+  char    chan[4];
+}
+DSIdent;
+
+/* A directory known to exist */
+typedef struct DSDirEntry_s
+{
+  uint32_t hash;         /* Hash of the directory path */
+  char    *path;         /* Directory path, NULL for an empty entry */
+}
+DSDirEntry;
+
+/* A path format compiled by ds_compileformat() */
+typedef struct DSFormat_s
+{
+  char       *pathformat; /* The original path format string */
+  char       *literals;   /* Literal text referenced by the operations */
+  DSFormatOp *ops;        /* Operations in path order */
+  int         numops;     /* Number of operations */
+  int         numdirs;    /* Number of directory separators */
+  int        *dirends;    /* Scratch: filename length at each separator */
+  DSIdent    *idcache;    /* Cache of cleaned stream codes */
+  DSDirEntry *dircache;   /* Cache of existing directories */
+}
+DSFormat;
+
 /* For the data stream chains */
+/* Initial number of hash buckets in a stream table, must be a power of 2 */
+#define DS_TABLESIZE 256
+
+/* Hash table of the DataStreams of an archive, shared by all entries */
+typedef struct DSStreamTable_s
+{
+  struct DataStream_s **buckets;   /* Hash buckets of streams by defkey */
+  int     numbuckets;
+  int     numstreams;
+  struct DataStream_s *tail;       /* Most recently modified stream */
+  DSAsync *aio;                    /* Asynchronous writes, see ds_setasync() */
+}
+DSStreamTable;
+
+/* Streams are linked in order of modification time, oldest first */
 typedef struct DataStream_s
 {
   char   *defkey;
   FILE   *filep;
+  DSAFile *afile;                  /* File for asynchronous writes */
+  char   *buffer;                  /* Write buffer, see ds_setbuffersize() */
+  int     buflen;                  /* Length of buffered data */
+  int     prealloc;                /* Bytes preallocated at a time, 0 if not */
+  off_t   size;                    /* Length of the data in a preallocated file */
+  off_t   allocated;               /* End of the preallocated space */
+  char   *map;                     /* Mapped window of DS_PREALLOC_MMAP */
+  off_t   mapstart;                /* File offset of the mapped window */
+  size_t  maplen;                  /* Length of the mapped window */
   time_t  modtime;
+  uint32_t hash;
   struct DataStream_s *next;
+  struct DataStream_s *prev;
+  struct DataStream_s *hashnext;
+  DSStreamTable *table;
 }
 DataStream;
 
 
-extern int ds_streamproc (DataStream **streamroot, char *pathformat,
-			  const SLMSrecord *msr, int reclen, int type,
+extern DSFormat *ds_compileformat (const char *pathformat);
+extern void ds_freeformat (DSFormat *format);
+extern void ds_setbuffersize (int size);
+extern void ds_setasync (int backend);
+extern int ds_setprealloc (int mode);
+extern int ds_streamproc (DataStream **streamroot, DSFormat *format,
+			  SLMSheader *msh, int reclen, int type,
 			  int idletimeout);
 
 #endif
-
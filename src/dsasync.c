@@ -0,0 +1,1030 @@
+/***************************************************************************
+ * dsasync.c
+ *
+ * Asynchronous writing of archive files.
+ *
+ * File opens, appends and closes are queued per file and submitted to
+ * an I/O backend without waiting for them to complete: io_uring on
+ * Linux or a pool of I/O threads otherwise.  Only one operation of a
+ * file is in flight at any time, preserving the order of the records
+ * written to each file, while the operations of many files are
+ * submitted in batches and run concurrently.
+ *
+ * Completions are collected by the thread using the archive with
+ * dsa_poll() or dsa_wait(), errors are reported through sl_log() and
+ * the modification time of a stream is updated when a write completes.
+ * Each DSAsync is used by a single archiving thread.
+ *
+ * modified: 2026.287
+ ***************************************************************************/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <libslink.h>
+
+#include "dsasync.h"
+
+#ifndef SLP_WIN
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#if defined(__linux__)
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+/* Use io_uring if the system headers support it */
+#if defined(__linux__) && defined(__NR_io_uring_setup) && defined(IORING_FEAT_RW_CUR_POS)
+#define DSA_HAVE_URING 1
+#endif
+
+/* Operation codes */
+#define DSA_OPOPEN  0
+#define DSA_OPWRITE 1
+#define DSA_OPCLOSE 2
+
+/* A queued file operation */
+typedef struct DSAOp_s
+{
+  int     opcode;
+  char   *buffer;        /* Data to write, owned by the operation */
+  int     length;        /* Length of the data to write */
+  int     done;          /* Number of bytes already written */
+  struct DSAOp_s *next;
+}
+DSAOp;
+
+struct DSAFile_s
+{
+  DSAsync *aio;
+  char   *path;
+  int     fd;            /* File descriptor, -1 until opened */
+  int     error;         /* errno of a failed open, 0 if none */
+  int     retried;       /* Flag: directories re-created after ENOENT */
+  time_t *modtime;       /* Updated when writes complete, NULL once closed */
+  DSAOp  *head;          /* Queued operations, the head is started first */
+  DSAOp  *tail;
+  int     inflight;      /* Flag: head operation is started */
+  int     result;        /* Result of a thread pool operation */
+  struct DSAFile_s *next; /* Next file in a ready, job or completion list */
+};
+
+struct DSAsync_s
+{
+  int     backend;       /* DSA_URING or DSA_THREADS */
+  int     inflight;      /* Number of operations in flight */
+  int64_t pending;       /* Number of bytes queued for writing */
+  int     errors;        /* Number of failed operations since dsa_wait() */
+
+#if defined(DSA_HAVE_URING)
+  /* io_uring */
+  int     ringfd;
+  unsigned entries;      /* Number of submission queue entries */
+  unsigned tosubmit;     /* Number of entries not yet submitted */
+  unsigned *sqtail;
+  unsigned *sqmask;
+  unsigned *sqarray;
+  unsigned *cqhead;
+  unsigned *cqtail;
+  unsigned *cqmask;
+  struct io_uring_sqe *sqes;
+  struct io_uring_cqe *cqes;
+  void   *sqring;
+  void   *cqring;
+  size_t  sqringsize;
+  size_t  cqringsize;
+  size_t  sqessize;
+  DSAFile *ready;        /* Files waiting for a free entry */
+  DSAFile *readytail;
+#endif
+
+  /* Thread pool */
+  pthread_t threads[DSA_POOLSIZE];
+  int     numthreads;
+  int     stop;          /* Flag: stop the I/O threads */
+  DSAFile *jobs;         /* Files with a started operation */
+  DSAFile *jobstail;
+  DSAFile *done;         /* Files with a completed operation */
+  DSAFile *donetail;
+  pthread_mutex_t lock;
+  pthread_cond_t  jobready;
+  pthread_cond_t  jobdone;
+};
+
+/* Functions internal to this source file */
+static DSAOp *dsa_addop (DSAFile *file, int opcode);
+static void dsa_start (DSAsync *aio, DSAFile *file);
+static void dsa_complete (DSAsync *aio, DSAFile *file, int result);
+static int dsa_dropops (DSAFile *file);
+static void dsa_freefile (DSAFile *file);
+static int dsa_makepath (const char *path);
+static void *dsa_worker (void *arg);
+#if defined(DSA_HAVE_URING)
+static int dsa_setupuring (DSAsync *aio);
+static void dsa_closeuring (DSAsync *aio);
+static void dsa_submitsqe (DSAsync *aio, DSAFile *file);
+static void dsa_enter (DSAsync *aio, int wait);
+static int dsa_reapuring (DSAsync *aio);
+#endif
+
+/***************************************************************************
+ * dsa_new():
+ * Create an asynchronous I/O context using the specified backend.  If
+ * io_uring is requested but not available the thread pool is used.
+ *
+ * Returns a pointer to the context on success and NULL on error.
+ ***************************************************************************/
+DSAsync *
+dsa_new (int backend)
+{
+  DSAsync *aio;
+
+  if ((aio = (DSAsync *)calloc (1, sizeof (DSAsync))) == NULL)
+  {
+    sl_log (1, 0, "dsa_new(): error allocating memory\n");
+    return NULL;
+  }
+
+  aio->backend = DSA_THREADS;
+
+#if defined(DSA_HAVE_URING)
+  aio->ringfd = -1;
+
+  if (backend == DSA_URING)
+  {
+    if (dsa_setupuring (aio) == 0)
+      aio->backend = DSA_URING;
+    else
+      sl_log (0, 1, "io_uring not available, using I/O threads\n");
+  }
+#endif
+
+  if (aio->backend == DSA_THREADS)
+  {
+    pthread_mutex_init (&aio->lock, NULL);
+    pthread_cond_init (&aio->jobready, NULL);
+    pthread_cond_init (&aio->jobdone, NULL);
+
+    for (; aio->numthreads < DSA_POOLSIZE; aio->numthreads++)
+    {
+      if (pthread_create (&aio->threads[aio->numthreads], NULL, dsa_worker, aio))
+        break;
+    }
+
+    if (aio->numthreads == 0)
+    {
+      sl_log (1, 0, "dsa_new(): cannot create I/O threads\n");
+      pthread_cond_destroy (&aio->jobdone);
+      pthread_cond_destroy (&aio->jobready);
+      pthread_mutex_destroy (&aio->lock);
+      free (aio);
+      return NULL;
+    }
+  }
+
+  return aio;
+} /* End of dsa_new() */
+
+/***************************************************************************
+ * dsa_free():
+ * Wait for all queued operations to complete and free the context.
+ * All files must have been closed with dsa_close().
+ ***************************************************************************/
+void
+dsa_free (DSAsync *aio)
+{
+  int idx;
+
+  if (aio == NULL)
+    return;
+
+  dsa_wait (aio);
+
+  if (aio->backend == DSA_THREADS)
+  {
+    pthread_mutex_lock (&aio->lock);
+    aio->stop = 1;
+    pthread_cond_broadcast (&aio->jobready);
+    pthread_mutex_unlock (&aio->lock);
+
+    for (idx = 0; idx < aio->numthreads; idx++)
+      pthread_join (aio->threads[idx], NULL);
+
+    pthread_cond_destroy (&aio->jobdone);
+    pthread_cond_destroy (&aio->jobready);
+    pthread_mutex_destroy (&aio->lock);
+  }
+
+#if defined(DSA_HAVE_URING)
+  dsa_closeuring (aio);
+#endif
+
+  free (aio);
+} /* End of dsa_free() */
+
+/***************************************************************************
+ * dsa_open():
+ * Queue the opening of a file for appending, creating it if needed.
+ * Writes may be queued before the open completes.  If 'modtime' is not
+ * NULL it is set to the current time whenever a write completes.
+ *
+ * Returns a pointer to the file on success and NULL on error.
+ ***************************************************************************/
+DSAFile *
+dsa_open (DSAsync *aio, const char *path, time_t *modtime)
+{
+  DSAFile *file;
+
+  if ((file = (DSAFile *)calloc (1, sizeof (DSAFile))) == NULL ||
+      (file->path = strdup (path)) == NULL)
+  {
+    sl_log (1, 0, "dsa_open(): error allocating memory\n");
+    free (file);
+    return NULL;
+  }
+
+  file->aio     = aio;
+  file->fd      = -1;
+  file->modtime = modtime;
+
+  if (dsa_addop (file, DSA_OPOPEN) == NULL)
+  {
+    dsa_freefile (file);
+    return NULL;
+  }
+
+  dsa_start (aio, file);
+
+  return file;
+} /* End of dsa_open() */
+
+/***************************************************************************
+ * dsa_write():
+ * Queue appending 'length' bytes of 'buffer' to a file.  The buffer
+ * must be allocated with malloc() and is freed once written.  If too
+ * much data is queued this waits for some writes to complete.
+ *
+ * Returns 0 on success and -1 on error.
+ ***************************************************************************/
+int
+dsa_write (DSAFile *file, char *buffer, int length)
+{
+  DSAsync *aio = file->aio;
+  DSAOp *op;
+
+  /* Wait for queued writes to complete if too much data is queued */
+  while (aio->pending >= DSA_MAXPENDING && aio->inflight)
+    dsa_poll (aio, 1);
+
+  if (file->error || (op = dsa_addop (file, DSA_OPWRITE)) == NULL)
+  {
+    free (buffer);
+    return -1;
+  }
+
+  op->buffer = buffer;
+  op->length = length;
+  aio->pending += length;
+
+  dsa_start (aio, file);
+
+  return 0;
+} /* End of dsa_write() */
+
+/***************************************************************************
+ * dsa_error():
+ * Returns the errno value of a failed open of the file and 0 if the
+ * file is open or the open is pending.  Writes to a file that failed
+ * to open are discarded, the file should be closed.
+ ***************************************************************************/
+int
+dsa_error (DSAFile *file)
+{
+  return file->error;
+} /* End of dsa_error() */
+
+/***************************************************************************
+ * dsa_close():
+ * Queue the closing of a file after all queued writes.  The file is
+ * freed once closed and must not be used after this call.
+ ***************************************************************************/
+void
+dsa_close (DSAFile *file)
+{
+  file->modtime = NULL;
+
+  /* Nothing is queued for a file that failed to open */
+  if (file->error)
+  {
+    dsa_freefile (file);
+    return;
+  }
+
+  if (dsa_addop (file, DSA_OPCLOSE) == NULL)
+    return;
+
+  dsa_start (file->aio, file);
+} /* End of dsa_close() */
+
+/***************************************************************************
+ * dsa_poll():
+ * Submit queued operations and process completed operations.  If
+ * 'wait' is set this waits for at least one operation to complete if
+ * any are in flight.
+ ***************************************************************************/
+void
+dsa_poll (DSAsync *aio, int wait)
+{
+  DSAFile *file;
+  DSAFile *done;
+
+#if defined(DSA_HAVE_URING)
+  if (aio->backend == DSA_URING)
+  {
+    if (!dsa_reapuring (aio) && wait && aio->inflight)
+    {
+      dsa_enter (aio, 1);
+      dsa_reapuring (aio);
+    }
+
+    if (aio->tosubmit)
+      dsa_enter (aio, 0);
+
+    return;
+  }
+#endif
+
+  pthread_mutex_lock (&aio->lock);
+
+  while (wait && aio->done == NULL && aio->inflight)
+    pthread_cond_wait (&aio->jobdone, &aio->lock);
+
+  done          = aio->done;
+  aio->done     = NULL;
+  aio->donetail = NULL;
+
+  pthread_mutex_unlock (&aio->lock);
+
+  while (done != NULL)
+  {
+    file = done;
+    done = file->next;
+
+    dsa_complete (aio, file, file->result);
+  }
+} /* End of dsa_poll() */
+
+/***************************************************************************
+ * dsa_wait():
+ * Wait for all queued operations to complete.
+ *
+ * Returns 0 if all operations since the last call succeeded and -1 if
+ * any failed.
+ ***************************************************************************/
+int
+dsa_wait (DSAsync *aio)
+{
+  int errors;
+
+  for (;;)
+  {
+    dsa_poll (aio, 1);
+
+#if defined(DSA_HAVE_URING)
+    if (aio->ready)
+      continue;
+#endif
+
+    if (aio->inflight == 0)
+      break;
+  }
+
+  errors      = aio->errors;
+  aio->errors = 0;
+
+  return (errors) ? -1 : 0;
+} /* End of dsa_wait() */
+
+/***************************************************************************
+ * dsa_addop():
+ * Add an operation at the tail of the queue of a file.
+ *
+ * Returns a pointer to the operation on success and NULL on error.
+ ***************************************************************************/
+static DSAOp *
+dsa_addop (DSAFile *file, int opcode)
+{
+  DSAOp *op;
+
+  if ((op = (DSAOp *)calloc (1, sizeof (DSAOp))) == NULL)
+  {
+    sl_log (1, 0, "dsa_addop(): error allocating memory\n");
+    return NULL;
+  }
+
+  op->opcode = opcode;
+
+  if (file->tail)
+    file->tail->next = op;
+  else
+    file->head = op;
+
+  file->tail = op;
+
+  return op;
+} /* End of dsa_addop() */
+
+/***************************************************************************
+ * dsa_start():
+ * Start the first queued operation of a file unless an operation of
+ * the file is already in flight.
+ ***************************************************************************/
+static void
+dsa_start (DSAsync *aio, DSAFile *file)
+{
+  if (file->inflight || file->head == NULL)
+    return;
+
+  file->inflight = 1;
+
+#if defined(DSA_HAVE_URING)
+  if (aio->backend == DSA_URING)
+  {
+    /* Wait for a free entry if all are in flight */
+    if (aio->inflight >= (int)aio->entries)
+    {
+      file->next = NULL;
+
+      if (aio->readytail)
+        aio->readytail->next = file;
+      else
+        aio->ready = file;
+
+      aio->readytail = file;
+      return;
+    }
+
+    dsa_submitsqe (aio, file);
+    return;
+  }
+#endif
+
+  aio->inflight++;
+
+  pthread_mutex_lock (&aio->lock);
+
+  file->next = NULL;
+
+  if (aio->jobstail)
+    aio->jobstail->next = file;
+  else
+    aio->jobs = file;
+
+  aio->jobstail = file;
+
+  pthread_cond_signal (&aio->jobready);
+  pthread_mutex_unlock (&aio->lock);
+} /* End of dsa_start() */
+
+/***************************************************************************
+ * dsa_complete():
+ * Process the result of the first queued operation of a file and start
+ * the next operation.  Results are byte counts or file descriptors on
+ * success and negative errno values on error.
+ ***************************************************************************/
+static void
+dsa_complete (DSAsync *aio, DSAFile *file, int result)
+{
+  DSAOp *op = file->head;
+
+  aio->inflight--;
+  file->inflight = 0;
+
+  switch (op->opcode)
+  {
+  case DSA_OPOPEN:
+    if (result < 0)
+    {
+      /* Directories removed since they were created, re-create them */
+      if (result == -ENOENT && !file->retried)
+      {
+        sl_log (0, 2, "Directory removed, creating directories for %s\n", file->path);
+
+        file->retried = 1;
+
+        if (dsa_makepath (file->path) == 0)
+        {
+          dsa_start (aio, file);
+          return;
+        }
+      }
+
+      sl_log (1, 0, "opening data stream file %s, %s\n", file->path, strerror (-result));
+
+      file->error = -result;
+      aio->errors++;
+      dsa_dropops (file);
+      return;
+    }
+
+    file->fd = result;
+    break;
+
+  case DSA_OPWRITE:
+    if (result == -EINTR || result == -EAGAIN)
+    {
+      dsa_start (aio, file);
+      return;
+    }
+
+    /* Continue a partial write */
+    if (result > 0 && (op->done += result) < op->length)
+    {
+      dsa_start (aio, file);
+      return;
+    }
+
+    if (result <= 0)
+    {
+      sl_log (1, 0, "error writing %d bytes to %s, %s\n", op->length - op->done,
+              file->path, strerror ((result) ? -result : EIO));
+      aio->errors++;
+    }
+    else if (file->modtime)
+    {
+      *file->modtime = time (NULL);
+    }
+
+    aio->pending -= op->length;
+    free (op->buffer);
+    break;
+
+  case DSA_OPCLOSE:
+    if (result < 0)
+    {
+      sl_log (1, 0, "closing data stream file %s, %s\n", file->path, strerror (-result));
+      aio->errors++;
+    }
+
+    file->fd = -1;
+    dsa_freefile (file);
+    return;
+  }
+
+  file->head = op->next;
+  if (file->head == NULL)
+    file->tail = NULL;
+
+  free (op);
+
+  dsa_start (aio, file);
+} /* End of dsa_complete() */
+
+/***************************************************************************
+ * dsa_dropops():
+ * Discard all queued operations of a file that failed to open.  If a
+ * close was queued the file is freed.
+ *
+ * Returns 1 if the file was freed and 0 otherwise.
+ ***************************************************************************/
+static int
+dsa_dropops (DSAFile *file)
+{
+  DSAOp *op;
+  int64_t dropped = 0;
+  int closed      = 0;
+
+  while ((op = file->head) != NULL)
+  {
+    file->head = op->next;
+
+    if (op->opcode == DSA_OPWRITE)
+    {
+      dropped += op->length;
+      file->aio->pending -= op->length;
+      free (op->buffer);
+    }
+    else if (op->opcode == DSA_OPCLOSE)
+    {
+      closed = 1;
+    }
+
+    free (op);
+  }
+
+  file->tail = NULL;
+
+  if (dropped)
+    sl_log (1, 0, "discarded %lld bytes for %s\n", (long long)dropped, file->path);
+
+  if (closed)
+  {
+    dsa_freefile (file);
+    return 1;
+  }
+
+  return 0;
+} /* End of dsa_dropops() */
+
+/***************************************************************************
+ * dsa_freefile():
+ * Free all memory associated with a file.
+ ***************************************************************************/
+static void
+dsa_freefile (DSAFile *file)
+{
+  DSAOp *op;
+
+  while ((op = file->head) != NULL)
+  {
+    file->head = op->next;
+    free (op->buffer);
+    free (op);
+  }
+
+  free (file->path);
+  free (file);
+} /* End of dsa_freefile() */
+
+/***************************************************************************
+ * dsa_makepath():
+ * Create all directories of a file path that do not exist.
+ *
+ * Returns 0 on success and -1 on error.
+ ***************************************************************************/
+static int
+dsa_makepath (const char *path)
+{
+  char *dirpath;
+  char *sep;
+
+  if ((dirpath = strdup (path)) == NULL)
+    return -1;
+
+  for (sep = strchr (dirpath + 1, '/'); sep; sep = strchr (sep + 1, '/'))
+  {
+    *sep = '\0';
+
+    if (mkdir (dirpath, S_IRWXU | S_IRGRP | S_IXGRP | S_IROTH | S_IXOTH) && errno != EEXIST)
+    {
+      sl_log (1, 0, "mkdir(%s) %s\n", dirpath, strerror (errno));
+      free (dirpath);
+      return -1;
+    }
+
+    *sep = '/';
+  }
+
+  free (dirpath);
+
+  return 0;
+} /* End of dsa_makepath() */
+
+/***************************************************************************
+ * dsa_worker():
+ * An I/O thread of the thread pool, runs the started operations of
+ * files until stopped.
+ ***************************************************************************/
+static void *
+dsa_worker (void *arg)
+{
+  DSAsync *aio = (DSAsync *)arg;
+  DSAFile *file;
+  DSAOp *op;
+  int result;
+
+  for (;;)
+  {
+    pthread_mutex_lock (&aio->lock);
+
+    while (aio->jobs == NULL && !aio->stop)
+      pthread_cond_wait (&aio->jobready, &aio->lock);
+
+    if ((file = aio->jobs) == NULL)
+    {
+      pthread_mutex_unlock (&aio->lock);
+      break;
+    }
+
+    if ((aio->jobs = file->next) == NULL)
+      aio->jobstail = NULL;
+
+    pthread_mutex_unlock (&aio->lock);
+
+    op = file->head;
+
+    switch (op->opcode)
+    {
+    case DSA_OPOPEN:
+      result = open (file->path, O_WRONLY | O_CREAT | O_APPEND, 0666);
+      break;
+    case DSA_OPWRITE:
+      result = write (file->fd, op->buffer + op->done, op->length - op->done);
+      break;
+    default:
+      result = close (file->fd);
+      break;
+    }
+
+    file->result = (result < 0) ? -errno : result;
+
+    pthread_mutex_lock (&aio->lock);
+
+    file->next = NULL;
+
+    if (aio->donetail)
+      aio->donetail->next = file;
+    else
+      aio->done = file;
+
+    aio->donetail = file;
+
+    pthread_cond_signal (&aio->jobdone);
+    pthread_mutex_unlock (&aio->lock);
+  }
+
+  return NULL;
+} /* End of dsa_worker() */
+
+#if defined(DSA_HAVE_URING)
+/***************************************************************************
+ * dsa_setupuring():
+ * Set up an io_uring instance and map its queues.  Writes at the
+ * current file position are required, i.e. Linux 5.6 or later, which
+ * also supports asynchronous opens and closes.
+ *
+ * Returns 0 on success and -1 on error.
+ ***************************************************************************/
+static int
+dsa_setupuring (DSAsync *aio)
+{
+  struct io_uring_params params;
+
+  memset (&params, 0, sizeof (params));
+
+  if ((aio->ringfd = syscall (__NR_io_uring_setup, DSA_DEPTH, &params)) < 0)
+    return -1;
+
+  if (!(params.features & IORING_FEAT_RW_CUR_POS))
+  {
+    dsa_closeuring (aio);
+    return -1;
+  }
+
+  aio->entries    = params.sq_entries;
+  aio->sqringsize = params.sq_off.array + params.sq_entries * sizeof (unsigned);
+  aio->cqringsize = params.cq_off.cqes + params.cq_entries * sizeof (struct io_uring_cqe);
+  aio->sqessize   = params.sq_entries * sizeof (struct io_uring_sqe);
+
+  /* Both rings may be mapped at once */
+  if (params.features & IORING_FEAT_SINGLE_MMAP)
+  {
+    if (aio->cqringsize > aio->sqringsize)
+      aio->sqringsize = aio->cqringsize;
+    aio->cqringsize = 0;
+  }
+
+  aio->sqring = mmap (NULL, aio->sqringsize, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, aio->ringfd, IORING_OFF_SQ_RING);
+
+  if (aio->sqring == MAP_FAILED)
+  {
+    aio->sqring = NULL;
+    dsa_closeuring (aio);
+    return -1;
+  }
+
+  if (aio->cqringsize)
+  {
+    aio->cqring = mmap (NULL, aio->cqringsize, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, aio->ringfd, IORING_OFF_CQ_RING);
+
+    if (aio->cqring == MAP_FAILED)
+    {
+      aio->cqring = NULL;
+      dsa_closeuring (aio);
+      return -1;
+    }
+  }
+  else
+  {
+    aio->cqring = aio->sqring;
+  }
+
+  aio->sqes = (struct io_uring_sqe *)mmap (NULL, aio->sqessize, PROT_READ | PROT_WRITE,
+                                           MAP_SHARED | MAP_POPULATE, aio->ringfd,
+                                           IORING_OFF_SQES);
+
+  if (aio->sqes == MAP_FAILED)
+  {
+    aio->sqes = NULL;
+    dsa_closeuring (aio);
+    return -1;
+  }
+
+  aio->sqtail  = (unsigned *)((char *)aio->sqring + params.sq_off.tail);
+  aio->sqmask  = (unsigned *)((char *)aio->sqring + params.sq_off.ring_mask);
+  aio->sqarray = (unsigned *)((char *)aio->sqring + params.sq_off.array);
+  aio->cqhead  = (unsigned *)((char *)aio->cqring + params.cq_off.head);
+  aio->cqtail  = (unsigned *)((char *)aio->cqring + params.cq_off.tail);
+  aio->cqmask  = (unsigned *)((char *)aio->cqring + params.cq_off.ring_mask);
+  aio->cqes    = (struct io_uring_cqe *)((char *)aio->cqring + params.cq_off.cqes);
+
+  return 0;
+} /* End of dsa_setupuring() */
+
+/***************************************************************************
+ * dsa_closeuring():
+ * Unmap the queues and close an io_uring instance.
+ ***************************************************************************/
+static void
+dsa_closeuring (DSAsync *aio)
+{
+  if (aio->sqes)
+    munmap (aio->sqes, aio->sqessize);
+  if (aio->cqring && aio->cqring != aio->sqring)
+    munmap (aio->cqring, aio->cqringsize);
+  if (aio->sqring)
+    munmap (aio->sqring, aio->sqringsize);
+  if (aio->ringfd >= 0)
+    close (aio->ringfd);
+
+  aio->sqes   = NULL;
+  aio->cqring = NULL;
+  aio->sqring = NULL;
+  aio->ringfd = -1;
+} /* End of dsa_closeuring() */
+
+/***************************************************************************
+ * dsa_submitsqe():
+ * Fill a submission queue entry for the first queued operation of a
+ * file, entries are submitted in batches by dsa_enter().
+ ***************************************************************************/
+static void
+dsa_submitsqe (DSAsync *aio, DSAFile *file)
+{
+  struct io_uring_sqe *sqe;
+  DSAOp *op     = file->head;
+  unsigned tail = *aio->sqtail;
+  unsigned idx  = tail & *aio->sqmask;
+
+  sqe = &aio->sqes[idx];
+  memset (sqe, 0, sizeof (struct io_uring_sqe));
+
+  switch (op->opcode)
+  {
+  case DSA_OPOPEN:
+    sqe->opcode     = IORING_OP_OPENAT;
+    sqe->fd         = AT_FDCWD;
+    sqe->addr       = (uintptr_t)file->path;
+    sqe->len        = 0666;
+    sqe->open_flags = O_WRONLY | O_CREAT | O_APPEND;
+    break;
+  case DSA_OPWRITE:
+    sqe->opcode = IORING_OP_WRITE;
+    sqe->fd     = file->fd;
+    sqe->addr   = (uintptr_t)(op->buffer + op->done);
+    sqe->len    = op->length - op->done;
+    sqe->off    = (uint64_t)-1;
+    break;
+  default:
+    sqe->opcode = IORING_OP_CLOSE;
+    sqe->fd     = file->fd;
+    break;
+  }
+
+  sqe->user_data = (uintptr_t)file;
+
+  aio->sqarray[idx] = idx;
+  __atomic_store_n (aio->sqtail, tail + 1, __ATOMIC_RELEASE);
+
+  aio->tosubmit++;
+  aio->inflight++;
+} /* End of dsa_submitsqe() */
+
+/***************************************************************************
+ * dsa_enter():
+ * Submit all filled entries with a single system call, if 'wait' is
+ * set wait for at least one completion.
+ ***************************************************************************/
+static void
+dsa_enter (DSAsync *aio, int wait)
+{
+  int submitted;
+
+  submitted = syscall (__NR_io_uring_enter, aio->ringfd, aio->tosubmit,
+                       (wait) ? 1 : 0, (wait) ? IORING_ENTER_GETEVENTS : 0,
+                       NULL, 0);
+
+  if (submitted < 0)
+  {
+    if (errno != EINTR && errno != EAGAIN && errno != EBUSY)
+      sl_log (1, 0, "io_uring_enter(): %s\n", strerror (errno));
+    return;
+  }
+
+  aio->tosubmit -= submitted;
+} /* End of dsa_enter() */
+
+/***************************************************************************
+ * dsa_reapuring():
+ * Process all completion queue entries and fill submission entries for
+ * files waiting for a free entry.
+ *
+ * Returns the number of completions processed.
+ ***************************************************************************/
+static int
+dsa_reapuring (DSAsync *aio)
+{
+  struct io_uring_cqe *cqe;
+  DSAFile *file;
+  unsigned head = *aio->cqhead;
+  int reaped    = 0;
+  int result;
+
+  while (head != __atomic_load_n (aio->cqtail, __ATOMIC_ACQUIRE))
+  {
+    cqe    = &aio->cqes[head & *aio->cqmask];
+    file   = (DSAFile *)(uintptr_t)cqe->user_data;
+    result = cqe->res;
+
+    __atomic_store_n (aio->cqhead, ++head, __ATOMIC_RELEASE);
+
+    dsa_complete (aio, file, result);
+    reaped++;
+  }
+
+  while (aio->ready && aio->inflight < (int)aio->entries)
+  {
+    file = aio->ready;
+
+    if ((aio->ready = file->next) == NULL)
+      aio->readytail = NULL;
+
+    dsa_submitsqe (aio, file);
+  }
+
+  return reaped;
+} /* End of dsa_reapuring() */
+#endif /* DSA_HAVE_URING */
+
+#else /* SLP_WIN */
+
+/***************************************************************************
+ * Asynchronous archive writes are not supported on Windows.
+ ***************************************************************************/
+DSAsync *
+dsa_new (int backend)
+{
+  sl_log (1, 0, "asynchronous archive writes are not supported on this platform\n");
+  return NULL;
+}
+
+void
+dsa_free (DSAsync *aio)
+{
+}
+
+DSAFile *
+dsa_open (DSAsync *aio, const char *path, time_t *modtime)
+{
+  return NULL;
+}
+
+int
+dsa_write (DSAFile *file, char *buffer, int length)
+{
+  free (buffer);
+  return -1;
+}
+
+int
+dsa_error (DSAFile *file)
+{
+  return 0;
+}
+
+void
+dsa_close (DSAFile *file)
+{
+}
+
+void
+dsa_poll (DSAsync *aio, int wait)
+{
+}
+
+int
+dsa_wait (DSAsync *aio)
+{
+  return 0;
+}
+
+#endif /* SLP_WIN */
@@ -0,0 +1,40 @@
+/***************************************************************************
+ * dsasync.h
+ *
+ * Interface declarations for asynchronous writing of archive files.
+ *
+ * modified: 2026.287
+ ***************************************************************************/
+
+#ifndef DSASYNC_H
+#define DSASYNC_H
+
+#include <time.h>
+
+/* Asynchronous I/O backends */
+#define DSA_NONE    0  /* Synchronous writes by the archiving thread */
+#define DSA_URING   1  /* io_uring, falls back to DSA_THREADS if unavailable */
+#define DSA_THREADS 2  /* A pool of I/O threads */
+
+/* Number of operations in flight for io_uring */
+#define DSA_DEPTH 256
+
+/* Number of I/O threads of the thread pool */
+#define DSA_POOLSIZE 4
+
+/* Maximum number of bytes queued for writing before waiting */
+#define DSA_MAXPENDING 16777216
+
+typedef struct DSAsync_s DSAsync;
+typedef struct DSAFile_s DSAFile;
+
+extern DSAsync *dsa_new (int backend);
+extern void dsa_free (DSAsync *aio);
+extern DSAFile *dsa_open (DSAsync *aio, const char *path, time_t *modtime);
+extern int dsa_write (DSAFile *file, char *buffer, int length);
+extern int dsa_error (DSAFile *file);
+extern void dsa_close (DSAFile *file);
+extern void dsa_poll (DSAsync *aio, int wait);
+extern int dsa_wait (DSAsync *aio);
+
+#endif
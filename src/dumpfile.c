@@ -0,0 +1,705 @@
+/***************************************************************************
+ * dumpfile.c
+ *
+ * The dump file writer, a raw capture of all received records.
+ *
+ * Records are copied into a buffer and written when it is full or
+ * flushed, without a buffer each record is written directly.  With
+ * DF_DIRECT the file is written with O_DIRECT from an aligned buffer:
+ * every write starts at an aligned offset and is padded to an aligned
+ * length, the file is truncated to the end of its records afterwards
+ * and the partial block at the end is kept in the buffer to be written
+ * again with the following records.  With DF_DSYNC writes complete
+ * once the records are on disk.
+ *
+ * The file name is a strftime(3) pattern formatted with the current
+ * UTC time when a file is opened.  Files are rotated when a record
+ * would make them larger than the rotation size or at the end of each
+ * rotation interval, intervals are aligned to multiples of their
+ * length since the epoch and names are formatted with the start of
+ * the interval.  If rotating by size results in the name of the
+ * current or a full file the name is suffixed with a counter.
+ *
+ * With DF_INDEX an index of fixed size entries, the offset, sequence
+ * number, start time and codes of each record, is written to a file
+ * of the same name with ".idx" appended.  The entries of buffered
+ * records are written after the records.
+ *
+ * The writer is called by the thread handling the packets or the
+ * first archive thread, flushes may come from any archive thread and
+ * are serialized with a mutex.
+ *
+ * modified: 2026.287
+ ***************************************************************************/
+
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE /* For O_DIRECT */
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include <libslink.h>
+
+#include "dumpfile.h"
+
+#if !defined(SLP_WIN)
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+#ifndef O_BINARY
+#define O_BINARY 0
+#endif
+
+/* Maximum length of a file name */
+#define DF_MAXPATH 1024
+
+struct DumpFile_s
+{
+  char   *pattern;       /* File name pattern, "-" for standard output */
+  char    base[DF_MAXPATH]; /* Formatted name without counter */
+  char    path[DF_MAXPATH + 16]; /* Name of the current file */
+  int     flags;         /* DF_DIRECT, DF_DSYNC, DF_INDEX */
+  int     fd;            /* Current file, -1 if none */
+  int     idxfd;         /* Current index file, -1 if none */
+  char   *buffer;        /* Buffered records, aligned to DF_ALIGN */
+  size_t  bufsize;       /* Size of the buffer, 0 to write each record */
+  size_t  buflen;        /* Bytes in the buffer */
+  size_t  bufsynced;     /* Bytes at the start of the buffer already written */
+  int64_t bufoffset;     /* File offset of the start of the buffer */
+  int64_t filesize;      /* Length of the file including buffered records */
+  DFIndexEntry *entries; /* Index entries of buffered records */
+  int     numentries;
+  int     maxentries;
+  int64_t rotatesize;    /* Rotate before exceeding this size, 0 for none */
+  int     rotatesecs;    /* Rotation interval (seconds), 0 for none */
+  time_t  periodend;     /* End of the current rotation interval */
+  int     counter;       /* Suffix of names when rotating by size */
+#if !defined(SLP_WIN)
+  pthread_mutex_t lock;
+#endif
+};
+
+#if !defined(SLP_WIN)
+#define DF_LOCK(df) pthread_mutex_lock (&(df)->lock)
+#define DF_UNLOCK(df) pthread_mutex_unlock (&(df)->lock)
+#else
+#define DF_LOCK(df)
+#define DF_UNLOCK(df)
+#endif
+
+static int df_openfile (DumpFile *df, time_t now);
+static void df_closefile (DumpFile *df);
+static int df_flushlocked (DumpFile *df);
+static int df_writeall (int fd, const char *data, size_t length);
+static void df_indexentry (DFIndexEntry *entry, const char *record, int reclen,
+                           int seqnum, int64_t offset);
+
+/***************************************************************************
+ * df_open:
+ *
+ * Open a dump file named by the strftime(3) 'pattern', or standard
+ * output for "-", buffering up to 'bufsize' bytes of records.  Files
+ * are rotated before exceeding 'rotatesize' bytes and every
+ * 'rotatesecs' seconds, 0 disables either.  'flags' is a combination
+ * of DF_DIRECT, DF_DSYNC and DF_INDEX, DF_DIRECT requires a buffer of
+ * at least SLMAXRECSIZE + DF_ALIGN bytes and uses DF_DEFBUFSIZE if
+ * 'bufsize' is 0.
+ *
+ * Returns a new dump file on success and NULL on error.
+ ***************************************************************************/
+DumpFile *
+df_open (const char *pattern, size_t bufsize, int flags,
+         int64_t rotatesize, int rotatesecs)
+{
+  DumpFile *df;
+  int isstdout = (strcmp (pattern, "-") == 0);
+
+#if defined(SLP_WIN) || !defined(O_DIRECT)
+  if (flags & DF_DIRECT)
+  {
+    sl_log (2, 0, "direct I/O is not supported on this platform\n");
+    return NULL;
+  }
+#endif
+#if defined(SLP_WIN) || !defined(O_DSYNC)
+  if (flags & DF_DSYNC)
+  {
+    sl_log (2, 0, "synchronous writes are not supported on this platform\n");
+    return NULL;
+  }
+#endif
+
+  if (isstdout && (flags || rotatesize || rotatesecs))
+  {
+    sl_log (2, 0, "dump file rotation, index and direct I/O require a file name\n");
+    return NULL;
+  }
+
+  if (rotatesize < 0 || rotatesecs < 0)
+  {
+    sl_log (2, 0, "invalid dump file rotation: %lld bytes, %d seconds\n",
+            (long long)rotatesize, rotatesecs);
+    return NULL;
+  }
+
+  if (flags & DF_DIRECT)
+  {
+    if (bufsize == 0)
+      bufsize = DF_DEFBUFSIZE;
+    else if (bufsize < SLMAXRECSIZE + DF_ALIGN)
+      bufsize = SLMAXRECSIZE + DF_ALIGN;
+
+    bufsize = (bufsize + DF_ALIGN - 1) & ~(size_t)(DF_ALIGN - 1);
+  }
+  else if (bufsize && bufsize < SLMAXRECSIZE)
+  {
+    bufsize = SLMAXRECSIZE;
+  }
+
+  if ((df = (DumpFile *)calloc (1, sizeof (DumpFile))) == NULL ||
+      (df->pattern = strdup (pattern)) == NULL)
+  {
+    sl_log (2, 0, "df_open(): cannot allocate memory\n");
+    free (df);
+    return NULL;
+  }
+
+  df->flags      = flags;
+  df->fd         = -1;
+  df->idxfd      = -1;
+  df->bufsize    = bufsize;
+  df->rotatesize = rotatesize;
+  df->rotatesecs = rotatesecs;
+
+#if !defined(SLP_WIN)
+  pthread_mutex_init (&df->lock, NULL);
+
+  if (bufsize && posix_memalign ((void **)&df->buffer, DF_ALIGN, bufsize))
+    df->buffer = NULL;
+#else
+  if (bufsize)
+    df->buffer = (char *)malloc (bufsize);
+#endif
+
+  if (bufsize && df->buffer == NULL)
+  {
+    sl_log (2, 0, "df_open(): cannot allocate %lld byte buffer\n", (long long)bufsize);
+    df_close (df);
+    return NULL;
+  }
+
+  if (isstdout)
+  {
+    df->fd = fileno (stdout);
+    strcpy (df->path, "standard output");
+  }
+  else if (df_openfile (df, time (NULL)))
+  {
+    df_close (df);
+    return NULL;
+  }
+
+  return df;
+} /* End of df_open() */
+
+/***************************************************************************
+ * df_write:
+ *
+ * Add a record to the dump file, rotating the file first if needed.
+ * 'seqnum' is the SeedLink sequence number recorded in the index.
+ *
+ * Returns 0 on success and -1 on error.
+ ***************************************************************************/
+int
+df_write (DumpFile *df, const char *record, int reclen, int seqnum)
+{
+  DFIndexEntry entry;
+  DFIndexEntry *entries;
+  time_t now;
+  int retval = 0;
+
+  if (reclen <= 0 || (df->bufsize && (size_t)reclen > SLMAXRECSIZE))
+  {
+    sl_log (2, 0, "df_write(): invalid record length %d\n", reclen);
+    return -1;
+  }
+
+  DF_LOCK (df);
+
+  /* Rotate at the end of the interval or before exceeding the size */
+  if (df->rotatesecs || df->rotatesize)
+  {
+    now = time (NULL);
+
+    if ((df->rotatesecs && now >= df->periodend) ||
+        (df->rotatesize && df->filesize > 0 &&
+         df->filesize + reclen > df->rotatesize))
+    {
+      df_closefile (df);
+
+      if (df_openfile (df, now))
+      {
+        DF_UNLOCK (df);
+        return -1;
+      }
+    }
+  }
+
+  if (df->fd < 0)
+  {
+    DF_UNLOCK (df);
+    return -1;
+  }
+
+  if (df->flags & DF_INDEX)
+    df_indexentry (&entry, record, reclen, seqnum, df->filesize);
+
+  if (!df->bufsize)
+  {
+    /* Write directly, followed by the index entry */
+    if (df_writeall (df->fd, record, reclen))
+    {
+      sl_log (2, 0, "error writing to %s: %s\n", df->path, strerror (errno));
+      retval = -1;
+    }
+    else
+    {
+      df->filesize += reclen;
+
+      if (df->idxfd >= 0 &&
+          df_writeall (df->idxfd, (const char *)&entry, sizeof (entry)))
+        sl_log (2, 0, "error writing index of %s: %s\n", df->path, strerror (errno));
+    }
+
+    DF_UNLOCK (df);
+    return retval;
+  }
+
+  /* Records are not added while the buffer cannot be written */
+  if (df->buflen + reclen > df->bufsize && df_flushlocked (df))
+  {
+    DF_UNLOCK (df);
+    return -1;
+  }
+
+  if (df->idxfd >= 0)
+  {
+    if (df->numentries == df->maxentries)
+    {
+      df->maxentries = (df->maxentries) ? df->maxentries * 2 : 256;
+
+      if ((entries = (DFIndexEntry *)realloc (df->entries, df->maxentries * sizeof (DFIndexEntry))) == NULL)
+      {
+        sl_log (2, 0, "df_write(): cannot allocate memory\n");
+        DF_UNLOCK (df);
+        return -1;
+      }
+
+      df->entries = entries;
+    }
+
+    df->entries[df->numentries++] = entry;
+  }
+
+  memcpy (df->buffer + df->buflen, record, reclen);
+  df->buflen += reclen;
+  df->filesize += reclen;
+
+  DF_UNLOCK (df);
+
+  return retval;
+} /* End of df_write() */
+
+/***************************************************************************
+ * df_flush:
+ *
+ * Write all buffered records and their index entries.
+ *
+ * Returns 0 on success and -1 on error.
+ ***************************************************************************/
+int
+df_flush (DumpFile *df)
+{
+  int retval;
+
+  DF_LOCK (df);
+  retval = df_flushlocked (df);
+  DF_UNLOCK (df);
+
+  return retval;
+} /* End of df_flush() */
+
+/***************************************************************************
+ * df_close:
+ *
+ * Write all buffered records, close the files and free the dump file.
+ ***************************************************************************/
+void
+df_close (DumpFile *df)
+{
+  if (!df)
+    return;
+
+  if (df->pattern && strcmp (df->pattern, "-") == 0)
+  {
+    df_flushlocked (df);
+    df->fd = -1;
+  }
+  else
+  {
+    df_closefile (df);
+  }
+
+#if !defined(SLP_WIN)
+  pthread_mutex_destroy (&df->lock);
+#endif
+
+  free (df->buffer);
+  free (df->entries);
+  free (df->pattern);
+  free (df);
+} /* End of df_close() */
+
+/***************************************************************************
+ * df_openfile:
+ *
+ * Format the name of the file for the time 'now' and open it and its
+ * index for appending.  For direct I/O the partial block at the end of
+ * an existing file is read into the buffer.
+ *
+ * Returns 0 on success and -1 on error.
+ ***************************************************************************/
+static int
+df_openfile (DumpFile *df, time_t now)
+{
+  DFIndexHeader header;
+  char idxpath[DF_MAXPATH + 20];
+  char base[DF_MAXPATH];
+  struct stat st;
+  struct tm tms;
+  time_t start = now;
+  int oflags   = O_WRONLY | O_CREAT | O_APPEND | O_BINARY;
+
+  /* Names of rotation intervals are formatted with their start */
+  if (df->rotatesecs)
+  {
+    start         = now - (now % df->rotatesecs);
+    df->periodend = start + df->rotatesecs;
+  }
+
+#if defined(SLP_WIN)
+  gmtime_s (&tms, &start);
+#else
+  gmtime_r (&start, &tms);
+#endif
+
+  if (strftime (base, sizeof (base), df->pattern, &tms) == 0)
+  {
+    sl_log (2, 0, "cannot format dump file name: %s\n", df->pattern);
+    return -1;
+  }
+
+  /* Names repeated when rotating by size are suffixed with a counter,
+     skipping files that are already full */
+  df->counter = (strcmp (base, df->base)) ? 0 : df->counter + 1;
+  strcpy (df->base, base);
+
+  for (;;)
+  {
+    if (df->counter)
+      snprintf (df->path, sizeof (df->path), "%s.%d", base, df->counter);
+    else
+      snprintf (df->path, sizeof (df->path), "%s", base);
+
+    if (!df->rotatesize || stat (df->path, &st) || st.st_size < df->rotatesize)
+      break;
+
+    df->counter++;
+  }
+
+#if defined(O_DIRECT)
+  if (df->flags & DF_DIRECT)
+    oflags = O_RDWR | O_CREAT | O_DIRECT;
+#endif
+#if defined(O_DSYNC)
+  if (df->flags & DF_DSYNC)
+    oflags |= O_DSYNC;
+#endif
+
+  df->fd = open (df->path, oflags, 0666);
+
+#if defined(O_DIRECT)
+  /* Fall back to the page cache if the file system cannot bypass it */
+  if (df->fd < 0 && errno == EINVAL && (df->flags & DF_DIRECT))
+  {
+    sl_log (1, 0, "direct I/O not supported for %s, writing through the page cache\n",
+            df->path);
+
+    df->flags &= ~DF_DIRECT;
+    oflags     = (oflags & ~(O_RDWR | O_DIRECT)) | O_WRONLY | O_APPEND;
+    df->fd     = open (df->path, oflags, 0666);
+  }
+#endif
+
+  if (df->fd < 0)
+  {
+    sl_log (2, 0, "cannot open dump file %s: %s\n", df->path, strerror (errno));
+    return -1;
+  }
+
+  if (fstat (df->fd, &st))
+  {
+    sl_log (2, 0, "cannot stat dump file %s: %s\n", df->path, strerror (errno));
+    df_closefile (df);
+    return -1;
+  }
+
+  df->filesize  = st.st_size;
+  df->bufoffset = st.st_size;
+  df->buflen    = 0;
+  df->bufsynced = 0;
+
+#if defined(O_DIRECT) && !defined(SLP_WIN)
+  /* Direct writes start at an aligned offset, keep the partial block */
+  if (df->flags & DF_DIRECT)
+  {
+    size_t tail = (size_t)(st.st_size % DF_ALIGN);
+    ssize_t nread;
+
+    df->bufoffset = st.st_size - tail;
+
+    if (tail)
+    {
+      if ((nread = pread (df->fd, df->buffer, DF_ALIGN, df->bufoffset)) < (ssize_t)tail)
+      {
+        sl_log (2, 0, "cannot read end of dump file %s: %s\n", df->path,
+                (nread < 0) ? strerror (errno) : "short read");
+        df_closefile (df);
+        return -1;
+      }
+
+      df->buflen    = tail;
+      df->bufsynced = tail;
+    }
+  }
+#endif
+
+  if (df->flags & DF_INDEX)
+  {
+    snprintf (idxpath, sizeof (idxpath), "%s.idx", df->path);
+
+    if ((df->idxfd = open (idxpath, O_WRONLY | O_CREAT | O_APPEND | O_BINARY, 0666)) < 0 ||
+        fstat (df->idxfd, &st))
+    {
+      sl_log (2, 0, "cannot open dump file index %s: %s\n", idxpath, strerror (errno));
+      df_closefile (df);
+      return -1;
+    }
+
+    if (st.st_size == 0)
+    {
+      memset (&header, 0, sizeof (header));
+      memcpy (header.magic, DF_INDEXMAGIC, sizeof (header.magic));
+      header.version   = DF_INDEXVERSION;
+      header.entrysize = sizeof (DFIndexEntry);
+
+      if (df_writeall (df->idxfd, (const char *)&header, sizeof (header)))
+      {
+        sl_log (2, 0, "error writing index %s: %s\n", idxpath, strerror (errno));
+        df_closefile (df);
+        return -1;
+      }
+    }
+  }
+
+  sl_log (0, 2, "Opened dump file %s\n", df->path);
+
+  return 0;
+} /* End of df_openfile() */
+
+/***************************************************************************
+ * df_closefile:
+ *
+ * Write all buffered records and close the current file and index.
+ ***************************************************************************/
+static void
+df_closefile (DumpFile *df)
+{
+  df_flushlocked (df);
+
+  if (df->fd >= 0)
+    close (df->fd);
+  if (df->idxfd >= 0)
+    close (df->idxfd);
+
+  df->fd         = -1;
+  df->idxfd      = -1;
+  df->buflen     = 0;
+  df->bufsynced  = 0;
+  df->numentries = 0;
+} /* End of df_closefile() */
+
+/***************************************************************************
+ * df_flushlocked:
+ *
+ * Write the buffered records followed by their index entries, the
+ * caller holds the lock.  Direct writes are padded to an aligned
+ * length and the file truncated to its records, the partial block at
+ * the end remains in the buffer.
+ *
+ * Returns 0 on success and -1 on error.
+ ***************************************************************************/
+static int
+df_flushlocked (DumpFile *df)
+{
+  int retval = 0;
+
+  if (df->fd < 0)
+    return -1;
+
+#if defined(O_DIRECT) && !defined(SLP_WIN)
+  if (df->flags & DF_DIRECT)
+  {
+    size_t padded  = (df->buflen + DF_ALIGN - 1) & ~(size_t)(DF_ALIGN - 1);
+    size_t aligned = df->buflen & ~(size_t)(DF_ALIGN - 1);
+    size_t written = 0;
+    ssize_t nwritten;
+
+    /* Nothing but the partial block already written remains */
+    if (df->buflen == df->bufsynced)
+      return 0;
+
+    memset (df->buffer + df->buflen, 0, padded - df->buflen);
+
+    while (written < padded)
+    {
+      if ((nwritten = pwrite (df->fd, df->buffer + written, padded - written,
+                              df->bufoffset + written)) < 0)
+      {
+        if (errno == EINTR)
+          continue;
+
+        sl_log (2, 0, "error writing to %s: %s\n", df->path, strerror (errno));
+        return -1;
+      }
+
+      written += nwritten;
+    }
+
+    if (padded != df->buflen &&
+        ftruncate (df->fd, df->bufoffset + df->buflen))
+    {
+      sl_log (2, 0, "cannot truncate %s: %s\n", df->path, strerror (errno));
+      retval = -1;
+    }
+
+    memmove (df->buffer, df->buffer + aligned, df->buflen - aligned);
+    df->bufoffset += aligned;
+    df->buflen    -= aligned;
+    df->bufsynced  = df->buflen;
+  }
+  else
+#endif
+  if (df->buflen)
+  {
+    if (df_writeall (df->fd, df->buffer, df->buflen))
+    {
+      sl_log (2, 0, "error writing to %s: %s\n", df->path, strerror (errno));
+      return -1;
+    }
+
+    df->bufoffset += df->buflen;
+    df->buflen = 0;
+  }
+
+  if (df->numentries)
+  {
+    if (df->idxfd >= 0 &&
+        df_writeall (df->idxfd, (const char *)df->entries,
+                     df->numentries * sizeof (DFIndexEntry)))
+    {
+      sl_log (2, 0, "error writing index of %s: %s\n", df->path, strerror (errno));
+      retval = -1;
+    }
+
+    df->numentries = 0;
+  }
+
+  return retval;
+} /* End of df_flushlocked() */
+
+/***************************************************************************
+ * df_writeall:
+ *
+ * Write all 'length' bytes of 'data' to a file descriptor.
+ *
+ * Returns 0 on success and -1 on error.
+ ***************************************************************************/
+static int
+df_writeall (int fd, const char *data, size_t length)
+{
+  size_t written = 0;
+  int nwritten;
+
+  while (written < length)
+  {
+    if ((nwritten = (int)write (fd, data + written, (unsigned int)(length - written))) < 0)
+    {
+      if (errno == EINTR)
+        continue;
+
+      return -1;
+    }
+
+    written += nwritten;
+  }
+
+  return 0;
+} /* End of df_writeall() */
+
+/***************************************************************************
+ * df_indexentry:
+ *
+ * Fill an index entry for a record at 'offset' from its header.
+ ***************************************************************************/
+static void
+df_indexentry (DFIndexEntry *entry, const char *record, int reclen,
+               int seqnum, int64_t offset)
+{
+  const struct sl_fsdh_s *fsdh = (const struct sl_fsdh_s *)record;
+  const struct sl_btime_s *btime;
+  SLMSheader msh;
+  int64_t days;
+  int year;
+
+  memset (entry, 0, sizeof (DFIndexEntry));
+
+  entry->offset = offset;
+  entry->seqnum = seqnum;
+  entry->reclen = reclen;
+
+  if (reclen < (int)sizeof (struct sl_fsdh_s))
+    return;
+
+  memcpy (entry->network, fsdh->network, sizeof (entry->network));
+  memcpy (entry->station, fsdh->station, sizeof (entry->station));
+  memcpy (entry->location, fsdh->location, sizeof (entry->location));
+  memcpy (entry->channel, fsdh->channel, sizeof (entry->channel));
+
+  sl_msh_init (&msh, record);
+  btime = sl_msh_starttime (&msh);
+  year  = btime->year;
+
+  days = (int64_t)(year - 1970) * 365 + (year - 1969) / 4 + (btime->day - 1);
+
+  entry->starttime = ((days * 86400 + btime->hour * 3600 + btime->min * 60 + btime->sec) *
+                      1000000) + (int64_t)btime->fract * 100;
+} /* End of df_indexentry() */
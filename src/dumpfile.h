@@ -0,0 +1,65 @@
+/***************************************************************************
+ * dumpfile.h
+ *
+ * Interface declarations for the dump file writer, a raw capture of
+ * all received records with buffered or direct I/O, rotation and an
+ * optional index of the records.
+ *
+ * modified: 2026.287
+ ***************************************************************************/
+
+#ifndef DUMPFILE_H
+#define DUMPFILE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* Flags of a dump file */
+#define DF_DIRECT 0x1 /* Bypass the page cache with O_DIRECT */
+#define DF_DSYNC  0x2 /* Complete writes only once on disk with O_DSYNC */
+#define DF_INDEX  0x4 /* Write an index of the records */
+
+/* Default buffer size when bypassing the page cache */
+#define DF_DEFBUFSIZE 1048576
+
+/* Alignment of the buffer, file offsets and lengths of direct writes */
+#define DF_ALIGN 4096
+
+/* Identification of an index file, followed by the version and the
+ * size of the entries in the byte order of the writer */
+#define DF_INDEXMAGIC "SLDUMPIX"
+#define DF_INDEXVERSION 1
+
+/* Header of an index file */
+typedef struct DFIndexHeader_s
+{
+  char     magic[8];     /* DF_INDEXMAGIC, not terminated */
+  uint32_t version;      /* DF_INDEXVERSION */
+  uint32_t entrysize;    /* sizeof (DFIndexEntry), byte swapped if not native */
+}
+DFIndexHeader;
+
+/* Index entry of a record in the dump file */
+typedef struct DFIndexEntry_s
+{
+  int64_t  offset;       /* Offset of the record in the dump file */
+  int64_t  starttime;    /* Record start time, microseconds since the epoch */
+  int32_t  seqnum;       /* SeedLink sequence number, -1 if none */
+  int32_t  reclen;       /* Length of the record */
+  char     network[2];   /* Codes of the record header, space padded */
+  char     station[5];
+  char     location[2];
+  char     channel[3];
+  char     reserved[4];
+}
+DFIndexEntry;
+
+typedef struct DumpFile_s DumpFile;
+
+extern DumpFile *df_open (const char *pattern, size_t bufsize, int flags,
+                          int64_t rotatesize, int rotatesecs);
+extern int df_write (DumpFile *df, const char *record, int reclen, int seqnum);
+extern int df_flush (DumpFile *df);
+extern void df_close (DumpFile *df);
+
+#endif
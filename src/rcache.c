@@ -0,0 +1,1107 @@
+/***************************************************************************
+ * rcache.c
+ *
+ * A bounded in-memory cache of the records received most recently,
+ * queried by local clients over a Unix domain socket so that recent
+ * data do not have to be requested from the server again.
+ *
+ * The records are copied into a single ring of bytes in arrival order.
+ * Each record has an entry in a ring of entries, identified by a serial
+ * number that increases with every record, and each channel keeps the
+ * serial numbers of its records in a ring of its own.  Records are
+ * evicted from the oldest end of the rings when they are older than
+ * the maximum age or when room is needed for a new record, so the
+ * oldest record of the cache is always the oldest of its channel.
+ *
+ * The records of a channel arrive in time order, a time window is
+ * found in the ring of a channel with a binary search on the end
+ * times of its records.
+ *
+ * Clients connect to the socket and send a single request line:
+ *
+ *   [begin:[end]] streams
+ *
+ * where 'streams' is a stream list in the format of the -S option,
+ * i.e. NET_STA[:selectors] separated by commas with the usual
+ * wildcards, and begin and end are optional times in the
+ * year,month,day,hour,min,sec format of the -tw option.  The records
+ * of the matching channels that overlap the time window are sent in
+ * the format of the dump file, channel by channel, and the connection
+ * is closed.  An invalid request, or one whose reply cannot be
+ * allocated, is answered with "ERROR".  The request "STATS" is
+ * answered with the cache counters as lines of name and value.
+ *
+ * Records are added by the thread handling the packets, queries are
+ * answered by a cache thread, one client at a time.  The cache is
+ * protected by a mutex.  A query first collects the serial numbers of
+ * the matching records while holding it, the records are then copied
+ * to a reply buffer in chunks, releasing the mutex between them so
+ * that a large reply does not stall the packets, and sent afterwards.
+ *
+ * modified: 2026.287
+ ***************************************************************************/
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <libslink.h>
+
+#include "rcache.h"
+
+#ifndef SLP_WIN
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/un.h>
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+/* Initial number of entries of the rings */
+#define RC_MINENTRIES 4096
+#define RC_MINSTREAM 16
+
+/* Maximum length of a request line */
+#define RC_MAXREQUEST 8192
+
+/* Timeout for receiving a request and sending a reply (seconds) */
+#define RC_TIMEOUT 10
+
+/* Number of records copied to a reply while holding the lock */
+#define RC_CHUNK 256
+
+/* A channel, the key is the station, location, channel and network codes */
+typedef struct RcStream_s
+{
+  char    key[12];
+  char    net[3];
+  char    sta[6];
+  char    loc[3];
+  char    chan[4];
+  uint64_t *serials;     /* Ring of the serial numbers of the records */
+  int     size;          /* Size of the ring, a power of 2 */
+  int     head;          /* Index of the oldest serial number */
+  int     count;         /* Number of serial numbers in the ring */
+  struct RcStream_s *next;
+}
+RcStream;
+
+/* A cached record */
+typedef struct RcEntry_s
+{
+  double  starttime;     /* Epoch start time */
+  double  endtime;       /* Epoch end time */
+  double  arrival;       /* Epoch time the record was added */
+  size_t  offset;        /* Offset of the record in the data ring */
+  int     length;        /* Length of the record */
+  int     span;          /* Bytes of the data ring used, including skipped bytes */
+  char    type;          /* Selector type: D, E, C, T, L or O */
+  RcStream *stream;
+}
+RcEntry;
+
+/* A growing reply buffer */
+typedef struct RcBuffer_s
+{
+  char   *data;
+  size_t  length;
+  size_t  size;
+}
+RcBuffer;
+
+static struct
+{
+  int     running;
+  int     stop;
+  char   *path;          /* Path of the listening socket */
+  int     maxage;        /* Maximum age of records (seconds) */
+  char   *data;          /* Ring of record bytes */
+  size_t  size;          /* Size of the data ring */
+  size_t  tail;          /* Offset for the next record */
+  size_t  used;          /* Bytes of the data ring in use */
+  RcEntry *entries;      /* Ring of entries, indexed by serial number */
+  size_t  numentries;    /* Size of the entries ring, a power of 2 */
+  uint64_t first;        /* Serial number of the oldest record */
+  uint64_t next;         /* Serial number of the next record */
+  RcStream **slots;      /* Hash table of channels */
+  int     numslots;      /* Number of slots, a power of 2 */
+  int     numstreams;
+  RcStream *streams;     /* Channels in the order they were added */
+  RcStream *laststream;
+  RcCounters counters;
+  int     listenfd;
+  int     wakefd[2];     /* Pipe to stop the cache thread */
+  pthread_mutex_t lock;
+  pthread_t thread;
+} rc = {0};
+
+static void *rc_thread (void *arg);
+static void rc_serve (int fd);
+static int rc_query (char *request, RcBuffer *reply);
+static int rc_selected (SLstream *streams, RcStream *stream, char type);
+static int rc_selmatch (const char *selector, int length, RcStream *stream, char type);
+static int rc_globmatch (const char *string, const char *pattern);
+static int rc_parsewindow (const char *window, double *begin, double *end);
+static double rc_epoch (int year, int day, int hour, int min, int sec, int fract);
+static void rc_expire (double now);
+static void rc_evict (void);
+static RcStream *rc_getstream (const char *key);
+static int rc_append (RcBuffer *buffer, const char *data, size_t length);
+
+/***************************************************************************
+ * rc_start:
+ *
+ * Allocate a cache of 'size' bytes keeping records up to 'maxage'
+ * seconds, 0 for no limit, and start the cache thread answering
+ * queries on the Unix socket at 'path'.
+ *
+ * Returns 0 on success and -1 on error.
+ ***************************************************************************/
+int
+rc_start (const char *path, size_t size, int maxage)
+{
+  struct sockaddr_un unaddr;
+
+  if (size < SLMAXRECSIZE)
+  {
+    sl_log (2, 0, "record cache size must be at least %d bytes\n", SLMAXRECSIZE);
+    return -1;
+  }
+
+  if (strlen (path) >= sizeof (unaddr.sun_path))
+  {
+    sl_log (2, 0, "cache socket path too long: %s\n", path);
+    return -1;
+  }
+
+  rc.size       = size;
+  rc.maxage     = maxage;
+  rc.numentries = RC_MINENTRIES;
+  rc.numslots   = 256;
+
+  if ((rc.path = strdup (path)) == NULL ||
+      (rc.data = (char *)malloc (rc.size)) == NULL ||
+      (rc.entries = (RcEntry *)malloc (rc.numentries * sizeof (RcEntry))) == NULL ||
+      (rc.slots = (RcStream **)calloc (rc.numslots, sizeof (RcStream *))) == NULL)
+  {
+    sl_log (2, 0, "cannot allocate memory for record cache\n");
+    return -1;
+  }
+
+  memset (&unaddr, 0, sizeof (unaddr));
+  unaddr.sun_family = AF_UNIX;
+  strcpy (unaddr.sun_path, path);
+
+  if ((rc.listenfd = socket (AF_UNIX, SOCK_STREAM, 0)) < 0)
+  {
+    sl_log (2, 0, "socket(): %s\n", strerror (errno));
+    return -1;
+  }
+
+  /* Replace a socket left by an earlier run */
+  unlink (path);
+
+  if (bind (rc.listenfd, (struct sockaddr *)&unaddr, sizeof (unaddr)) ||
+      listen (rc.listenfd, 16))
+  {
+    sl_log (2, 0, "cannot listen for cache clients on %s: %s\n", path,
+            strerror (errno));
+    close (rc.listenfd);
+    return -1;
+  }
+
+  fcntl (rc.listenfd, F_SETFL, fcntl (rc.listenfd, F_GETFL) | O_NONBLOCK);
+
+  if (pipe (rc.wakefd))
+  {
+    sl_log (2, 0, "cannot create pipe: %s\n", strerror (errno));
+    close (rc.listenfd);
+    return -1;
+  }
+
+  pthread_mutex_init (&rc.lock, NULL);
+
+  /* Set before the thread starts, STATS queries are answered from it */
+  __atomic_store_n (&rc.running, 1, __ATOMIC_RELEASE);
+
+  if (pthread_create (&rc.thread, NULL, rc_thread, NULL))
+  {
+    sl_log (2, 0, "cannot start cache thread\n");
+    __atomic_store_n (&rc.running, 0, __ATOMIC_RELEASE);
+    return -1;
+  }
+
+  return 0;
+} /* End of rc_start() */
+
+/***************************************************************************
+ * rc_stop:
+ *
+ * Stop the cache thread, report the cache counters and release the
+ * cache.
+ ***************************************************************************/
+void
+rc_stop (void)
+{
+  RcStream *stream;
+  RcStream *next;
+
+  if (!rc.running)
+    return;
+
+  __atomic_store_n (&rc.stop, 1, __ATOMIC_SEQ_CST);
+
+  if (write (rc.wakefd[1], "", 1) < 0)
+    sl_log (2, 0, "cannot wake up cache thread: %s\n", strerror (errno));
+
+  pthread_join (rc.thread, NULL);
+  __atomic_store_n (&rc.running, 0, __ATOMIC_RELEASE);
+
+  sl_log (1, 1, "record cache: %lld records, %lld evicted for age, %lld for room, "
+                "%lld queries, %lld hits, %lld misses, %lld records served\n",
+          (long long)rc.counters.records, (long long)rc.counters.ageevictions,
+          (long long)rc.counters.sizeevictions, (long long)rc.counters.queries,
+          (long long)rc.counters.hits, (long long)rc.counters.misses,
+          (long long)rc.counters.served);
+
+  close (rc.wakefd[0]);
+  close (rc.wakefd[1]);
+  close (rc.listenfd);
+  unlink (rc.path);
+
+  pthread_mutex_destroy (&rc.lock);
+
+  for (stream = rc.streams; stream; stream = next)
+  {
+    next = stream->next;
+    free (stream->serials);
+    free (stream);
+  }
+
+  free (rc.path);
+  free (rc.data);
+  free (rc.entries);
+  free (rc.slots);
+
+  memset (&rc, 0, sizeof (rc));
+} /* End of rc_stop() */
+
+/***************************************************************************
+ * rc_packet:
+ *
+ * Add a received record to the cache, evicting the oldest records as
+ * needed.  Only SeedLink data packets (data, detection, calibration,
+ * timing, message and general records) are cached.
+ ***************************************************************************/
+void
+rc_packet (const char *msrecord, int reclen, int packet_type)
+{
+  static const char types[] = "DECTLO";
+  const struct sl_btime_s *btime;
+  SLMSheader msh;
+  RcStream *stream;
+  RcEntry *entry;
+  RcEntry *entries;
+  uint64_t *serials;
+  uint64_t serial;
+  double now;
+  size_t offset;
+  size_t skip;
+  int idx;
+
+  if (!rc.running || packet_type < SLDATA || packet_type > SLBLK ||
+      (size_t)reclen > rc.size)
+    return;
+
+  sl_msh_init (&msh, msrecord);
+  now = sl_dtime ();
+
+  pthread_mutex_lock (&rc.lock);
+
+  rc_expire (now);
+
+  if ((stream = rc_getstream (msh.fsdh->station)) == NULL)
+  {
+    pthread_mutex_unlock (&rc.lock);
+    return;
+  }
+
+  /* Grow the rings of entries and of the channel when full */
+  if (rc.next - rc.first == rc.numentries)
+  {
+    if ((entries = (RcEntry *)malloc (2 * rc.numentries * sizeof (RcEntry))) == NULL)
+    {
+      sl_log (2, 0, "cannot allocate memory for record cache\n");
+      pthread_mutex_unlock (&rc.lock);
+      return;
+    }
+
+    for (serial = rc.first; serial < rc.next; serial++)
+      entries[serial & (2 * rc.numentries - 1)] = rc.entries[serial & (rc.numentries - 1)];
+
+    free (rc.entries);
+    rc.entries = entries;
+    rc.numentries *= 2;
+  }
+
+  if (stream->count == stream->size)
+  {
+    if ((serials = (uint64_t *)malloc (2 * stream->size * sizeof (uint64_t))) == NULL)
+    {
+      sl_log (2, 0, "cannot allocate memory for record cache\n");
+      pthread_mutex_unlock (&rc.lock);
+      return;
+    }
+
+    for (idx = 0; idx < stream->count; idx++)
+      serials[idx] = stream->serials[(stream->head + idx) & (stream->size - 1)];
+
+    free (stream->serials);
+    stream->serials = serials;
+    stream->head    = 0;
+    stream->size *= 2;
+  }
+
+  /* Make room, a record that does not fit before the end of the data
+     ring starts at the beginning and the bytes in between are skipped */
+  for (;;)
+  {
+    skip = (rc.tail + reclen > rc.size) ? rc.size - rc.tail : 0;
+
+    if (rc.used + skip + reclen <= rc.size)
+      break;
+
+    rc_evict ();
+    rc.counters.sizeevictions++;
+  }
+
+  /* A record ending exactly at the end of the ring skips no bytes */
+  offset = (rc.tail + reclen > rc.size) ? 0 : rc.tail;
+
+  btime = sl_msh_starttime (&msh);
+
+  entry            = &rc.entries[rc.next & (rc.numentries - 1)];
+  entry->starttime = rc_epoch (btime->year, btime->day, btime->hour,
+                               btime->min, btime->sec, btime->fract);
+  entry->endtime   = sl_msh_depochetime (&msh);
+  entry->arrival   = now;
+  entry->offset    = offset;
+  entry->length    = reclen;
+  entry->span      = skip + reclen;
+  entry->type      = types[packet_type];
+  entry->stream    = stream;
+
+  memcpy (rc.data + offset, msrecord, reclen);
+
+  rc.tail = offset + reclen;
+  rc.used += skip + reclen;
+
+  if (stream->count++ == 0)
+    rc.counters.channels++;
+
+  stream->serials[(stream->head + stream->count - 1) & (stream->size - 1)] = rc.next++;
+
+  rc.counters.records++;
+  rc.counters.cached++;
+  rc.counters.bytes += reclen;
+
+  pthread_mutex_unlock (&rc.lock);
+} /* End of rc_packet() */
+
+/***************************************************************************
+ * rc_counters:
+ *
+ * Copy the cache counters to 'counters'.  May be called by any thread.
+ *
+ * Returns 0 on success or -1 if the cache is not running.
+ ***************************************************************************/
+int
+rc_counters (RcCounters *counters)
+{
+  if (!__atomic_load_n (&rc.running, __ATOMIC_ACQUIRE))
+    return -1;
+
+  pthread_mutex_lock (&rc.lock);
+  *counters = rc.counters;
+  pthread_mutex_unlock (&rc.lock);
+
+  return 0;
+} /* End of rc_counters() */
+
+/***************************************************************************
+ * rc_thread:
+ *
+ * Cache thread, accepts clients and answers their queries until
+ * rc_stop() writes to the wake pipe.
+ ***************************************************************************/
+static void *
+rc_thread (void *arg)
+{
+  struct pollfd fds[2];
+  int fd;
+
+  fds[0].fd     = rc.wakefd[0];
+  fds[0].events = POLLIN;
+  fds[1].fd     = rc.listenfd;
+  fds[1].events = POLLIN;
+
+  while (!__atomic_load_n (&rc.stop, __ATOMIC_SEQ_CST))
+  {
+    if (poll (fds, 2, -1) < 0)
+    {
+      if (errno == EINTR)
+        continue;
+
+      sl_log (2, 0, "poll(): %s\n", strerror (errno));
+      break;
+    }
+
+    if (fds[0].revents & POLLIN)
+      break;
+
+    if ((fds[1].revents & POLLIN) && (fd = accept (rc.listenfd, NULL, NULL)) >= 0)
+    {
+      rc_serve (fd);
+      close (fd);
+    }
+  }
+
+  return NULL;
+} /* End of rc_thread() */
+
+/***************************************************************************
+ * rc_serve:
+ *
+ * Receive the request of a client and send the reply.
+ ***************************************************************************/
+static void
+rc_serve (int fd)
+{
+  struct timeval timeout;
+  RcBuffer reply = {0};
+  RcCounters counters;
+  char request[RC_MAXREQUEST];
+  char *newline = NULL;
+  size_t length = 0;
+  size_t offset;
+  ssize_t nread;
+  ssize_t sent;
+
+  /* Accepted sockets are blocking, do not wait for a stalled client */
+  fcntl (fd, F_SETFL, fcntl (fd, F_GETFL) & ~O_NONBLOCK);
+
+  timeout.tv_sec  = RC_TIMEOUT;
+  timeout.tv_usec = 0;
+  setsockopt (fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof (timeout));
+  setsockopt (fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof (timeout));
+
+  while (!newline && length < sizeof (request) - 1)
+  {
+    if ((nread = recv (fd, request + length, sizeof (request) - 1 - length, 0)) <= 0)
+      break;
+
+    length += nread;
+    request[length] = '\0';
+    newline = strpbrk (request, "\r\n");
+  }
+
+  /* A request is also accepted when the client shuts down its side */
+  request[length] = '\0';
+
+  if (newline)
+    *newline = '\0';
+
+  if (!strcmp (request, "STATS"))
+  {
+    if (rc_counters (&counters))
+    {
+      rc_append (&reply, "ERROR\n", 6);
+    }
+    else
+    {
+      snprintf (request, sizeof (request),
+                "records %lld\nage_evictions %lld\nsize_evictions %lld\n"
+                "queries %lld\nhits %lld\nmisses %lld\nserved %lld\n"
+                "cached %lld\nbytes %lld\nchannels %lld\n",
+                (long long)counters.records, (long long)counters.ageevictions,
+                (long long)counters.sizeevictions, (long long)counters.queries,
+                (long long)counters.hits, (long long)counters.misses,
+                (long long)counters.served, (long long)counters.cached,
+                (long long)counters.bytes, (long long)counters.channels);
+
+      rc_append (&reply, request, strlen (request));
+    }
+  }
+  else if (rc_query (request, &reply))
+  {
+    reply.length = 0;
+    rc_append (&reply, "ERROR\n", 6);
+  }
+
+  for (offset = 0; offset < reply.length; offset += sent)
+  {
+    if ((sent = send (fd, reply.data + offset, reply.length - offset, MSG_NOSIGNAL)) <= 0)
+    {
+      sl_log (1, 1, "record cache: cannot send reply: %s\n", strerror (errno));
+      break;
+    }
+  }
+
+  free (reply.data);
+} /* End of rc_serve() */
+
+/***************************************************************************
+ * rc_query:
+ *
+ * Collect the records matching a request in 'reply'.  The serial
+ * numbers of the matching records are collected first, the records
+ * are then copied in chunks of RC_CHUNK.  Records evicted in between
+ * are left out, as they are the oldest of their channels the reply
+ * still holds consecutive records of each channel.
+ *
+ * Returns 0 on success and -1 for an invalid request or when the
+ * reply cannot be collected completely.
+ ***************************************************************************/
+static int
+rc_query (char *request, RcBuffer *reply)
+{
+  RcBuffer matches = {0};
+  RcStream *stream;
+  RcEntry *entry;
+  SLCD *query;
+  uint64_t *serials;
+  uint64_t serial;
+  char *streamlist = request;
+  double begin = 0.0;
+  double end   = 0.0;
+  int64_t served = 0;
+  size_t count;
+  size_t match;
+  size_t next;
+  int failed = 0;
+  int low, high, mid;
+  int idx;
+
+  while (*streamlist == ' ')
+    streamlist++;
+
+  /* A leading time window only consists of digits, commas and a colon */
+  if (strspn (streamlist, "0123456789,:") == strcspn (streamlist, " ") &&
+      strchr (streamlist, ':') && strchr (streamlist, ' '))
+  {
+    *strchr (streamlist, ' ') = '\0';
+
+    if (rc_parsewindow (streamlist, &begin, &end))
+      return -1;
+
+    streamlist += strlen (streamlist) + 1;
+
+    while (*streamlist == ' ')
+      streamlist++;
+  }
+
+  if ((query = sl_newslcd ()) == NULL)
+    return -1;
+
+  if (sl_parse_streamlist (query, streamlist, NULL) <= 0)
+  {
+    sl_freeslcd (query);
+    return -1;
+  }
+
+  pthread_mutex_lock (&rc.lock);
+
+  rc_expire (sl_dtime ());
+
+  for (stream = rc.streams; stream && !failed; stream = stream->next)
+  {
+    if (!stream->count || !rc_selected (query->streams, stream, 0))
+      continue;
+
+    /* Find the first record ending at or after the beginning */
+    low  = 0;
+    high = stream->count;
+
+    while (begin > 0.0 && low < high)
+    {
+      mid   = (low + high) / 2;
+      entry = &rc.entries[stream->serials[(stream->head + mid) & (stream->size - 1)] &
+                          (rc.numentries - 1)];
+
+      if (entry->endtime < begin)
+        low = mid + 1;
+      else
+        high = mid;
+    }
+
+    for (idx = low; idx < stream->count; idx++)
+    {
+      serial = stream->serials[(stream->head + idx) & (stream->size - 1)];
+      entry  = &rc.entries[serial & (rc.numentries - 1)];
+
+      if (end > 0.0 && entry->starttime > end)
+        break;
+
+      if (!rc_selected (query->streams, stream, entry->type))
+        continue;
+
+      if (rc_append (&matches, (const char *)&serial, sizeof (serial)))
+      {
+        failed = 1;
+        break;
+      }
+    }
+  }
+
+  pthread_mutex_unlock (&rc.lock);
+
+  sl_freeslcd (query);
+
+  serials = (uint64_t *)matches.data;
+  count   = matches.length / sizeof (uint64_t);
+
+  /* Copy the records, the oldest may have been evicted meanwhile */
+  for (next = 0; next < count && !failed; next = match)
+  {
+    pthread_mutex_lock (&rc.lock);
+
+    for (match = next; match < count && match < next + RC_CHUNK; match++)
+    {
+      if (serials[match] < rc.first)
+        continue;
+
+      entry = &rc.entries[serials[match] & (rc.numentries - 1)];
+
+      if (rc_append (reply, rc.data + entry->offset, entry->length))
+      {
+        failed = 1;
+        break;
+      }
+
+      served++;
+    }
+
+    pthread_mutex_unlock (&rc.lock);
+  }
+
+  free (matches.data);
+
+  pthread_mutex_lock (&rc.lock);
+
+  rc.counters.queries++;
+
+  /* A partial reply is not sent, the client is answered with an error */
+  if (!failed)
+  {
+    rc.counters.served += served;
+
+    if (served)
+      rc.counters.hits++;
+    else
+      rc.counters.misses++;
+  }
+
+  pthread_mutex_unlock (&rc.lock);
+
+  return (failed) ? -1 : 0;
+} /* End of rc_query() */
+
+/***************************************************************************
+ * rc_selected:
+ *
+ * Test if records of a channel with selector type 'type' are selected
+ * by a stream list.  A 'type' of 0 matches any type, to test if any
+ * records of the channel may be selected.  Records are selected by a
+ * stream matching their network and station whose selectors include
+ * them: a record matching a negated selector (!) is excluded, without
+ * any other selectors all records are included.
+ *
+ * Returns 1 if selected, otherwise 0.
+ ***************************************************************************/
+static int
+rc_selected (SLstream *streams, RcStream *stream, char type)
+{
+  const char *selector;
+  int length;
+  int negated;
+  int positive;
+  int included;
+  int excluded;
+
+  for (; streams; streams = streams->next)
+  {
+    if (!rc_globmatch (stream->net, streams->net) ||
+        !rc_globmatch (stream->sta, streams->sta))
+      continue;
+
+    if (!streams->selectors)
+      return 1;
+
+    positive = 0;
+    included = 0;
+    excluded = 0;
+
+    for (selector = streams->selectors;; selector += length)
+    {
+      selector += strspn (selector, " ");
+
+      if (!(length = strcspn (selector, " ")))
+        break;
+
+      negated = (*selector == '!');
+
+      if (rc_selmatch (selector + negated, length - negated, stream, type))
+      {
+        if (negated)
+          excluded = 1;
+        else
+          included = 1;
+      }
+
+      if (!negated)
+        positive = 1;
+    }
+
+    /* Exclusions only apply to records of a known type */
+    if ((included || !positive) && !(excluded && type))
+      return 1;
+  }
+
+  return 0;
+} /* End of rc_selected() */
+
+/***************************************************************************
+ * rc_selmatch:
+ *
+ * Test if a SeedLink selector, [LL]CCC[.T] with ? wildcards, matches
+ * a channel and selector type.  Without a location any location
+ * matches, a - matches a blank location character.  A 'type' of 0
+ * matches any type.
+ *
+ * Returns 1 if it matches, otherwise 0.
+ ***************************************************************************/
+static int
+rc_selmatch (const char *selector, int length, RcStream *stream, char type)
+{
+  const char *dot = memchr (selector, '.', length);
+  const char *chan = stream->key + 7;
+  const char *loc = stream->key + 5;
+  int codes = (dot) ? (int)(dot - selector) : length;
+  int idx;
+
+  if (dot && type && (length - codes != 2 || (dot[1] != '?' && dot[1] != type)))
+    return 0;
+
+  if (codes == 5)
+  {
+    for (idx = 0; idx < 2; idx++)
+    {
+      if (selector[idx] != '?' && selector[idx] != loc[idx] &&
+          !(selector[idx] == '-' && loc[idx] == ' '))
+        return 0;
+    }
+
+    selector += 2;
+  }
+  else if (codes != 3)
+  {
+    return 0;
+  }
+
+  for (idx = 0; idx < 3; idx++)
+  {
+    if (selector[idx] != '?' && selector[idx] != chan[idx])
+      return 0;
+  }
+
+  return 1;
+} /* End of rc_selmatch() */
+
+/***************************************************************************
+ * rc_globmatch:
+ *
+ * Test if a string matches a pattern with * and ? wildcards.
+ *
+ * Returns 1 if it matches, otherwise 0.
+ ***************************************************************************/
+static int
+rc_globmatch (const char *string, const char *pattern)
+{
+  for (; *pattern; pattern++, string++)
+  {
+    if (*pattern == '*')
+    {
+      for (; *string; string++)
+      {
+        if (rc_globmatch (string, pattern + 1))
+          return 1;
+      }
+
+      return rc_globmatch (string, pattern + 1);
+    }
+
+    if (!*string || (*pattern != '?' && *pattern != *string))
+      return 0;
+  }
+
+  return (*string == '\0');
+} /* End of rc_globmatch() */
+
+/***************************************************************************
+ * rc_parsewindow:
+ *
+ * Parse a time window in the begin:[end] format of the -tw option, the
+ * times in year,month,day,hour,min,sec format.  An omitted end is
+ * returned as 0.
+ *
+ * Returns 0 on success and -1 on error.
+ ***************************************************************************/
+static int
+rc_parsewindow (const char *window, double *begin, double *end)
+{
+  static const int mdays[] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+  double *times[2] = {begin, end};
+  int year, month, mday, hour, min, sec;
+  int day;
+  int idx;
+
+  *end = 0.0;
+
+  for (idx = 0; idx < 2 && *window; idx++)
+  {
+    if (sscanf (window, "%d,%d,%d,%d,%d,%d", &year, &month, &mday, &hour, &min, &sec) != 6 ||
+        month < 1 || month > 12)
+      return -1;
+
+    for (day = mday; --month > 0;)
+      day += mdays[month - 1] + (month == 2 && year % 4 == 0 &&
+                                 (year % 100 != 0 || year % 400 == 0));
+
+    *times[idx] = rc_epoch (year, day, hour, min, sec, 0);
+
+    window += strcspn (window, ":");
+
+    if (*window == ':')
+      window++;
+    else if (idx == 0)
+      return -1;
+  }
+
+  return 0;
+} /* End of rc_parsewindow() */
+
+/***************************************************************************
+ * rc_epoch:
+ *
+ * Returns the epoch time of a year, day of year and time, calculated
+ * like sl_msh_depochetime().
+ ***************************************************************************/
+static double
+rc_epoch (int year, int day, int hour, int min, int sec, int fract)
+{
+  return (double)(year - 1970) * 31536000 +
+         ((year - 1969) / 4) * 86400 +
+         (day - 1) * 86400 +
+         hour * 3600 +
+         min * 60 +
+         sec +
+         (double)fract / 10000.0;
+} /* End of rc_epoch() */
+
+/***************************************************************************
+ * rc_expire:
+ *
+ * Evict records older than the maximum age.  The cache lock must be
+ * held.
+ ***************************************************************************/
+static void
+rc_expire (double now)
+{
+  while (rc.maxage > 0 && rc.first < rc.next &&
+         rc.entries[rc.first & (rc.numentries - 1)].arrival < now - rc.maxage)
+  {
+    rc_evict ();
+    rc.counters.ageevictions++;
+  }
+} /* End of rc_expire() */
+
+/***************************************************************************
+ * rc_evict:
+ *
+ * Evict the oldest record, which is also the oldest of its channel.  The
+ * cache lock must be held.
+ ***************************************************************************/
+static void
+rc_evict (void)
+{
+  RcEntry *entry = &rc.entries[rc.first & (rc.numentries - 1)];
+  RcStream *stream = entry->stream;
+
+  stream->head = (stream->head + 1) & (stream->size - 1);
+
+  if (--stream->count == 0)
+    rc.counters.channels--;
+
+  rc.used -= entry->span;
+  rc.first++;
+
+  rc.counters.cached--;
+  rc.counters.bytes -= entry->length;
+
+  /* Start over at the beginning of an empty data ring */
+  if (rc.first == rc.next)
+  {
+    rc.used = 0;
+    rc.tail = 0;
+  }
+} /* End of rc_evict() */
+
+/***************************************************************************
+ * rc_getstream:
+ *
+ * Find the channel for the 12 byte 'key', the station, location,
+ * channel and network codes of a fixed header, or add it.  The hash
+ * table is doubled when half full.  The cache lock must be held.
+ *
+ * Returns a pointer to the channel or NULL on error.
+ ***************************************************************************/
+static RcStream *
+rc_getstream (const char *key)
+{
+  RcStream **slots;
+  RcStream *stream;
+  uint32_t hash = 2166136261u;
+  int idx;
+
+  for (idx = 0; idx < 12; idx++)
+    hash = (hash ^ (unsigned char)key[idx]) * 16777619u;
+
+  for (idx = hash & (rc.numslots - 1); rc.slots[idx];
+       idx = (idx + 1) & (rc.numslots - 1))
+  {
+    if (!memcmp (rc.slots[idx]->key, key, 12))
+      return rc.slots[idx];
+  }
+
+  if ((stream = (RcStream *)calloc (1, sizeof (RcStream))) == NULL ||
+      (stream->serials = (uint64_t *)malloc (RC_MINSTREAM * sizeof (uint64_t))) == NULL)
+  {
+    sl_log (2, 0, "cannot allocate memory for record cache\n");
+    free (stream);
+    return NULL;
+  }
+
+  memcpy (stream->key, key, 12);
+  sl_strncpclean (stream->sta, key, 5);
+  sl_strncpclean (stream->loc, key + 5, 2);
+  sl_strncpclean (stream->chan, key + 7, 3);
+  sl_strncpclean (stream->net, key + 10, 2);
+  stream->size = RC_MINSTREAM;
+
+  rc.slots[idx] = stream;
+
+  if (rc.laststream)
+    rc.laststream->next = stream;
+  else
+    rc.streams = stream;
+
+  rc.laststream = stream;
+
+  if (++rc.numstreams * 2 > rc.numslots)
+  {
+    if ((slots = (RcStream **)calloc (2 * rc.numslots, sizeof (RcStream *))) == NULL)
+      return stream;
+
+    free (rc.slots);
+    rc.slots = slots;
+    rc.numslots *= 2;
+
+    for (stream = rc.streams; stream; stream = stream->next)
+    {
+      for (hash = 2166136261u, idx = 0; idx < 12; idx++)
+        hash = (hash ^ (unsigned char)stream->key[idx]) * 16777619u;
+
+      for (idx = hash & (rc.numslots - 1); rc.slots[idx];
+           idx = (idx + 1) & (rc.numslots - 1))
+        ;
+
+      rc.slots[idx] = stream;
+    }
+
+    stream = rc.laststream;
+  }
+
+  return stream;
+} /* End of rc_getstream() */
+
+/***************************************************************************
+ * rc_append:
+ *
+ * Append data to a reply buffer, doubling its size as needed.
+ *
+ * Returns 0 on success and -1 on error.
+ ***************************************************************************/
+static int
+rc_append (RcBuffer *buffer, const char *data, size_t length)
+{
+  char *newdata;
+  size_t newsize;
+
+  if (buffer->length + length > buffer->size)
+  {
+    for (newsize = (buffer->size) ? buffer->size : 65536;
+         newsize < buffer->length + length;)
+      newsize *= 2;
+
+    if ((newdata = (char *)realloc (buffer->data, newsize)) == NULL)
+    {
+      sl_log (2, 0, "cannot allocate memory for cache reply\n");
+      return -1;
+    }
+
+    buffer->data = newdata;
+    buffer->size = newsize;
+  }
+
+  memcpy (buffer->data + buffer->length, data, length);
+  buffer->length += length;
+
+  return 0;
+} /* End of rc_append() */
+
+#else /* SLP_WIN */
+
+/***************************************************************************
+ * The record cache is not supported on Windows.
+ ***************************************************************************/
+int
+rc_start (const char *path, size_t size, int maxage)
+{
+  sl_log (2, 0, "the record cache is not supported on this platform\n");
+  return -1;
+}
+
+void
+rc_stop (void)
+{
+}
+
+void
+rc_packet (const char *msrecord, int reclen, int packet_type)
+{
+}
+
+int
+rc_counters (RcCounters *counters)
+{
+  return -1;
+}
+
+#endif /* SLP_WIN */
@@ -0,0 +1,42 @@
+/***************************************************************************
+ * rcache.h
+ *
+ * Interface declarations for the cache of recently received records
+ * and its query interface on a Unix domain socket.
+ *
+ * modified: 2026.287
+ ***************************************************************************/
+
+#ifndef RCACHE_H
+#define RCACHE_H
+
+#include <stdint.h>
+
+/* Default size of the record cache (bytes) */
+#define RC_DEFSIZE 67108864
+
+/* Default maximum age of cached records (seconds) */
+#define RC_DEFAGE 600
+
+/* Cache counters, see rc_counters() */
+typedef struct RcCounters_s
+{
+  int64_t records;       /* Records added to the cache */
+  int64_t ageevictions;  /* Records evicted for their age */
+  int64_t sizeevictions; /* Records evicted for room */
+  int64_t queries;       /* Queries answered */
+  int64_t hits;          /* Queries answered with records */
+  int64_t misses;        /* Queries without matching records */
+  int64_t served;        /* Records sent to clients */
+  int64_t cached;        /* Records in the cache */
+  int64_t bytes;         /* Bytes of the records in the cache */
+  int64_t channels;      /* Channels with records in the cache */
+}
+RcCounters;
+
+extern int rc_start (const char *path, size_t size, int maxage);
+extern void rc_stop (void);
+extern void rc_packet (const char *msrecord, int reclen, int packet_type);
+extern int rc_counters (RcCounters *counters);
+
+#endif
@@ -0,0 +1,936 @@
+/***************************************************************************
+ * repack.c
+ *
+ * Repacking of data records into larger Steim2 records before
+ * archiving, e.g. the 512-byte records of a SeedLink server into
+ * RP_RECLEN-byte records.
+ *
+ * The samples of each channel are buffered while its records are
+ * contiguous and encoded into a record whenever they fill one.  The
+ * buffered samples are repacked into a last, shorter record when the
+ * continuity breaks: a gap or overlap of more than half a sample
+ * period, a change of the sample rate, quality or flags, the start of
+ * a new day, or when they were buffered longer than the maximum age.
+ * Records that cannot be decoded exactly, e.g. with an unknown
+ * encoding, a time correction not yet applied or a Blockette 100, are
+ * not repacked; the buffered samples of their channel are repacked
+ * first to keep the order.
+ *
+ * The first difference of a repacked record continues from the last
+ * sample of the previous record of the channel, the times of all
+ * records of a contiguous run are calculated from the start of the run
+ * and the nominal sample rate.
+ *
+ * Each channel also keeps the sequence numbers of the records with
+ * buffered samples, see rp_pending().
+ *
+ * modified: 2026.287
+ ***************************************************************************/
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <globmatch.h>
+
+#include "repack.h"
+
+/* Data frames of a repacked record after the header and blockettes */
+#define RP_DATAOFFSET 64
+#define RP_FRAMES ((RP_RECLEN - RP_DATAOFFSET) / 64)
+
+/* Key lengths, the codes followed by the source of the records */
+#define RP_STATIONKEY (7 + sizeof (void *))
+#define RP_CHANNELKEY (12 + sizeof (void *))
+
+/* A record with samples in the buffer of a channel */
+typedef struct RpSegment_s
+{
+  int     seqnum;        /* Sequence number of the record */
+  int     end;           /* Buffer index after its last sample */
+  int64_t serial;        /* Order in which the records were buffered */
+  double  arrival;       /* Time the record was buffered */
+}
+RpSegment;
+
+/* A channel, the key is the station, location, channel and network codes */
+typedef struct RpChannel_s
+{
+  char     key[RP_CHANNELKEY];
+  struct RpStation_s *station;
+  struct RpChannel_s *next;   /* Next channel of the station */
+  int32_t *samples;      /* Buffered samples */
+  int      count;
+  int      size;
+  RpSegment *segments;   /* Records of the buffered samples, oldest first */
+  int      numsegments;
+  int      maxsegments;
+  int      databytes;    /* Encoded size of the buffered samples */
+  int      valid;        /* Flag: the buffer continues a contiguous run */
+  int64_t  base;         /* Start time of the run (us) */
+  int64_t  offset;       /* Samples of the run repacked before the buffer */
+  int32_t  last;         /* Last sample repacked, if 'offset' */
+  double   rate;         /* Nominal sample rate */
+  int16_t  fact;         /* Header fields of the first buffered record */
+  int16_t  mult;
+  char     seqfield[6];
+  char     quality;
+  uint8_t  actflags;
+  uint8_t  ioflags;
+  uint8_t  dqflags;
+  int      timequal;     /* Timing quality of Blockette 1001 or -1 */
+}
+RpChannel;
+
+/* A station, the key is the station and network codes */
+typedef struct RpStation_s
+{
+  char     key[RP_STATIONKEY];
+  char     net[3];
+  char     sta[6];
+  const void *source;
+  RpChannel *channels;
+}
+RpStation;
+
+/* A hash table of entries starting with their key */
+typedef struct RpTable_s
+{
+  void  **slots;
+  int     size;          /* Number of slots, a power of 2 */
+  int     count;
+  int     keylen;
+}
+RpTable;
+
+static struct
+{
+  int        enabled;
+  RPHandler  handler;
+  int        maxage;
+  double     lastexpire;
+  int64_t    serial;
+  RpTable    stations;
+  RpTable    channels;
+  SLMSrecord *msr;
+  uint32_t   frames[RP_FRAMES * 16];
+  char       record[RP_RECLEN];
+} rp = {0};
+
+static RpChannel *rp_channel (const char *key, const char *msrecord,
+                              const void *source);
+static int rp_append (RpChannel *channel, SLMSrecord *msr, int seqnum,
+                      int reclen);
+static void rp_pack (RpChannel *channel, int flush);
+static int rp_encode (const int32_t *samples, int count, int32_t prev,
+                      int *nframes);
+static void rp_emit (RpChannel *channel, int count, int nframes);
+static int rp_oldest (RpChannel *channel, RpSegment **oldest);
+static int64_t rp_time (RpChannel *channel, int64_t index);
+static int64_t rp_ticks (const struct sl_btime_s *btime);
+static int rp_fits (int64_t value, int bits);
+static void rp_put16 (char *dest, uint16_t value);
+static void rp_put32 (char *dest, uint32_t value);
+static void *rp_lookup (RpTable *table, const char *key);
+static int rp_insert (RpTable *table, void *entry);
+static void rp_free (RpTable *table);
+
+/***************************************************************************
+ * rp_start:
+ *
+ * Start repacking records, repacked records are passed to 'handler'.
+ * Samples are buffered at most 'maxage' seconds, 0 for no limit.
+ *
+ * Returns 0 on success and -1 on error.
+ ***************************************************************************/
+int
+rp_start (RPHandler handler, int maxage)
+{
+  rp.stations.keylen = RP_STATIONKEY;
+  rp.channels.keylen = RP_CHANNELKEY;
+  rp.handler         = handler;
+  rp.maxage          = maxage;
+  rp.lastexpire      = sl_dtime ();
+  rp.enabled         = 1;
+
+  return 0;
+} /* End of rp_start() */
+
+/***************************************************************************
+ * rp_stop:
+ *
+ * Repack the buffered samples of all channels, stop repacking and free
+ * all entries.
+ ***************************************************************************/
+void
+rp_stop (void)
+{
+  RpChannel *channel;
+  int idx;
+
+  if (!rp.enabled)
+    return;
+
+  for (idx = 0; idx < rp.channels.size; idx++)
+  {
+    if ((channel = (RpChannel *)rp.channels.slots[idx]) == NULL)
+      continue;
+
+    rp_pack (channel, 1);
+
+    free (channel->samples);
+    free (channel->segments);
+  }
+
+  rp.enabled = 0;
+
+  rp_free (&rp.stations);
+  rp_free (&rp.channels);
+
+  sl_msr_free (&rp.msr);
+} /* End of rp_stop() */
+
+/***************************************************************************
+ * rp_record:
+ *
+ * Buffer the samples of a data record to be repacked, 'source'
+ * identifies the server the record was received from.  Records that
+ * are not repacked must be archived by the caller, the buffered
+ * samples of their channel were already repacked.
+ *
+ * Returns 1 if the record was buffered and 0 if it is not repacked.
+ ***************************************************************************/
+int
+rp_record (const char *msrecord, int reclen, int seqnum, const void *source)
+{
+  const struct sl_fsdh_s *fsdh = (const struct sl_fsdh_s *)msrecord;
+  SLMSrecord *msr;
+  RpChannel *channel;
+  char key[RP_CHANNELKEY];
+  uint8_t encoding;
+  int idx;
+
+  if (!rp.enabled)
+    return 0;
+
+  memcpy (key, fsdh->station, 12);
+  memcpy (key + 12, &source, sizeof (source));
+
+  channel = (RpChannel *)rp_lookup (&rp.channels, key);
+
+  /* Only records with samples that are decoded exactly are repacked */
+  msr = sl_msr_parse_size (NULL, msrecord, &rp.msr, 1, 0, reclen);
+
+  if (!msr || reclen >= RP_RECLEN || !msr->Blkt1000 || msr->Blkt100 ||
+      msr->fsdh.num_samples == 0 || msr->fsdh.samprate_fact == 0 ||
+      (msr->fsdh.time_correct != 0 && !(msr->fsdh.act_flags & 0x02)))
+    goto passthrough;
+
+  encoding = msr->Blkt1000->encoding;
+
+  if (encoding != 1 && encoding != 3 && encoding != 10 && encoding != 11)
+    goto passthrough;
+
+  msr = sl_msr_parse_size (NULL, msrecord, &rp.msr, 1, 1, reclen);
+
+  if (!msr || msr->unpackerr != MSD_NOERROR ||
+      msr->numsamples != msr->fsdh.num_samples || sl_msr_dnomsamprate (msr) <= 0.0)
+    goto passthrough;
+
+  /* All differences must fit a Steim2 word */
+  for (idx = 1; idx < msr->numsamples; idx++)
+  {
+    if (!rp_fits ((int64_t)msr->datasamples[idx] - msr->datasamples[idx - 1], 30))
+      goto passthrough;
+  }
+
+  if (!channel && (channel = rp_channel (key, msrecord, source)) == NULL)
+    return 0;
+
+  if (rp_append (channel, msr, seqnum, reclen))
+    goto passthrough;
+
+  if (channel->databytes >= RP_RECLEN - RP_DATAOFFSET)
+    rp_pack (channel, 0);
+
+  return 1;
+
+passthrough:
+  if (channel)
+  {
+    rp_pack (channel, 1);
+    channel->valid = 0;
+  }
+
+  return 0;
+} /* End of rp_record() */
+
+/***************************************************************************
+ * rp_expire:
+ *
+ * Repack the buffered samples of channels with records buffered longer
+ * than the maximum age, checked at most once per second.
+ ***************************************************************************/
+void
+rp_expire (double now)
+{
+  RpChannel *channel;
+  int idx;
+
+  if (!rp.enabled || rp.maxage <= 0 || now - rp.lastexpire < 1.0)
+    return;
+
+  rp.lastexpire = now;
+
+  for (idx = 0; idx < rp.channels.size; idx++)
+  {
+    channel = (RpChannel *)rp.channels.slots[idx];
+
+    if (channel && channel->numsegments &&
+        now - channel->segments[0].arrival >= rp.maxage)
+      rp_pack (channel, 1);
+  }
+} /* End of rp_expire() */
+
+/***************************************************************************
+ * rp_pending:
+ *
+ * Find the oldest buffered record of the stations matching a stream
+ * of a server, the network and station codes may be wildcarded and
+ * the uni-station stream matches all stations of the server.  A state
+ * saved with the sequence number before that record resumes with the
+ * first record not archived yet.
+ *
+ * Returns the sequence number of the record or -1 if none is buffered.
+ ***************************************************************************/
+int
+rp_pending (const char *net, const char *sta, const void *source)
+{
+  RpStation *station;
+  RpChannel *channel;
+  RpSegment *segment;
+  RpSegment *oldest = NULL;
+  char key[RP_STATIONKEY + 1];
+  int uni;
+  int idx;
+
+  if (!rp.enabled)
+    return -1;
+
+  uni = !strcmp (net, UNINETWORK) && !strcmp (sta, UNISTATION);
+
+  if (!uni && !strpbrk (net, "*?[") && !strpbrk (sta, "*?["))
+  {
+    snprintf (key, sizeof (key), "%-5.5s%-2.2s", sta, net);
+    memcpy (key + 7, &source, sizeof (source));
+
+    if ((station = (RpStation *)rp_lookup (&rp.stations, key)) == NULL)
+      return -1;
+
+    for (channel = station->channels; channel; channel = channel->next)
+    {
+      if (rp_oldest (channel, &segment) && (!oldest || segment->serial < oldest->serial))
+        oldest = segment;
+    }
+
+    return (oldest) ? oldest->seqnum : -1;
+  }
+
+  for (idx = 0; idx < rp.stations.size; idx++)
+  {
+    station = (RpStation *)rp.stations.slots[idx];
+
+    if (!station || station->source != source)
+      continue;
+
+    if (!uni && (!sl_globmatch (station->net, (char *)net) ||
+                 !sl_globmatch (station->sta, (char *)sta)))
+      continue;
+
+    for (channel = station->channels; channel; channel = channel->next)
+    {
+      if (rp_oldest (channel, &segment) && (!oldest || segment->serial < oldest->serial))
+        oldest = segment;
+    }
+  }
+
+  return (oldest) ? oldest->seqnum : -1;
+} /* End of rp_pending() */
+
+/***************************************************************************
+ * rp_channel:
+ *
+ * Add a channel and, if new, its station.
+ *
+ * Returns the channel or NULL on error.
+ ***************************************************************************/
+static RpChannel *
+rp_channel (const char *key, const char *msrecord, const void *source)
+{
+  const struct sl_fsdh_s *fsdh = (const struct sl_fsdh_s *)msrecord;
+  RpStation *station;
+  RpChannel *channel;
+  char stakey[RP_STATIONKEY];
+
+  memcpy (stakey, fsdh->station, 5);
+  memcpy (stakey + 5, fsdh->network, 2);
+  memcpy (stakey + 7, &source, sizeof (source));
+
+  if ((station = (RpStation *)rp_lookup (&rp.stations, stakey)) == NULL)
+  {
+    if ((station = (RpStation *)calloc (1, sizeof (RpStation))) == NULL ||
+        rp_insert (&rp.stations, memcpy (station->key, stakey, RP_STATIONKEY)))
+    {
+      sl_log (2, 0, "rp_channel(): error allocating memory\n");
+      free (station);
+      return NULL;
+    }
+
+    sl_strncpclean (station->net, fsdh->network, 2);
+    sl_strncpclean (station->sta, fsdh->station, 5);
+    station->source = source;
+  }
+
+  if ((channel = (RpChannel *)calloc (1, sizeof (RpChannel))) == NULL ||
+      rp_insert (&rp.channels, memcpy (channel->key, key, RP_CHANNELKEY)))
+  {
+    sl_log (2, 0, "rp_channel(): error allocating memory\n");
+    free (channel);
+    return NULL;
+  }
+
+  channel->station   = station;
+  channel->next      = station->channels;
+  station->channels  = channel;
+
+  return channel;
+} /* End of rp_channel() */
+
+/***************************************************************************
+ * rp_append:
+ *
+ * Add the unpacked samples of a record to the buffer of its channel,
+ * after repacking the buffered samples if the record does not continue
+ * them.
+ *
+ * Returns 0 on success and -1 on error.
+ ***************************************************************************/
+static int
+rp_append (RpChannel *channel, SLMSrecord *msr, int seqnum, int reclen)
+{
+  struct sl_fsdh_s *fsdh = &msr->fsdh;
+  RpSegment *segment;
+  int64_t start;
+  int64_t expected;
+  int64_t tolerance;
+  int32_t previous;
+  double rate   = sl_msr_dnomsamprate (msr);
+  int timequal  = (msr->Blkt1001) ? (uint8_t)msr->Blkt1001->timing_qual : -1;
+  int size;
+
+  start = rp_ticks (&fsdh->start_time);
+
+  if (msr->Blkt1001)
+    start += msr->Blkt1001->usec;
+
+  if (channel->valid)
+  {
+    expected  = rp_time (channel, channel->offset + channel->count);
+    tolerance = (int64_t)(500000.0 / rate);
+    previous  = (channel->count) ? channel->samples[channel->count - 1] : channel->last;
+
+    /* A new run after a gap, an overlap or a change of the sample rate */
+    if (fsdh->samprate_fact != channel->fact || fsdh->samprate_mult != channel->mult ||
+        start > expected + tolerance || start < expected - tolerance ||
+        (channel->offset + channel->count &&
+         !rp_fits ((int64_t)msr->datasamples[0] - previous, 30)))
+    {
+      rp_pack (channel, 1);
+      channel->valid = 0;
+    }
+    /* A new record within the run */
+    else if (channel->count &&
+             (fsdh->dhq_indicator != channel->quality || fsdh->act_flags != channel->actflags ||
+              fsdh->io_flags != channel->ioflags || fsdh->dq_flags != channel->dqflags ||
+              start / 86400000000LL != rp_time (channel, channel->offset) / 86400000000LL))
+    {
+      rp_pack (channel, 1);
+    }
+  }
+
+  if (!channel->valid)
+  {
+    channel->valid  = 1;
+    channel->base   = start;
+    channel->offset = 0;
+    channel->rate   = rate;
+    channel->fact   = fsdh->samprate_fact;
+    channel->mult   = fsdh->samprate_mult;
+  }
+
+  if (!channel->count)
+  {
+    memcpy (channel->seqfield, fsdh->sequence_number, 6);
+    channel->quality  = fsdh->dhq_indicator;
+    channel->actflags = fsdh->act_flags;
+    channel->ioflags  = fsdh->io_flags;
+    channel->dqflags  = fsdh->dq_flags;
+    channel->timequal = timequal;
+  }
+
+  if (channel->count + msr->numsamples > channel->size)
+  {
+    int32_t *samples;
+
+    size = (channel->size) ? channel->size : 4096;
+    while (size < channel->count + msr->numsamples)
+      size *= 2;
+
+    if ((samples = (int32_t *)realloc (channel->samples, size * sizeof (int32_t))) == NULL)
+    {
+      sl_log (2, 0, "rp_append(): error allocating memory\n");
+      return -1;
+    }
+
+    channel->samples = samples;
+    channel->size    = size;
+  }
+
+  if (channel->numsegments == channel->maxsegments)
+  {
+    size = (channel->maxsegments) ? channel->maxsegments * 2 : 16;
+
+    if ((segment = (RpSegment *)realloc (channel->segments, size * sizeof (RpSegment))) == NULL)
+    {
+      sl_log (2, 0, "rp_append(): error allocating memory\n");
+      return -1;
+    }
+
+    channel->segments    = segment;
+    channel->maxsegments = size;
+  }
+
+  memcpy (channel->samples + channel->count, msr->datasamples,
+          msr->numsamples * sizeof (int32_t));
+  channel->count     += msr->numsamples;
+  channel->databytes += reclen - fsdh->begin_data;
+
+  segment          = &channel->segments[channel->numsegments++];
+  segment->seqnum  = seqnum;
+  segment->end     = channel->count;
+  segment->serial  = rp.serial++;
+  segment->arrival = sl_dtime ();
+
+  return 0;
+} /* End of rp_append() */
+
+/***************************************************************************
+ * rp_pack:
+ *
+ * Repack the buffered samples of a channel while they fill a record,
+ * with 'flush' also the remaining samples into a shorter record.
+ ***************************************************************************/
+static void
+rp_pack (RpChannel *channel, int flush)
+{
+  int32_t prev;
+  int nframes;
+  int count;
+  int idx;
+
+  while (channel->count > 0)
+  {
+    prev  = (channel->offset) ? channel->last : channel->samples[0];
+    count = rp_encode (channel->samples, channel->count, prev, &nframes);
+
+    if (count == channel->count && !flush)
+      break;
+
+    rp_emit (channel, count, nframes);
+
+    channel->last    = channel->samples[count - 1];
+    channel->offset += count;
+    channel->count  -= count;
+    memmove (channel->samples, channel->samples + count,
+             channel->count * sizeof (int32_t));
+
+    /* Forget the records repacked completely */
+    for (idx = 0; idx < channel->numsegments && channel->segments[idx].end <= count; idx++)
+      ;
+
+    channel->numsegments -= idx;
+    memmove (channel->segments, channel->segments + idx,
+             channel->numsegments * sizeof (RpSegment));
+
+    for (idx = 0; idx < channel->numsegments; idx++)
+      channel->segments[idx].end -= count;
+
+    channel->databytes = (int)((int64_t)channel->databytes * channel->count /
+                               (channel->count + count));
+  }
+} /* End of rp_pack() */
+
+/***************************************************************************
+ * rp_encode:
+ *
+ * Encode samples into the Steim2 frames of a record, the first
+ * difference is taken from 'prev'.  Each word holds the most
+ * differences that fit, from seven 4-bit to one 30-bit difference.
+ * Differences must fit 30 bits.
+ *
+ * Returns the number of samples encoded, 'nframes' is set to the
+ * number of frames used.
+ ***************************************************************************/
+static int
+rp_encode (const int32_t *samples, int count, int32_t prev, int *nframes)
+{
+  /* Differences per word, their width and the word's nibbles */
+  static const struct
+  {
+    int      number;
+    int      bits;
+    uint32_t nibble;
+    uint32_t dnib;
+  } packings[7] = {
+      {7, 4, 3, 2}, {6, 5, 3, 1}, {5, 6, 3, 0}, {4, 8, 1, 0},
+      {3, 10, 2, 3}, {2, 15, 2, 2}, {1, 30, 2, 1}};
+
+  uint32_t *frame;
+  uint32_t word;
+  uint32_t mask;
+  int64_t diff;
+  int pos = 0;
+  int fidx;
+  int widx;
+  int pidx;
+  int idx;
+
+  memset (rp.frames, 0, sizeof (rp.frames));
+
+  for (fidx = 0; fidx < RP_FRAMES && pos < count; fidx++)
+  {
+    frame = rp.frames + fidx * 16;
+
+    /* The first frame starts with the first and last sample */
+    for (widx = (fidx == 0) ? 3 : 1; widx < 16 && pos < count; widx++)
+    {
+      for (pidx = 0; pidx < 6; pidx++)
+      {
+        if (packings[pidx].number > count - pos)
+          continue;
+
+        for (idx = 0; idx < packings[pidx].number; idx++)
+        {
+          diff = (int64_t)samples[pos + idx] - ((pos + idx) ? samples[pos + idx - 1] : prev);
+
+          if (!rp_fits (diff, packings[pidx].bits))
+            break;
+        }
+
+        if (idx == packings[pidx].number)
+          break;
+      }
+
+      mask = ((uint32_t)1 << packings[pidx].bits) - 1;
+      word = (packings[pidx].nibble == 1) ? 0 : packings[pidx].dnib << 30;
+
+      for (idx = 0; idx < packings[pidx].number; idx++)
+      {
+        diff = (int64_t)samples[pos + idx] - ((pos + idx) ? samples[pos + idx - 1] : prev);
+        word |= ((uint32_t)diff & mask) << ((packings[pidx].number - 1 - idx) * packings[pidx].bits);
+      }
+
+      frame[widx] = word;
+      frame[0] |= packings[pidx].nibble << (30 - 2 * widx);
+      pos += packings[pidx].number;
+    }
+  }
+
+  rp.frames[1] = (uint32_t)samples[0];
+  rp.frames[2] = (uint32_t)samples[pos - 1];
+
+  *nframes = fidx;
+
+  return pos;
+} /* End of rp_encode() */
+
+/***************************************************************************
+ * rp_emit:
+ *
+ * Build a record of the first 'count' buffered samples of a channel
+ * from the encoded frames and pass it to the handler.  The header is
+ * that of the first buffered record with the start time of the
+ * samples, Blockette 1001 is added for its timing quality or a start
+ * time with microseconds.
+ ***************************************************************************/
+static void
+rp_emit (RpChannel *channel, int count, int nframes)
+{
+  char *record = rp.record;
+  int64_t start;
+  int64_t seconds;
+  int64_t days;
+  int usec;
+  int year;
+  int length;
+  int idx;
+
+  memset (record, 0, RP_RECLEN);
+
+  /* Start time of the samples as year, day and time of day */
+  start   = rp_time (channel, channel->offset);
+  seconds = start / 1000000;
+  usec    = (int)(start % 1000000);
+
+  if (usec < 0)
+  {
+    usec += 1000000;
+    seconds--;
+  }
+
+  days    = seconds / 86400;
+  seconds = seconds % 86400;
+
+  if (seconds < 0)
+  {
+    seconds += 86400;
+    days--;
+  }
+
+  for (year = 1970; days < 0; days += 365 + (year % 4 == 0))
+    year--;
+
+  for (; days >= (length = 365 + (year % 4 == 0)); days -= length)
+    year++;
+
+  memcpy (record, channel->seqfield, 6);
+  record[6] = channel->quality;
+  record[7] = ' ';
+  memcpy (record + 8, channel->key, 12);
+
+  rp_put16 (record + 20, (uint16_t)year);
+  rp_put16 (record + 22, (uint16_t)(days + 1));
+  record[24] = (char)(seconds / 3600);
+  record[25] = (char)(seconds / 60 % 60);
+  record[26] = (char)(seconds % 60);
+  rp_put16 (record + 28, (uint16_t)(usec / 100));
+  rp_put16 (record + 30, (uint16_t)count);
+  rp_put16 (record + 32, (uint16_t)channel->fact);
+  rp_put16 (record + 34, (uint16_t)channel->mult);
+  record[36] = (char)channel->actflags;
+  record[37] = (char)channel->ioflags;
+  record[38] = (char)channel->dqflags;
+  record[39] = 1;
+  rp_put16 (record + 44, RP_DATAOFFSET);
+  rp_put16 (record + 46, 48);
+
+  /* Blockette 1000: Steim2, big-endian */
+  rp_put16 (record + 48, 1000);
+  record[52] = 11;
+  record[53] = 1;
+
+  for (length = 0; (1 << length) < RP_RECLEN; length++)
+    ;
+  record[54] = (char)length;
+
+  if (channel->timequal >= 0 || usec % 100)
+  {
+    record[39] = 2;
+    rp_put16 (record + 50, 56);
+
+    rp_put16 (record + 56, 1001);
+    record[60] = (char)((channel->timequal >= 0) ? channel->timequal : 0);
+    record[61] = (char)(usec % 100);
+    record[63] = (char)nframes;
+  }
+
+  for (idx = 0; idx < nframes * 16; idx++)
+    rp_put32 (record + RP_DATAOFFSET + idx * 4, rp.frames[idx]);
+
+  rp.handler (record, RP_RECLEN, channel->segments[0].seqnum);
+} /* End of rp_emit() */
+
+/***************************************************************************
+ * rp_oldest:
+ *
+ * Returns 1 and sets 'oldest' to the oldest record with buffered
+ * samples of a channel, or 0 if none.
+ ***************************************************************************/
+static int
+rp_oldest (RpChannel *channel, RpSegment **oldest)
+{
+  if (!channel->numsegments)
+    return 0;
+
+  *oldest = &channel->segments[0];
+
+  return 1;
+} /* End of rp_oldest() */
+
+/***************************************************************************
+ * rp_time:
+ *
+ * Returns the time of a sample of the contiguous run of a channel in
+ * microseconds since the epoch.
+ ***************************************************************************/
+static int64_t
+rp_time (RpChannel *channel, int64_t index)
+{
+  return channel->base + (int64_t)((double)index * 1e6 / channel->rate + 0.5);
+} /* End of rp_time() */
+
+/***************************************************************************
+ * rp_ticks:
+ *
+ * Returns a start time in microseconds since the epoch, calculated
+ * like sl_msh_depochetime().
+ ***************************************************************************/
+static int64_t
+rp_ticks (const struct sl_btime_s *btime)
+{
+  int64_t seconds;
+
+  seconds = (int64_t)(btime->year - 1970) * 31536000 +
+            (int64_t)((btime->year - 1969) / 4) * 86400 +
+            (int64_t)(btime->day - 1) * 86400 +
+            btime->hour * 3600 + btime->min * 60 + btime->sec;
+
+  return seconds * 1000000 + (int64_t)btime->fract * 100;
+} /* End of rp_ticks() */
+
+/***************************************************************************
+ * rp_fits:
+ *
+ * Returns 1 if 'value' fits a signed integer of 'bits' bits, else 0.
+ ***************************************************************************/
+static int
+rp_fits (int64_t value, int bits)
+{
+  return (value >= -((int64_t)1 << (bits - 1)) && value < ((int64_t)1 << (bits - 1)));
+} /* End of rp_fits() */
+
+/***************************************************************************
+ * rp_put16:
+ *
+ * Store a 16-bit value in network byte order.
+ ***************************************************************************/
+static void
+rp_put16 (char *dest, uint16_t value)
+{
+  uint8_t *ptr = (uint8_t *)dest;
+
+  ptr[0] = (uint8_t)(value >> 8);
+  ptr[1] = (uint8_t)value;
+} /* End of rp_put16() */
+
+/***************************************************************************
+ * rp_put32:
+ *
+ * Store a 32-bit value in network byte order.
+ ***************************************************************************/
+static void
+rp_put32 (char *dest, uint32_t value)
+{
+  uint8_t *ptr = (uint8_t *)dest;
+
+  ptr[0] = (uint8_t)(value >> 24);
+  ptr[1] = (uint8_t)(value >> 16);
+  ptr[2] = (uint8_t)(value >> 8);
+  ptr[3] = (uint8_t)value;
+} /* End of rp_put32() */
+
+/***************************************************************************
+ * rp_lookup:
+ *
+ * Find the entry for 'key' in a hash table.
+ *
+ * Returns the entry or NULL if not found.
+ ***************************************************************************/
+static void *
+rp_lookup (RpTable *table, const char *key)
+{
+  uint32_t hash = 2166136261u;
+  int idx;
+
+  if (!table->size)
+    return NULL;
+
+  for (idx = 0; idx < table->keylen; idx++)
+    hash = (hash ^ (uint8_t)key[idx]) * 16777619u;
+
+  for (idx = hash & (table->size - 1); table->slots[idx];
+       idx = (idx + 1) & (table->size - 1))
+  {
+    if (!memcmp (table->slots[idx], key, table->keylen))
+      return table->slots[idx];
+  }
+
+  return NULL;
+} /* End of rp_lookup() */
+
+/***************************************************************************
+ * rp_insert:
+ *
+ * Insert an entry in a hash table, growing the table to keep it at most
+ * half full.
+ *
+ * Returns 0 on success and -1 on error.
+ ***************************************************************************/
+static int
+rp_insert (RpTable *table, void *entry)
+{
+  RpTable grown;
+  uint32_t hash = 2166136261u;
+  int idx;
+
+  if ((table->count + 1) * 2 > table->size)
+  {
+    grown.size   = (table->size) ? table->size * 2 : 256;
+    grown.count  = 0;
+    grown.keylen = table->keylen;
+
+    if ((grown.slots = (void **)calloc (grown.size, sizeof (void *))) == NULL)
+      return -1;
+
+    for (idx = 0; idx < table->size; idx++)
+    {
+      if (table->slots[idx])
+        rp_insert (&grown, table->slots[idx]);
+    }
+
+    free (table->slots);
+    *table = grown;
+  }
+
+  for (idx = 0; idx < table->keylen; idx++)
+    hash = (hash ^ (uint8_t) ((char *)entry)[idx]) * 16777619u;
+
+  for (idx = hash & (table->size - 1); table->slots[idx];
+       idx = (idx + 1) & (table->size - 1))
+    ;
+
+  table->slots[idx] = entry;
+  table->count++;
+
+  return 0;
+} /* End of rp_insert() */
+
+/***************************************************************************
+ * rp_free:
+ *
+ * Free all entries of a hash table and the table.
+ ***************************************************************************/
+static void
+rp_free (RpTable *table)
+{
+  int idx;
+
+  for (idx = 0; idx < table->size; idx++)
+    free (table->slots[idx]);
+
+  free (table->slots);
+
+  table->slots = NULL;
+  table->size  = 0;
+  table->count = 0;
+} /* End of rp_free() */
@@ -0,0 +1,32 @@
+/***************************************************************************
+ * repack.h
+ *
+ * Interface declarations for the repacking of data records into larger
+ * Steim2 records before archiving.
+ *
+ * modified: 2026.287
+ ***************************************************************************/
+
+#ifndef REPACK_H
+#define REPACK_H
+
+#include <libslink.h>
+
+/* Length of the repacked records */
+#define RP_RECLEN 4096
+
+/* Default maximum time samples are buffered (s) */
+#define RP_DEFAGE 300
+
+/* Handler for a repacked record, 'seqnum' is the sequence number of the
+ * first record repacked into it */
+typedef void (*RPHandler) (char *record, int reclen, int seqnum);
+
+extern int rp_start (RPHandler handler, int maxage);
+extern void rp_stop (void);
+extern int rp_record (const char *msrecord, int reclen, int seqnum,
+                      const void *source);
+extern void rp_expire (double now);
+extern int rp_pending (const char *net, const char *sta, const void *source);
+
+#endif
@@ -0,0 +1,314 @@
+/***************************************************************************
+ * samples.c
+ *
+ * Bulk output of the unpacked samples of data records, each record is
+ * formatted into one buffer and written with a single call.
+ *
+ * The text format is the layout of the -u option, six right aligned
+ * columns per line, formatted with a table of digit pairs instead of
+ * printf(3).  The binary formats are the samples as 32-bit integers or
+ * floats in native or network byte order, without any framing.
+ *
+ * The framed format is a header followed by the samples as 32-bit
+ * integers, all values in network byte order:
+ *
+ *   offset  size  field
+ *        0     4  "SLSF"
+ *        4     4  length of the frame including the header (uint32)
+ *        8     2  network code, space padded
+ *       10     5  station code
+ *       15     2  location code
+ *       17     3  channel code
+ *       20     8  start time, microseconds since the epoch (int64)
+ *       28     8  sample rate in Hz (IEEE double)
+ *       36     4  number of samples (int32)
+ *       40         samples (int32)
+ *
+ * modified: 2026.287
+ ***************************************************************************/
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "samples.h"
+
+/* Width of a column of the text format */
+#define SF_COLUMN 10
+
+/* Digit pairs "00" to "99" */
+static const char sfdigits[201] =
+  "00010203040506070809101112131415161718192021222324"
+  "25262728293031323334353637383940414243444546474849"
+  "50515253545556575859606162636465666768697071727374"
+  "75767778798081828384858687888990919293949596979899";
+
+/* The output buffer, reused for all records */
+static char *sfbuffer = NULL;
+static size_t sfsize  = 0;
+
+static char *sf_reserve (size_t size);
+static char *sf_itoa (char *end, int32_t value);
+static void sf_put32 (char *dest, uint32_t value);
+static void sf_put64 (char *dest, uint64_t value);
+
+/***************************************************************************
+ * sf_format:
+ *
+ * Find an output format by name: "text", "int32", "int32net",
+ * "float32", "float32net" or "framed".
+ *
+ * Returns the SF_* format on success and -1 if the name is unknown.
+ ***************************************************************************/
+int
+sf_format (const char *name)
+{
+  if (!strcmp (name, "text"))
+    return SF_TEXT;
+  if (!strcmp (name, "int32"))
+    return SF_INT32;
+  if (!strcmp (name, "int32net"))
+    return SF_INT32NET;
+  if (!strcmp (name, "float32"))
+    return SF_FLOAT32;
+  if (!strcmp (name, "float32net"))
+    return SF_FLOAT32NET;
+  if (!strcmp (name, "framed"))
+    return SF_FRAMED;
+
+  return -1;
+} /* End of sf_format() */
+
+/***************************************************************************
+ * sf_write:
+ *
+ * Write the unpacked samples of a record to 'stream' in an SF_*
+ * format.  Nothing is written for records that were not unpacked,
+ * like -u the text format ends the samples of each record with an
+ * empty line if their count is a multiple of six.
+ *
+ * Returns 0 on success and -1 on error.
+ ***************************************************************************/
+int
+sf_write (FILE *stream, int format, SLMSrecord *msr)
+{
+  const int32_t *samples = msr->datasamples;
+  int count              = (samples && msr->numsamples > 0) ? msr->numsamples : 0;
+  char *buffer;
+  char *ptr;
+  char *digits;
+  double samprate = 0.0;
+  double stime;
+  int64_t utime;
+  uint32_t word;
+  float fvalue;
+  size_t length;
+  int col;
+  int idx;
+
+  if (!samples)
+    return 0;
+
+  switch (format)
+  {
+  case SF_TEXT:
+    /* Columns of at least SF_COLUMN characters and two spaces, six per line */
+    if ((buffer = sf_reserve ((size_t)count * (SF_COLUMN + 4) + count / 6 + 2)) == NULL)
+      return -1;
+
+    for (ptr = buffer, col = 0, idx = 0; idx < count; idx++)
+    {
+      char field[16];
+
+      digits = sf_itoa (field + sizeof (field), samples[idx]);
+      length = field + sizeof (field) - digits;
+
+      if (length < SF_COLUMN)
+      {
+        memset (ptr, ' ', SF_COLUMN - length);
+        ptr += SF_COLUMN - length;
+      }
+
+      memcpy (ptr, digits, length);
+      ptr += length;
+      *ptr++ = ' ';
+      *ptr++ = ' ';
+
+      if (++col == 6)
+      {
+        *ptr++ = '\n';
+        col    = 0;
+      }
+    }
+
+    *ptr++ = '\n';
+    length = ptr - buffer;
+    break;
+
+  case SF_INT32:
+    buffer = (char *)samples;
+    length = (size_t)count * 4;
+    break;
+
+  case SF_INT32NET:
+  case SF_FLOAT32:
+  case SF_FLOAT32NET:
+    if ((buffer = sf_reserve ((size_t)count * 4)) == NULL)
+      return -1;
+
+    for (idx = 0; idx < count; idx++)
+    {
+      if (format == SF_INT32NET)
+      {
+        sf_put32 (buffer + idx * 4, (uint32_t)samples[idx]);
+      }
+      else
+      {
+        fvalue = (float)samples[idx];
+
+        if (format == SF_FLOAT32)
+        {
+          memcpy (buffer + idx * 4, &fvalue, 4);
+        }
+        else
+        {
+          memcpy (&word, &fvalue, 4);
+          sf_put32 (buffer + idx * 4, word);
+        }
+      }
+    }
+
+    length = (size_t)count * 4;
+    break;
+
+  case SF_FRAMED:
+    length = SF_FRAMEHEADER + (size_t)count * 4;
+
+    if ((buffer = sf_reserve (length)) == NULL)
+      return -1;
+
+    sl_msr_dsamprate (msr, &samprate);
+    stime = sl_msr_depochstime (msr);
+    utime = (int64_t)((stime < 0.0) ? stime * 1e6 - 0.5 : stime * 1e6 + 0.5);
+
+    memcpy (buffer, SF_FRAMEMAGIC, 4);
+    sf_put32 (buffer + 4, (uint32_t)length);
+    memcpy (buffer + 8, msr->fsdh.network, 2);
+    memcpy (buffer + 10, msr->fsdh.station, 5);
+    memcpy (buffer + 15, msr->fsdh.location, 2);
+    memcpy (buffer + 17, msr->fsdh.channel, 3);
+    sf_put64 (buffer + 20, (uint64_t)utime);
+    memcpy (&utime, &samprate, 8);
+    sf_put64 (buffer + 28, (uint64_t)utime);
+    sf_put32 (buffer + 36, (uint32_t)count);
+
+    for (idx = 0; idx < count; idx++)
+      sf_put32 (buffer + SF_FRAMEHEADER + idx * 4, (uint32_t)samples[idx]);
+    break;
+
+  default:
+    sl_log (2, 0, "sf_write(): unknown sample format %d\n", format);
+    return -1;
+  }
+
+  if (length && fwrite (buffer, length, 1, stream) != 1)
+    return -1;
+
+  return 0;
+} /* End of sf_write() */
+
+/***************************************************************************
+ * sf_reserve:
+ *
+ * Returns the output buffer grown to at least 'size' bytes or NULL on
+ * error.
+ ***************************************************************************/
+static char *
+sf_reserve (size_t size)
+{
+  char *buffer;
+
+  if (size > sfsize)
+  {
+    if (size < 65536)
+      size = 65536;
+
+    if ((buffer = (char *)realloc (sfbuffer, size)) == NULL)
+    {
+      sl_log (2, 0, "sf_reserve(): cannot allocate %lld bytes\n", (long long)size);
+      return NULL;
+    }
+
+    sfbuffer = buffer;
+    sfsize   = size;
+  }
+
+  return sfbuffer;
+} /* End of sf_reserve() */
+
+/***************************************************************************
+ * sf_itoa:
+ *
+ * Format 'value' in decimal into the characters before 'end', two
+ * digits at a time.
+ *
+ * Returns a pointer to the first character.
+ ***************************************************************************/
+static char *
+sf_itoa (char *end, int32_t value)
+{
+  uint32_t uvalue = (value < 0) ? 0U - (uint32_t)value : (uint32_t)value;
+  uint32_t pair;
+
+  while (uvalue >= 100)
+  {
+    pair    = (uvalue % 100) * 2;
+    uvalue /= 100;
+    *--end  = sfdigits[pair + 1];
+    *--end  = sfdigits[pair];
+  }
+
+  if (uvalue >= 10)
+  {
+    pair   = uvalue * 2;
+    *--end = sfdigits[pair + 1];
+    *--end = sfdigits[pair];
+  }
+  else
+  {
+    *--end = (char)('0' + uvalue);
+  }
+
+  if (value < 0)
+    *--end = '-';
+
+  return end;
+} /* End of sf_itoa() */
+
+/***************************************************************************
+ * sf_put32:
+ *
+ * Store a 32-bit value in network byte order.
+ ***************************************************************************/
+static void
+sf_put32 (char *dest, uint32_t value)
+{
+  uint8_t *ptr = (uint8_t *)dest;
+
+  ptr[0] = (uint8_t)(value >> 24);
+  ptr[1] = (uint8_t)(value >> 16);
+  ptr[2] = (uint8_t)(value >> 8);
+  ptr[3] = (uint8_t)value;
+} /* End of sf_put32() */
+
+/***************************************************************************
+ * sf_put64:
+ *
+ * Store a 64-bit value in network byte order.
+ ***************************************************************************/
+static void
+sf_put64 (char *dest, uint64_t value)
+{
+  sf_put32 (dest, (uint32_t)(value >> 32));
+  sf_put32 (dest + 4, (uint32_t)value);
+} /* End of sf_put64() */
@@ -0,0 +1,31 @@
+/***************************************************************************
+ * samples.h
+ *
+ * Interface declarations for the bulk output of unpacked samples.
+ *
+ * modified: 2026.287
+ ***************************************************************************/
+
+#ifndef SAMPLES_H
+#define SAMPLES_H
+
+#include <stdio.h>
+
+#include <libslink.h>
+
+/* Sample output formats */
+#define SF_TEXT       1 /* Six right aligned columns, the layout of -u */
+#define SF_INT32      2 /* 32-bit integers, native byte order */
+#define SF_INT32NET   3 /* 32-bit integers, network byte order */
+#define SF_FLOAT32    4 /* 32-bit IEEE floats, native byte order */
+#define SF_FLOAT32NET 5 /* 32-bit IEEE floats, network byte order */
+#define SF_FRAMED     6 /* Header and 32-bit integers, network byte order */
+
+/* Identification and header size of a frame of the framed format */
+#define SF_FRAMEMAGIC "SLSF"
+#define SF_FRAMEHEADER 40
+
+extern int sf_format (const char *name);
+extern int sf_write (FILE *stream, int format, SLMSrecord *msr);
+
+#endif
@@ -0,0 +1,768 @@
+/***************************************************************************
+ * sinks.c
+ *
+ * Forwarding of received packets to output sinks, complete SeedLink
+ * packets (header and record) are sent to:
+ *
+ *   udp:host:port    UDP datagrams, one per packet, unicast or multicast
+ *   tcp:[host:]port  each client connected to a listening TCP socket
+ *   unix:path        each client connected to a listening Unix socket
+ *
+ * Packets are sent directly from the receive buffer by the thread
+ * handling the packets with non-blocking sends.  A datagram that
+ * cannot be sent immediately is dropped.  For stream clients only the
+ * part a socket does not accept is copied to the bounded queue of the
+ * client, which a sink thread sends when the socket is writable.  A
+ * client whose queue would overflow is disconnected, all other
+ * clients and the data collection are not held up.
+ *
+ * The sink thread accepts clients and drains the queues.  The clients
+ * of a sink and their queues are protected by a mutex of the sink,
+ * clients are only added and removed by the sink thread; the packet
+ * thread marks clients to disconnect and shuts their sockets down.
+ *
+ * modified: 2026.287
+ ***************************************************************************/
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <libslink.h>
+
+#include "sinks.h"
+
+#ifndef SLP_WIN
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/un.h>
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+/* Sink types */
+#define SK_UDP  1
+#define SK_TCP  2
+#define SK_UNIX 3
+
+/* A client of a stream sink */
+typedef struct SkClient_s
+{
+  int     fd;
+  int     dead;          /* Set to have the sink thread close the client */
+  char   *queue;         /* Ring of bytes not yet sent */
+  size_t  head;          /* Offset of the first queued byte */
+  size_t  used;          /* Number of queued bytes */
+}
+SkClient;
+
+/* An output sink */
+typedef struct SkSink_s
+{
+  char   *spec;          /* Sink specification as given */
+  int     type;
+  int     fd;            /* Datagram or listening socket */
+  struct sockaddr_storage addr; /* Destination of datagrams */
+  socklen_t addrlen;
+  SkClient *clients[SK_MAXCLIENTS];
+  int     numclients;
+  int64_t packets;       /* Packets sent or queued */
+  int64_t dropped;       /* Datagrams dropped */
+  int64_t disconnects;   /* Clients disconnected for a full queue */
+  pthread_mutex_t lock;
+  struct SkSink_s *next;
+}
+SkSink;
+
+static struct
+{
+  SkSink *sinks;
+  SkSink *last;
+  int     running;
+  int     stop;
+  size_t  queuesize;     /* Size of the queue of each client */
+  int     wakefd[2];     /* Pipe to wake up the sink thread */
+  pthread_t thread;
+} sk = {0};
+
+static void *sk_thread (void *arg);
+static int sk_open (SkSink *sink);
+static int sk_accept (SkSink *sink);
+static void sk_forward (SkSink *sink, const char *packet, int length);
+static int sk_drain (SkClient *client, size_t queuesize);
+static void sk_close (SkSink *sink, int idx);
+static void sk_wake (void);
+
+/***************************************************************************
+ * sk_add:
+ *
+ * Add an output sink given as udp:host:port, tcp:[host:]port or
+ * unix:path, the sink is opened by sk_start().
+ *
+ * Returns 0 on success and -1 on error.
+ ***************************************************************************/
+int
+sk_add (const char *spec)
+{
+  SkSink *sink;
+  int type;
+
+  if (!strncmp (spec, "udp:", 4))
+    type = SK_UDP;
+  else if (!strncmp (spec, "tcp:", 4))
+    type = SK_TCP;
+  else if (!strncmp (spec, "unix:", 5))
+    type = SK_UNIX;
+  else
+  {
+    sl_log (2, 0, "unrecognized sink, expected udp:, tcp: or unix: %s\n", spec);
+    return -1;
+  }
+
+  if ((sink = (SkSink *)calloc (1, sizeof (SkSink))) == NULL ||
+      (sink->spec = strdup (spec)) == NULL)
+  {
+    sl_log (2, 0, "cannot allocate memory for sink\n");
+    free (sink);
+    return -1;
+  }
+
+  sink->type = type;
+  sink->fd   = -1;
+
+  if (sk.last)
+    sk.last->next = sink;
+  else
+    sk.sinks = sink;
+
+  sk.last = sink;
+
+  return 0;
+} /* End of sk_add() */
+
+/***************************************************************************
+ * sk_start:
+ *
+ * Open all added sinks and start the sink thread, each client of a
+ * stream sink gets a queue of 'queuesize' bytes.
+ *
+ * Returns 0 on success or without sinks and -1 on error.
+ ***************************************************************************/
+int
+sk_start (int queuesize)
+{
+  SkSink *sink;
+
+  if (!sk.sinks)
+    return 0;
+
+  if (queuesize < SLHEADSIZE + SLMAXRECSIZE)
+  {
+    sl_log (2, 0, "sink queue size must be at least %d bytes\n",
+            SLHEADSIZE + SLMAXRECSIZE);
+    return -1;
+  }
+
+  sk.queuesize = queuesize;
+
+  for (sink = sk.sinks; sink; sink = sink->next)
+  {
+    if (sk_open (sink))
+      return -1;
+
+    pthread_mutex_init (&sink->lock, NULL);
+  }
+
+  if (pipe (sk.wakefd))
+  {
+    sl_log (2, 0, "cannot create pipe: %s\n", strerror (errno));
+    return -1;
+  }
+
+  /* The packet thread must never block waking the sink thread */
+  fcntl (sk.wakefd[1], F_SETFL, fcntl (sk.wakefd[1], F_GETFL) | O_NONBLOCK);
+  fcntl (sk.wakefd[0], F_SETFL, fcntl (sk.wakefd[0], F_GETFL) | O_NONBLOCK);
+
+  if (pthread_create (&sk.thread, NULL, sk_thread, NULL))
+  {
+    sl_log (2, 0, "cannot start sink thread\n");
+    return -1;
+  }
+
+  sk.running = 1;
+
+  return 0;
+} /* End of sk_start() */
+
+/***************************************************************************
+ * sk_stop:
+ *
+ * Stop the sink thread, close all sinks and clients and report the
+ * number of packets forwarded.  Packets still queued are discarded.
+ ***************************************************************************/
+void
+sk_stop (void)
+{
+  SkSink *sink;
+  SkSink *next;
+
+  if (sk.running)
+  {
+    __atomic_store_n (&sk.stop, 1, __ATOMIC_SEQ_CST);
+    sk_wake ();
+    pthread_join (sk.thread, NULL);
+    sk.running = 0;
+
+    close (sk.wakefd[0]);
+    close (sk.wakefd[1]);
+  }
+
+  for (sink = sk.sinks; sink; sink = next)
+  {
+    next = sink->next;
+
+    if (sink->fd >= 0)
+    {
+      sl_log (1, 1, "sink %s: %lld packets, %lld dropped, %lld slow clients disconnected\n",
+              sink->spec, (long long)sink->packets, (long long)sink->dropped,
+              (long long)sink->disconnects);
+
+      while (sink->numclients > 0)
+        sk_close (sink, sink->numclients - 1);
+
+      close (sink->fd);
+
+      if (sink->type == SK_UNIX)
+        unlink (sink->spec + 5);
+
+      pthread_mutex_destroy (&sink->lock);
+    }
+
+    free (sink->spec);
+    free (sink);
+  }
+
+  sk.sinks = NULL;
+  sk.last  = NULL;
+} /* End of sk_stop() */
+
+/***************************************************************************
+ * sk_packet:
+ *
+ * Forward a packet to all sinks, called by the thread handling the
+ * packets.  The packet is not copied unless a stream client does not
+ * accept all of it immediately.
+ ***************************************************************************/
+void
+sk_packet (const char *packet, int length)
+{
+  SkSink *sink;
+
+  if (!sk.running)
+    return;
+
+  for (sink = sk.sinks; sink; sink = sink->next)
+  {
+    if (sink->type == SK_UDP)
+    {
+      if (sendto (sink->fd, packet, length, MSG_DONTWAIT | MSG_NOSIGNAL,
+                  (struct sockaddr *)&sink->addr, sink->addrlen) == length)
+        sink->packets++;
+      else
+        sink->dropped++;
+    }
+    else
+    {
+      pthread_mutex_lock (&sink->lock);
+      sk_forward (sink, packet, length);
+      pthread_mutex_unlock (&sink->lock);
+    }
+  }
+} /* End of sk_packet() */
+
+/***************************************************************************
+ * sk_forward:
+ *
+ * Send a packet to all clients of a stream sink, sending directly while
+ * a client has nothing queued.  The sink lock must be held.
+ ***************************************************************************/
+static void
+sk_forward (SkSink *sink, const char *packet, int length)
+{
+  SkClient *client;
+  size_t offset;
+  size_t tail;
+  size_t part;
+  ssize_t sent;
+  int idx;
+
+  for (idx = 0; idx < sink->numclients; idx++)
+  {
+    client = sink->clients[idx];
+
+    if (client->dead)
+      continue;
+
+    sent = 0;
+
+    if (!client->used)
+    {
+      if ((sent = send (client->fd, packet, length, MSG_DONTWAIT | MSG_NOSIGNAL)) == length)
+        continue;
+
+      if (sent < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+      {
+        client->dead = 1;
+        sk_wake ();
+        continue;
+      }
+
+      if (sent < 0)
+        sent = 0;
+    }
+
+    /* Disconnect a client that does not keep up */
+    if (sk.queuesize - client->used < (size_t)(length - sent))
+    {
+      sl_log (2, 0, "sink %s: client queue full, disconnecting slow client\n",
+              sink->spec);
+      sink->disconnects++;
+      client->dead = 1;
+      shutdown (client->fd, SHUT_RDWR);
+      sk_wake ();
+      continue;
+    }
+
+    /* Queue the rest, wrapping around the end of the ring */
+    for (offset = sent; offset < (size_t)length; offset += part)
+    {
+      tail = (client->head + client->used) % sk.queuesize;
+      part = length - offset;
+
+      if (part > sk.queuesize - tail)
+        part = sk.queuesize - tail;
+
+      memcpy (client->queue + tail, packet + offset, part);
+      client->used += part;
+    }
+
+    /* The sink thread waits for the socket when the queue was empty */
+    if (client->used == (size_t)(length - sent))
+      sk_wake ();
+  }
+
+  sink->packets++;
+} /* End of sk_forward() */
+
+/***************************************************************************
+ * sk_thread:
+ *
+ * Accept clients, send queued data to writable clients and close
+ * clients that disconnected or were marked to disconnect.
+ ***************************************************************************/
+static void *
+sk_thread (void *arg)
+{
+  struct pollfd *fds;
+  SkSink **owner;
+  int *client;
+  SkSink *sink;
+  char buffer[1024];
+  ssize_t nread;
+  int maxfds = 1;
+  int nfds;
+  int idx;
+
+  /* The wake pipe, and each stream sink with the most clients */
+  for (sink = sk.sinks; sink; sink = sink->next)
+  {
+    if (sink->type != SK_UDP)
+      maxfds += 1 + SK_MAXCLIENTS;
+  }
+
+  fds    = (struct pollfd *)malloc (maxfds * sizeof (struct pollfd));
+  owner  = (SkSink **)malloc (maxfds * sizeof (SkSink *));
+  client = (int *)malloc (maxfds * sizeof (int));
+
+  if (!fds || !owner || !client)
+  {
+    sl_log (2, 0, "cannot allocate memory for sink thread\n");
+    free (fds);
+    free (owner);
+    free (client);
+    return NULL;
+  }
+
+  for (;;)
+  {
+    fds[0].fd     = sk.wakefd[0];
+    fds[0].events = POLLIN;
+    nfds          = 1;
+
+    /* Listening sockets and clients, POLLOUT for clients with queued data */
+    for (sink = sk.sinks; sink; sink = sink->next)
+    {
+      if (sink->type == SK_UDP)
+        continue;
+
+      pthread_mutex_lock (&sink->lock);
+
+      for (idx = sink->numclients - 1; idx >= 0; idx--)
+      {
+        if (sink->clients[idx]->dead)
+          sk_close (sink, idx);
+      }
+
+      fds[nfds].fd     = sink->fd;
+      fds[nfds].events = (sink->numclients < SK_MAXCLIENTS) ? POLLIN : 0;
+      owner[nfds]      = sink;
+      client[nfds++]   = -1;
+
+      for (idx = 0; idx < sink->numclients; idx++)
+      {
+        fds[nfds].fd     = sink->clients[idx]->fd;
+        fds[nfds].events = POLLIN | ((sink->clients[idx]->used) ? POLLOUT : 0);
+        owner[nfds]      = sink;
+        client[nfds++]   = idx;
+      }
+
+      pthread_mutex_unlock (&sink->lock);
+    }
+
+    if (poll (fds, nfds, -1) < 0 && errno != EINTR)
+    {
+      sl_log (2, 0, "poll(): %s\n", strerror (errno));
+      break;
+    }
+
+    if (fds[0].revents & POLLIN)
+    {
+      while (read (sk.wakefd[0], buffer, sizeof (buffer)) > 0)
+        ;
+    }
+
+    if (__atomic_load_n (&sk.stop, __ATOMIC_SEQ_CST))
+      break;
+
+    for (idx = 1; idx < nfds; idx++)
+    {
+      if (!fds[idx].revents)
+        continue;
+
+      sink = owner[idx];
+
+      if (client[idx] < 0)
+      {
+        sk_accept (sink);
+        continue;
+      }
+
+      pthread_mutex_lock (&sink->lock);
+
+      /* Data from clients is discarded, end of file or errors disconnect */
+      if (fds[idx].revents & (POLLHUP | POLLERR))
+      {
+        sink->clients[client[idx]]->dead = 1;
+      }
+      else if (fds[idx].revents & POLLIN)
+      {
+        nread = recv (fds[idx].fd, buffer, sizeof (buffer), MSG_DONTWAIT);
+
+        if (nread == 0 || (nread < 0 && errno != EAGAIN && errno != EINTR))
+          sink->clients[client[idx]]->dead = 1;
+      }
+
+      if ((fds[idx].revents & POLLOUT) && !sink->clients[client[idx]]->dead &&
+          sk_drain (sink->clients[client[idx]], sk.queuesize))
+        sink->clients[client[idx]]->dead = 1;
+
+      pthread_mutex_unlock (&sink->lock);
+    }
+  }
+
+  free (fds);
+  free (owner);
+  free (client);
+
+  return NULL;
+} /* End of sk_thread() */
+
+/***************************************************************************
+ * sk_drain:
+ *
+ * Send as much queued data to a client as its socket accepts.  The sink
+ * lock must be held.
+ *
+ * Returns 0 on success and -1 if the client should be disconnected.
+ ***************************************************************************/
+static int
+sk_drain (SkClient *client, size_t queuesize)
+{
+  ssize_t sent;
+  size_t part;
+
+  while (client->used)
+  {
+    part = client->used;
+
+    if (part > queuesize - client->head)
+      part = queuesize - client->head;
+
+    if ((sent = send (client->fd, client->queue + client->head, part,
+                      MSG_DONTWAIT | MSG_NOSIGNAL)) < 0)
+    {
+      if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+        return 0;
+
+      return -1;
+    }
+
+    client->head  = (client->head + sent) % queuesize;
+    client->used -= sent;
+  }
+
+  client->head = 0;
+
+  return 0;
+} /* End of sk_drain() */
+
+/***************************************************************************
+ * sk_accept:
+ *
+ * Accept a client on the listening socket of a stream sink.
+ *
+ * Returns 0 on success and -1 on error.
+ ***************************************************************************/
+static int
+sk_accept (SkSink *sink)
+{
+  SkClient *client;
+  int fd;
+
+  if ((fd = accept (sink->fd, NULL, NULL)) < 0)
+    return -1;
+
+  fcntl (fd, F_SETFL, fcntl (fd, F_GETFL) | O_NONBLOCK);
+
+  if ((client = (SkClient *)calloc (1, sizeof (SkClient))) == NULL ||
+      (client->queue = (char *)malloc (sk.queuesize)) == NULL)
+  {
+    sl_log (2, 0, "sink %s: cannot allocate memory for client\n", sink->spec);
+    free (client);
+    close (fd);
+    return -1;
+  }
+
+  client->fd = fd;
+
+  pthread_mutex_lock (&sink->lock);
+
+  if (sink->numclients >= SK_MAXCLIENTS)
+  {
+    pthread_mutex_unlock (&sink->lock);
+    sl_log (2, 0, "sink %s: too many clients\n", sink->spec);
+    free (client->queue);
+    free (client);
+    close (fd);
+    return -1;
+  }
+
+  sink->clients[sink->numclients++] = client;
+
+  pthread_mutex_unlock (&sink->lock);
+
+  sl_log (1, 1, "sink %s: client connected\n", sink->spec);
+
+  return 0;
+} /* End of sk_accept() */
+
+/***************************************************************************
+ * sk_close:
+ *
+ * Close and remove a client of a stream sink, moving the last client
+ * into its place.  The sink lock must be held or the thread stopped.
+ ***************************************************************************/
+static void
+sk_close (SkSink *sink, int idx)
+{
+  SkClient *client = sink->clients[idx];
+
+  close (client->fd);
+  free (client->queue);
+  free (client);
+
+  sink->clients[idx] = sink->clients[--sink->numclients];
+
+  sl_log (1, 1, "sink %s: client disconnected\n", sink->spec);
+} /* End of sk_close() */
+
+/***************************************************************************
+ * sk_wake:
+ *
+ * Wake up the sink thread, a full pipe means it is already woken up.
+ ***************************************************************************/
+static void
+sk_wake (void)
+{
+  if (write (sk.wakefd[1], "", 1) < 0 && errno != EAGAIN)
+    sl_log (2, 0, "cannot wake up sink thread: %s\n", strerror (errno));
+} /* End of sk_wake() */
+
+/***************************************************************************
+ * sk_open:
+ *
+ * Open the socket of a sink: a datagram socket for the destination of
+ * a UDP sink or a listening socket for a TCP or Unix sink.
+ *
+ * Returns 0 on success and -1 on error.
+ ***************************************************************************/
+static int
+sk_open (SkSink *sink)
+{
+  struct addrinfo hints;
+  struct addrinfo *result;
+  struct sockaddr_un unaddr;
+  char host[256];
+  const char *address;
+  const char *port;
+  const char *sep;
+  int on = 1;
+  int ret;
+
+  if (sink->type == SK_UNIX)
+  {
+    address = sink->spec + 5;
+
+    if (strlen (address) >= sizeof (unaddr.sun_path))
+    {
+      sl_log (2, 0, "sink socket path too long: %s\n", address);
+      return -1;
+    }
+
+    memset (&unaddr, 0, sizeof (unaddr));
+    unaddr.sun_family = AF_UNIX;
+    strcpy (unaddr.sun_path, address);
+
+    if ((sink->fd = socket (AF_UNIX, SOCK_STREAM, 0)) < 0)
+    {
+      sl_log (2, 0, "socket(): %s\n", strerror (errno));
+      return -1;
+    }
+
+    /* Replace a socket left by an earlier run */
+    unlink (address);
+
+    if (bind (sink->fd, (struct sockaddr *)&unaddr, sizeof (unaddr)) ||
+        listen (sink->fd, 16))
+    {
+      sl_log (2, 0, "cannot listen for sink clients on %s: %s\n", address,
+              strerror (errno));
+      close (sink->fd);
+      sink->fd = -1;
+      return -1;
+    }
+
+    fcntl (sink->fd, F_SETFL, fcntl (sink->fd, F_GETFL) | O_NONBLOCK);
+
+    return 0;
+  }
+
+  address = sink->spec + 4;
+  host[0] = '\0';
+  port    = address;
+
+  if ((sep = strrchr (address, ':')) != NULL)
+  {
+    snprintf (host, sizeof (host), "%.*s", (int)(sep - address), address);
+    port = sep + 1;
+  }
+
+  if (sink->type == SK_UDP && !host[0])
+  {
+    sl_log (2, 0, "UDP sink requires a host: %s\n", sink->spec);
+    return -1;
+  }
+
+  memset (&hints, 0, sizeof (hints));
+  hints.ai_family   = AF_UNSPEC;
+  hints.ai_socktype = (sink->type == SK_UDP) ? SOCK_DGRAM : SOCK_STREAM;
+  hints.ai_flags    = (sink->type == SK_UDP) ? 0 : AI_PASSIVE;
+
+  if ((ret = getaddrinfo ((host[0]) ? host : NULL, port, &hints, &result)))
+  {
+    sl_log (2, 0, "cannot resolve sink address %s: %s\n", address,
+            gai_strerror (ret));
+    return -1;
+  }
+
+  if ((sink->fd = socket (result->ai_family, result->ai_socktype, result->ai_protocol)) < 0)
+  {
+    sl_log (2, 0, "socket(): %s\n", strerror (errno));
+    freeaddrinfo (result);
+    return -1;
+  }
+
+  if (sink->type == SK_UDP)
+  {
+    /* Multicast groups use the default interface and TTL */
+    memcpy (&sink->addr, result->ai_addr, result->ai_addrlen);
+    sink->addrlen = result->ai_addrlen;
+  }
+  else
+  {
+    setsockopt (sink->fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof (on));
+
+    if (bind (sink->fd, result->ai_addr, result->ai_addrlen) || listen (sink->fd, 16))
+    {
+      sl_log (2, 0, "cannot listen for sink clients on %s: %s\n", address,
+              strerror (errno));
+      freeaddrinfo (result);
+      close (sink->fd);
+      sink->fd = -1;
+      return -1;
+    }
+
+    fcntl (sink->fd, F_SETFL, fcntl (sink->fd, F_GETFL) | O_NONBLOCK);
+  }
+
+  freeaddrinfo (result);
+
+  return 0;
+} /* End of sk_open() */
+
+#else /* SLP_WIN */
+
+/***************************************************************************
+ * Output sinks are not supported on Windows.
+ ***************************************************************************/
+int
+sk_add (const char *spec)
+{
+  sl_log (2, 0, "output sinks are not supported on this platform\n");
+  return -1;
+}
+
+int
+sk_start (int queuesize)
+{
+  return 0;
+}
+
+void
+sk_stop (void)
+{
+}
+
+void
+sk_packet (const char *packet, int length)
+{
+}
+
+#endif /* SLP_WIN */
@@ -0,0 +1,25 @@
+/***************************************************************************
+ * sinks.h
+ *
+ * Interface declarations for forwarding received packets to output
+ * sinks: UDP unicast/multicast, TCP clients and Unix domain socket
+ * clients.
+ *
+ * modified: 2026.287
+ ***************************************************************************/
+
+#ifndef SINKS_H
+#define SINKS_H
+
+/* Default size of the queue of each sink client (bytes) */
+#define SK_DEFQUEUE 1048576
+
+/* Maximum number of clients connected to a sink */
+#define SK_MAXCLIENTS 64
+
+extern int sk_add (const char *spec);
+extern int sk_start (int queuesize);
+extern void sk_stop (void);
+extern void sk_packet (const char *packet, int length);
+
+#endif
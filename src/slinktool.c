@@ -23,7 +23,15 @@
 #include <libslink.h>
 
 #include "archive.h"
+#include "archqueue.h"
+#include "dedup.h"
+#include "dumpfile.h"
+#include "rcache.h"
+#include "repack.h"
+#include "samples.h"
+#include "sinks.h"
 #include "slinkxml.h"
+#include "stats.h"
 
 #define PACKAGE "slinktool"
 #define VERSION "4.3"
@@ -31,19 +39,86 @@
 /* Idle archive stream timeout */
 #define IDLE_ARCH_STREAM_TIMEOUT 120
 
+/* Maximum number of packets collected in a batch */
+#define MAX_BATCH_PACKETS 256
+
 static short int verbose  = 0; /* flag to control general verbosity */
 static short int pingonly = 0; /* flag to control ping function */
 static short int ppackets = 0; /* flag to control printing of data packets */
 static short int psamples = 0; /* flag to control printing of data samples */
-static int stateint       = 0; /* packet interval to save statefile */
+static char *sampleoutput = 0; /* bulk output format of data samples */
+static int sampleformat   = 0; /* SF_* format of sample output, 0 for -u */
 static char *archformat   = 0; /* format string for a custom structure */
 static char *sdsdir       = 0; /* base directory for a SDS structure */
 static char *buddir       = 0; /* base directory for a BUD structure */
-static char *statefile    = 0; /* state file for saving/restoring the seq. no. */
 static char *dumpfile     = 0; /* output file for data dump */
-static FILE *outfile      = 0; /* the descriptor for the dumpfile */
+static DumpFile *outfile  = 0; /* the writer of the dumpfile */
+static int dumpbufsize    = 0; /* dumpfile write buffer size */
+static char *dumpmode     = 0; /* direct and synchronous dumpfile writes */
+static int64_t dumprotsize = 0; /* dumpfile rotation size */
+static int dumprotsecs    = 0; /* dumpfile rotation interval (s) */
+static short int dumpindex = 0; /* flag to write a dumpfile index */
+static int wbufsize       = 0; /* per-stream archive write buffer size */
+static int wbufage        = 1000; /* max. age of buffered archive data (ms) */
+static int rbufsize       = 0; /* receive buffer size, 0 for library default */
+static char *aiobackend   = 0; /* asynchronous archive I/O backend */
+static short int asyncwrite = 0; /* flag: archive files are written asynchronously */
+static char *preallocmode = 0; /* preallocation of archive files */
+static int archthreads    = 0; /* number of archive worker threads */
+static int archslots      = AQ_DEFSLOTS; /* packet slots of the archive queue */
+static ArchQueue *archqueue = 0; /* queue to the archive threads */
+static char *statsaddr    = 0; /* address to serve statistics at */
+static char *statsfile    = 0; /* file to write statistics to */
+static int statsint       = ST_DEFINTERVAL; /* statistics file interval (s) */
+static short int statebinary = 0; /* flag to save state files in binary format */
+static short int logasync = 0; /* flag to log from a background thread */
+static int sinkqueue      = SK_DEFQUEUE; /* queue size of each sink client */
+static size_t infomaxsize = IX_DEFMAXSIZE; /* limit of buffered INFO XML */
+static char *cachepath    = 0; /* socket to serve the record cache at */
+static size_t cachesize   = RC_DEFSIZE; /* size of the record cache */
+static int cacheage       = RC_DEFAGE; /* max. age of cached records (s) */
+static int shardcount     = 1; /* connections per multi-station server */
+static char *shardbalance = 0; /* balancing of streams across the connections */
+static short int shardrate = 0; /* flag to balance shards by packet rate */
+static short int dedup    = 0; /* flag to drop records archived before */
+static short int repack   = 0; /* flag to repack records before archiving */
+static int repackage      = RP_DEFAGE; /* max. time samples are buffered (s) */
+
+/* A server group: a SeedLink connection and its stream selection */
+typedef struct ServerGroup_s
+{
+  SLCD *slconn;      /* connection parameters */
+  char *streamfile;  /* stream list file for configuring streams */
+  char *multiselect; /* stream list following '-S' */
+  char *selectors;   /* default selectors */
+  char *timewin;     /* time window following '-tw' */
+  char *statefile;   /* state file for saving/restoring the seq. no. */
+  int stateint;      /* packet interval to save statefile */
+  int packetcnt;     /* packets received since the state was saved */
+  SLstream *snapshot;  /* stream states waiting to be saved */
+  int snapcount;       /* number of streams in the snapshot */
+  int64_t snapbarrier; /* archive queue position the snapshot waits for */
+  int statsid;         /* connection identifier for the statistics */
+  struct ServerGroup_s *primary; /* first shard of the server, NULL for it */
+  struct ServerGroup_s **shards; /* all shards of the server, for the first */
+  int numshards;       /* number of shards, set for the first */
+  int shardid;         /* index of the shard */
+  int connected;       /* flag: the link was open when last checked */
+  int rebalance;       /* flag: rebalance the shards once possible */
+  SLstream *jointail;  /* last stream of the shard while joined */
+  struct ServerGroup_s *next;
+} ServerGroup;
+
+/* A stream of a sharded server while balancing the shards */
+typedef struct ShardStream_s
+{
+  int64_t weight;    /* packets received plus one, one if not by rate */
+  int index;         /* position of the stream in the joined chains */
+} ShardStream;
 
-static SLCD *slconn; /* connection parameters */
+static SLCD *slconn;           /* connection parameters of the first group */
+static ServerGroup *groups;    /* server groups, in command line order */
+static SLCDset *slset;         /* the connections of all groups */
 
 /* Possible query types */
 static enum {
@@ -59,10 +134,28 @@ static enum {
 
 /* Functions internal to this source file */
 static void packet_handler (char *msrecord, int packet_type,
-                            int seqnum, int packet_size);
+                            int seqnum, int packet_size, ServerGroup *group);
+static void archive_packet (char *msrecord, int packet_type, int seqnum,
+                            int packet_size, int archflag, int dumpflag);
+static void archive_repacked (char *record, int reclen, int seqnum);
+static void flush_archives (void);
+static void shutdown_archives (void);
+static void snapshot_state (ServerGroup *group);
+static void save_snapshot (ServerGroup *group);
+static void save_state (SLCD *slconn, const char *statefile);
+static void swap_state (SLstream *stream, SLstream *saved);
+static void hold_state (ServerGroup *group, SLstream *stream);
 static int info_handler (SLMSrecord *msr, int terminate);
 
 static int parameter_proc (int argcount, char **argvec);
+static ServerGroup *add_group (void);
+static int configure_group (ServerGroup *group);
+static int add_shards (ServerGroup *group);
+static int balance_shards (ServerGroup *group, int force);
+static void watch_shards (ServerGroup *group);
+static void join_shards (ServerGroup *group);
+static void split_shards (ServerGroup *group);
+static int cmp_shardstream (const void *a, const void *b);
 static char *getoptval (int argcount, char **argvec, int argopt);
 static void print_samples (SLMSrecord *msr);
 static int ping_server (SLCD *slconn);
@@ -77,10 +170,18 @@ static void term_handler (int sig);
 int
 main (int argc, char **argv)
 {
-  SLpacket *slpack;
+  SLpacket *slpacks[MAX_BATCH_PACKETS];
+  SLCD *pktconn;
+  ServerGroup *group;
   int seqnum;
-  int ptype;
-  int packetcnt = 0;
+  int reclen;
+  int ptype    = -1;
+  int retval;
+  int npacks;
+  int timeout  = -1;
+  int idx;
+  double flushtime = 0.0;
+  double reporttime = sl_dtime ();
 
 #ifndef SLP_WIN
   /* Signal handling, use POSIX calls with standardized semantics */
@@ -109,6 +210,11 @@ main (int argc, char **argv)
     return -1;
   }
 
+  /* Print log messages from a background thread if requested, queued
+     messages are printed at exit */
+  if (logasync)
+    sl_logasync (SLLOGSLOTS);
+
   /* Print important parameters if verbose enough */
   if (verbose >= 3)
     report_environ ();
@@ -117,46 +223,240 @@ main (int argc, char **argv)
   if (pingonly)
     exit (ping_server (slconn));
 
-  /* Loop with the connection manager */
-  while (sl_collect (slconn, &slpack))
+  /* Start collecting statistics if requested or to balance shards by
+     packet rate, connections are updated at least every second */
+  if (statsaddr || statsfile || shardrate)
   {
-    ptype  = sl_packettype (slpack);
-    seqnum = sl_sequence (slpack);
+    if (st_start (statsaddr, statsfile, statsint))
+      return -1;
+
+    for (group = groups; group != NULL; group = group->next)
+    {
+      /* Shards are identified by their index after the address */
+      if (group->primary || group->numshards > 1)
+      {
+        char label[300];
+
+        snprintf (label, sizeof (label), "%s#%d", group->slconn->sladdr, group->shardid);
+        group->statsid = st_addconnection (label);
+      }
+      else
+      {
+        group->statsid = st_addconnection (group->slconn->sladdr);
+      }
+    }
+
+    timeout = 1000;
+  }
+
+  /* Open the output sinks, if any */
+  if (sk_start (sinkqueue))
+    return -1;
+
+  /* Check records for duplicates before archiving if requested */
+  if (dedup && dd_start ())
+    return -1;
 
-    packet_handler ((char *)&slpack->msrecord, ptype, seqnum, SLRECSIZE);
+  /* Cache recent records for local queries if requested */
+  if (cachepath && rc_start (cachepath, cachesize, cacheage))
+    return -1;
+
+  /* Start the archive worker threads if requested */
+  if (archthreads && (dumpfile || archformat || sdsdir || buddir))
+  {
+    /* Records are only durable once flushed when writes are buffered
+       or asynchronous */
+    if ((archqueue = aq_new (archthreads, archslots, SLMAXRECSIZE, archive_packet,
+                             (wbufsize || dumpbufsize || asyncwrite) ?
+                             flush_archives : NULL,
+                             shutdown_archives, wbufage)) == NULL)
+    {
+      sl_log (2, 0, "cannot start archive threads\n");
+      return -1;
+    }
+
+    sl_log (1, 1, "Started %d archive threads\n", archthreads);
+  }
+
+  /* Repack the records before archiving if requested, buffered samples
+     are repacked at least every second once older than the maximum age */
+  if (repack && (archformat || sdsdir || buddir))
+  {
+    if (rp_start (archive_repacked, repackage))
+      return -1;
+
+    if (repackage > 0 && (timeout < 0 || timeout > 1000))
+      timeout = 1000;
+  }
+
+  /* Loop with the connection manager, when buffering archive writes
+     only wait as long as buffered records may be kept */
+  if ((wbufsize || dumpbufsize || asyncwrite) && wbufage > 0 && (timeout < 0 || wbufage < timeout))
+    timeout = wbufage;
+
+  for (;;)
+  {
+    retval = sl_collect_set_batch (slset, &pktconn, slpacks, MAX_BATCH_PACKETS,
+                                   &npacks, SLRECVARIABLE, timeout);
+
+    /* Flush buffered archive records older than the maximum age, the
+       archive threads flush their own records */
+    if (!archqueue && (wbufsize || dumpbufsize || asyncwrite) && wbufage > 0 &&
+        (sl_dtime () - flushtime) * 1000.0 >= wbufage)
+    {
+      flush_archives ();
+      flushtime = sl_dtime ();
+    }
+
+    /* Repack samples buffered longer than the maximum age */
+    if (repack)
+      rp_expire (sl_dtime ());
+
+    if (archqueue)
+    {
+      /* Save state snapshots once all their records are written */
+      for (group = groups; group != NULL; group = group->next)
+      {
+        if (group->snapshot && aq_durable (archqueue) >= group->snapbarrier)
+          save_snapshot (group);
+      }
+
+      /* Report queue statistics periodically */
+      if (verbose >= 2 && (sl_dtime () - reporttime) >= 60.0)
+      {
+        aq_report (archqueue, 2);
+        reporttime = sl_dtime ();
+      }
+    }
+
+    if (statsaddr || statsfile || shardrate)
+    {
+      for (group = groups; group != NULL; group = group->next)
+        st_connection (group->statsid, sl_connstats (group->slconn),
+                       group->slconn->link != -1);
+    }
 
-    if (statefile && stateint)
+    /* Rebalance sharded servers by packet rate after a shard disconnects */
+    if (shardrate)
     {
-      if (++packetcnt >= stateint)
+      for (group = groups; group != NULL; group = group->next)
       {
-        sl_savestate (slconn, statefile);
-        packetcnt = 0;
+        if (group->numshards > 1)
+          watch_shards (group);
       }
     }
 
-    /* Quit if no streams and terminated INFO is received */
-    if (slconn->streams == NULL && ptype == SLINFT)
+    if (retval == SLTERMINATE)
       break;
+
+    if (retval == SLNOPACKET)
+      continue;
+
+    /* Find the server group of the connection */
+    for (group = groups; group->slconn != pktconn; group = group->next)
+      ;
+
+    /* The state of all shards of a server is saved by the first */
+    if (group->primary)
+      group = group->primary;
+
+    for (idx = 0; idx < npacks; idx++)
+    {
+      ptype  = sl_packettype (slpacks[idx]);
+      seqnum = sl_sequence (slpacks[idx]);
+      reclen = sl_packetreclen (slpacks[idx]);
+
+      packet_handler ((char *)&slpacks[idx]->msrecord, ptype, seqnum, reclen, group);
+
+      /* Forward complete packets from the receive buffer to the sinks */
+      if (ptype != SLINF && ptype != SLINFT && ptype != SLKEEP)
+        sk_packet ((const char *)slpacks[idx], SLHEADSIZE + reclen);
+
+      rc_packet ((const char *)&slpacks[idx]->msrecord, reclen, ptype);
+
+      /* Quit if no streams and terminated INFO is received */
+      if (pktconn->streams == NULL && ptype == SLINFT)
+        break;
+    }
+
+    if (pktconn->streams == NULL && ptype == SLINFT)
+      break;
+
+    /* Write the samples of the batch to the pipe at once */
+    if (sampleformat)
+      fflush (stdout);
+
+    /* Save the state once per batch when the interval is reached */
+    if (group->statefile && group->stateint)
+    {
+      group->packetcnt += npacks;
+
+      if (group->packetcnt >= group->stateint)
+      {
+        /* The state file must not include records not yet written */
+        if (archqueue)
+        {
+          snapshot_state (group);
+        }
+        else if (repack)
+        {
+          flush_archives ();
+          snapshot_state (group);
+
+          if (group->snapshot)
+            save_snapshot (group);
+        }
+        else
+        {
+          flush_archives ();
+          join_shards (group);
+          save_state (group->slconn, group->statefile);
+          split_shards (group);
+        }
+
+        group->packetcnt = 0;
+      }
+    }
   }
 
   /* Shutdown */
-  if (slconn->link != -1)
-    sl_disconnect (slconn);
+  for (group = groups; group != NULL; group = group->next)
+  {
+    if (group->slconn->link != -1)
+      sl_disconnect (group->slconn);
+  }
 
-  if (dumpfile)
-    fclose (outfile);
+  sk_stop ();
+  rc_stop ();
 
-  if (buddir)
-    bud_streamproc (NULL, NULL, 0, 0);
+  /* Repack all buffered samples before the archives are closed */
+  rp_stop ();
 
-  if (archformat)
-    arch_streamproc (NULL, NULL, 0, 0, 0);
+  /* Write all queued records, the archive threads shut down their archives */
+  if (archqueue)
+    aq_stop (archqueue);
+  else
+    shutdown_archives ();
 
-  if (sdsdir)
-    sds_streamproc (NULL, NULL, 0, 0, 0);
+  if (outfile)
+    df_close (outfile);
 
-  if (statefile)
-    sl_savestate (slconn, statefile);
+  st_stop ();
+  dd_stop ();
+
+  for (group = groups; group != NULL; group = group->next)
+  {
+    free (group->snapshot);
+
+    if (group->statefile)
+    {
+      join_shards (group);
+      save_state (group->slconn, group->statefile);
+      split_shards (group);
+    }
+  }
+
+  sl_logsync ();
 
   return 0;
 } /* End of main() */
@@ -164,11 +464,17 @@ main (int argc, char **argv)
 /***************************************************************************
  * packet_handler:
  * Process a received packet based on packet type.
+ *
+ * Records are routed to the archives using a lazily decoded header,
+ * they are only fully parsed when packet details or samples are
+ * printed and for INFO packets.
  ***************************************************************************/
 static void
-packet_handler (char *msrecord, int packet_type, int seqnum, int packet_size)
+packet_handler (char *msrecord, int packet_type, int seqnum, int packet_size,
+                ServerGroup *group)
 {
   static SLMSrecord *msr = NULL;
+  SLMSheader msh;
 
   double dtime;   /* Epoch time */
   double secfrac; /* Fractional part of epoch time */
@@ -182,14 +488,23 @@ packet_handler (char *msrecord, int packet_type, int seqnum, int packet_size)
                   "Message", "General", "Request", "Info",
                   "Info (terminated)", "KeepAlive"};
 
-  /* Build a current local time string */
-  dtime   = sl_dtime ();
-  secfrac = (double)((double)dtime - (int)dtime);
-  ttime   = (time_t)dtime;
-  timep   = localtime (&ttime);
-  snprintf (timestamp, 20, "%04d.%03d.%02d:%02d:%02d.%01.0f",
-            timep->tm_year + 1900, timep->tm_yday + 1, timep->tm_hour,
-            timep->tm_min, timep->tm_sec, secfrac);
+  dtime = sl_dtime ();
+
+  /* Build a current local time string if the packets are reported */
+  if (sl_log_enabled (NULL, 1))
+  {
+    secfrac = (double)((double)dtime - (int)dtime);
+    ttime   = (time_t)dtime;
+    timep   = localtime (&ttime);
+    snprintf (timestamp, 20, "%04d.%03d.%02d:%02d:%02d.%01.0f",
+              timep->tm_year + 1900, timep->tm_yday + 1, timep->tm_hour,
+              timep->tm_min, timep->tm_sec, secfrac);
+  }
+
+  sl_msh_init (&msh, msrecord);
+
+  if (packet_type != SLINF && packet_type != SLINFT && packet_type != SLKEEP)
+    st_packet (&msh, packet_type, seqnum, packet_size, dtime);
 
   /* Process waveform data and send it on */
   if (packet_type == SLDATA)
@@ -198,28 +513,29 @@ packet_handler (char *msrecord, int packet_type, int seqnum, int packet_size)
             timestamp, seqnum, type[packet_type]);
 
     /* Parse data record and print requested detail if any */
-    if (psamples)
-      sl_msr_parse (slconn->log, msrecord, &msr, 1, 1);
-    else
-      sl_msr_parse (slconn->log, msrecord, &msr, 1, 0);
-
-    if (ppackets)
-      sl_msr_print (slconn->log, msr, ppackets - 1);
-
-    if (psamples)
-      print_samples (msr);
+    if (ppackets || psamples)
+    {
+      if (sl_msr_parse_size (slconn->log, msrecord, &msr, 1, (psamples) ? 1 : 0,
+                             packet_size))
+      {
+        if (ppackets)
+          sl_msr_print (slconn->log, msr, ppackets - 1);
+
+        if (sampleformat)
+        {
+          if (sf_write (stdout, sampleformat, msr))
+            sl_log (2, 0, "error writing samples to standard output\n");
+        }
+        else if (psamples)
+        {
+          print_samples (msr);
+        }
+      }
+    }
 
     /* Test for a so-called end-of-detection record */
-    if (msr->fsdh.samprate_fact == 0 && msr->fsdh.num_samples == 0)
+    if (sl_msh_sampratefact (&msh) == 0 && sl_msh_numsamples (&msh) == 0)
       archflag = 0;
-
-    /* Write packet to BUD structure if requested */
-    if (buddir && archflag)
-    {
-      if (bud_streamproc (buddir, msr, packet_size,
-                          IDLE_ARCH_STREAM_TIMEOUT))
-        sl_log (2, 0, "cannot write data to BUD at %s\n", buddir);
-    }
   }
   else if (packet_type == SLINF || packet_type == SLINFT)
   {
@@ -230,9 +546,8 @@ packet_handler (char *msrecord, int packet_type, int seqnum, int packet_size)
 
     terminate = (packet_type == SLINFT);
 
-    sl_msr_parse (slconn->log, msrecord, &msr, 0, 0);
-
-    if (info_handler (msr, terminate) == -2)
+    if (!sl_msr_parse (slconn->log, msrecord, &msr, 0, 0) ||
+        info_handler (msr, terminate) == -2)
     {
       sl_log (2, 1, "processing of INFO packet failed\n");
     }
@@ -251,17 +566,73 @@ packet_handler (char *msrecord, int packet_type, int seqnum, int packet_size)
             timestamp, seqnum, type[packet_type]);
   }
 
+  /* Drop records that were archived before, the dumpfile keeps them */
+  if (dedup && archflag)
+  {
+    int result = dd_check (&msh, packet_type, seqnum, group->slconn->sladdr);
+
+    if (result != DD_NEW)
+    {
+      sl_log (1, 2, "seq %d, dropped %s record of %.2s_%.5s\n", seqnum,
+              (result == DD_DUPLICATE) ? "duplicate" : "overlapping",
+              msh.fsdh->network, msh.fsdh->station);
+
+      archflag = 0;
+    }
+  }
+
+  /* Buffer the samples for repacking, the dumpfile keeps the record */
+  if (repack && archflag && packet_type == SLDATA &&
+      rp_record (msrecord, packet_size, seqnum, group))
+    archflag = 0;
+
+  /* Hand the packet to the archive threads or write it directly */
+  if (archqueue)
+  {
+    if ((dumpfile || archflag) &&
+        aq_put (archqueue, msrecord, packet_type, seqnum, packet_size, archflag, 1))
+      sl_log (2, 0, "cannot queue packet for archiving\n");
+  }
+  else
+  {
+    archive_packet (msrecord, packet_type, seqnum, packet_size, archflag, 1);
+  }
+} /* End of packet_handler() */
+
+/***************************************************************************
+ * archive_packet:
+ * Write a packet to the dumpfile if 'dumpflag' is set and to the
+ * archives if 'archflag' is set.  Called by packet_handler() or by the
+ * archive threads.
+ ***************************************************************************/
+static void
+archive_packet (char *msrecord, int packet_type, int seqnum, int packet_size,
+                int archflag, int dumpflag)
+{
+  SLMSheader msh;
+  int64_t start = st_clock ();
+
+  sl_msh_init (&msh, msrecord);
+
+  /* Write packet to BUD structure if requested */
+  if (buddir && archflag && packet_type == SLDATA)
+  {
+    if (bud_streamproc (buddir, &msh, packet_size,
+                        IDLE_ARCH_STREAM_TIMEOUT))
+      sl_log (2, 0, "cannot write data to BUD at %s\n", buddir);
+  }
+
   /* Write packet to dumpfile if defined */
-  if (dumpfile)
+  if (outfile && dumpflag)
   {
-    if (fwrite (msrecord, packet_size, 1, outfile) == 0)
-      sl_log (2, 0, "fwrite(): error writing data to %s\n", dumpfile);
+    if (df_write (outfile, msrecord, packet_size, seqnum))
+      sl_log (2, 0, "error writing data to %s\n", dumpfile);
   }
 
   /* Write packet to an archive if requested */
   if (archformat && archflag)
   {
-    if (arch_streamproc (archformat, msr, packet_size, packet_type,
+    if (arch_streamproc (archformat, &msh, packet_size, packet_type,
                          IDLE_ARCH_STREAM_TIMEOUT))
       sl_log (2, 0, "cannot write data to archive\n");
   }
@@ -269,11 +640,206 @@ packet_handler (char *msrecord, int packet_type, int seqnum, int packet_size)
   /* Write packet to an SDS archive if requested */
   if (sdsdir && archflag)
   {
-    if (sds_streamproc (sdsdir, msr, packet_size, packet_type,
+    if (sds_streamproc (sdsdir, &msh, packet_size, packet_type,
                         IDLE_ARCH_STREAM_TIMEOUT))
       sl_log (2, 0, "cannot write data to SDS at %s\n", sdsdir);
   }
-} /* End of packet_handler() */
+
+  if (start)
+    st_archive (start);
+} /* End of archive_packet() */
+
+/***************************************************************************
+ * archive_repacked:
+ * Hand a record of the repacking stage to the archive threads or write
+ * it directly to the archives, the dumpfile has the original records.
+ ***************************************************************************/
+static void
+archive_repacked (char *record, int reclen, int seqnum)
+{
+  if (archqueue)
+  {
+    if (aq_put (archqueue, record, SLDATA, seqnum, reclen, 1, 0))
+      sl_log (2, 0, "cannot queue repacked record for archiving\n");
+  }
+  else
+  {
+    archive_packet (record, SLDATA, seqnum, reclen, 1, 0);
+  }
+} /* End of archive_repacked() */
+
+/***************************************************************************
+ * flush_archives:
+ * Write all buffered records of the archives to their files and wait
+ * for pending asynchronous writes.
+ ***************************************************************************/
+static void
+flush_archives (void)
+{
+  if (outfile && dumpbufsize && df_flush (outfile))
+    sl_log (2, 0, "cannot flush data to %s\n", dumpfile);
+
+  if (!wbufsize && !asyncwrite)
+    return;
+
+  if (buddir && bud_streamproc (buddir, NULL, 0, 0))
+    sl_log (2, 0, "cannot flush data to BUD at %s\n", buddir);
+
+  if (archformat && arch_streamproc (archformat, NULL, 0, 0, 0))
+    sl_log (2, 0, "cannot flush data to archive\n");
+
+  if (sdsdir && sds_streamproc (sdsdir, NULL, 0, 0, 0))
+    sl_log (2, 0, "cannot flush data to SDS at %s\n", sdsdir);
+} /* End of flush_archives() */
+
+/***************************************************************************
+ * shutdown_archives:
+ * Write all buffered records, close all archive files and free all
+ * associated memory.
+ ***************************************************************************/
+static void
+shutdown_archives (void)
+{
+  if (buddir)
+    bud_streamproc (NULL, NULL, 0, 0);
+
+  if (archformat)
+    arch_streamproc (NULL, NULL, 0, 0, 0);
+
+  if (sdsdir)
+    sds_streamproc (NULL, NULL, 0, 0, 0);
+} /* End of shutdown_archives() */
+
+/***************************************************************************
+ * snapshot_state:
+ * Take a snapshot of the stream states of a server group to be saved
+ * once the archive threads have written all records queued so far,
+ * see save_snapshot().  If a snapshot is already waiting no new one
+ * is taken.  The snapshot of a sharded server includes all its shards,
+ * which are not rebalanced while it is waiting.
+ ***************************************************************************/
+static void
+snapshot_state (ServerGroup *group)
+{
+  SLstream *curstream;
+  int idx;
+
+  if (group->snapshot)
+    return;
+
+  join_shards (group);
+
+  group->snapcount = 0;
+  for (curstream = group->slconn->streams; curstream; curstream = curstream->next)
+    group->snapcount++;
+
+  if ((group->snapshot = (SLstream *)malloc ((group->snapcount + 1) * sizeof (SLstream))) == NULL)
+  {
+    sl_log (2, 0, "snapshot_state(): error allocating memory\n");
+    split_shards (group);
+    return;
+  }
+
+  for (idx = 0, curstream = group->slconn->streams; curstream;
+       idx++, curstream = curstream->next)
+  {
+    group->snapshot[idx] = *curstream;
+
+    if (repack)
+      hold_state (group, &group->snapshot[idx]);
+  }
+
+  split_shards (group);
+
+  if (!archqueue)
+    return;
+
+  group->snapbarrier = aq_position (archqueue);
+
+  /* Have buffered records and pending asynchronous writes completed
+     even when not flushed by age */
+  if (wbufsize || dumpbufsize || asyncwrite)
+    aq_flush (archqueue);
+} /* End of snapshot_state() */
+
+/***************************************************************************
+ * save_snapshot:
+ * Save the stream state snapshot of a server group to its state file
+ * and release the snapshot.
+ ***************************************************************************/
+static void
+save_snapshot (ServerGroup *group)
+{
+  SLstream *curstream;
+  int idx;
+
+  join_shards (group);
+
+  for (idx = 0, curstream = group->slconn->streams;
+       curstream && idx < group->snapcount; idx++, curstream = curstream->next)
+    swap_state (curstream, &group->snapshot[idx]);
+
+  save_state (group->slconn, group->statefile);
+
+  for (idx = 0, curstream = group->slconn->streams;
+       curstream && idx < group->snapcount; idx++, curstream = curstream->next)
+    swap_state (curstream, &group->snapshot[idx]);
+
+  split_shards (group);
+
+  free (group->snapshot);
+  group->snapshot = NULL;
+} /* End of save_snapshot() */
+
+/***************************************************************************
+ * save_state:
+ * Save the stream state of a connection to a state file in the format
+ * selected with -xb.
+ ***************************************************************************/
+static void
+save_state (SLCD *slconn, const char *statefile)
+{
+  if (statebinary)
+    sl_savestate_binary (slconn, statefile);
+  else
+    sl_savestate (slconn, statefile);
+} /* End of save_state() */
+
+/***************************************************************************
+ * swap_state:
+ * Swap the sequence number and time stamp of a stream with a saved state.
+ ***************************************************************************/
+static void
+swap_state (SLstream *stream, SLstream *saved)
+{
+  SLstream live = *stream;
+
+  stream->seqnum    = saved->seqnum;
+  stream->lasttime  = saved->lasttime;
+  stream->timestale = saved->timestale;
+  memcpy (stream->timestamp, saved->timestamp, sizeof (stream->timestamp));
+
+  saved->seqnum    = live.seqnum;
+  saved->lasttime  = live.lasttime;
+  saved->timestale = live.timestale;
+  memcpy (saved->timestamp, live.timestamp, sizeof (live.timestamp));
+} /* End of swap_state() */
+
+/***************************************************************************
+ * hold_state:
+ * Set the sequence number of a stream to resume with its oldest record
+ * buffered for repacking, which is not archived yet.  Records of other
+ * channels received after it are archived again after a restart.
+ ***************************************************************************/
+static void
+hold_state (ServerGroup *group, SLstream *stream)
+{
+  int pending;
+
+  if (stream->seqnum >= 0 &&
+      (pending = rp_pending (stream->net, stream->sta, group)) >= 0)
+    stream->seqnum = (pending - 1) & 0xFFFFFF;
+} /* End of hold_state() */
 
 /***************************************************************************
  * info_handler:
@@ -287,72 +853,78 @@ packet_handler (char *msrecord, int packet_type, int seqnum, int packet_size)
 static int
 info_handler (SLMSrecord *msr, int terminate)
 {
-  static char *xml_buffer = 0;
-  static int xml_size     = 0;
+  static InfoXML infoxml;
+  static int failed = 0; /* flag: discard the rest of the XML after errors */
 
-  char *xml_bit   = (char *)msr->msrecord + msr->fsdh.begin_data;
-  int xml_bitsize = msr->fsdh.num_samples;
+  char *xml_bit      = (char *)msr->msrecord + msr->fsdh.begin_data;
+  size_t xml_bitsize = msr->fsdh.num_samples;
+  char *nul;
 
   ezxml_t xmldoc;
 
-  /* Buffer size sanity check: 10MB limit */
-  if ((xml_size + xml_bitsize) > 10485760)
+  if (failed)
   {
-    sl_log (2, 0, "info_handler(): XML buffer beyond sanity limit\n");
-
-    if (xml_buffer)
-      free (xml_buffer);
-    xml_buffer = 0;
-    xml_size   = 0;
-
-    return -2;
+    failed = !terminate;
+    return 0;
   }
 
-  /* Grow XML string buffer, include room (+1) for NULL terminator */
-  if ((xml_buffer = realloc (xml_buffer, (xml_size + xml_bitsize + 1))) == NULL)
+  /* Check for an error condition */
+  if (!strncmp (msr->fsdh.channel, "ERR", 3))
   {
-    sl_log (2, 0, "info_handler(): XML buffer memory allocation error\n");
+    sl_log (2, 0, "INFO type requested is not enabled\n");
+
+    ix_free (&infoxml);
+    failed = !terminate;
+
     return -2;
   }
 
-  /* First character is terminator for initial buffer allocation */
-  if (xml_size == 0)
+  /* The XML ends at a NULL in the record */
+  if ((nul = memchr (xml_bit, '\0', xml_bitsize)))
+    xml_bitsize = nul - xml_bit;
+
+  /* Raw XML is written as it arrives */
+  if (slt_query == SLTGenericQuery)
   {
-    *xml_buffer = '\0';
+    fwrite (xml_bit, 1, xml_bitsize, stdout);
   }
+  else if (ix_append (&infoxml, xml_bit, xml_bitsize, infomaxsize))
+  {
+    ix_free (&infoxml);
+    failed = !terminate;
 
-  /* Append new XML to buffer */
-  strncat (xml_buffer, xml_bit, xml_bitsize);
-  xml_size += xml_bitsize;
+    return -2;
+  }
 
-  /* Check for an error condition */
-  if (!strncmp (msr->fsdh.channel, "ERR", 3))
+  /* Stream and gap lists are printed station by station */
+  if (slt_query == SLTStreamQuery || slt_query == SLTGapQuery)
   {
-    sl_log (2, 0, "INFO type requested is not enabled\n");
-
-    if (xml_buffer)
-      free (xml_buffer);
-    xml_buffer = 0;
-    xml_size   = 0;
+    if (ix_stations (&infoxml, (slt_query == SLTStreamQuery) ?
+                     prtinfo_stationstreams : prtinfo_stationgaps,
+                     terminate))
+    {
+      ix_free (&infoxml);
+      failed = !terminate;
 
-    return -2;
+      return -2;
+    }
   }
 
   /* Process the XML if terminated */
   if (terminate)
   {
-
-    /* Parse the XML if not dumping the raw XML */
-    if (slt_query != SLTGenericQuery)
+    if (slt_query == SLTGenericQuery)
+    {
+      fprintf (stdout, "\n");
+    }
+    /* Parse the XML if not already processed */
+    else if (slt_query != SLTStreamQuery && slt_query != SLTGapQuery)
     {
-      if ((xmldoc = ezxml_parse_str (xml_buffer, xml_size)) == NULL)
+      if ((xmldoc = ezxml_parse_str (infoxml.data, infoxml.length)) == NULL)
       {
         sl_log (2, 0, "XML parse error\n");
 
-        if (xml_buffer)
-          free (xml_buffer);
-        xml_buffer = 0;
-        xml_size   = 0;
+        ix_free (&infoxml);
 
         return -2;
       }
@@ -365,12 +937,6 @@ info_handler (SLMSrecord *msr, int terminate)
       case SLTStationQuery:
         prtinfo_stations (xmldoc);
         break;
-      case SLTStreamQuery:
-        prtinfo_streams (xmldoc);
-        break;
-      case SLTGapQuery:
-        prtinfo_gaps (xmldoc);
-        break;
       case SLTConnectionQuery:
         prtinfo_connections (xmldoc);
         break;
@@ -381,18 +947,11 @@ info_handler (SLMSrecord *msr, int terminate)
 
       ezxml_free (xmldoc);
     }
-    else
-    {
-      fprintf (stdout, "%s\n", xml_buffer);
-    }
 
     /* Clean up */
     slt_query = SLTNoQuery;
 
-    if (xml_buffer)
-      free (xml_buffer);
-    xml_buffer = 0;
-    xml_size   = 0;
+    ix_free (&infoxml);
 
     return -1;
   }
@@ -412,17 +971,16 @@ parameter_proc (int argcount, char **argvec)
   int error = 0;
   int optind;
 
-  char *streamfile  = 0; /* stream list file for configuring streams */
-  char *multiselect = 0;
-  char *selectors   = 0;
-  char *timewin     = 0;
-  char *tptr;
-
-  SLstrlist *timelist; /* split the time window arg */
+  ServerGroup *group; /* group for stream selection options */
+  ServerGroup *last;
 
   if (argcount <= 1)
     error++;
 
+  /* The first group uses the already allocated connection description */
+  if ((group = add_group ()) == NULL)
+    return -1;
+
   /* Process all command line arguments */
   for (optind = 1; optind < argcount; optind++)
   {
@@ -440,6 +998,10 @@ parameter_proc (int argcount, char **argvec)
     {
       verbose += strspn (&argvec[optind][1], "v");
     }
+    else if (strcmp (argvec[optind], "-la") == 0)
+    {
+      logasync = 1;
+    }
     else if (strcmp (argvec[optind], "-P") == 0)
     {
       pingonly = 1;
@@ -452,6 +1014,11 @@ parameter_proc (int argcount, char **argvec)
     {
       psamples = 1;
     }
+    else if (strcmp (argvec[optind], "-uf") == 0)
+    {
+      sampleoutput = getoptval (argcount, argvec, optind++);
+      psamples     = 1;
+    }
     else if (strcmp (argvec[optind], "-d") == 0)
     {
       slconn->dialup = 1;
@@ -460,6 +1027,22 @@ parameter_proc (int argcount, char **argvec)
     {
       slconn->batchmode = 1;
     }
+    else if (strcmp (argvec[optind], "-np") == 0)
+    {
+      slconn->pipeline = 1;
+    }
+    else if (strcmp (argvec[optind], "-rb") == 0)
+    {
+      rbufsize = atoi (getoptval (argcount, argvec, optind++));
+    }
+    else if (strcmp (argvec[optind], "-m") == 0)
+    {
+      statsaddr = getoptval (argcount, argvec, optind++);
+    }
+    else if (strcmp (argvec[optind], "-mf") == 0)
+    {
+      statsfile = getoptval (argcount, argvec, optind++);
+    }
     else if (strcmp (argvec[optind], "-nt") == 0)
     {
       slconn->netto = atoi (getoptval (argcount, argvec, optind++));
@@ -476,6 +1059,26 @@ parameter_proc (int argcount, char **argvec)
     {
       dumpfile = getoptval (argcount, argvec, optind++);
     }
+    else if (strcmp (argvec[optind], "-ob") == 0)
+    {
+      dumpbufsize = atoi (getoptval (argcount, argvec, optind++));
+    }
+    else if (strcmp (argvec[optind], "-od") == 0)
+    {
+      dumpmode = getoptval (argcount, argvec, optind++);
+    }
+    else if (strcmp (argvec[optind], "-os") == 0)
+    {
+      dumprotsize = strtoll (getoptval (argcount, argvec, optind++), NULL, 10);
+    }
+    else if (strcmp (argvec[optind], "-ot") == 0)
+    {
+      dumprotsecs = atoi (getoptval (argcount, argvec, optind++));
+    }
+    else if (strcmp (argvec[optind], "-oi") == 0)
+    {
+      dumpindex = 1;
+    }
     else if (strcmp (argvec[optind], "-A") == 0)
     {
       archformat = getoptval (argcount, argvec, optind++);
@@ -488,21 +1091,102 @@ parameter_proc (int argcount, char **argvec)
     {
       buddir = getoptval (argcount, argvec, optind++);
     }
+    else if (strcmp (argvec[optind], "-wb") == 0)
+    {
+      wbufsize = atoi (getoptval (argcount, argvec, optind++));
+    }
+    else if (strcmp (argvec[optind], "-wt") == 0)
+    {
+      wbufage = atoi (getoptval (argcount, argvec, optind++));
+    }
+    else if (strcmp (argvec[optind], "-wp") == 0)
+    {
+      preallocmode = getoptval (argcount, argvec, optind++);
+    }
+    else if (strcmp (argvec[optind], "-aio") == 0)
+    {
+      aiobackend = getoptval (argcount, argvec, optind++);
+    }
+    else if (strcmp (argvec[optind], "-at") == 0)
+    {
+      archthreads = atoi (getoptval (argcount, argvec, optind++));
+    }
+    else if (strcmp (argvec[optind], "-aq") == 0)
+    {
+      archslots = atoi (getoptval (argcount, argvec, optind++));
+    }
+    else if (strcmp (argvec[optind], "-dd") == 0)
+    {
+      dedup = 1;
+    }
+    else if (strcmp (argvec[optind], "-rp") == 0)
+    {
+      repack = 1;
+    }
+    else if (strcmp (argvec[optind], "-rpt") == 0)
+    {
+      repackage = atoi (getoptval (argcount, argvec, optind++));
+    }
+    else if (strcmp (argvec[optind], "-F") == 0)
+    {
+      if (sk_add (getoptval (argcount, argvec, optind++)))
+        return -1;
+    }
+    else if (strcmp (argvec[optind], "-Fq") == 0)
+    {
+      sinkqueue = atoi (getoptval (argcount, argvec, optind++));
+    }
+    else if (strcmp (argvec[optind], "-R") == 0)
+    {
+      cachepath = getoptval (argcount, argvec, optind++);
+    }
+    else if (strcmp (argvec[optind], "-Rs") == 0)
+    {
+      cachesize = strtoul (getoptval (argcount, argvec, optind++), NULL, 10);
+    }
+    else if (strcmp (argvec[optind], "-Ra") == 0)
+    {
+      cacheage = atoi (getoptval (argcount, argvec, optind++));
+    }
+    else if (strcmp (argvec[optind], "-K") == 0)
+    {
+      shardcount = atoi (getoptval (argcount, argvec, optind++));
+    }
+    else if (strcmp (argvec[optind], "-Kb") == 0)
+    {
+      shardbalance = getoptval (argcount, argvec, optind++);
+    }
     else if (strcmp (argvec[optind], "-l") == 0)
     {
-      streamfile = getoptval (argcount, argvec, optind++);
+      if (group->slconn->sladdr && (group = add_group ()) == NULL)
+        return -1;
+
+      group->streamfile = getoptval (argcount, argvec, optind++);
     }
     else if (strcmp (argvec[optind], "-s") == 0)
     {
-      selectors = getoptval (argcount, argvec, optind++);
+      if (group->slconn->sladdr && (group = add_group ()) == NULL)
+        return -1;
+
+      group->selectors = getoptval (argcount, argvec, optind++);
     }
     else if (strcmp (argvec[optind], "-S") == 0)
     {
-      multiselect = getoptval (argcount, argvec, optind++);
+      if (group->slconn->sladdr && (group = add_group ()) == NULL)
+        return -1;
+
+      group->multiselect = getoptval (argcount, argvec, optind++);
     }
     else if (strcmp (argvec[optind], "-x") == 0)
     {
-      statefile = getoptval (argcount, argvec, optind++);
+      if (group->slconn->sladdr && (group = add_group ()) == NULL)
+        return -1;
+
+      group->statefile = getoptval (argcount, argvec, optind++);
+    }
+    else if (strcmp (argvec[optind], "-xb") == 0)
+    {
+      statebinary = 1;
     }
     else if (strcmp (argvec[optind], "-i") == 0)
     {
@@ -531,94 +1215,382 @@ parameter_proc (int argcount, char **argvec)
     }
     else if (strcmp (argvec[optind], "-C") == 0)
     {
-      if (sl_request_info (slconn, "CONNECTIONS") == 0)
-        slt_query = SLTConnectionQuery;
+      if (sl_request_info (slconn, "CONNECTIONS") == 0)
+        slt_query = SLTConnectionQuery;
+    }
+    else if (strcmp (argvec[optind], "-im") == 0)
+    {
+      infomaxsize = strtoul (getoptval (argcount, argvec, optind++), NULL, 10);
+    }
+    else if (strcmp (argvec[optind], "-tw") == 0)
+    {
+      if (group->slconn->sladdr && (group = add_group ()) == NULL)
+        return -1;
+
+      group->timewin = getoptval (argcount, argvec, optind++);
+    }
+    else if (strncmp (argvec[optind], "-", 1) == 0)
+    {
+      fprintf (stderr, "Unknown option: %s\n", argvec[optind]);
+      exit (1);
+    }
+    else
+    {
+      /* Each server address completes a server group */
+      if (group->slconn->sladdr && (group = add_group ()) == NULL)
+        return -1;
+
+      group->slconn->sladdr = argvec[optind];
+    }
+  }
+
+  /* Selection options after the last address apply to the last group */
+  if (!group->slconn->sladdr && group != groups)
+  {
+    for (last = groups; last->next != group; last = last->next)
+      ;
+
+    if (group->streamfile)
+      last->streamfile = group->streamfile;
+    if (group->multiselect)
+      last->multiselect = group->multiselect;
+    if (group->selectors)
+      last->selectors = group->selectors;
+    if (group->timewin)
+      last->timewin = group->timewin;
+    if (group->statefile)
+      last->statefile = group->statefile;
+
+    sl_freeslcd (group->slconn);
+    free (group);
+    last->next = NULL;
+  }
+
+  /* Make sure a server was specified */
+  if (!slconn->sladdr)
+  {
+    fprintf (stderr, "No SeedLink server specified\n\n");
+    fprintf (stderr, "%s version %s\n\n", PACKAGE, VERSION);
+    fprintf (stderr, "Usage: %s [options] [host][:][port]\n\n", PACKAGE);
+    fprintf (stderr, "Try '-h' for detailed help\n");
+    exit (1);
+  }
+
+  /* Initialize the verbosity for the sl_log function */
+  sl_loginit (verbose, NULL, NULL, NULL, NULL);
+
+  /* Open dumpfile if requested */
+  if (dumpfile)
+  {
+    int dumpflags = (dumpindex) ? DF_INDEX : 0;
+    char *mode;
+
+    /* Direct and synchronous writes, as a comma separated list */
+    for (mode = (dumpmode) ? strtok (dumpmode, ",") : NULL; mode;
+         mode = strtok (NULL, ","))
+    {
+      if (!strcmp (mode, "direct"))
+        dumpflags |= DF_DIRECT;
+      else if (!strcmp (mode, "dsync"))
+        dumpflags |= DF_DSYNC;
+      else if (strcmp (mode, "none"))
+      {
+        sl_log (2, 0, "unknown dumpfile write mode: %s\n", mode);
+        exit (1);
+      }
+    }
+
+    if (dumpbufsize < 0)
+    {
+      sl_log (2, 0, "invalid dumpfile write buffer size: %d\n", dumpbufsize);
+      exit (1);
+    }
+
+    /* Direct writes require a buffer */
+    if ((dumpflags & DF_DIRECT) && !dumpbufsize)
+      dumpbufsize = DF_DEFBUFSIZE;
+
+    /* Re-direct all messages to standard error */
+    if (!strcmp (dumpfile, "-"))
+      sl_loginit (verbose, &print_stderr, NULL, &print_stderr, NULL);
+
+    if ((outfile = df_open (dumpfile, dumpbufsize, dumpflags,
+                            dumprotsize, dumprotsecs)) == NULL)
+    {
+      sl_log (2, 0, "cannot open dumpfile: %s\n", dumpfile);
+      exit (1);
+    }
+  }
+
+  /* Select the bulk sample output, written to standard output */
+  if (sampleoutput)
+  {
+    if ((sampleformat = sf_format (sampleoutput)) < 0)
+    {
+      sl_log (2, 0, "unknown sample output format: %s\n", sampleoutput);
+      exit (1);
+    }
+
+    if (dumpfile && !strcmp (dumpfile, "-"))
+    {
+      sl_log (2, 0, "-uf cannot be combined with a dumpfile on standard output\n");
+      exit (1);
+    }
+
+    /* Re-direct all messages to standard error for binary samples */
+    if (sampleformat != SF_TEXT)
+      sl_loginit (verbose, &print_stderr, NULL, &print_stderr, NULL);
+  }
+
+  /* Report the program version */
+  sl_log (1, 1, "%s version: %s\n", PACKAGE, VERSION);
+
+  /* If errors then report the usage message and quit */
+  if (error)
+  {
+    usage ();
+    exit (1);
+  }
+
+  /* Configure buffering of archive writes */
+  if (wbufsize < 0)
+  {
+    sl_log (2, 0, "invalid archive write buffer size: %d\n", wbufsize);
+    return -1;
+  }
+
+  arch_setbuffersize (wbufsize);
+
+  /* Configure asynchronous archive writes */
+  if (aiobackend && arch_setasync (aiobackend))
+  {
+    sl_log (2, 0, "unknown archive I/O backend: %s\n", aiobackend);
+    return -1;
+  }
+
+  asyncwrite = (aiobackend && strcmp (aiobackend, "none"));
+
+  /* Configure preallocation of archive files, only for synchronous writes */
+  if (preallocmode)
+  {
+    if (aiobackend && strcmp (aiobackend, "none") && strcmp (preallocmode, "none"))
+    {
+      sl_log (2, 0, "-wp cannot be combined with asynchronous archive writes\n");
+      return -1;
     }
-    else if (strcmp (argvec[optind], "-tw") == 0)
+
+    if (arch_setprealloc (preallocmode))
     {
-      timewin = getoptval (argcount, argvec, optind++);
+      sl_log (2, 0, "unknown or unsupported archive preallocation: %s\n", preallocmode);
+      return -1;
     }
-    else if (strncmp (argvec[optind], "-", 1) == 0)
+  }
+
+  /* Check if an interval was specified for writing statistics */
+  if (statsfile)
+  {
+    char *tptr;
+    char *tail;
+
+    if ((tptr = strchr (statsfile, ':')) != NULL)
     {
-      fprintf (stderr, "Unknown option: %s\n", argvec[optind]);
-      exit (1);
+      *tptr++ = '\0';
+
+      statsint = (int)strtol (tptr, &tail, 0);
+
+      if (*tail || statsint <= 0)
+      {
+        sl_log (2, 0, "statistics file interval specified incorrectly\n");
+        return -1;
+      }
     }
-    else if (!slconn->sladdr)
+  }
+
+  /* Configure the archive threads */
+  if (archthreads < 0 || archslots <= 0)
+  {
+    sl_log (2, 0, "invalid archive threads or queue size: %d, %d\n",
+            archthreads, archslots);
+    return -1;
+  }
+
+  /* Configure repacking */
+  if (repackage < 0)
+  {
+    sl_log (2, 0, "invalid maximum age of repacked samples: %d\n", repackage);
+    return -1;
+  }
+
+  /* Saved states are held back by the records buffered for repacking,
+     after a crash the records since then are archived again */
+  if (repack)
+  {
+    for (group = groups; group != NULL && !group->statefile; group = group->next)
+      ;
+
+    if (group && repackage > 0)
+      sl_log (1, 0, "with -rp and -x up to %d seconds of records are archived "
+              "again after a crash, -dd does not detect them\n", repackage);
+    else if (group)
+      sl_log (1, 0, "with -rp and -x all records since the oldest buffered "
+              "record are archived again after a crash, -dd does not detect them\n");
+  }
+
+  /* Configure the sharding of multi-station servers */
+  if (shardcount < 1)
+  {
+    sl_log (2, 0, "invalid number of connections per server: %d\n", shardcount);
+    return -1;
+  }
+
+  if (shardbalance)
+  {
+    if (!strcmp (shardbalance, "rate"))
     {
-      slconn->sladdr = argvec[optind];
+      shardrate = 1;
     }
-    else
+    else if (strcmp (shardbalance, "stations"))
     {
-      fprintf (stderr, "Unknown option: %s\n", argvec[optind]);
-      exit (1);
+      sl_log (2, 0, "unknown balancing of shards: %s\n", shardbalance);
+      return -1;
     }
   }
 
-  /* Make sure a server was specified */
-  if (!slconn->sladdr)
+  /* Make sure we print basic packet details if printing samples as text */
+  if (psamples && ppackets == 0 && sampleformat <= SF_TEXT)
+    ppackets = 1;
+
+  /* INFO requests and ping are only supported with a single server */
+  if (groups->next && (slconn->info || pingonly))
   {
-    fprintf (stderr, "No SeedLink server specified\n\n");
-    fprintf (stderr, "%s version %s\n\n", PACKAGE, VERSION);
-    fprintf (stderr, "Usage: %s [options] [host][:][port]\n\n", PACKAGE);
-    fprintf (stderr, "Try '-h' for detailed help\n");
-    exit (1);
+    sl_log (2, 0, "INFO requests and ping require a single server\n");
+    return -1;
   }
 
-  /* Initialize the verbosity for the sl_log function */
-  sl_loginit (verbose, NULL, NULL, NULL, NULL);
+  if ((slset = sl_newslcdset ()) == NULL)
+    return -1;
 
-  /* Open dumpfile if requested */
-  if (dumpfile)
+  /* Configure the connection of each server group */
+  for (group = groups; group != NULL; group = group->next)
   {
-    if (!strcmp (dumpfile, "-"))
+    /* Shards are configured by their first group */
+    if (group->primary)
     {
-      /* Re-direct all messages to standard error */
-      sl_loginit (verbose, &print_stderr, NULL, &print_stderr, NULL);
+      if (sl_addslcdset (slset, group->slconn) < 0)
+        return -1;
 
-      outfile = stdout;
-      setvbuf (stdout, NULL, _IONBF, 0);
+      continue;
     }
-    else if ((outfile = fopen (dumpfile, "a+b")) != NULL)
+
+    /* Connection options are shared by all groups */
+    if (group->slconn != slconn)
     {
-      setvbuf (outfile, NULL, _IONBF, 0);
+      group->slconn->dialup    = slconn->dialup;
+      group->slconn->batchmode = slconn->batchmode;
+      group->slconn->pipeline  = slconn->pipeline;
+      group->slconn->netto     = slconn->netto;
+      group->slconn->netdly    = slconn->netdly;
+      group->slconn->keepalive = slconn->keepalive;
     }
-    else
+
+    if (rbufsize && sl_setbuffersize (group->slconn, rbufsize) < 0)
+      return -1;
+
+    if (configure_group (group) < 0)
+      return -1;
+
+    for (last = groups; last != group; last = last->next)
     {
-      sl_log (2, 0, "cannot open dumpfile: %s\n", dumpfile);
-      exit (1);
+      if (group->statefile && last->statefile &&
+          !strcmp (group->statefile, last->statefile))
+      {
+        sl_log (2, 0, "each server requires its own state file: %s\n",
+                group->statefile);
+        return -1;
+      }
     }
+
+    /* Split the streams across parallel connections if requested */
+    if (shardcount > 1 && add_shards (group) < 0)
+      return -1;
+
+    if (sl_addslcdset (slset, group->slconn) < 0)
+      return -1;
   }
 
-  /* Report the program version */
-  sl_log (1, 1, "%s version: %s\n", PACKAGE, VERSION);
+  return 0;
+} /* End of parameter_proc() */
 
-  /* If errors then report the usage message and quit */
-  if (error)
+/***************************************************************************
+ * add_group:
+ * Allocate a new server group and add it to the end of the group list.
+ * The first group uses the global connection description, 'slconn'.
+ *
+ * Returns a pointer to the new group on success and NULL on error.
+ ***************************************************************************/
+static ServerGroup *
+add_group (void)
+{
+  ServerGroup *group;
+  ServerGroup *last;
+
+  if ((group = (ServerGroup *)calloc (1, sizeof (ServerGroup))) == NULL)
   {
-    usage ();
-    exit (1);
+    sl_log (2, 0, "add_group(): error allocating memory\n");
+    return NULL;
   }
 
-  /* Make sure we print basic packet details if printing samples */
-  if (psamples && ppackets == 0)
-    ppackets = 1;
+  if (groups == NULL)
+  {
+    group->slconn = slconn;
+    groups        = group;
+  }
+  else
+  {
+    if ((group->slconn = sl_newslcd ()) == NULL)
+    {
+      free (group);
+      return NULL;
+    }
+
+    for (last = groups; last->next != NULL; last = last->next)
+      ;
+
+    last->next = group;
+  }
+
+  return group;
+} /* End of add_group() */
+
+/***************************************************************************
+ * configure_group:
+ * Configure the streams, time window and state recovery for the
+ * connection of a server group.
+ *
+ * Returns 0 on success and -1 on error.
+ ***************************************************************************/
+static int
+configure_group (ServerGroup *group)
+{
+  SLstrlist *timelist; /* split the time window arg */
+  char *tptr;
 
   /* Load the stream list from a file if specified */
-  if (streamfile)
-    sl_read_streamlist (slconn, streamfile, selectors);
+  if (group->streamfile)
+    sl_read_streamlist (group->slconn, group->streamfile, group->selectors);
 
   /* Split the time window argument */
-  if (timewin)
+  if (group->timewin)
   {
     SLstrlist *timeptr;
 
-    if (strchr (timewin, ':') == NULL)
+    if (strchr (group->timewin, ':') == NULL)
     {
       sl_log (2, 0, "time window not in begin:[end] format\n");
       return -1;
     }
 
-    if (sl_strparse (timewin, ":", &timelist) > 2)
+    if (sl_strparse (group->timewin, ":", &timelist) > 2)
     {
       sl_log (2, 0, "time window not in begin:[end] format\n");
       return -1;
@@ -632,13 +1604,13 @@ parameter_proc (int argcount, char **argvec)
       return -1;
     }
 
-    slconn->begin_time = strdup (timeptr->element);
+    group->slconn->begin_time = strdup (timeptr->element);
 
     timeptr = timeptr->next;
 
     if (timeptr != 0)
     {
-      slconn->end_time = strdup (timeptr->element);
+      group->slconn->end_time = strdup (timeptr->element);
 
       if (timeptr->next != 0)
       {
@@ -652,43 +1624,354 @@ parameter_proc (int argcount, char **argvec)
   }
 
   /* Parse the 'multiselect' string following '-S' */
-  if (multiselect)
+  if (group->multiselect)
   {
-    if (sl_parse_streamlist (slconn, multiselect, selectors) == -1)
+    if (sl_parse_streamlist (group->slconn, group->multiselect, group->selectors) == -1)
       return -1;
   }
-  else if (slconn->streams == NULL && slconn->info == NULL)
+  else if (group->slconn->streams == NULL && group->slconn->info == NULL)
   { /* No 'streams' array, assuming uni-station mode */
-    sl_setuniparams (slconn, selectors, -1, 0);
+    sl_setuniparams (group->slconn, group->selectors, -1, 0);
   }
 
   /* Attempt to recover sequence numbers from state file */
-  if (statefile)
+  if (group->statefile)
   {
     /* Check if interval was specified for state saving */
-    if ((tptr = strchr (statefile, ':')) != NULL)
+    if ((tptr = strchr (group->statefile, ':')) != NULL)
     {
       char *tail;
 
       *tptr++ = '\0';
 
-      stateint = (unsigned int)strtoul (tptr, &tail, 0);
+      group->stateint = (unsigned int)strtoul (tptr, &tail, 0);
 
-      if (*tail || (stateint < 0 || stateint > 1e9))
+      if (*tail || (group->stateint < 0 || group->stateint > 1e9))
       {
         sl_log (2, 0, "state saving interval specified incorrectly\n");
         return -1;
       }
     }
 
-    if (sl_recoverstate (slconn, statefile) < 0)
+    if (sl_recoverstate (group->slconn, group->statefile) < 0)
     {
       sl_log (2, 0, "state recovery failed\n");
     }
   }
 
   return 0;
-} /* End of parameter_proc() */
+} /* End of configure_group() */
+
+/***************************************************************************
+ * add_shards:
+ * Split the streams of a multi-station server group across 'shardcount'
+ * parallel connections to the same server.  The additional shards are
+ * inserted after the group, which remains the first shard and holds the
+ * state file of all shards.  A server with fewer streams than
+ * connections gets one connection per stream.
+ *
+ * Returns 0 on success and -1 on error.
+ ***************************************************************************/
+static int
+add_shards (ServerGroup *group)
+{
+  ServerGroup *shard;
+  ServerGroup *prev;
+  SLstream *curstream;
+  SLCD *conn;
+  int count = 0;
+  int sidx;
+
+  for (curstream = group->slconn->streams; curstream; curstream = curstream->next)
+    count++;
+
+  if (!group->slconn->multistation || group->slconn->info || count < 2)
+  {
+    sl_log (1, 1, "[%s] not sharded, requires multiple stations\n",
+            group->slconn->sladdr);
+    return 0;
+  }
+
+  group->numshards = (count < shardcount) ? count : shardcount;
+
+  if ((group->shards = (ServerGroup **)calloc (group->numshards, sizeof (ServerGroup *))) == NULL)
+  {
+    sl_log (2, 0, "add_shards(): error allocating memory\n");
+    return -1;
+  }
+
+  group->shards[0] = group;
+
+  for (sidx = 1, prev = group; sidx < group->numshards; sidx++, prev = shard)
+  {
+    if ((shard = (ServerGroup *)calloc (1, sizeof (ServerGroup))) == NULL ||
+        (shard->slconn = sl_newslcd ()) == NULL)
+    {
+      sl_log (2, 0, "add_shards(): error allocating memory\n");
+      free (shard);
+      return -1;
+    }
+
+    conn = shard->slconn;
+
+    /* Connect to the same server with the same options and time window */
+    conn->sladdr     = strdup (group->slconn->sladdr);
+    conn->begin_time = (group->slconn->begin_time) ? strdup (group->slconn->begin_time) : NULL;
+    conn->end_time   = (group->slconn->end_time) ? strdup (group->slconn->end_time) : NULL;
+    conn->dialup     = group->slconn->dialup;
+    conn->batchmode  = group->slconn->batchmode;
+    conn->pipeline   = group->slconn->pipeline;
+    conn->netto      = group->slconn->netto;
+    conn->netdly     = group->slconn->netdly;
+    conn->keepalive  = group->slconn->keepalive;
+
+    if (rbufsize && sl_setbuffersize (conn, rbufsize) < 0)
+      return -1;
+
+    shard->primary = group;
+    shard->shardid = sidx;
+    shard->next    = prev->next;
+    prev->next     = shard;
+
+    group->shards[sidx] = shard;
+  }
+
+  balance_shards (group, 1);
+
+  sl_log (1, 1, "[%s] %d streams split across %d connections\n",
+          group->slconn->sladdr, count, group->numshards);
+
+  return 0;
+} /* End of add_shards() */
+
+/***************************************************************************
+ * balance_shards:
+ * Distribute the streams of a sharded server across its shards, the
+ * largest first to the least loaded shard.  Each stream weighs one, or
+ * one plus its received packets when balancing by packet rate.
+ *
+ * Unless 'force' is set the streams are only moved if the load of the
+ * most loaded shard drops by more than 10%.  Moving streams reconnects
+ * the open shards, which resume at the sequence numbers of their
+ * streams.
+ *
+ * Returns 1 if the streams were distributed, 0 if not and -1 on error.
+ ***************************************************************************/
+static int
+balance_shards (ServerGroup *group, int force)
+{
+  SLstream **streams;
+  SLstream *curstream;
+  SLstream *head;
+  SLstream *tail;
+  ShardStream *order;
+  int64_t *load;
+  int64_t curmax = 0;
+  int64_t newmax = 0;
+  int64_t weight;
+  int *owner;
+  int count = 0;
+  int best;
+  int sidx;
+  int idx;
+
+  for (sidx = 0; sidx < group->numshards; sidx++)
+    for (curstream = group->shards[sidx]->slconn->streams; curstream; curstream = curstream->next)
+      count++;
+
+  streams = (SLstream **)malloc (count * sizeof (SLstream *));
+  order   = (ShardStream *)malloc (count * sizeof (ShardStream));
+  owner   = (int *)malloc (count * sizeof (int));
+  load    = (int64_t *)calloc (group->numshards, sizeof (int64_t));
+
+  if (!streams || !order || !owner || !load)
+  {
+    sl_log (2, 0, "balance_shards(): error allocating memory\n");
+    free (streams);
+    free (order);
+    free (owner);
+    free (load);
+    return -1;
+  }
+
+  /* Weigh the streams and the current load of each shard */
+  for (idx = 0, sidx = 0; sidx < group->numshards; sidx++)
+  {
+    for (curstream = group->shards[sidx]->slconn->streams; curstream;
+         curstream = curstream->next, idx++)
+    {
+      weight = (shardrate) ? st_stationpackets (curstream->net, curstream->sta) : 0;
+      weight = (weight > 0) ? weight + 1 : 1;
+
+      streams[idx]      = curstream;
+      order[idx].weight = weight;
+      order[idx].index  = idx;
+      load[sidx] += weight;
+    }
+
+    if (load[sidx] > curmax)
+      curmax = load[sidx];
+  }
+
+  /* Assign the largest streams first, each to the least loaded shard */
+  qsort (order, count, sizeof (ShardStream), cmp_shardstream);
+  memset (load, 0, group->numshards * sizeof (int64_t));
+
+  for (idx = 0; idx < count; idx++)
+  {
+    for (best = 0, sidx = 1; sidx < group->numshards; sidx++)
+    {
+      if (load[sidx] < load[best])
+        best = sidx;
+    }
+
+    owner[order[idx].index] = best;
+    load[best] += order[idx].weight;
+
+    if (load[best] > newmax)
+      newmax = load[best];
+  }
+
+  if (!force && newmax * 10 >= curmax * 9)
+  {
+    sl_log (1, 2, "[%s] shards not rebalanced, largest load %lld, balanced %lld\n",
+            group->slconn->sladdr, (long long)curmax, (long long)newmax);
+  }
+  else
+  {
+    /* Rebuild the chain of each shard, keeping the order of the streams */
+    for (sidx = 0; sidx < group->numshards; sidx++)
+    {
+      for (head = tail = NULL, idx = 0; idx < count; idx++)
+      {
+        if (owner[idx] != sidx)
+          continue;
+
+        if (tail)
+          tail->next = streams[idx];
+        else
+          head = streams[idx];
+
+        tail = streams[idx];
+      }
+
+      if (tail)
+        tail->next = NULL;
+
+      sl_setstreams (group->shards[sidx]->slconn, head);
+    }
+
+    if (!force)
+      sl_log (1, 0, "[%s] shards rebalanced by packet rate, largest load %lld, was %lld\n",
+              group->slconn->sladdr, (long long)newmax, (long long)curmax);
+
+    force = 1;
+  }
+
+  free (streams);
+  free (order);
+  free (owner);
+  free (load);
+
+  return (force) ? 1 : 0;
+} /* End of balance_shards() */
+
+/***************************************************************************
+ * watch_shards:
+ * Check the connections of a sharded server and rebalance the shards
+ * by packet rate when a shard that was connected is disconnected.  No
+ * streams are moved while a state snapshot is waiting, in dial-up mode
+ * or when terminating.
+ ***************************************************************************/
+static void
+watch_shards (ServerGroup *group)
+{
+  ServerGroup *shard;
+  int connected;
+  int sidx;
+
+  for (sidx = 0; sidx < group->numshards; sidx++)
+  {
+    shard     = group->shards[sidx];
+    connected = (shard->slconn->link != -1);
+
+    if (shard->connected && !connected)
+      group->rebalance = 1;
+
+    shard->connected = connected;
+  }
+
+  if (group->rebalance && !group->snapshot &&
+      !group->slconn->dialup && !group->slconn->terminate)
+  {
+    group->rebalance = 0;
+
+    /* Rebalancing closes the open shards */
+    if (balance_shards (group, 0) > 0)
+    {
+      for (sidx = 0; sidx < group->numshards; sidx++)
+        group->shards[sidx]->connected = 0;
+    }
+  }
+} /* End of watch_shards() */
+
+/***************************************************************************
+ * join_shards:
+ * Temporarily link the stream chains of all shards of a server to the
+ * chain of the first shard, to save their state to its state file.
+ * Must be followed by split_shards().
+ ***************************************************************************/
+static void
+join_shards (ServerGroup *group)
+{
+  SLstream *tail;
+  int sidx;
+
+  for (sidx = 0; sidx + 1 < group->numshards; sidx++)
+  {
+    for (tail = group->shards[sidx]->slconn->streams; tail->next; tail = tail->next)
+      ;
+
+    tail->next = group->shards[sidx + 1]->slconn->streams;
+
+    group->shards[sidx]->jointail = tail;
+  }
+} /* End of join_shards() */
+
+/***************************************************************************
+ * split_shards:
+ * Restore the stream chains of the shards of a server after
+ * join_shards().
+ ***************************************************************************/
+static void
+split_shards (ServerGroup *group)
+{
+  int sidx;
+
+  for (sidx = 0; sidx + 1 < group->numshards; sidx++)
+  {
+    if (group->shards[sidx]->jointail)
+      group->shards[sidx]->jointail->next = NULL;
+
+    group->shards[sidx]->jointail = NULL;
+  }
+} /* End of split_shards() */
+
+/***************************************************************************
+ * cmp_shardstream:
+ * Order streams by decreasing weight and then by position.
+ ***************************************************************************/
+static int
+cmp_shardstream (const void *a, const void *b)
+{
+  const ShardStream *sa = (const ShardStream *)a;
+  const ShardStream *sb = (const ShardStream *)b;
+
+  if (sa->weight != sb->weight)
+    return (sa->weight > sb->weight) ? -1 : 1;
+
+  return (sa->index > sb->index) - (sa->index < sb->index);
+} /* End of cmp_shardstream() */
 
 /***************************************************************************
  * getoptval:
@@ -804,6 +2087,7 @@ print_stderr (const char *message)
 static void
 report_environ ()
 {
+  ServerGroup *group;
   SLstream *curstream;
 
   sl_log (1, 0, "verbose:\t%d\n", verbose);
@@ -829,68 +2113,73 @@ report_environ ()
   else
     sl_log (1, 0, "'buddir' not defined\n");
 
-  if (statefile)
-    sl_log (1, 0, "statefile:\t%s\n", statefile);
-  else
-    sl_log (1, 0, "'statefile' not defined\n");
+  for (group = groups; group != NULL; group = group->next)
+  {
+    SLCD *conn = group->slconn;
 
-  if (slconn->sladdr)
-    sl_log (1, 0, "sladdr:\t%s\n", slconn->sladdr);
-  else
-    sl_log (1, 0, "'slconn->sladdr' not defined\n");
+    if (group->statefile)
+      sl_log (1, 0, "statefile:\t%s\n", group->statefile);
+    else
+      sl_log (1, 0, "'statefile' not defined\n");
 
-  if (slconn->begin_time)
-    sl_log (1, 0, "slconn->begin_time:\t%s\n", slconn->begin_time);
-  else
-    sl_log (1, 0, "'slconn->begin_time' not defined\n");
-  if (slconn->end_time)
-    sl_log (1, 0, "slconn->end_time:\t%s\n", slconn->end_time);
-  else
-    sl_log (1, 0, "'slconn->end_time' not defined\n");
+    if (conn->sladdr)
+      sl_log (1, 0, "sladdr:\t%s\n", conn->sladdr);
+    else
+      sl_log (1, 0, "'slconn->sladdr' not defined\n");
 
-  sl_log (1, 0, "slconn->dialup:\t%d\n", slconn->dialup);
-  sl_log (1, 0, "slconn->multistation:\t%d\n", slconn->multistation);
+    if (conn->begin_time)
+      sl_log (1, 0, "slconn->begin_time:\t%s\n", conn->begin_time);
+    else
+      sl_log (1, 0, "'slconn->begin_time' not defined\n");
+    if (conn->end_time)
+      sl_log (1, 0, "slconn->end_time:\t%s\n", conn->end_time);
+    else
+      sl_log (1, 0, "'slconn->end_time' not defined\n");
 
-  if (slconn->info)
-    sl_log (1, 0, "slconn->info:\t%s\n", slconn->info);
-  else
-    sl_log (1, 0, "'slconn->info' not defined\n");
+    sl_log (1, 0, "slconn->dialup:\t%d\n", conn->dialup);
+    sl_log (1, 0, "slconn->multistation:\t%d\n", conn->multistation);
 
-  sl_log (1, 0, "keepalive:\t%d\n", slconn->keepalive);
-  sl_log (1, 0, "nettimeout:\t%d\n", slconn->netto);
-  sl_log (1, 0, "netdelay:\t%d\n", slconn->netdly);
+    if (conn->info)
+      sl_log (1, 0, "slconn->info:\t%s\n", conn->info);
+    else
+      sl_log (1, 0, "'slconn->info' not defined\n");
 
-  sl_log (1, 0, "slconn->protocol_ver:\t%f\n", slconn->protocol_ver);
-  sl_log (1, 0, "slconn->link:\t%d\n", slconn->link);
+    sl_log (1, 0, "keepalive:\t%d\n", conn->keepalive);
+    sl_log (1, 0, "nettimeout:\t%d\n", conn->netto);
+    sl_log (1, 0, "netdelay:\t%d\n", conn->netdly);
 
-  curstream = slconn->streams;
+    sl_log (1, 0, "slconn->protocol_ver:\t%f\n", conn->protocol_ver);
+    sl_log (1, 0, "slconn->link:\t%d\n", conn->link);
 
-  sl_log (1, 0, "'streams' array:\n");
-  while (curstream != NULL)
-  {
-    if (curstream->net)
-      sl_log (1, 0, "Sta - net: %s\n", curstream->net);
-    else
-      sl_log (1, 0, "'net' not defined\n");
+    curstream = conn->streams;
 
-    if (curstream->sta)
-      sl_log (1, 0, "Sta - sta: %s\n", curstream->sta);
-    else
-      sl_log (1, 0, "'sta' not defined\n");
+    sl_log (1, 0, "'streams' array:\n");
+    while (curstream != NULL)
+    {
+      if (curstream->net)
+        sl_log (1, 0, "Sta - net: %s\n", curstream->net);
+      else
+        sl_log (1, 0, "'net' not defined\n");
 
-    if (curstream->selectors)
-      sl_log (1, 0, "Sta - selectors: %s\n", curstream->selectors);
-    else
-      sl_log (1, 0, "'selectors' not defined\n");
+      if (curstream->sta)
+        sl_log (1, 0, "Sta - sta: %s\n", curstream->sta);
+      else
+        sl_log (1, 0, "'sta' not defined\n");
 
-    sl_log (1, 0, "Sta - seqnum: %d\n", curstream->seqnum);
+      if (curstream->selectors)
+        sl_log (1, 0, "Sta - selectors: %s\n", curstream->selectors);
+      else
+        sl_log (1, 0, "'selectors' not defined\n");
 
-    if (curstream->timestamp[0] != '\0')
-      sl_log (1, 0, "Sta - timestamp: %s\n", curstream->timestamp);
-    else
-      sl_log (1, 0, "'timestamp' not defined\n");
+      sl_log (1, 0, "Sta - seqnum: %d\n", curstream->seqnum);
 
-    curstream = curstream->next;
+      if (sl_streamtimestamp (curstream)[0] != '\0')
+        sl_log (1, 0, "Sta - timestamp: %s\n", curstream->timestamp);
+      else
+        sl_log (1, 0, "'timestamp' not defined\n");
+
+      curstream = curstream->next;
+    }
   }
 } /* End of report_environ() */
 
@@ -902,7 +2191,10 @@ report_environ ()
 static void
 term_handler (int sig)
 {
-  sl_terminate (slconn);
+  if (slset)
+    sl_terminate_set (slset);
+  else
+    sl_terminate (slconn);
 }
 #endif
 
@@ -914,7 +2206,7 @@ static void
 usage (void)
 {
   fprintf (stderr, "%s version %s\n\n", PACKAGE, VERSION);
-  fprintf (stderr, "Usage: %s [options] [host][:][port]\n\n", PACKAGE);
+  fprintf (stderr, "Usage: %s [options] [host][:][port] [[options] [host][:][port] ...]\n\n", PACKAGE);
   fprintf (stderr,
            " ## General program options ##\n"
            " -V              report program version\n"
@@ -922,14 +2214,25 @@ usage (void)
            " -v              be more verbose, multiple flags can be used\n"
            " -P              ping the server, report the server ID and exit\n"
            " -p              print details of data packets, multiple flags can be used\n"
-           " -u              print unpacked samples of data packets\n\n"
+           " -u              print unpacked samples of data packets\n"
+           " -uf format      write unpacked samples in bulk, format is one of: text,\n"
+           "                   int32, int32net, float32, float32net, framed\n"
+           " -la             print log messages from a background thread\n\n"
            " -nd delay       network re-connect delay (seconds), default 30\n"
            " -nt timeout     network timeout (seconds), re-establish connection if no\n"
            "                   data/keepalives are received in this time, default 600\n"
            " -k interval     send keepalive (heartbeat) packets this often (seconds)\n"
            " -x sfile[:int]  save/restore stream state information to this file\n"
+           " -xb             save state files in a binary format that is updated in\n"
+           "                   place for the streams that changed\n"
            " -d              configure the connection in dial-up mode\n"
            " -b              configure the connection in batch mode\n"
+           " -np             pipeline multi-station negotiation commands\n"
+           " -rb bytes       size of the receive buffer, default 1048576\n"
+           " -K count        split multi-station servers across count connections\n"
+           " -Kb mode        balance the connections by 'stations' (default) or 'rate'\n"
+           " -m [host:]port  serve stream and connection statistics over HTTP\n"
+           " -mf file[:int]  write statistics to this file every int seconds, default 60\n"
            "\n"
            " ## Data stream selection ##\n"
            " -s selectors    selectors for uni-station or default for multi-station mode\n"
@@ -944,10 +2247,43 @@ usage (void)
            "        the end time is optional, but the colon must be present\n"
            "\n"
            " ## Data saving options ##\n"
-           " -o dumpfile     write all received records to this file\n"
+           " -o dumpfile     write all received records to this file, the name\n"
+           "                   may include strftime(3) conversions\n"
+           " -ob bytes       buffer up to this many bytes before writing the dumpfile\n"
+           " -od mode        write the dumpfile with: direct (O_DIRECT), dsync\n"
+           "                   (O_DSYNC) or direct,dsync, default none\n"
+           " -os bytes       rotate the dumpfile before exceeding this size\n"
+           " -ot secs        rotate the dumpfile at this interval\n"
+           " -oi             write an index of the dumpfile records to dumpfile.idx\n"
            " -A format       save all received records is a custom file structure\n"
            " -SDS SDSdir     save all received records in a SDS file structure\n"
            " -BUD BUDdir     save all received data records in a BUD file structure\n"
+           " -wb bytes       buffer up to this many bytes per archive stream before\n"
+           "                   writing, default is to write each record directly\n"
+           " -wt msecs       flush buffered archive records at least this often\n"
+           "                   (milliseconds), 0 to disable, default 1000\n"
+           " -wp mode        preallocate archive files, mode is one of: fallocate\n"
+           "                   (reserve space), mmap (append through a mapping), none\n"
+           " -aio backend    write archive files asynchronously, backend is one of:\n"
+           "                   uring (io_uring), threads (I/O threads), none\n"
+           " -at threads     write records in this many archive threads\n"
+           " -aq slots       size of the archive thread queue, default 4096 packets\n"
+           " -dd             do not archive records archived before (duplicates)\n"
+           " -rp             repack data records into 4096-byte Steim2 records\n"
+           " -rpt secs       maximum time samples are buffered for repacking,\n"
+           "                   0 for no limit, default 300\n"
+           "\n"
+           " ## Packet forwarding options ##\n"
+           " -F sink         forward received packets to a sink, multiple are allowed:\n"
+           "                   udp:host:port    UDP datagrams, unicast or multicast\n"
+           "                   tcp:[host:]port  clients connecting to this port\n"
+           "                   unix:path        clients connecting to this socket\n"
+           " -Fq bytes       queue size of each sink client, default 1048576\n"
+           "\n"
+           " ## Record cache options ##\n"
+           " -R path         cache recent records and serve queries on this Unix socket\n"
+           " -Rs bytes       size of the record cache, default 67108864\n"
+           " -Ra secs        maximum age of cached records, 0 for none, default 600\n"
            "\n"
            " ## Data server  information ## (requires SeedLink >= 3)\n"
            " -i type         send info request, type is one of the following:\n"
@@ -958,8 +2294,13 @@ usage (void)
            " -Q              print formatted stream list (if supported by server)\n"
            " -G              print formatted gap list (if supported by server)\n"
            " -C              print formatted connection list (if supported by server)\n"
+           " -im bytes       limit of the buffered INFO XML, 0 for no limit, default\n"
+           "                   10485760, stream and gap lists are printed per station\n"
            "\n"
            " [host][:][port] Address of the SeedLink server in host:port format\n"
-           "                   Default host is 'localhost' and default port is '18000'\n");
+           "                   Default host is 'localhost' and default port is '18000'\n"
+           "\n"
+           " Multiple servers may be given, the -s, -l, -S, -tw and -x options apply\n"
+           " to the server address following them (the last server if none follows)\n");
 
 } /* End of usage() */
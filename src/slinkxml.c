@@ -6,16 +6,20 @@
  *   Chad Trabant, ORFEUS Data Center/MEREDIAN Project, IRIS/DMC
  *   Andres Heinloo, GFZ Potsdam GEOFON Project
  *
- * modified: 2007.038
+ * modified: 2026.287
  ***************************************************************************/
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include <libslink.h>
 
 #include "slinkxml.h"
 
+static char *ix_tagend (char *tag);
+static int ix_isname (const char *tag, const char *name);
+
 /***************************************************************************
  * prtinfo_identification():
  * Format the specified XML document into an identification summary.
@@ -72,7 +76,7 @@ prtinfo_stations (ezxml_t xmldoc)
 void
 prtinfo_streams (ezxml_t xmldoc)
 {
-  ezxml_t station, stream;
+  ezxml_t station;
   char *rootname = ezxml_name (xmldoc);
 
   if (strcmp (rootname, "seedlink"))
@@ -82,32 +86,41 @@ prtinfo_streams (ezxml_t xmldoc)
   }
 
   for (station = ezxml_child (xmldoc, "station"); station; station = ezxml_next (station))
-  {
-    const char *name, *network, *stream_check;
+    prtinfo_stationstreams (station);
+} /* End of prtinfo_streams() */
 
-    name         = ezxml_attr (station, "name");
-    network      = ezxml_attr (station, "network");
-    stream_check = ezxml_attr (station, "stream_check");
+/***************************************************************************
+ * prtinfo_stationstreams():
+ * Format the specified <station> element into stream list lines.
+ ***************************************************************************/
+void
+prtinfo_stationstreams (ezxml_t station)
+{
+  ezxml_t stream;
+  const char *name, *network, *stream_check;
 
-    if (!strcmp (stream_check, "enabled"))
-    {
-      for (stream = ezxml_child (station, "stream"); stream; stream = ezxml_next (stream))
-      {
-        printf ("%-2s %-5s %-2s %-3s %s %s  -  %s\n", network, name,
-                ezxml_attr (stream, "location"),
-                ezxml_attr (stream, "seedname"),
-                ezxml_attr (stream, "type"),
-                ezxml_attr (stream, "begin_time"),
-                ezxml_attr (stream, "end_time"));
-      }
-    }
-    else
+  name         = ezxml_attr (station, "name");
+  network      = ezxml_attr (station, "network");
+  stream_check = ezxml_attr (station, "stream_check");
+
+  if (!strcmp (stream_check, "enabled"))
+  {
+    for (stream = ezxml_child (station, "stream"); stream; stream = ezxml_next (stream))
     {
-      sl_log (0, 1, "%-2s %-5s: No stream information, stream check disabled\n",
-              network, name);
+      printf ("%-2s %-5s %-2s %-3s %s %s  -  %s\n", network, name,
+              ezxml_attr (stream, "location"),
+              ezxml_attr (stream, "seedname"),
+              ezxml_attr (stream, "type"),
+              ezxml_attr (stream, "begin_time"),
+              ezxml_attr (stream, "end_time"));
     }
   }
-} /* End of prtinfo_streams() */
+  else
+  {
+    sl_log (0, 1, "%-2s %-5s: No stream information, stream check disabled\n",
+            network, name);
+  }
+} /* End of prtinfo_stationstreams() */
 
 /***************************************************************************
  * prtinfo_gaps():
@@ -116,7 +129,7 @@ prtinfo_streams (ezxml_t xmldoc)
 void
 prtinfo_gaps (ezxml_t xmldoc)
 {
-  ezxml_t station, stream, gap;
+  ezxml_t station;
   char *rootname = ezxml_name (xmldoc);
 
   if (strcmp (rootname, "seedlink"))
@@ -126,39 +139,48 @@ prtinfo_gaps (ezxml_t xmldoc)
   }
 
   for (station = ezxml_child (xmldoc, "station"); station; station = ezxml_next (station))
-  {
-    const char *name, *network, *stream_check;
+    prtinfo_stationgaps (station);
+} /* End of prtinfo_gaps() */
+
+/***************************************************************************
+ * prtinfo_stationgaps():
+ * Format the specified <station> element into gap list lines.
+ ***************************************************************************/
+void
+prtinfo_stationgaps (ezxml_t station)
+{
+  ezxml_t stream, gap;
+  const char *name, *network, *stream_check;
 
-    name         = ezxml_attr (station, "name");
-    network      = ezxml_attr (station, "network");
-    stream_check = ezxml_attr (station, "stream_check");
+  name         = ezxml_attr (station, "name");
+  network      = ezxml_attr (station, "network");
+  stream_check = ezxml_attr (station, "stream_check");
 
-    if (!strcmp (stream_check, "enabled"))
+  if (!strcmp (stream_check, "enabled"))
+  {
+    for (stream = ezxml_child (station, "stream"); stream; stream = ezxml_next (stream))
     {
-      for (stream = ezxml_child (station, "stream"); stream; stream = ezxml_next (stream))
-      {
-        const char *location, *seedname, *type;
+      const char *location, *seedname, *type;
 
-        location = ezxml_attr (stream, "location");
-        seedname = ezxml_attr (stream, "seedname");
-        type     = ezxml_attr (stream, "type");
+      location = ezxml_attr (stream, "location");
+      seedname = ezxml_attr (stream, "seedname");
+      type     = ezxml_attr (stream, "type");
 
-        for (gap = ezxml_child (stream, "gap"); gap; gap = ezxml_next (gap))
-        {
-          printf ("%-2s %-5s %-2s %-3s %s %s  -  %s\n", network, name,
-                  location, seedname, type,
-                  ezxml_attr (gap, "begin_time"),
-                  ezxml_attr (gap, "end_time"));
-        }
+      for (gap = ezxml_child (stream, "gap"); gap; gap = ezxml_next (gap))
+      {
+        printf ("%-2s %-5s %-2s %-3s %s %s  -  %s\n", network, name,
+                location, seedname, type,
+                ezxml_attr (gap, "begin_time"),
+                ezxml_attr (gap, "end_time"));
       }
     }
-    else
-    {
-      sl_log (0, 1, "%-2s %-5s: No gap information, stream check disabled\n",
-              network, name);
-    }
   }
-} /* End of prtinfo_gaps() */
+  else
+  {
+    sl_log (0, 1, "%-2s %-5s: No gap information, stream check disabled\n",
+            network, name);
+  }
+} /* End of prtinfo_stationgaps() */
 
 /***************************************************************************
  * prtinfo_connections():
@@ -244,3 +266,226 @@ prtinfo_connections (ezxml_t xmldoc)
     }
   }
 } /* End of prtinfo_connections() */
+
+/***************************************************************************
+ * ix_append():
+ * Append a piece of INFO XML to the buffer, growing the buffer
+ * geometrically so that accumulating a large document stays linear.
+ * Buffering more than maxsize bytes is an error, a maxsize of 0
+ * places no limit on the buffer.
+ *
+ * Returns 0 on success and -1 on error.
+ ***************************************************************************/
+int
+ix_append (InfoXML *ix, const char *xml, size_t length, size_t maxsize)
+{
+  size_t newsize;
+  char *newdata;
+
+  if (maxsize && (ix->length + length) > maxsize)
+  {
+    sl_log (2, 0, "INFO XML beyond the buffer limit of %lu bytes\n",
+            (unsigned long)maxsize);
+    return -1;
+  }
+
+  /* Include room (+1) for the NULL terminator */
+  if ((ix->length + length + 1) > ix->size)
+  {
+    newsize = (ix->size) ? ix->size : IX_MINSIZE;
+
+    while (newsize < (ix->length + length + 1))
+      newsize *= 2;
+
+    if ((newdata = realloc (ix->data, newsize)) == NULL)
+    {
+      sl_log (2, 0, "ix_append(): XML buffer memory allocation error\n");
+      return -1;
+    }
+
+    ix->data = newdata;
+    ix->size = newsize;
+  }
+
+  memcpy (ix->data + ix->length, xml, length);
+  ix->length += length;
+  ix->data[ix->length] = '\0';
+
+  return 0;
+} /* End of ix_append() */
+
+/***************************************************************************
+ * ix_stations():
+ * Process the complete <station> elements in the INFO XML buffer as
+ * they arrive, calling prtstation() for each of them in document
+ * order.  The processed XML is removed from the buffer so that only
+ * an incomplete station element is kept between INFO packets.  If
+ * terminate is set the XML is expected to be complete.
+ *
+ * Returns 0 on success and -1 on error.
+ ***************************************************************************/
+int
+ix_stations (InfoXML *ix, void (*prtstation) (ezxml_t station), int terminate)
+{
+  char *pos, *tag, *close;
+  size_t consumed;
+  ezxml_t station;
+
+  if (!ix->data)
+    return 0;
+
+  pos = ix->data;
+
+  while ((tag = strchr (pos, '<')))
+  {
+    /* Skip processing instructions, comments and closing tags */
+    if (tag[1] == '?')
+    {
+      if ((close = strstr (tag, "?>")))
+        close++;
+    }
+    else if (!strncmp (tag, "<!--", 4))
+    {
+      if ((close = strstr (tag, "-->")))
+        close += 2;
+    }
+    else if ((close = ix_tagend (tag)) && tag[1] != '/' && tag[1] != '!')
+    {
+      if (!ix->root)
+      {
+        if (!ix_isname (tag, "seedlink"))
+        {
+          sl_log (1, 0, "XML INFO root tag is not <seedlink>, invalid data\n");
+          return -1;
+        }
+
+        ix->root = 1;
+      }
+      else if (ix_isname (tag, "station") && close[-1] != '/')
+      {
+        /* Find the end of the station element, resuming a previous search */
+        char *search = ix->data + ix->resume;
+
+        if (search < close)
+          search = close;
+
+        if ((close = strstr (search, "</station")))
+        {
+          close = ix_tagend (close);
+        }
+        else
+        {
+          ix->resume = ix->length - strlen ("</station");
+        }
+
+        if (!close)
+          break;
+      }
+
+      if (ix_isname (tag, "station"))
+      {
+        if ((station = ezxml_parse_str (tag, close - tag + 1)) == NULL)
+        {
+          sl_log (2, 0, "XML parse error\n");
+          return -1;
+        }
+
+        prtstation (station);
+        ezxml_free (station);
+      }
+    }
+
+    if (!close)
+      break;
+
+    pos = close + 1;
+  }
+
+  if (terminate)
+  {
+    if (tag || !ix->root)
+    {
+      sl_log (2, 0, "XML parse error, INFO XML is not complete\n");
+      return -1;
+    }
+
+    return 0;
+  }
+
+  /* Shift the unprocessed XML to the beginning of the buffer */
+  consumed = pos - ix->data;
+
+  if (consumed)
+  {
+    memmove (ix->data, pos, ix->length - consumed + 1);
+    ix->length -= consumed;
+    ix->resume = (ix->resume > consumed) ? ix->resume - consumed : 0;
+  }
+
+  return 0;
+} /* End of ix_stations() */
+
+/***************************************************************************
+ * ix_free():
+ * Release the INFO XML buffer and reset it for the next document.
+ ***************************************************************************/
+void
+ix_free (InfoXML *ix)
+{
+  if (ix->data)
+    free (ix->data);
+
+  memset (ix, 0, sizeof (InfoXML));
+} /* End of ix_free() */
+
+/***************************************************************************
+ * ix_tagend():
+ * Find the '>' ending the tag beginning at tag, skipping over quoted
+ * attribute values.
+ *
+ * Returns a pointer to the '>' or NULL if the tag is not complete.
+ ***************************************************************************/
+static char *
+ix_tagend (char *tag)
+{
+  char quote = 0;
+
+  for (tag++; *tag; tag++)
+  {
+    if (quote)
+    {
+      if (*tag == quote)
+        quote = 0;
+    }
+    else if (*tag == '"' || *tag == '\'')
+    {
+      quote = *tag;
+    }
+    else if (*tag == '>')
+    {
+      return tag;
+    }
+  }
+
+  return NULL;
+} /* End of ix_tagend() */
+
+/***************************************************************************
+ * ix_isname():
+ * Test if the opening tag beginning at tag is for an element named name.
+ *
+ * Returns 1 if it is, otherwise 0.
+ ***************************************************************************/
+static int
+ix_isname (const char *tag, const char *name)
+{
+  size_t length = strlen (name);
+
+  if (strncmp (tag + 1, name, length))
+    return 0;
+
+  tag += length + 1;
+
+  return (*tag == '>' || *tag == '/' || *tag == ' ' || *tag == '\t' ||
+          *tag == '\r' || *tag == '\n');
+} /* End of ix_isname() */
@@ -9,10 +9,31 @@ extern "C"
 {
 #endif
 
+/* Initial allocation and default limit of the INFO XML buffer (bytes) */
+#define IX_MINSIZE 65536
+#define IX_DEFMAXSIZE 10485760
+
+/* INFO XML received so far, accumulated over the INFO packets */
+typedef struct InfoXML_s
+{
+  char   *data;       /* XML not yet processed, NULL terminated */
+  size_t  length;     /* length of the XML in data */
+  size_t  size;       /* allocated size of data */
+  size_t  resume;     /* offset at which to resume a closing tag search */
+  int     root;       /* flag: the <seedlink> root tag has been seen */
+} InfoXML;
+
+extern int ix_append(InfoXML *ix, const char *xml, size_t length, size_t maxsize);
+extern int ix_stations(InfoXML *ix, void (*prtstation) (ezxml_t station),
+                       int terminate);
+extern void ix_free(InfoXML *ix);
+
 extern void prtinfo_identification(ezxml_t xmldoc);
 extern void prtinfo_stations(ezxml_t xmldoc);
 extern void prtinfo_streams(ezxml_t xmldoc);
+extern void prtinfo_stationstreams(ezxml_t station);
 extern void prtinfo_gaps(ezxml_t xmldoc);
+extern void prtinfo_stationgaps(ezxml_t station);
 extern void prtinfo_connections(ezxml_t xmldoc);
 
 #ifdef __cplusplus
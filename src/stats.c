@@ -0,0 +1,1265 @@
+/***************************************************************************
+ * stats.c
+ *
+ * Stream, connection and archive statistics and their export in the
+ * Prometheus text format, served over HTTP and/or written to a file
+ * periodically.
+ *
+ * Counters are kept per station (packets, bytes and sequence number
+ * gaps) and per channel (packets, bytes, out-of-order records and
+ * histograms of the data and feed latency).  The counters are updated
+ * by the thread handling the packets with relaxed atomic stores and
+ * read by the exporter thread with atomic loads, no locks are taken.
+ *
+ * Entries are found with hash tables only used by the updating thread.
+ * New entries are pushed on lists published with release stores and
+ * are never freed while the exporter runs, so the exporter can walk
+ * the lists at any time.
+ *
+ * The counters of the record cache and of the duplicate suppression, if
+ * used, are copied from their modules when the statistics are exported.
+ *
+ * Histograms use base-2 buckets, the bucket of a value is found from
+ * its bit length; the latencies in milliseconds start with a bucket
+ * of 16 ms, the archive write times in microseconds with 4 us.
+ *
+ * modified: 2026.287
+ ***************************************************************************/
+
+#include <errno.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <libslink.h>
+
+#include "dedup.h"
+#include "rcache.h"
+#include "stats.h"
+
+#ifndef SLP_WIN
+#include <netdb.h>
+#include <poll.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+/* Update a counter only modified by a single thread */
+#define ST_ADD(C, N) __atomic_store_n (&(C), (C) + (N), __ATOMIC_RELAXED)
+#define ST_LOAD(C) __atomic_load_n (&(C), __ATOMIC_RELAXED)
+
+/* Bit length of the lower bound of the first bucket of the histograms */
+#define ST_LATENCYSHIFT 4
+#define ST_ARCHIVESHIFT 2
+
+/* A histogram, the last bucket counts values above all bounds */
+typedef struct StHistogram_s
+{
+  int64_t count[ST_BUCKETS + 1];
+  int64_t sum;
+}
+StHistogram;
+
+/* A station, the key is the station and network codes */
+typedef struct StStation_s
+{
+  char    key[12];
+  int     lastseq;       /* Last sequence number or -1 */
+  int64_t packets;
+  int64_t bytes;
+  int64_t seqgaps;       /* Number of sequence number breaks */
+  struct StStation_s *next;
+}
+StStation;
+
+/* A channel, the key is the station, location, channel and network codes */
+typedef struct StChannel_s
+{
+  char    key[12];
+  StStation *station;
+  int64_t laststart;     /* Latest start time, see st_timekey() */
+  double  lastarrival;   /* Arrival time of the last data record */
+  int64_t packets;
+  int64_t bytes;
+  int64_t outoforder;    /* Records starting before an earlier record */
+  StHistogram datalatency;
+  StHistogram feedlatency;
+  struct StChannel_s *next;
+}
+StChannel;
+
+/* A connection, counters copied from the SLconnstats of the connection */
+typedef struct StConnection_s
+{
+  char   *server;
+  int     id;
+  int     connected;
+  SLconnstats stats;
+  struct StConnection_s *next;
+}
+StConnection;
+
+/* A hash table of entries starting with their key */
+typedef struct StTable_s
+{
+  void  **slots;
+  int     size;          /* Number of slots, a power of 2 */
+  int     count;
+  int     keylen;
+}
+StTable;
+
+/* A growing output buffer */
+typedef struct StBuffer_s
+{
+  char   *data;
+  size_t  length;
+  size_t  size;
+}
+StBuffer;
+
+static struct
+{
+  int     enabled;
+  StTable stations;
+  StTable channels;
+  StStation *stationlist;
+  StChannel *channellist;
+  StConnection *connlist;
+  int     numconns;
+  StHistogram archive;
+  char   *file;          /* File to write periodically */
+  int     interval;      /* File write interval (seconds) */
+  int     listenfd;      /* HTTP listening socket or -1 */
+  int     wakefd[2];     /* Pipe to stop the exporter thread */
+  pthread_t thread;
+  StBuffer output;
+} st = {0};
+
+static void *st_exporter (void *arg);
+static void st_serve (int fd);
+static int st_writefile (void);
+static void st_render (StBuffer *out);
+static void st_histogram (StBuffer *out, const char *name,
+                          const char *labels, StHistogram *hist,
+                          int shift, double scale);
+static void st_printf (StBuffer *out, const char *format, ...);
+static void st_label (char *dst, const char *src, int length);
+static void st_observe (StHistogram *hist, int64_t value, int shift);
+static int64_t st_timekey (const struct sl_btime_s *btime);
+static void *st_lookup (StTable *table, const char *key);
+static int st_insert (StTable *table, void *entry);
+static StChannel *st_newchannel (const char *key);
+static int st_listen (const char *address);
+
+/***************************************************************************
+ * st_start:
+ *
+ * Start collecting statistics and the exporter thread.  If 'address'
+ * is not NULL the statistics are served over HTTP at the [host:]port
+ * it specifies, if 'file' is not NULL they are written to the file
+ * every 'interval' seconds, replacing it atomically.
+ *
+ * Returns 0 on success and -1 on error.
+ ***************************************************************************/
+int
+st_start (const char *address, const char *file, int interval)
+{
+  st.listenfd  = -1;
+  st.wakefd[0] = -1;
+  st.wakefd[1] = -1;
+
+  st.stations.keylen = 7;
+  st.channels.keylen = 12;
+
+  if (file && interval <= 0)
+  {
+    sl_log (2, 0, "invalid statistics file interval: %d\n", interval);
+    return -1;
+  }
+
+  if (address && (st.listenfd = st_listen (address)) < 0)
+    return -1;
+
+  if (file && (st.file = strdup (file)) == NULL)
+  {
+    sl_log (2, 0, "cannot allocate memory for statistics\n");
+    return -1;
+  }
+
+  st.interval = interval;
+
+  if (pipe (st.wakefd))
+  {
+    sl_log (2, 0, "cannot create pipe: %s\n", strerror (errno));
+    return -1;
+  }
+
+  st.enabled = 1;
+
+  if (pthread_create (&st.thread, NULL, st_exporter, NULL))
+  {
+    sl_log (2, 0, "cannot start statistics thread\n");
+    st.enabled = 0;
+    return -1;
+  }
+
+  return 0;
+} /* End of st_start() */
+
+/***************************************************************************
+ * st_stop:
+ *
+ * Stop the exporter thread, write the statistics file a last time and
+ * free all entries.
+ ***************************************************************************/
+void
+st_stop (void)
+{
+  StStation *station;
+  StChannel *channel;
+  StConnection *conn;
+  void *next;
+
+  if (!st.enabled)
+    return;
+
+  if (write (st.wakefd[1], "", 1) != 1)
+  {
+    sl_log (2, 0, "cannot stop statistics thread: %s\n", strerror (errno));
+    return;
+  }
+
+  pthread_join (st.thread, NULL);
+
+  st.enabled = 0;
+
+  if (st.file)
+    st_writefile ();
+
+  if (st.listenfd >= 0)
+    close (st.listenfd);
+
+  close (st.wakefd[0]);
+  close (st.wakefd[1]);
+
+  for (station = st.stationlist; station; station = next)
+  {
+    next = station->next;
+    free (station);
+  }
+
+  for (channel = st.channellist; channel; channel = next)
+  {
+    next = channel->next;
+    free (channel);
+  }
+
+  for (conn = st.connlist; conn; conn = next)
+  {
+    next = conn->next;
+    free (conn->server);
+    free (conn);
+  }
+
+  free (st.stations.slots);
+  free (st.channels.slots);
+  free (st.output.data);
+  free (st.file);
+} /* End of st_stop() */
+
+/***************************************************************************
+ * st_packet:
+ *
+ * Count a received packet of the station and channel of its header.
+ * For data records also track the order of start times and the data
+ * latency, the time from the end of the record to its arrival time
+ * 'now', and the feed latency, the time since the previous record of
+ * the channel arrived.
+ *
+ * Must always be called by the same thread.
+ ***************************************************************************/
+void
+st_packet (SLMSheader *msh, int packet_type, int seqnum, int packet_size,
+           double now)
+{
+  StChannel *channel;
+  StStation *station;
+  int64_t start;
+
+  if (!st.enabled)
+    return;
+
+  if ((channel = st_lookup (&st.channels, msh->fsdh->station)) == NULL &&
+      (channel = st_newchannel (msh->fsdh->station)) == NULL)
+    return;
+
+  station = channel->station;
+
+  ST_ADD (station->packets, 1);
+  ST_ADD (station->bytes, packet_size);
+
+  if (seqnum >= 0)
+  {
+    if (station->lastseq >= 0 && seqnum != ((station->lastseq + 1) & 0xFFFFFF))
+      ST_ADD (station->seqgaps, 1);
+
+    station->lastseq = seqnum;
+  }
+
+  ST_ADD (channel->packets, 1);
+  ST_ADD (channel->bytes, packet_size);
+
+  if (packet_type != SLDATA)
+    return;
+
+  start = st_timekey (sl_msh_starttime (msh));
+
+  if (start < channel->laststart)
+    ST_ADD (channel->outoforder, 1);
+  else
+    channel->laststart = start;
+
+  if (sl_msh_numsamples (msh) > 0)
+    st_observe (&channel->datalatency,
+                (int64_t) ((now - sl_msh_depochetime (msh)) * 1000.0),
+                ST_LATENCYSHIFT);
+
+  if (channel->lastarrival > 0.0)
+    st_observe (&channel->feedlatency,
+                (int64_t) ((now - channel->lastarrival) * 1000.0),
+                ST_LATENCYSHIFT);
+
+  channel->lastarrival = now;
+} /* End of st_packet() */
+
+/***************************************************************************
+ * st_addconnection:
+ *
+ * Add a connection to the statistics, 'server' is its address.
+ *
+ * Returns the identifier of the connection for st_connection() or -1
+ * on error.
+ ***************************************************************************/
+int
+st_addconnection (const char *server)
+{
+  StConnection *conn;
+
+  if ((conn = (StConnection *)calloc (1, sizeof (StConnection))) == NULL ||
+      (conn->server = strdup (server)) == NULL)
+  {
+    sl_log (2, 0, "cannot allocate memory for statistics\n");
+    free (conn);
+    return -1;
+  }
+
+  conn->id   = st.numconns++;
+  conn->next = st.connlist;
+
+  __atomic_store_n (&st.connlist, conn, __ATOMIC_RELEASE);
+
+  return conn->id;
+} /* End of st_addconnection() */
+
+/***************************************************************************
+ * st_connection:
+ *
+ * Update the statistics of connection 'id' from the statistics of its
+ * SeedLink connection, 'connected' is set while the link is open.
+ *
+ * Must always be called by the same thread.
+ ***************************************************************************/
+void
+st_connection (int id, const SLconnstats *stats, int connected)
+{
+  StConnection *conn;
+
+  if (!st.enabled)
+    return;
+
+  for (conn = st.connlist; conn; conn = conn->next)
+  {
+    if (conn->id == id)
+      break;
+  }
+
+  if (!conn)
+    return;
+
+  __atomic_store_n (&conn->connected, connected, __ATOMIC_RELAXED);
+  __atomic_store_n (&conn->stats.connattempts, stats->connattempts, __ATOMIC_RELAXED);
+  __atomic_store_n (&conn->stats.connects, stats->connects, __ATOMIC_RELAXED);
+  __atomic_store_n (&conn->stats.negfailures, stats->negfailures, __ATOMIC_RELAXED);
+  __atomic_store_n (&conn->stats.timeouts, stats->timeouts, __ATOMIC_RELAXED);
+  __atomic_store_n (&conn->stats.packets, stats->packets, __ATOMIC_RELAXED);
+  __atomic_store_n (&conn->stats.bytes, stats->bytes, __ATOMIC_RELAXED);
+  __atomic_store (&conn->stats.negtime, &stats->negtime, __ATOMIC_RELAXED);
+  __atomic_store (&conn->stats.negtimetotal, &stats->negtimetotal, __ATOMIC_RELAXED);
+} /* End of st_connection() */
+
+/***************************************************************************
+ * st_stationpackets:
+ *
+ * Find the number of packets received for a station.
+ *
+ * Must be called by the thread updating the statistics.
+ *
+ * Returns the packet count or -1 if the station is not known.
+ ***************************************************************************/
+int64_t
+st_stationpackets (const char *net, const char *sta)
+{
+  StStation *station;
+  char key[7];
+  size_t length;
+
+  if (!st.enabled)
+    return -1;
+
+  memset (key, ' ', sizeof (key));
+
+  if ((length = strlen (sta)) > 5)
+    return -1;
+  memcpy (key, sta, length);
+
+  if ((length = strlen (net)) > 2)
+    return -1;
+  memcpy (key + 5, net, length);
+
+  if ((station = st_lookup (&st.stations, key)) == NULL)
+    return -1;
+
+  return station->packets;
+} /* End of st_stationpackets() */
+
+/***************************************************************************
+ * st_clock:
+ *
+ * Returns a monotonic time in nanoseconds for st_archive() or 0 if
+ * statistics are not collected.
+ ***************************************************************************/
+int64_t
+st_clock (void)
+{
+  struct timespec ts;
+
+  if (!st.enabled)
+    return 0;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+
+  return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+} /* End of st_clock() */
+
+/***************************************************************************
+ * st_archive:
+ *
+ * Add the time since 'start', from st_clock(), to the histogram of
+ * archive write times.  May be called by any thread.
+ ***************************************************************************/
+void
+st_archive (int64_t start)
+{
+  int64_t usec;
+  int idx;
+
+  if (!st.enabled)
+    return;
+
+  usec = (st_clock () - start) / 1000;
+  idx  = (usec > 0) ? 64 - __builtin_clzll ((uint64_t)usec) - ST_ARCHIVESHIFT : 0;
+
+  if (idx < 0)
+    idx = 0;
+  else if (idx > ST_BUCKETS)
+    idx = ST_BUCKETS;
+
+  __atomic_fetch_add (&st.archive.count[idx], 1, __ATOMIC_RELAXED);
+  __atomic_fetch_add (&st.archive.sum, usec, __ATOMIC_RELAXED);
+} /* End of st_archive() */
+
+/***************************************************************************
+ * st_exporter:
+ *
+ * Exporter thread, serves HTTP requests and writes the statistics file
+ * until st_stop() writes to the wake pipe.
+ ***************************************************************************/
+static void *
+st_exporter (void *arg)
+{
+  struct pollfd fds[2];
+  double nextwrite = sl_dtime () + st.interval;
+  double now;
+  int timeout;
+  int nfds;
+  int fd;
+
+  fds[0].fd     = st.wakefd[0];
+  fds[0].events = POLLIN;
+  fds[1].fd     = st.listenfd;
+  fds[1].events = POLLIN;
+  nfds          = (st.listenfd >= 0) ? 2 : 1;
+
+  for (;;)
+  {
+    timeout = -1;
+
+    if (st.file)
+    {
+      now     = sl_dtime ();
+      timeout = (now < nextwrite) ? (int)((nextwrite - now) * 1000.0) + 1 : 0;
+    }
+
+    if (poll (fds, nfds, timeout) < 0 && errno != EINTR)
+    {
+      sl_log (2, 0, "poll(): %s\n", strerror (errno));
+      break;
+    }
+
+    if (fds[0].revents)
+      break;
+
+    if (nfds > 1 && (fds[1].revents & POLLIN))
+    {
+      if ((fd = accept (st.listenfd, NULL, NULL)) >= 0)
+      {
+        st_serve (fd);
+        close (fd);
+      }
+    }
+
+    if (st.file && sl_dtime () >= nextwrite)
+    {
+      st_writefile ();
+      nextwrite = sl_dtime () + st.interval;
+    }
+  }
+
+  return NULL;
+} /* End of st_exporter() */
+
+/***************************************************************************
+ * st_serve:
+ *
+ * Read an HTTP request from 'fd' and send the statistics for a GET of
+ * "/" or "/metrics".
+ ***************************************************************************/
+static void
+st_serve (int fd)
+{
+  struct timeval tv = {2, 0};
+  char request[2048];
+  char header[200];
+  const char *status = "200 OK";
+  size_t length = 0;
+  size_t sent;
+  ssize_t bytes;
+  int hlength;
+
+  setsockopt (fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof (tv));
+  setsockopt (fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof (tv));
+
+  /* Read the request line and headers */
+  while (length < sizeof (request) - 1)
+  {
+    if ((bytes = recv (fd, request + length, sizeof (request) - 1 - length, 0)) <= 0)
+      return;
+
+    length += bytes;
+    request[length] = '\0';
+
+    if (strstr (request, "\r\n\r\n") || strstr (request, "\n\n"))
+      break;
+  }
+
+  st.output.length = 0;
+
+  if (strncmp (request, "GET ", 4))
+  {
+    status = "405 Method Not Allowed";
+  }
+  else if (strncmp (request + 4, "/ ", 2) && strncmp (request + 4, "/metrics ", 9) &&
+           strncmp (request + 4, "/metrics?", 9))
+  {
+    status = "404 Not Found";
+  }
+  else
+  {
+    st_render (&st.output);
+  }
+
+  hlength = snprintf (header, sizeof (header),
+                      "HTTP/1.0 %s\r\n"
+                      "Content-Type: text/plain; version=0.0.4\r\n"
+                      "Content-Length: %lu\r\n"
+                      "Connection: close\r\n\r\n",
+                      status, (unsigned long)st.output.length);
+
+  if (send (fd, header, hlength, MSG_NOSIGNAL) != hlength)
+    return;
+
+  for (sent = 0; sent < st.output.length; sent += bytes)
+  {
+    if ((bytes = send (fd, st.output.data + sent, st.output.length - sent,
+                       MSG_NOSIGNAL)) <= 0)
+      return;
+  }
+} /* End of st_serve() */
+
+/***************************************************************************
+ * st_writefile:
+ *
+ * Write the statistics to a temporary file and rename it to the
+ * statistics file.
+ *
+ * Returns 0 on success and -1 on error.
+ ***************************************************************************/
+static int
+st_writefile (void)
+{
+  char tmpfile[1024];
+  FILE *fp;
+
+  snprintf (tmpfile, sizeof (tmpfile), "%s.tmp", st.file);
+
+  st.output.length = 0;
+  st_render (&st.output);
+
+  if ((fp = fopen (tmpfile, "wb")) == NULL)
+  {
+    sl_log (2, 0, "cannot open statistics file %s: %s\n", tmpfile, strerror (errno));
+    return -1;
+  }
+
+  if ((st.output.length && fwrite (st.output.data, st.output.length, 1, fp) != 1) ||
+      fclose (fp))
+  {
+    sl_log (2, 0, "cannot write statistics file %s: %s\n", tmpfile, strerror (errno));
+    return -1;
+  }
+
+  if (rename (tmpfile, st.file))
+  {
+    sl_log (2, 0, "cannot rename %s to %s: %s\n", tmpfile, st.file, strerror (errno));
+    return -1;
+  }
+
+  return 0;
+} /* End of st_writefile() */
+
+/***************************************************************************
+ * st_render:
+ *
+ * Format all statistics in the Prometheus text format.
+ ***************************************************************************/
+static void
+st_render (StBuffer *out)
+{
+  StStation *stations;
+  StStation *station;
+  StChannel *channels;
+  StChannel *channel;
+  StConnection *conns;
+  StConnection *conn;
+  RcCounters cache;
+  DdCounters dedup;
+  char labels[200];
+  char server[200];
+  char net[3], sta[6], loc[3], chan[4];
+  double value;
+  int idx;
+
+  const char *stationfields[][2] = {
+      {"packets_total", "Number of packets received"},
+      {"bytes_total", "Number of bytes received"},
+      {"sequence_gaps_total", "Number of breaks in the packet sequence numbers"}};
+  const char *channelfields[][2] = {
+      {"packets_total", "Number of packets received"},
+      {"bytes_total", "Number of bytes received"},
+      {"out_of_order_total", "Number of records starting before an earlier record"}};
+  const char *connfields[][3] = {
+      {"up", "gauge", "Whether the connection is open"},
+      {"attempts_total", "counter", "Number of connection attempts"},
+      {"connects_total", "counter", "Number of established connections"},
+      {"negotiation_failures_total", "counter", "Number of failed negotiations"},
+      {"timeouts_total", "counter", "Number of network timeouts"},
+      {"packets_total", "counter", "Number of packets received"},
+      {"bytes_total", "counter", "Number of bytes received"},
+      {"negotiation_seconds", "gauge", "Duration of the last negotiation"},
+      {"negotiation_seconds_total", "counter", "Total duration of negotiations"}};
+  const char *dedupfields[][2] = {
+      {"records_total", "Number of records checked before archiving"},
+      {"dropped_total", "Number of records not archived as they were archived before"},
+      {"out_of_order_total", "Number of records with a sequence number below the latest"},
+      {"sequence_gaps_total", "Number of breaks in the sequence numbers of the archived records"}};
+  const char *cachefields[][3] = {
+      {"records_total", "counter", "Number of records added to the cache"},
+      {"evictions_total", "counter", "Number of records evicted from the cache"},
+      {"queries_total", "counter", "Number of cache queries answered"},
+      {"hits_total", "counter", "Number of cache queries answered with records"},
+      {"misses_total", "counter", "Number of cache queries without matching records"},
+      {"served_records_total", "counter", "Number of records sent to cache clients"},
+      {"records", "gauge", "Number of records in the cache"},
+      {"bytes", "gauge", "Number of bytes of the records in the cache"},
+      {"channels", "gauge", "Number of channels with records in the cache"}};
+
+  stations = __atomic_load_n (&st.stationlist, __ATOMIC_ACQUIRE);
+  channels = __atomic_load_n (&st.channellist, __ATOMIC_ACQUIRE);
+  conns    = __atomic_load_n (&st.connlist, __ATOMIC_ACQUIRE);
+
+  /* Station counters */
+  for (idx = 0; idx < 3; idx++)
+  {
+    st_printf (out, "# HELP slinktool_station_%s %s\n"
+                    "# TYPE slinktool_station_%s counter\n",
+               stationfields[idx][0], stationfields[idx][1],
+               stationfields[idx][0]);
+
+    for (station = stations; station; station = station->next)
+    {
+      st_label (sta, station->key, 5);
+      st_label (net, station->key + 5, 2);
+
+      st_printf (out, "slinktool_station_%s{network=\"%s\",station=\"%s\"} %lld\n",
+                 stationfields[idx][0], net, sta,
+                 (long long)((idx == 0) ? ST_LOAD (station->packets) :
+                             (idx == 1) ? ST_LOAD (station->bytes) :
+                                          ST_LOAD (station->seqgaps)));
+    }
+  }
+
+  /* Channel counters and latency histograms */
+  for (idx = 0; idx < 5; idx++)
+  {
+    if (idx < 3)
+      st_printf (out, "# HELP slinktool_channel_%s %s\n"
+                      "# TYPE slinktool_channel_%s counter\n",
+                 channelfields[idx][0], channelfields[idx][1],
+                 channelfields[idx][0]);
+    else if (idx == 3)
+      st_printf (out, "# HELP slinktool_channel_data_latency_seconds "
+                      "Time from the end of a record to its arrival\n"
+                      "# TYPE slinktool_channel_data_latency_seconds histogram\n");
+    else
+      st_printf (out, "# HELP slinktool_channel_feed_latency_seconds "
+                      "Time between the arrival of records\n"
+                      "# TYPE slinktool_channel_feed_latency_seconds histogram\n");
+
+    for (channel = channels; channel; channel = channel->next)
+    {
+      st_label (sta, channel->key, 5);
+      st_label (loc, channel->key + 5, 2);
+      st_label (chan, channel->key + 7, 3);
+      st_label (net, channel->key + 10, 2);
+
+      snprintf (labels, sizeof (labels),
+                "network=\"%s\",station=\"%s\",location=\"%s\",channel=\"%s\"",
+                net, sta, loc, chan);
+
+      if (idx < 3)
+        st_printf (out, "slinktool_channel_%s{%s} %lld\n",
+                   channelfields[idx][0], labels,
+                   (long long)((idx == 0) ? ST_LOAD (channel->packets) :
+                               (idx == 1) ? ST_LOAD (channel->bytes) :
+                                            ST_LOAD (channel->outoforder)));
+      else
+        st_histogram (out, (idx == 3) ? "slinktool_channel_data_latency_seconds" :
+                                        "slinktool_channel_feed_latency_seconds",
+                      labels,
+                      (idx == 3) ? &channel->datalatency : &channel->feedlatency,
+                      ST_LATENCYSHIFT, 0.001);
+    }
+  }
+
+  /* Connection counters */
+  for (idx = 0; idx < 9; idx++)
+  {
+    st_printf (out, "# HELP slinktool_connection_%s %s\n"
+                    "# TYPE slinktool_connection_%s %s\n",
+               connfields[idx][0], connfields[idx][2],
+               connfields[idx][0], connfields[idx][1]);
+
+    for (conn = conns; conn; conn = conn->next)
+    {
+      st_label (server, conn->server, sizeof (server) - 1);
+
+      if (idx == 7)
+        __atomic_load (&conn->stats.negtime, &value, __ATOMIC_RELAXED);
+      else if (idx == 8)
+        __atomic_load (&conn->stats.negtimetotal, &value, __ATOMIC_RELAXED);
+      else
+        value = (idx == 0) ? ST_LOAD (conn->connected) :
+                (idx == 1) ? ST_LOAD (conn->stats.connattempts) :
+                (idx == 2) ? ST_LOAD (conn->stats.connects) :
+                (idx == 3) ? ST_LOAD (conn->stats.negfailures) :
+                (idx == 4) ? ST_LOAD (conn->stats.timeouts) :
+                (idx == 5) ? ST_LOAD (conn->stats.packets) :
+                             ST_LOAD (conn->stats.bytes);
+
+      st_printf (out, "slinktool_connection_%s{server=\"%s\"} %.9g\n",
+                 connfields[idx][0], server, value);
+    }
+  }
+
+  /* Archive write times */
+  st_printf (out, "# HELP slinktool_archive_write_seconds "
+                  "Time to write a record to the archives\n"
+                  "# TYPE slinktool_archive_write_seconds histogram\n");
+  st_histogram (out, "slinktool_archive_write_seconds", NULL, &st.archive,
+                ST_ARCHIVESHIFT, 0.000001);
+
+  /* Record cache counters, if the cache is used */
+  if (!rc_counters (&cache))
+  {
+    for (idx = 0; idx < 9; idx++)
+    {
+      st_printf (out, "# HELP slinktool_cache_%s %s\n"
+                      "# TYPE slinktool_cache_%s %s\n",
+                 cachefields[idx][0], cachefields[idx][2],
+                 cachefields[idx][0], cachefields[idx][1]);
+
+      if (idx == 1)
+        st_printf (out, "slinktool_cache_evictions_total{reason=\"age\"} %lld\n"
+                        "slinktool_cache_evictions_total{reason=\"size\"} %lld\n",
+                   (long long)cache.ageevictions, (long long)cache.sizeevictions);
+      else
+        st_printf (out, "slinktool_cache_%s %lld\n", cachefields[idx][0],
+                   (long long)((idx == 0) ? cache.records :
+                               (idx == 2) ? cache.queries :
+                               (idx == 3) ? cache.hits :
+                               (idx == 4) ? cache.misses :
+                               (idx == 5) ? cache.served :
+                               (idx == 6) ? cache.cached :
+                               (idx == 7) ? cache.bytes :
+                                            cache.channels));
+    }
+  }
+
+  /* Duplicate suppression counters, if records are checked */
+  if (!dd_counters (&dedup))
+  {
+    for (idx = 0; idx < 4; idx++)
+    {
+      st_printf (out, "# HELP slinktool_dedup_%s %s\n"
+                      "# TYPE slinktool_dedup_%s counter\n",
+                 dedupfields[idx][0], dedupfields[idx][1], dedupfields[idx][0]);
+
+      if (idx == 1)
+        st_printf (out, "slinktool_dedup_dropped_total{reason=\"sequence\"} %lld\n"
+                        "slinktool_dedup_dropped_total{reason=\"overlap\"} %lld\n",
+                   (long long)dedup.duplicates, (long long)dedup.overlaps);
+      else
+        st_printf (out, "slinktool_dedup_%s %lld\n", dedupfields[idx][0],
+                   (long long)((idx == 0) ? dedup.records :
+                               (idx == 2) ? dedup.outoforder :
+                                            dedup.gaps));
+    }
+  }
+} /* End of st_render() */
+
+/***************************************************************************
+ * st_histogram:
+ *
+ * Format the cumulative buckets, sum and count of a histogram, bucket
+ * bounds and the sum are multiplied by 'scale' to convert to seconds.
+ ***************************************************************************/
+static void
+st_histogram (StBuffer *out, const char *name, const char *labels,
+              StHistogram *hist, int shift, double scale)
+{
+  const char *sep = (labels) ? "," : "";
+  int64_t total = 0;
+  int idx;
+
+  if (!labels)
+    labels = "";
+
+  for (idx = 0; idx < ST_BUCKETS; idx++)
+  {
+    total += ST_LOAD (hist->count[idx]);
+
+    st_printf (out, "%s_bucket{%s%sle=\"%g\"} %lld\n", name, labels, sep,
+               (double)((int64_t)1 << (idx + shift)) * scale, (long long)total);
+  }
+
+  total += ST_LOAD (hist->count[ST_BUCKETS]);
+
+  st_printf (out, "%s_bucket{%s%sle=\"+Inf\"} %lld\n", name, labels, sep,
+             (long long)total);
+
+  if (*labels)
+  {
+    st_printf (out, "%s_sum{%s} %.9g\n", name, labels,
+               (double)ST_LOAD (hist->sum) * scale);
+    st_printf (out, "%s_count{%s} %lld\n", name, labels, (long long)total);
+  }
+  else
+  {
+    st_printf (out, "%s_sum %.9g\n", name, (double)ST_LOAD (hist->sum) * scale);
+    st_printf (out, "%s_count %lld\n", name, (long long)total);
+  }
+} /* End of st_histogram() */
+
+/***************************************************************************
+ * st_printf:
+ *
+ * Append formatted text to an output buffer, growing it as needed.
+ ***************************************************************************/
+static void
+st_printf (StBuffer *out, const char *format, ...)
+{
+  va_list ap;
+  char *data;
+  size_t size;
+  int length;
+
+  for (;;)
+  {
+    va_start (ap, format);
+    length = vsnprintf (out->data + out->length, out->size - out->length,
+                        format, ap);
+    va_end (ap);
+
+    if (length < 0)
+      return;
+
+    if ((size_t)length < out->size - out->length)
+      break;
+
+    size = (out->size) ? out->size * 2 : 65536;
+
+    while (size < out->length + length + 1)
+      size *= 2;
+
+    if ((data = (char *)realloc (out->data, size)) == NULL)
+    {
+      sl_log (2, 0, "cannot allocate memory for statistics output\n");
+      return;
+    }
+
+    out->data = data;
+    out->size = size;
+  }
+
+  out->length += length;
+} /* End of st_printf() */
+
+/***************************************************************************
+ * st_label:
+ *
+ * Copy up to 'length' characters of a code or address to 'dst' for
+ * use as a label value, stopping at a space or the end of the string.
+ * Characters that would need escaping are replaced with '_'.
+ ***************************************************************************/
+static void
+st_label (char *dst, const char *src, int length)
+{
+  int idx;
+
+  for (idx = 0; idx < length && src[idx] && src[idx] != ' '; idx++)
+  {
+    if (src[idx] == '"' || src[idx] == '\\' || src[idx] < 0x20 || src[idx] > 0x7e)
+      dst[idx] = '_';
+    else
+      dst[idx] = src[idx];
+  }
+
+  dst[idx] = '\0';
+} /* End of st_label() */
+
+/***************************************************************************
+ * st_observe:
+ *
+ * Add a value to a histogram updated by a single thread, negative
+ * values are counted as zero.
+ ***************************************************************************/
+static void
+st_observe (StHistogram *hist, int64_t value, int shift)
+{
+  int idx = 0;
+
+  if (value > 0)
+  {
+    idx = 64 - __builtin_clzll ((uint64_t)value) - shift;
+
+    if (idx < 0)
+      idx = 0;
+    else if (idx > ST_BUCKETS)
+      idx = ST_BUCKETS;
+  }
+  else
+  {
+    value = 0;
+  }
+
+  ST_ADD (hist->count[idx], 1);
+  ST_ADD (hist->sum, value);
+} /* End of st_observe() */
+
+/***************************************************************************
+ * st_timekey:
+ *
+ * Returns a start time as an integer in ten-thousandths of a second
+ * that orders like the time, without calculating an epoch time.
+ ***************************************************************************/
+static int64_t
+st_timekey (const struct sl_btime_s *btime)
+{
+  return ((((int64_t)btime->year * 400 + btime->day) * 24 + btime->hour) * 3600 +
+          btime->min * 60 + btime->sec) * 10000 + btime->fract;
+} /* End of st_timekey() */
+
+/***************************************************************************
+ * st_lookup:
+ *
+ * Find the entry for 'key' in a hash table.
+ *
+ * Returns a pointer to the entry or NULL if not found.
+ ***************************************************************************/
+static void *
+st_lookup (StTable *table, const char *key)
+{
+  uint32_t hash = 2166136261u;
+  int idx;
+
+  if (!table->size)
+    return NULL;
+
+  for (idx = 0; idx < table->keylen; idx++)
+    hash = (hash ^ (uint8_t)key[idx]) * 16777619u;
+
+  for (idx = hash & (table->size - 1); table->slots[idx];
+       idx = (idx + 1) & (table->size - 1))
+  {
+    if (!memcmp (table->slots[idx], key, table->keylen))
+      return table->slots[idx];
+  }
+
+  return NULL;
+} /* End of st_lookup() */
+
+/***************************************************************************
+ * st_insert:
+ *
+ * Insert an entry, which must not be in the table yet, growing the
+ * table to keep it at most half full.
+ *
+ * Returns 0 on success and -1 on error.
+ ***************************************************************************/
+static int
+st_insert (StTable *table, void *entry)
+{
+  StTable grown;
+  uint32_t hash = 2166136261u;
+  int idx;
+
+  if ((table->count + 1) * 2 > table->size)
+  {
+    grown.size   = (table->size) ? table->size * 2 : 256;
+    grown.count  = 0;
+    grown.keylen = table->keylen;
+
+    if ((grown.slots = (void **)calloc (grown.size, sizeof (void *))) == NULL)
+      return -1;
+
+    for (idx = 0; idx < table->size; idx++)
+    {
+      if (table->slots[idx])
+        st_insert (&grown, table->slots[idx]);
+    }
+
+    free (table->slots);
+    *table = grown;
+  }
+
+  for (idx = 0; idx < table->keylen; idx++)
+    hash = (hash ^ (uint8_t) ((char *)entry)[idx]) * 16777619u;
+
+  for (idx = hash & (table->size - 1); table->slots[idx];
+       idx = (idx + 1) & (table->size - 1))
+    ;
+
+  table->slots[idx] = entry;
+  table->count++;
+
+  return 0;
+} /* End of st_insert() */
+
+/***************************************************************************
+ * st_newchannel:
+ *
+ * Create and publish the entry of a channel and, if needed, of its
+ * station.  'key' points to the station code of a fixed header.
+ *
+ * Returns a pointer to the new entry or NULL on error.
+ ***************************************************************************/
+static StChannel *
+st_newchannel (const char *key)
+{
+  const struct sl_fsdh_s *fsdh;
+  StStation *station;
+  StChannel *channel;
+  char stationkey[7];
+
+  fsdh = (const struct sl_fsdh_s *)(key - offsetof (struct sl_fsdh_s, station));
+
+  memcpy (stationkey, fsdh->station, 5);
+  memcpy (stationkey + 5, fsdh->network, 2);
+
+  if ((station = st_lookup (&st.stations, stationkey)) == NULL)
+  {
+    if ((station = (StStation *)calloc (1, sizeof (StStation))) == NULL ||
+        st_insert (&st.stations, memcpy (station->key, stationkey, 7)))
+    {
+      sl_log (2, 0, "cannot allocate memory for statistics\n");
+      free (station);
+      return NULL;
+    }
+
+    station->lastseq = -1;
+    station->next    = st.stationlist;
+
+    __atomic_store_n (&st.stationlist, station, __ATOMIC_RELEASE);
+  }
+
+  if ((channel = (StChannel *)calloc (1, sizeof (StChannel))) == NULL ||
+      st_insert (&st.channels, memcpy (channel->key, key, 12)))
+  {
+    sl_log (2, 0, "cannot allocate memory for statistics\n");
+    free (channel);
+    return NULL;
+  }
+
+  channel->station = station;
+  channel->next    = st.channellist;
+
+  __atomic_store_n (&st.channellist, channel, __ATOMIC_RELEASE);
+
+  return channel;
+} /* End of st_newchannel() */
+
+/***************************************************************************
+ * st_listen:
+ *
+ * Open a listening socket for the [host:]port in 'address', without a
+ * host all addresses are used.
+ *
+ * Returns the socket descriptor on success and -1 on error.
+ ***************************************************************************/
+static int
+st_listen (const char *address)
+{
+  struct addrinfo hints;
+  struct addrinfo *result;
+  char host[256];
+  const char *port;
+  const char *sep;
+  int on = 1;
+  int ret;
+  int fd;
+
+  host[0] = '\0';
+  port    = address;
+
+  if ((sep = strrchr (address, ':')) != NULL)
+  {
+    snprintf (host, sizeof (host), "%.*s", (int)(sep - address), address);
+    port = sep + 1;
+  }
+
+  memset (&hints, 0, sizeof (hints));
+  hints.ai_family   = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  hints.ai_flags    = AI_PASSIVE;
+
+  if ((ret = getaddrinfo ((host[0]) ? host : NULL, port, &hints, &result)))
+  {
+    sl_log (2, 0, "cannot resolve statistics address %s: %s\n", address,
+            gai_strerror (ret));
+    return -1;
+  }
+
+  if ((fd = socket (result->ai_family, result->ai_socktype, result->ai_protocol)) < 0)
+  {
+    sl_log (2, 0, "socket(): %s\n", strerror (errno));
+    freeaddrinfo (result);
+    return -1;
+  }
+
+  setsockopt (fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof (on));
+
+  if (bind (fd, result->ai_addr, result->ai_addrlen) || listen (fd, 16))
+  {
+    sl_log (2, 0, "cannot listen for statistics requests on %s: %s\n", address,
+            strerror (errno));
+    freeaddrinfo (result);
+    close (fd);
+    return -1;
+  }
+
+  freeaddrinfo (result);
+
+  return fd;
+} /* End of st_listen() */
+
+#else /* SLP_WIN */
+
+/***************************************************************************
+ * Statistics are not supported on Windows.
+ ***************************************************************************/
+int
+st_start (const char *address, const char *file, int interval)
+{
+  sl_log (2, 0, "statistics are not supported on this platform\n");
+  return -1;
+}
+
+void
+st_stop (void)
+{
+}
+
+void
+st_packet (SLMSheader *msh, int packet_type, int seqnum, int packet_size,
+           double now)
+{
+}
+
+int
+st_addconnection (const char *server)
+{
+  return -1;
+}
+
+void
+st_connection (int id, const SLconnstats *stats, int connected)
+{
+}
+
+int64_t
+st_stationpackets (const char *net, const char *sta)
+{
+  return -1;
+}
+
+int64_t
+st_clock (void)
+{
+  return 0;
+}
+
+void
+st_archive (int64_t start)
+{
+}
+
+#endif /* SLP_WIN */
@@ -0,0 +1,33 @@
+/***************************************************************************
+ * stats.h
+ *
+ * Interface declarations for the stream, connection and archive
+ * statistics and their export in the Prometheus text format.
+ *
+ * modified: 2026.287
+ ***************************************************************************/
+
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdint.h>
+
+#include <libslink.h>
+
+/* Default interval for writing the statistics file (seconds) */
+#define ST_DEFINTERVAL 60
+
+/* Number of finite histogram buckets, each twice the previous bound */
+#define ST_BUCKETS 20
+
+extern int st_start (const char *address, const char *file, int interval);
+extern void st_stop (void);
+extern void st_packet (SLMSheader *msh, int packet_type, int seqnum,
+                       int packet_size, double now);
+extern int st_addconnection (const char *server);
+extern void st_connection (int id, const SLconnstats *stats, int connected);
+extern int64_t st_stationpackets (const char *net, const char *sta);
+extern int64_t st_clock (void);
+extern void st_archive (int64_t start);
+
+#endif